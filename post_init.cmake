@@ -12,3 +12,7 @@ if (PICO_EXTRAS_TESTS_ENABLED OR PICO_EXTRAS_TOP_LEVEL_PROJECT)
     add_subdirectory(${CMAKE_CURRENT_LIST_DIR}/test ${CMAKE_BINARY_DIR}/pico_extras/test)
 endif ()
 
+# host tools (e.g. asset encoders) are only built for the host platform
+if (NOT PICO_ON_DEVICE)
+    add_subdirectory(${CMAKE_CURRENT_LIST_DIR}/tools ${CMAKE_BINARY_DIR}/pico_extras/tools)
+endif ()
@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <string.h>
+#include "pico.h"
+#include "pico/scanvideo/compositor.h"
+#include "pico/scanvideo/composable_scanline.h"
+
+// color runs must be at least 3 pixels
+#define MIN_COLOR_RUN 3
+
+void scanvideo_compositor_init(scanvideo_compositor_t *comp, uint width, uint16_t background_color) {
+    invalid_params_if(SCANVIDEO_COMPOSITOR, !width || width > 0xffff);
+    comp->layer_count = 0;
+    comp->width = (uint16_t) width;
+    comp->background_color = background_color;
+}
+
+uint scanvideo_compositor_add_layer(scanvideo_compositor_t *comp, int16_t priority,
+                                    scanvideo_layer_spans_func get_spans, void *context) {
+    invalid_params_if(SCANVIDEO_COMPOSITOR, comp->layer_count == SCANVIDEO_COMPOSITOR_MAX_LAYERS);
+    uint layer = comp->layer_count++;
+    comp->layers[layer] = (scanvideo_layer_t) {
+            .get_spans = get_spans,
+            .context = context,
+            .priority = priority,
+            .enabled = true,
+    };
+    // insert after all layers of higher or equal priority
+    uint i = layer;
+    while (i > 0 && comp->layers[comp->order[i - 1]].priority < priority) {
+        comp->order[i] = comp->order[i - 1];
+        i--;
+    }
+    comp->order[i] = (uint8_t) layer;
+    return layer;
+}
+
+typedef struct {
+    scanvideo_compositor_segment_t *segments;
+    uint count;
+} segment_list_t;
+
+static inline bool append(segment_list_t *list, uint x, uint width, uint type, uint color, const uint16_t *pixels) {
+    if (list->count) {
+        // merge with the previous segment if possible, to keep the list (and the token stream) short
+        scanvideo_compositor_segment_t *prev = list->segments + list->count - 1;
+        if (prev->type == type && (!type || (type == SCANVIDEO_SPAN_COLOR && prev->color == color))) {
+            prev->width = (uint16_t) (prev->width + width);
+            return true;
+        }
+    }
+    if (list->count == SCANVIDEO_COMPOSITOR_MAX_SEGMENTS) return false;
+    list->segments[list->count++] = (scanvideo_compositor_segment_t) {
+            .x = (uint16_t) x,
+            .width = (uint16_t) width,
+            .type = (uint16_t) type,
+            .color = (uint16_t) color,
+            .pixels = pixels,
+    };
+    return true;
+}
+
+// split the covered part [a, b) of a keyed span into opaque and uncovered segments
+static bool append_keyed(segment_list_t *list, const scanvideo_span_t *span, uint a, uint b, uint *covered) {
+    const uint16_t *pixels = span->pixels + (a - span->x);
+    uint key = span->color;
+    uint x = a;
+    while (x < b) {
+        uint start = x;
+        if (*pixels == key) {
+            do { x++; pixels++; } while (x < b && *pixels == key);
+            if (!append(list, start, x - start, 0, 0, NULL)) return false;
+        } else {
+            const uint16_t *start_pixels = pixels;
+            do { x++; pixels++; } while (x < b && *pixels != key);
+            if (!append(list, start, x - start, SCANVIDEO_SPAN_PIXELS, 0, start_pixels)) return false;
+            *covered += x - start;
+        }
+    }
+    return true;
+}
+
+// merge a layer's spans into the uncovered segments of in, writing the result to out
+static bool merge_layer(const segment_list_t *in, segment_list_t *out, const scanvideo_span_t *spans, uint n,
+                        uint *covered) {
+    uint si = 0;
+    for (uint i = 0; i < in->count; i++) {
+        const scanvideo_compositor_segment_t *seg = in->segments + i;
+        if (seg->type) {
+            if (!append(out, seg->x, seg->width, seg->type, seg->color, seg->pixels)) return false;
+            continue;
+        }
+        uint pos = seg->x;
+        uint end = seg->x + seg->width;
+        while (si < n && spans[si].x + spans[si].width <= pos) si++;
+        // the last span considered may extend into the next segment, so si is not advanced past it
+        for (uint k = si; k < n && spans[k].x < end; k++) {
+            const scanvideo_span_t *span = spans + k;
+            uint a = MAX(span->x, pos);
+            uint b = MIN(span->x + span->width, end);
+            if (a >= b) continue;
+            if (a > pos && !append(out, pos, a - pos, 0, 0, NULL)) return false;
+            if (span->type == SCANVIDEO_SPAN_PIXELS_KEYED) {
+                if (!append_keyed(out, span, a, b, covered)) return false;
+            } else {
+                if (!append(out, a, b - a, span->type, span->color,
+                            span->type == SCANVIDEO_SPAN_PIXELS ? span->pixels + (a - span->x) : NULL)) {
+                    return false;
+                }
+                *covered += b - a;
+            }
+            pos = b;
+        }
+        if (pos < end && !append(out, pos, end - pos, 0, 0, NULL)) return false;
+    }
+    return true;
+}
+
+// fix up the header of a raw run whose count pixels were written from raw + 1, skipping raw + 2
+static inline uint16_t *end_raw_run(uint16_t *raw, uint16_t *p, uint count) {
+    if (count == 1) {
+        raw[0] = COMPOSABLE_RAW_1P;
+        return raw + 2;
+    }
+    if (count == 2) {
+        raw[0] = COMPOSABLE_RAW_2P;
+        raw[2] = raw[3];
+        return raw + 3;
+    }
+    // | jmp raw_run | color | n-3 | n-1 colors |
+    raw[0] = COMPOSABLE_RAW_RUN;
+    raw[2] = (uint16_t) (count - 3);
+    return p;
+}
+
+int __time_critical_func(scanvideo_compositor_compose_line)(scanvideo_compositor_t *comp, uint line, uint32_t *data,
+                                                            uint max_words) {
+    uint width = comp->width;
+    uint which = 0;
+    segment_list_t list = {
+            .segments = comp->segments[0],
+            .count = 0,
+    };
+    append(&list, 0, width, 0, 0, NULL);
+    uint covered = 0;
+    for (uint i = 0; i < comp->layer_count && covered < width; i++) {
+        const scanvideo_layer_t *layer = comp->layers + comp->order[i];
+        if (!layer->enabled) continue;
+        const scanvideo_span_t *spans;
+        uint n = layer->get_spans(layer->context, line, &spans);
+        if (!n) continue;
+        which ^= 1;
+        segment_list_t next = {
+                .segments = comp->segments[which],
+                .count = 0,
+        };
+        if (!merge_layer(&list, &next, spans, n, &covered)) return -1;
+        list = next;
+    }
+
+    // now write the segments as tokens; solid segments of at least MIN_COLOR_RUN become color runs, and everything
+    // else is gathered into raw runs. The first pixel of a raw run goes in its header, so the run's pixels are written
+    // from raw + 1 leaving raw + 2 free for the count, and the header is fixed up when the run ends.
+    uint16_t *p = (uint16_t *) data;
+    uint16_t *end = (uint16_t *) (data + max_words);
+    uint16_t *raw = NULL;
+    uint raw_count = 0;
+    for (uint i = 0; i < list.count; i++) {
+        const scanvideo_compositor_segment_t *seg = list.segments + i;
+        uint w = seg->width;
+        uint color = seg->type ? seg->color : comp->background_color;
+        bool color_run = seg->type != SCANVIDEO_SPAN_PIXELS && w >= MIN_COLOR_RUN;
+        // this segment (at worst starting a new raw run) plus the end of line
+        if (end - p < (int) (color_run ? 3 : w + 2) + 4) return -1;
+        if (color_run) {
+            if (raw) {
+                p = end_raw_run(raw, p, raw_count);
+                raw = NULL;
+            }
+            // | jmp color_run | color | n-3 |
+            *p++ = COMPOSABLE_COLOR_RUN;
+            *p++ = (uint16_t) color;
+            *p++ = (uint16_t) (w - 3);
+            continue;
+        }
+        const uint16_t *pixels = seg->type == SCANVIDEO_SPAN_PIXELS ? seg->pixels : NULL;
+        if (!raw) {
+            raw = p;
+            raw[1] = (uint16_t) (pixels ? *pixels++ : color);
+            p = raw + 3;
+            raw_count = 1;
+            w--;
+        }
+        if (pixels) {
+            memcpy(p, pixels, w * sizeof(uint16_t));
+            p += w;
+        } else {
+            for (uint j = 0; j < w; j++) *p++ = (uint16_t) color;
+        }
+        raw_count += w;
+    }
+    if (raw) p = end_raw_run(raw, p, raw_count);
+    // the line must end with a black pixel
+    *p++ = COMPOSABLE_RAW_1P;
+    *p++ = 0;
+    if (1u & (uintptr_t) (p - (uint16_t *) data)) {
+        *p++ = COMPOSABLE_EOL_ALIGN;
+    } else {
+        *p++ = COMPOSABLE_EOL_SKIP_ALIGN;
+        *p++ = 0;
+    }
+    return (int) ((uint32_t *) p - data);
+}
+
+bool __time_critical_func(scanvideo_compositor_compose_scanline)(scanvideo_compositor_t *comp,
+                                                                 scanvideo_scanline_buffer_t *buffer) {
+    int words = scanvideo_compositor_compose_line(comp, scanvideo_scanline_number(buffer->scanline_id), buffer->data,
+                                                  buffer->data_max);
+    if (words < 0) return false;
+    buffer->data_used = (uint16_t) words;
+    buffer->status = SCANLINE_OK;
+    return true;
+}
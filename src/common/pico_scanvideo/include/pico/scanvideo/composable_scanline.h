@@ -15,11 +15,43 @@
 #define PICO_SCANVIDEO_USE_RAW1P_2CYCLE 0
 #endif
 
-#if !PICO_SCANVIDEO_USE_RAW1P_2CYCLE
+// PICO_CONFIG: PICO_SCANVIDEO_ENABLE_FRACTIONAL_XSCALE, Enable/disable support for modes with xscale_denominator > 1 (adds the SCALED_RUN token), type=bool, default=0, group=video
+#ifndef PICO_SCANVIDEO_ENABLE_FRACTIONAL_XSCALE
+#define PICO_SCANVIDEO_ENABLE_FRACTIONAL_XSCALE 0
+#endif
+
+// see scanvideo_base.h
+#ifndef PICO_SCANVIDEO_BPP
+#define PICO_SCANVIDEO_BPP 16
+#endif
+
+#if PICO_SCANVIDEO_BPP != 16
+#if PICO_SCANVIDEO_USE_RAW1P_2CYCLE || PICO_SCANVIDEO_ENABLE_FRACTIONAL_XSCALE
+#error PICO_SCANVIDEO_BPP other than 16 cannot be used with PICO_SCANVIDEO_USE_RAW1P_2CYCLE or PICO_SCANVIDEO_ENABLE_FRACTIONAL_XSCALE
+#endif
+#if PICO_SCANVIDEO_BPP == 8
+#define video_24mhz_composable_prefix video_24mhz_composable_8bpp
+// tokens (pixels, counts and jmps alike) are the size of a pixel, except that 24 bit pixels take a 32 bit token
+typedef uint8_t scanvideo_composable_token_t;
+#elif PICO_SCANVIDEO_BPP == 24
+#define video_24mhz_composable_prefix video_24mhz_composable_24bpp
+typedef uint32_t scanvideo_composable_token_t;
+#else
+#error PICO_SCANVIDEO_BPP must be 8, 16 or 24
+#endif
+#elif PICO_SCANVIDEO_ENABLE_FRACTIONAL_XSCALE
+#if PICO_SCANVIDEO_USE_RAW1P_2CYCLE
+#error PICO_SCANVIDEO_ENABLE_FRACTIONAL_XSCALE cannot be used with PICO_SCANVIDEO_USE_RAW1P_2CYCLE
+#endif
+#define video_24mhz_composable_prefix video_24mhz_composable_fractional_xscale
+#elif !PICO_SCANVIDEO_USE_RAW1P_2CYCLE
 #define video_24mhz_composable_prefix video_24mhz_composable_default
 #else
 #define video_24mhz_composable_prefix video_24mhz_composable_raw1p_2cycle
 #endif
+#if PICO_SCANVIDEO_BPP == 16
+typedef uint16_t scanvideo_composable_token_t;
+#endif
 
 // seems needed on some platforms
 #define __EXTRA_CONCAT(x, y) __CONCAT(x,y)
@@ -31,10 +63,224 @@
 #define COMPOSABLE_RAW_RUN __DVP_JMP(raw_run)
 #define COMPOSABLE_RAW_1P __DVP_JMP(raw_1p)
 #define COMPOSABLE_RAW_2P __DVP_JMP(raw_2p)
+// | jmp nop_raw | - consumes a single token, useful for aligning a following token sequence
+#define COMPOSABLE_NOP __DVP_JMP(nop_raw)
 #if !PICO_SCANVIDEO_USE_RAW1P_2CYCLE
 #define COMPOSABLE_RAW_1P_SKIP_ALIGN __DVP_JMP(raw_1p_skip_ALIGN)
 #else
 #define COMPOSABLE_RAW_1P_2CYCLE __DVP_JMP(raw_1p_2cycle)
 #endif
+#if PICO_SCANVIDEO_ENABLE_FRACTIONAL_XSCALE
+// | jmp scaled_run | groups-1 | <groups * xscale_denominator colors> | - each group is xscale pixels wide, and the
+// header holds the previous pixel for one more pixel
+#define COMPOSABLE_SCALED_RUN __DVP_JMP(scaled_run)
+
+/**
+ * Encode a line of pixels for a mode with fractional xscale (xscale_denominator > 1) as a scaled run, followed by the
+ * black pixel and end of line tokens
+ *
+ * This costs about one token per source pixel however large the scale, so e.g. a 320 pixel wide line fills an 800
+ * pixel wide panel (xscale 5, xscale_denominator 2) without upscaling it in software.
+ *
+ * A scaled run's header holds the pixel before it for one more (output) pixel. Where xscale is one more than a
+ * multiple of xscale_denominator (e.g. 3/2, 5/2 or 5/4), and there are at least two groups, the first group is
+ * therefore sent as raw pixels of the integer part of the scale, the last of which the header stretches by exactly
+ * the pixel it needs; the line then starts, and every pixel falls, just where it would with an integer scale. For
+ * other scales the whole line is a scaled run, so starts one pixel late (after a black pixel).
+ *
+ * \param pixels the source pixels
+ * \param width the number of source pixels, which must be a non zero multiple of xscale_denominator
+ * \param xscale the mode's xscale
+ * \param xscale_denominator the mode's xscale_denominator (at most 4)
+ * \param data the destination for the tokens
+ * \param max_words the size of data
+ * \return the number of words written, or -1 if they don't fit
+ */
+static inline int composable_encode_scaled_line(const uint16_t *pixels, uint width, uint xscale,
+                                                uint xscale_denominator, uint32_t *data, uint max_words) {
+    // the first group as raw pixels: | RAW_2P | 2 colors | or | RAW_RUN | color | n | n + 2 colors |
+    uint first = (xscale % xscale_denominator == 1 && width > xscale_denominator) ? xscale_denominator : 0;
+    uint tokens = first ? (first == 2 ? 1 : 2) : 0;
+    // header, pixels, black pixel and end of line (which needs a skip after an even number of tokens)
+    tokens += 2 + width + 2;
+    tokens += (tokens & 1u) ? 1 : 2;
+    if (tokens > max_words * 2) return -1;
+    uint16_t *p = (uint16_t *) data;
+    if (first == 2) {
+        *p++ = COMPOSABLE_RAW_2P;
+        *p++ = pixels[0];
+        *p++ = pixels[1];
+    } else if (first) {
+        *p++ = COMPOSABLE_RAW_RUN;
+        *p++ = pixels[0];
+        *p++ = (uint16_t) (first - 3);
+        __builtin_memcpy(p, pixels + 1, (first - 1) * sizeof(uint16_t));
+        p += first - 1;
+    }
+    *p++ = COMPOSABLE_SCALED_RUN;
+    *p++ = (uint16_t) ((width - first) / xscale_denominator - 1);
+    __builtin_memcpy(p, pixels + first, (width - first) * sizeof(uint16_t));
+    p += width - first;
+    *p++ = COMPOSABLE_RAW_1P;
+    *p++ = 0;
+    if (1u & (uintptr_t) (p - (uint16_t *) data)) {
+        *p++ = COMPOSABLE_EOL_ALIGN;
+    } else {
+        *p++ = COMPOSABLE_EOL_SKIP_ALIGN;
+        *p++ = 0;
+    }
+    return (int) ((uint32_t *) p - data);
+}
+#endif
+
+/**
+ * Set the delays of the composable scanline program's instructions for a horizontal scale of xscale /
+ * xscale_denominator (as video_24mhz_composable_adapt_for_mode does when the program is loaded)
+ *
+ * Tokens other than scaled runs use the integer part of the scale. The instructions are those of the program
+ * selected by the PICO_SCANVIDEO_ defines, with their delays still 0.
+ *
+ * \param instructions the program's instructions, which are modified
+ * \param xscale the mode's xscale
+ * \param xscale_denominator the mode's xscale_denominator (0 or 1 for an integer scale)
+ * \return false if the scale can't be produced
+ */
+static inline bool composable_set_program_delays(uint16_t *instructions, uint xscale, uint xscale_denominator) {
+    if (!xscale_denominator) xscale_denominator = 1;
+    uint int_xscale = xscale / xscale_denominator;
+    // two cycles per pixel, less the instruction which follows the delayed one
+    uint delay0 = 2 * int_xscale - 2;
+    uint delay1 = delay0 + 1;
+    if (!int_xscale || delay1 > 31) return false;
+    instructions[video_24mhz_composable_program_extern(delay_a_1)] |= (uint16_t) (delay1 << 8u);
+    instructions[video_24mhz_composable_program_extern(delay_b_1)] |= (uint16_t) (delay1 << 8u);
+    instructions[video_24mhz_composable_program_extern(delay_c_0)] |= (uint16_t) (delay0 << 8u);
+    instructions[video_24mhz_composable_program_extern(delay_d_0)] |= (uint16_t) (delay0 << 8u);
+    instructions[video_24mhz_composable_program_extern(delay_e_0)] |= (uint16_t) (delay0 << 8u);
+    instructions[video_24mhz_composable_program_extern(delay_f_1)] |= (uint16_t) (delay1 << 8u);
+#if !PICO_SCANVIDEO_USE_RAW1P_2CYCLE
+    instructions[video_24mhz_composable_program_extern(delay_g_0)] |= (uint16_t) (delay0 << 8u);
+#else
+    uint delay_half = xscale - 2;
+    instructions[video_24mhz_composable_program_extern(delay_g_0)] |= (uint16_t) (delay_half << 8u);
+#endif
+    instructions[video_24mhz_composable_program_extern(delay_h_0)] |= (uint16_t) (delay0 << 8u);
+#if PICO_SCANVIDEO_ENABLE_FRACTIONAL_XSCALE
+    if (xscale_denominator > 1) {
+        if (xscale_denominator > 4) return false;
+        // a scaled run uses the last xscale_denominator slots, with slot i of those (i + 1) * xscale / denominator -
+        // i * xscale / denominator pixels (i.e. two cycles per pixel) wide, so each group is exactly xscale wide
+        static const uint8_t slot_offsets[4] = {
+                video_24mhz_composable_program_extern(scaled_slot_0),
+                video_24mhz_composable_program_extern(scaled_slot_1),
+                video_24mhz_composable_program_extern(scaled_slot_2),
+                video_24mhz_composable_program_extern(scaled_slot_3),
+        };
+        uint first = 4 - xscale_denominator;
+        for (uint i = 0; i < xscale_denominator; i++) {
+            uint slot = first + i;
+            uint width = (i + 1) * xscale / xscale_denominator - i * xscale / xscale_denominator;
+            // slots 0 and 1 run straight into the next slot; the others are followed by a jmp (or out pc)
+            uint delay = 2 * width - (slot < 2 ? 1 : 2);
+            if (delay > 31) return false;
+            instructions[slot_offsets[slot]] |= (uint16_t) (delay << 8u);
+            if (slot == 3) {
+                instructions[video_24mhz_composable_program_extern(scaled_slot_3_last)] |= (uint16_t) (delay << 8u);
+            }
+        }
+        // jmp targets are the low 5 bits
+        uint16_t *entry = &instructions[video_24mhz_composable_program_extern(scaled_entry)];
+        uint16_t *loop = &instructions[video_24mhz_composable_program_extern(scaled_loop)];
+        *entry = (uint16_t) ((*entry & ~0x1fu) | slot_offsets[first]);
+        *loop = (uint16_t) ((*loop & ~0x1fu) | slot_offsets[first]);
+    }
+#else
+    if (xscale_denominator > 1) return false;
+#endif
+    return true;
+}
+
+// the most pixels in a color run or raw run; counts are a single token
+#define COMPOSABLE_MAX_RUN_8BPP (0xffu + 3u)
+
+/**
+ * Encode a line of 8bpp pixels (for PICO_SCANVIDEO_BPP 8) as raw runs, followed by the black pixel and end of line
+ * tokens
+ *
+ * Tokens are bytes, so a run is at most COMPOSABLE_MAX_RUN_8BPP pixels; longer lines take several runs. The line ends
+ * with padding to a word boundary.
+ *
+ * \param pixels the pixels
+ * \param width the number of pixels
+ * \param data the destination for the tokens
+ * \param max_words the size of data
+ * \return the number of words written, or -1 if they don't fit
+ */
+static inline int composable_encode_line_8bpp(const uint8_t *pixels, uint width, uint32_t *data, uint max_words) {
+    uint8_t *p = (uint8_t *) data;
+    const uint8_t *end = p + max_words * 4;
+    while (width) {
+        uint n = width < COMPOSABLE_MAX_RUN_8BPP ? width : COMPOSABLE_MAX_RUN_8BPP;
+        // a raw run costs 2 tokens more than its pixels, a raw_1p or raw_2p 1 more
+        if (p + n + (n >= 3 ? 2 : 1) > end) return -1;
+        if (n >= 3) {
+            *p++ = (uint8_t) COMPOSABLE_RAW_RUN;
+            *p++ = pixels[0];
+            *p++ = (uint8_t) (n - 3);
+            __builtin_memcpy(p, pixels + 1, n - 1);
+            p += n - 1;
+        } else {
+            *p++ = (uint8_t) (n == 1 ? COMPOSABLE_RAW_1P : COMPOSABLE_RAW_2P);
+            __builtin_memcpy(p, pixels, n);
+            p += n;
+        }
+        pixels += n;
+        width -= n;
+    }
+    // black pixel, and end of line (the skip variant discards the rest of its word)
+    if (p + 3 > end) return -1;
+    *p++ = (uint8_t) COMPOSABLE_RAW_1P;
+    *p++ = 0;
+    if ((3u & (uintptr_t) (p - (uint8_t *) data)) == 3) {
+        *p++ = (uint8_t) COMPOSABLE_EOL_ALIGN;
+    } else {
+        *p++ = (uint8_t) COMPOSABLE_EOL_SKIP_ALIGN;
+        while (3u & (uintptr_t) (p - (uint8_t *) data)) *p++ = 0;
+    }
+    return (int) ((uint32_t *) p - data);
+}
+
+/**
+ * Encode a line of 24bpp pixels (for PICO_SCANVIDEO_BPP 24) as a raw run, followed by the black pixel and end of line
+ * tokens
+ *
+ * Tokens are words, so the line is always a single run, and needs width + 5 words (width + 4 for fewer than 3
+ * pixels).
+ *
+ * \param pixels the pixels (in the bottom 24 bits)
+ * \param width the number of pixels
+ * \param data the destination for the tokens
+ * \param max_words the size of data
+ * \return the number of words written, or -1 if they don't fit
+ */
+static inline int composable_encode_line_24bpp(const uint32_t *pixels, uint width, uint32_t *data, uint max_words) {
+    uint32_t *p = data;
+    if (width + (width >= 3 ? 2 : width ? 1 : 0) + 3 > max_words) return -1;
+    if (width >= 3) {
+        *p++ = COMPOSABLE_RAW_RUN;
+        *p++ = pixels[0];
+        *p++ = width - 3;
+        __builtin_memcpy(p, pixels + 1, (width - 1) * sizeof(uint32_t));
+        p += width - 1;
+    } else if (width) {
+        *p++ = width == 1 ? COMPOSABLE_RAW_1P : COMPOSABLE_RAW_2P;
+        __builtin_memcpy(p, pixels, width * sizeof(uint32_t));
+        p += width;
+    }
+    *p++ = COMPOSABLE_RAW_1P;
+    *p++ = 0;
+    *p++ = COMPOSABLE_EOL_ALIGN;
+    return (int) (p - data);
+}
 
 #endif
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef SCANVIDEO_COMPOSITOR_H_
+#define SCANVIDEO_COMPOSITOR_H_
+
+#include "pico/scanvideo/scanvideo_base.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file compositor.h
+ *
+ * Software compositing of several logical layers (e.g. background, tiles, sprites, text) into a single plane's
+ * composable token stream.
+ *
+ * Each layer describes a line as a list of spans (solid color, or a pointer to pixels), and the compositor merges
+ * the span lists front to back rather than the pixels: a line is tracked as a sorted list of segments, each either
+ * already resolved to a span of some layer or still uncovered, and each layer only splits the uncovered segments
+ * it overlaps. Opaque spans therefore cost O(spans) however wide they are, pixel data is never copied until the
+ * final token stream is written, and once a line is fully covered lower priority layers aren't even asked for
+ * their spans.
+ *
+ * Keyed pixel spans (where pixels equal to a key color are transparent) are the exception; the pixels of the part
+ * of such a span which is still uncovered are examined to split it into opaque runs.
+ *
+ * Anything not covered by any layer is filled with the background color.
+ */
+
+#ifndef PARAM_ASSERTIONS_ENABLED_SCANVIDEO_COMPOSITOR
+#define PARAM_ASSERTIONS_ENABLED_SCANVIDEO_COMPOSITOR 0
+#endif
+
+#ifndef SCANVIDEO_COMPOSITOR_MAX_LAYERS
+#define SCANVIDEO_COMPOSITOR_MAX_LAYERS 8
+#endif
+
+// maximum number of distinct segments in a line
+#ifndef SCANVIDEO_COMPOSITOR_MAX_SEGMENTS
+#define SCANVIDEO_COMPOSITOR_MAX_SEGMENTS 128
+#endif
+
+enum scanvideo_span_type {
+    SCANVIDEO_SPAN_COLOR = 1,
+    SCANVIDEO_SPAN_PIXELS,
+    // pixels, where those equal to the span's color are transparent
+    SCANVIDEO_SPAN_PIXELS_KEYED,
+};
+
+typedef struct scanvideo_span {
+    uint16_t x;
+    uint16_t width;
+    uint16_t type;
+    // the color for SCANVIDEO_SPAN_COLOR, or the key color for SCANVIDEO_SPAN_PIXELS_KEYED
+    uint16_t color;
+    // the pixels for x to x + width - 1
+    const uint16_t *pixels;
+} scanvideo_span_t;
+
+/**
+ * Callback to get a layer's spans for a line
+ *
+ * \param context the layer's context
+ * \param line the line (scanline number) being composited
+ * \param spans set to the spans, which must be sorted by x and must not overlap one another
+ * \return the number of spans
+ */
+typedef uint (*scanvideo_layer_spans_func)(void *context, uint line, const scanvideo_span_t **spans);
+
+typedef struct scanvideo_layer {
+    scanvideo_layer_spans_func get_spans;
+    void *context;
+    // higher priority layers are in front
+    int16_t priority;
+    bool enabled;
+} scanvideo_layer_t;
+
+typedef struct scanvideo_compositor_segment {
+    uint16_t x;
+    uint16_t width;
+    // 0 for uncovered, otherwise SCANVIDEO_SPAN_COLOR or SCANVIDEO_SPAN_PIXELS
+    uint16_t type;
+    uint16_t color;
+    const uint16_t *pixels;
+} scanvideo_compositor_segment_t;
+
+typedef struct scanvideo_compositor {
+    scanvideo_layer_t layers[SCANVIDEO_COMPOSITOR_MAX_LAYERS];
+    // layer indexes in descending priority order
+    uint8_t order[SCANVIDEO_COMPOSITOR_MAX_LAYERS];
+    uint8_t layer_count;
+    uint16_t width;
+    uint16_t background_color;
+    // segments are double buffered as each layer rewrites the list
+    scanvideo_compositor_segment_t segments[2][SCANVIDEO_COMPOSITOR_MAX_SEGMENTS];
+} scanvideo_compositor_t;
+
+/**
+ * Initialize a compositor with no layers
+ *
+ * \param comp the compositor
+ * \param width the width of the lines to compose in pixels
+ * \param background_color the color of pixels not covered by any layer
+ */
+void scanvideo_compositor_init(scanvideo_compositor_t *comp, uint width, uint16_t background_color);
+
+/**
+ * Add a layer; layers of equal priority are ordered front to back in the order they were added
+ *
+ * \return the layer index (for scanvideo_compositor_set_layer_enabled)
+ */
+uint scanvideo_compositor_add_layer(scanvideo_compositor_t *comp, int16_t priority,
+                                    scanvideo_layer_spans_func get_spans, void *context);
+
+static inline void scanvideo_compositor_set_layer_enabled(scanvideo_compositor_t *comp, uint layer, bool enabled) {
+    comp->layers[layer].enabled = enabled;
+}
+
+/**
+ * Composite the enabled layers for a line into a composable token stream (ending with a black pixel)
+ *
+ * \param comp the compositor
+ * \param line the line to pass to the layers
+ * \param data the destination for the tokens
+ * \param max_words the size of data
+ * \return the number of words written, or -1 if the line was too complex (more than
+ * SCANVIDEO_COMPOSITOR_MAX_SEGMENTS segments) or didn't fit
+ */
+int scanvideo_compositor_compose_line(scanvideo_compositor_t *comp, uint line, uint32_t *data, uint max_words);
+
+/**
+ * Composite the enabled layers for the buffer's scanline into its plane 1 data
+ *
+ * \return false if the line was too complex or didn't fit, in which case the buffer's data_used and status are
+ * unchanged
+ */
+bool scanvideo_compositor_compose_scanline(scanvideo_compositor_t *comp, scanvideo_scanline_buffer_t *buffer);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef SCANVIDEO_PALETTE_H_
+#define SCANVIDEO_PALETTE_H_
+
+#include "pico/scanvideo/scanvideo_base.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file palette.h
+ *
+ * Expansion of 1, 2, 4 or 8 bits per pixel palette indexed rows into 16bpp pixels, and composable scanlines.
+ *
+ * Indexes are packed least significant bits first, so pixel 0 is in the low bits of the first byte, and the expanded
+ * pixels are written 2 per word (pixel 0 in the low half word).
+ *
+ * Expansion goes via a per byte lookup table (each entry holding the 8/bpp pixels for that byte). On device, the
+ * interpolators are used to extract the table addresses for all 4 bytes of each source word, so the calling core's
+ * interp0 and interp1 must be set up with scanvideo_palette_configure_interp() before expanding (and again if
+ * anything else reconfigures them). scanvideo_palette_expand_row_portable() is a plain C implementation which is used
+ * on the host, and is available on device for verification.
+ */
+
+#ifndef PARAM_ASSERTIONS_ENABLED_SCANVIDEO_PALETTE
+#define PARAM_ASSERTIONS_ENABLED_SCANVIDEO_PALETTE 0
+#endif
+
+typedef struct scanvideo_palette {
+    const uint16_t *colors;
+    uint16_t *table;
+    uint8_t bpp;
+    // log2 of the size in bytes of one table entry
+    uint8_t entry_shift;
+} scanvideo_palette_t;
+
+/**
+ * \return the size in 32 bit words of the lookup table for the given bits per pixel (between 128 and 1024 words)
+ */
+static inline uint scanvideo_palette_table_words(uint bpp) {
+    return 128u * (8u / bpp);
+}
+
+/**
+ * \return the number of 32 bit words of scanline buffer needed by scanvideo_palette_expand_scanline for the given
+ * bits per pixel and width
+ */
+static inline uint scanvideo_palette_scanline_words(uint bpp, uint width) {
+    // expansion always happens a whole byte at a time, then there is the trailer
+    uint pixels = ((width * bpp + 7u) / 8u) * (8u / bpp);
+    uint expanded_words = 1u + (pixels + 1u) / 2u;
+    uint scanline_words = (width + 6u) / 2u;
+    return expanded_words > scanline_words ? expanded_words : scanline_words;
+}
+
+/**
+ * Initialize a palette, building its lookup table; this must be called again if the colors change
+ *
+ * \param pal the palette to initialize
+ * \param bpp the bits per pixel of the source indexes; 1, 2, 4 or 8
+ * \param colors the (1 << bpp) 16bpp colors
+ * \param table storage for the lookup table of scanvideo_palette_table_words(bpp) words
+ */
+void scanvideo_palette_init(scanvideo_palette_t *pal, uint bpp, const uint16_t *colors, uint32_t *table);
+
+#if !PICO_NO_HARDWARE
+/**
+ * Configure the calling core's interp0 and interp1 for expanding rows with the given palette
+ */
+void scanvideo_palette_configure_interp(const scanvideo_palette_t *pal);
+#endif
+
+/**
+ * Expand a row of palette indexes into 16bpp pixels
+ *
+ * \param pal the palette
+ * \param dest the destination (2 pixels per word); note that a whole number of source bytes is always expanded, so up
+ *             to 8/bpp - 1 pixels past width may be written
+ * \param src the source indexes, which must be word aligned
+ * \param width the number of pixels
+ */
+void scanvideo_palette_expand_row(const scanvideo_palette_t *pal, uint32_t *dest, const void *src, uint width);
+
+/**
+ * Plain C version of scanvideo_palette_expand_row which looks up each pixel individually in pal->colors; the
+ * result is identical
+ */
+void scanvideo_palette_expand_row_portable(const scanvideo_palette_t *pal, uint32_t *dest, const void *src, uint width);
+
+/**
+ * Fill a scanline buffer with a single COMPOSABLE_RAW_RUN of the expanded row followed by a black pixel
+ *
+ * \param pal the palette
+ * \param buffer the scanline buffer, which must have at least scanvideo_palette_scanline_words(bpp, width) words
+ * \param src the source indexes, which must be word aligned
+ * \param width the number of pixels, which must be at least 3
+ */
+void scanvideo_palette_expand_scanline(const scanvideo_palette_t *pal, scanvideo_scanline_buffer_t *buffer,
+                                       const void *src, uint width);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,146 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef SCANVIDEO_RLE_H_
+#define SCANVIDEO_RLE_H_
+
+#include <stddef.h>
+#include "pico/scanvideo/scanvideo_base.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file rle.h
+ *
+ * Images pre-encoded as composable scanline token streams (color runs for repeated pixels, raw runs for the rest).
+ *
+ * Each line is a complete, word aligned token stream (ending with a black pixel and EOL), so displaying a line is
+ * either a bounded copy into a scanline buffer, or (with PICO_SCANVIDEO_PLANE1_VARIABLE_FRAGMENT_DMA) a direct DMA
+ * from flash. Lines are found via a per line offset index.
+ *
+ * Image layout (all 32 bit words):
+ *
+ *     | magic | token signature | width | height << 16 | line offsets (height + 1) | token data ... |
+ *
+ * Line offsets are in words from the start of the token data; line y is from offsets[y] to offsets[y + 1].
+ * The token signature records the PIO program offsets the image was encoded with.
+ *
+ * Images are usually encoded at build time by the scanvideo_rle_encode host tool, but the encoder is also
+ * available at runtime.
+ */
+
+#ifndef PARAM_ASSERTIONS_ENABLED_SCANVIDEO_RLE
+#define PARAM_ASSERTIONS_ENABLED_SCANVIDEO_RLE 0
+#endif
+
+#define SCANVIDEO_RLE_MAGIC 0x4c525653u // "SVRL"
+#define SCANVIDEO_RLE_HEADER_WORDS 3u
+
+// runs of identical pixels at least this long are encoded as color runs
+#ifndef SCANVIDEO_RLE_MIN_COLOR_RUN
+#define SCANVIDEO_RLE_MIN_COLOR_RUN 5
+#endif
+
+typedef struct scanvideo_rle_image {
+    uint16_t width;
+    uint16_t height;
+    const uint32_t *line_offsets;
+    const uint32_t *data;
+} scanvideo_rle_image_t;
+
+/**
+ * \return the maximum number of words an encoded line of the given width can take
+ */
+static inline uint scanvideo_rle_max_line_words(uint width) {
+    // worst case a single raw run (width + 2 tokens), a black pixel (2) and EOL with padding (2)
+    return (width + 7) / 2;
+}
+
+/**
+ * \return the maximum number of words an encoded image of the given size can take
+ */
+static inline size_t scanvideo_rle_max_image_words(uint width, uint height) {
+    return SCANVIDEO_RLE_HEADER_WORDS + height + 1 + (size_t) height * scanvideo_rle_max_line_words(width);
+}
+
+/**
+ * \return the token signature for the scanline program being used (images must be encoded with the same one)
+ */
+uint32_t scanvideo_rle_token_signature();
+
+/**
+ * Encode a line of 16bpp pixels as a composable token stream
+ *
+ * \param pixels the pixels
+ * \param width the number of pixels
+ * \param out the destination
+ * \param max_words the size of out
+ * \return the number of words written, or -1 if out was too small
+ */
+int scanvideo_rle_encode_line(const uint16_t *pixels, uint width, uint32_t *out, uint max_words);
+
+/**
+ * Encode an image of 16bpp pixels
+ *
+ * \param pixels the pixels
+ * \param width the width in pixels
+ * \param height the height in pixels
+ * \param stride the distance between rows in pixels
+ * \param out the destination
+ * \param max_words the size of out (scanvideo_rle_max_image_words is always enough)
+ * \return the number of words written, or 0 if out was too small
+ */
+size_t scanvideo_rle_encode_image(const uint16_t *pixels, uint width, uint height, uint stride, uint32_t *out,
+                                  size_t max_words);
+
+/**
+ * Decode a composable token stream (as produced by the encoder) back into pixels; this is mostly useful for
+ * verification
+ *
+ * \return the number of pixels (including the trailing black pixel), or -1 if the stream is malformed or
+ * max_pixels is too small
+ */
+int scanvideo_rle_decode_line(const uint32_t *tokens, uint words, uint16_t *pixels, uint max_pixels);
+
+/**
+ * Initialize an image from its encoded form
+ *
+ * \return false if the data is not an encoded image, or was encoded for a different scanline program
+ */
+bool scanvideo_rle_image_init(scanvideo_rle_image_t *image, const uint32_t *encoded);
+
+static inline const uint32_t *scanvideo_rle_image_line(const scanvideo_rle_image_t *image, uint y, uint *words) {
+    *words = image->line_offsets[y + 1] - image->line_offsets[y];
+    return image->data + image->line_offsets[y];
+}
+
+/**
+ * \return the number of bytes read from the image to display every line once (token data plus index)
+ */
+static inline size_t scanvideo_rle_image_frame_bytes(const scanvideo_rle_image_t *image) {
+    return (image->line_offsets[image->height] + 2u * image->height) * sizeof(uint32_t);
+}
+
+/**
+ * Copy a line of the image into a scanline buffer
+ *
+ * \return false if the line does not fit in the buffer
+ */
+bool scanvideo_rle_image_copy_line(const scanvideo_rle_image_t *image, uint y, scanvideo_scanline_buffer_t *buffer);
+
+#if PICO_SCANVIDEO_PLANE1_VARIABLE_FRAGMENT_DMA
+/**
+ * Point a (variable fragment DMA) scanline buffer directly at a line of the image, so the line is DMAed from
+ * wherever the image is stored with no copying
+ */
+void scanvideo_rle_image_fragment_line(const scanvideo_rle_image_t *image, uint y, scanvideo_scanline_buffer_t *buffer);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif
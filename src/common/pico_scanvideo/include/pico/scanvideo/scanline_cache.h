@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef SCANVIDEO_SCANLINE_CACHE_H_
+#define SCANVIDEO_SCANLINE_CACHE_H_
+
+#include "pico/scanvideo/scanvideo_base.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file scanline_cache.h
+ *
+ * Cache of generated (encoded) scanlines, so that scanlines which have not changed since they were last generated
+ * can be re-submitted by copying their token data rather than re-encoding them.
+ *
+ * Each cache has a fixed number of fixed size slots (so its memory use is bounded), which are recycled in least
+ * recently used order. The application marks lines as changed with scanvideo_scanline_cache_invalidate(), which
+ * simply bumps a per line generation number; a cached scanline is only re-used if it was stored for the current
+ * generation of its line.
+ *
+ * The data for every plane is cached (each plane of a slot holds up to slot_words words). Note that in fragment DMA
+ * modes the cached data is the fragment chain, so the fragments it points at must not change either.
+ *
+ * A cache is not thread safe; if scanlines are generated on both cores, give each core its own cache.
+ *
+ * Typical usage:
+ *
+ *     scanvideo_scanline_buffer_t *buffer = scanvideo_begin_scanline_generation(true);
+ *     if (!scanvideo_scanline_cache_lookup(&cache, buffer)) {
+ *         render_scanline(buffer);
+ *     }
+ *     scanvideo_scanline_cache_end_scanline_generation(&cache, buffer);
+ */
+
+#ifndef PARAM_ASSERTIONS_ENABLED_SCANVIDEO_SCANLINE_CACHE
+#define PARAM_ASSERTIONS_ENABLED_SCANVIDEO_SCANLINE_CACHE 0
+#endif
+
+typedef struct scanvideo_scanline_cache_stats {
+    uint32_t hits;
+    uint32_t misses;
+    // lines which were generated and passed back to the cache after a miss
+    uint32_t generated;
+    // cached lines discarded to make room for another line
+    uint32_t evictions;
+    // generated lines which were too long for a slot (in any plane)
+    uint32_t uncacheable;
+    // total time spent between a miss and the generated line being passed back to the cache
+    uint64_t generate_us;
+    // total time spent copying cached lines into scanline buffers
+    uint64_t hit_us;
+} scanvideo_scanline_cache_stats_t;
+
+typedef struct scanvideo_scanline_cache_slot {
+    uint16_t line;
+    uint16_t data_used[PICO_SCANVIDEO_PLANE_COUNT];
+#if PICO_SCANVIDEO_PLANE1_FIXED_FRAGMENT_DMA
+    uint16_t fragment_words;
+#endif
+    uint32_t generation;
+    // LRU list links (slot indexes)
+    uint16_t prev;
+    uint16_t next;
+} scanvideo_scanline_cache_slot_t;
+
+typedef struct scanvideo_scanline_cache_line {
+    uint32_t generation;
+    uint32_t miss_time;
+    uint16_t slot;
+    bool generating;
+} scanvideo_scanline_cache_line_t;
+
+typedef struct scanvideo_scanline_cache {
+    scanvideo_scanline_cache_slot_t *slots;
+    uint32_t *slot_data;
+    scanvideo_scanline_cache_line_t *lines;
+    uint16_t height;
+    uint16_t slot_count;
+    uint16_t slot_words;
+    // most and least recently used slots
+    uint16_t lru_head;
+    uint16_t lru_tail;
+    scanvideo_scanline_cache_stats_t stats;
+} scanvideo_scanline_cache_t;
+
+/**
+ * Initialize a scanline cache; the cache uses slot_count * slot_words * PICO_SCANVIDEO_PLANE_COUNT words of scanline
+ * data storage (plus a small amount of per slot and per line state)
+ *
+ * \param cache the cache to initialize
+ * \param height the number of (logical) scanlines in the mode
+ * \param slot_count the maximum number of cached scanlines
+ * \param slot_words the maximum length of each plane of a cached scanline in words; longer scanlines are never cached
+ * \return false if the memory could not be allocated
+ */
+bool scanvideo_scanline_cache_init(scanvideo_scanline_cache_t *cache, uint height, uint slot_count, uint slot_words);
+
+/**
+ * Free the memory allocated by scanvideo_scanline_cache_init
+ */
+void scanvideo_scanline_cache_deinit(scanvideo_scanline_cache_t *cache);
+
+/**
+ * Mark scanlines as changed, so any cached data for them will no longer be used
+ *
+ * \param cache the cache
+ * \param first_line the first changed scanline number
+ * \param line_count the number of changed scanlines
+ */
+void scanvideo_scanline_cache_invalidate(scanvideo_scanline_cache_t *cache, uint first_line, uint line_count);
+
+static inline void scanvideo_scanline_cache_invalidate_all(scanvideo_scanline_cache_t *cache) {
+    scanvideo_scanline_cache_invalidate(cache, 0, cache->height);
+}
+
+/**
+ * Fill a scanline buffer from the cache if there is an up to date copy of its scanline
+ *
+ * \param cache the cache
+ * \param buffer the buffer returned by scanvideo_begin_scanline_generation
+ * \return true if the buffer was filled (and status set to SCANLINE_OK); false if the caller must generate the scanline
+ */
+bool scanvideo_scanline_cache_lookup(scanvideo_scanline_cache_t *cache, scanvideo_scanline_buffer_t *buffer);
+
+/**
+ * Store a generated scanline in the cache (this is only needed if not using scanvideo_scanline_cache_end_scanline_generation).
+ * Scanlines whose status is not SCANLINE_OK are not stored.
+ */
+void scanvideo_scanline_cache_store(scanvideo_scanline_cache_t *cache, const scanvideo_scanline_buffer_t *buffer);
+
+/**
+ * Store the scanline in the cache if it was generated following a miss, then pass it to scanvideo_end_scanline_generation
+ */
+void scanvideo_scanline_cache_end_scanline_generation(scanvideo_scanline_cache_t *cache, scanvideo_scanline_buffer_t *buffer);
+
+/**
+ * Retrieve (and optionally reset) the cache statistics
+ */
+void scanvideo_scanline_cache_get_stats(scanvideo_scanline_cache_t *cache, scanvideo_scanline_cache_stats_t *stats, bool reset);
+
+static inline uint scanvideo_scanline_cache_hit_rate_percent(const scanvideo_scanline_cache_stats_t *stats) {
+    uint32_t total = stats->hits + stats->misses;
+    return total ? (uint) ((stats->hits * 100ull) / total) : 0;
+}
+
+/**
+ * \return an estimate of the CPU time saved by the cache, i.e. the hits at the measured average generation cost less
+ * the time actually spent copying them
+ */
+static inline uint64_t scanvideo_scanline_cache_saved_us(const scanvideo_scanline_cache_stats_t *stats) {
+    if (!stats->generated) return 0;
+    uint64_t would_have_cost = (stats->generate_us * stats->hits) / stats->generated;
+    return would_have_cost > stats->hit_us ? would_have_cost - stats->hit_us : 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
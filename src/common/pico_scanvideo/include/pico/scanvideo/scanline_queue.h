@@ -0,0 +1,417 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef SCANVIDEO_SCANLINE_QUEUE_H_
+#define SCANVIDEO_SCANLINE_QUEUE_H_
+
+#include "pico/types.h"
+#include "hardware/sync.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file scanline_queue.h
+ *
+ * The scanline buffer queue shared by the scanvideo output back-ends (DPI and DBI).
+ *
+ * Every scanline buffer is in exactly one of:
+ *
+ * - the free list; available to be handed out for generation
+ * - the generating list (only tracked with PICO_SCANVIDEO_ENABLE_SCANLINE_ASSERTIONS); owned by the application
+ * - the generated ring; waiting to be displayed
+ * - the in use queue; latched by the back-end for display (which happens in ascending scanline_id order), and
+ *   released oldest first once the back-end has finished with it
+ *
+ * The back-end owns everything to do with timing and output: it decides which scanline_id it wants next, latches it
+ * from the generated ring (which at the same time drops any generated buffers that are now in the past), and
+ * releases it when the scanline has been sent. Buffers leaving the generated ring or in use queue are gathered on a
+ * caller local list, and returned to the free list in one go once the caller is no longer holding any other locks.
+ *
+ * Since the scanlines waiting to be displayed are (almost always) a handful of consecutive lines, the generated ring
+ * is indexed by scanline number modulo PICO_SCANVIDEO_SCANLINE_QUEUE_SLOTS rather than being a sorted list, and a
+ * bit mask records which slots are occupied. Buffers keep their full scanline_id (including the frame number) so a
+ * buffer for the same line of a different frame is never mistaken for the one wanted. Adding a generated buffer,
+ * latching a scanline and releasing it are all O(1) whatever order buffers are generated in; the only walks are
+ * over buffers which are being dropped because they are already in the past, and over the occupied slots when the
+ * display moves on to a new frame (which the DPI back-end does in the vertical blanking interval). Two buffers only
+ * share a slot if they are PICO_SCANVIDEO_SCANLINE_QUEUE_SLOTS or more lines apart, in which case the slot holds a
+ * short list in ascending scanline_id order.
+ *
+ * The generated ring is protected by the back-end's scanline lock, which the back-end also uses for its own
+ * scanline state, so that latching only needs to take one extra (in use) lock. The in use queue and the free list
+ * have their own locks.
+ *
+ * The back-end's private buffer type must begin with a scanvideo_scanline_queue_entry_t.
+ */
+
+#ifndef PICO_SCANVIDEO_ENABLE_SCANLINE_ASSERTIONS
+#define PICO_SCANVIDEO_ENABLE_SCANLINE_ASSERTIONS 0
+#endif
+
+// number of slots in the generated ring; a power of 2 no greater than 32, which should be at least the number of
+// scanline buffers
+#ifndef PICO_SCANVIDEO_SCANLINE_QUEUE_SLOTS
+#define PICO_SCANVIDEO_SCANLINE_QUEUE_SLOTS 32
+#endif
+
+#if PICO_SCANVIDEO_SCANLINE_QUEUE_SLOTS > 32 || \
+    (PICO_SCANVIDEO_SCANLINE_QUEUE_SLOTS & (PICO_SCANVIDEO_SCANLINE_QUEUE_SLOTS - 1))
+#error PICO_SCANVIDEO_SCANLINE_QUEUE_SLOTS must be a power of 2 no greater than 32
+#endif
+
+#define SCANVIDEO_SCANLINE_QUEUE_SLOT_MASK (PICO_SCANVIDEO_SCANLINE_QUEUE_SLOTS == 32 ? 0xffffffffu : \
+                                           (1u << (PICO_SCANVIDEO_SCANLINE_QUEUE_SLOTS & 31)) - 1u)
+
+#if PICO_SCANVIDEO_ENABLE_SCANLINE_ASSERTIONS
+#define scanline_queue_assert(x) hard_assert(x)
+#else
+#define scanline_queue_assert(x) (void)0
+#endif
+
+typedef struct scanvideo_scanline_queue_entry {
+    struct scanvideo_scanline_queue_entry *next;
+    // the scanline_id the buffer was queued with (kept here so walking the queues doesn't touch the buffers)
+    uint32_t scanline_id;
+} scanvideo_scanline_queue_entry_t;
+
+typedef struct scanvideo_scanline_queue {
+    struct {
+        // the back-end's scanline lock
+        spin_lock_t *lock;
+        // generated buffers by scanline number
+        scanvideo_scanline_queue_entry_t *slots[PICO_SCANVIDEO_SCANLINE_QUEUE_SLOTS];
+        // bit n set if slots[n] is non empty
+        uint32_t occupied;
+        // the scanline_id most recently asked for by the back-end; generated buffers before it are stale
+        uint32_t display_id;
+#if PICO_SCANVIDEO_ENABLE_SCANLINE_ASSERTIONS
+        scanvideo_scanline_queue_entry_t *generating;
+#endif
+    } generated;
+
+    struct {
+        spin_lock_t *lock;
+        // note in_use is a queue as we are lazy in removing buffers from it; buffers are latched in ascending
+        // scanline_id order, so are always appended at the tail
+        scanvideo_scanline_queue_entry_t *head;
+        scanvideo_scanline_queue_entry_t *tail;
+    } in_use;
+
+    struct {
+        spin_lock_t *lock;
+        scanvideo_scanline_queue_entry_t *head;
+    } free_list;
+} scanvideo_scanline_queue_t;
+
+/**
+ * \return true if scanline_id1 is after scanline_id2 (allowing for the frame number wrapping)
+ */
+static inline bool scanvideo_scanline_id_is_after(uint32_t scanline_id1, uint32_t scanline_id2) {
+    return ((int32_t) (scanline_id1 - scanline_id2)) > 0;
+}
+
+// --- list primitives
+
+static inline void scanvideo_scanline_list_prepend(scanvideo_scanline_queue_entry_t **phead,
+                                                   scanvideo_scanline_queue_entry_t *e) {
+    scanline_queue_assert(e);
+    scanline_queue_assert(e->next == NULL);
+    scanline_queue_assert(e != *phead);
+    e->next = *phead;
+    *phead = e;
+}
+
+static inline void scanvideo_scanline_list_prepend_all(scanvideo_scanline_queue_entry_t **phead,
+                                                       scanvideo_scanline_queue_entry_t *to_prepend) {
+    if (to_prepend) {
+        scanvideo_scanline_queue_entry_t *e = to_prepend;
+        while (e->next) {
+            e = e->next;
+        }
+        e->next = *phead;
+        *phead = to_prepend;
+    }
+}
+
+static inline void scanvideo_scanline_list_remove(scanvideo_scanline_queue_entry_t **phead,
+                                                  scanvideo_scanline_queue_entry_t *e) {
+    scanline_queue_assert(*phead);
+    scanvideo_scanline_queue_entry_t *prev = *phead;
+    if (prev == e) {
+        *phead = e->next;
+    } else {
+        while (prev->next && prev->next != e) {
+            prev = prev->next;
+        }
+        scanline_queue_assert(prev->next == e);
+        prev->next = e->next;
+    }
+    e->next = NULL;
+}
+
+static inline scanvideo_scanline_queue_entry_t *scanvideo_scanline_list_remove_head(
+        scanvideo_scanline_queue_entry_t **phead, scanvideo_scanline_queue_entry_t **ptail) {
+    scanvideo_scanline_queue_entry_t *e = *phead;
+    if (e) {
+        *phead = e->next;
+        if (!e->next) {
+            scanline_queue_assert(*ptail == e);
+            *ptail = NULL;
+        } else {
+            e->next = NULL;
+        }
+    }
+    return e;
+}
+
+static inline void scanvideo_scanline_list_append(scanvideo_scanline_queue_entry_t **phead,
+                                                  scanvideo_scanline_queue_entry_t **ptail,
+                                                  scanvideo_scanline_queue_entry_t *e) {
+    scanline_queue_assert(e->next == NULL);
+    if (*ptail) {
+        (*ptail)->next = e;
+    } else {
+        *phead = e;
+    }
+    *ptail = e;
+}
+
+// --- generated ring
+
+static inline uint scanvideo_scanline_queue_slot(uint32_t scanline_id) {
+    // the low bits of the scanline_id are the low bits of the scanline number
+    return scanline_id & (PICO_SCANVIDEO_SCANLINE_QUEUE_SLOTS - 1);
+}
+
+// the mask of count slots starting at slot first
+static inline uint32_t scanvideo_scanline_queue_slot_range(uint first, uint count) {
+    if (count >= PICO_SCANVIDEO_SCANLINE_QUEUE_SLOTS) return SCANVIDEO_SCANLINE_QUEUE_SLOT_MASK;
+    uint32_t bits = (1u << count) - 1;
+    first &= PICO_SCANVIDEO_SCANLINE_QUEUE_SLOTS - 1;
+    if (!first) return bits;
+    return ((bits << first) | (bits >> (PICO_SCANVIDEO_SCANLINE_QUEUE_SLOTS - first))) &
+           SCANVIDEO_SCANLINE_QUEUE_SLOT_MASK;
+}
+
+// remove any buffers before scanline_id from the slot to local_free_list, and the buffer for scanline_id if present
+static inline scanvideo_scanline_queue_entry_t *scanvideo_scanline_queue_sweep_slot(
+        scanvideo_scanline_queue_t *q, uint slot, uint32_t scanline_id,
+        scanvideo_scanline_queue_entry_t **local_free_list) {
+    scanvideo_scanline_queue_entry_t **phead = &q->generated.slots[slot];
+    scanvideo_scanline_queue_entry_t *e;
+    while (NULL != (e = *phead) && scanvideo_scanline_id_is_after(scanline_id, e->scanline_id)) {
+        // scanline is in the past
+        *phead = e->next;
+        e->next = NULL;
+        scanvideo_scanline_list_prepend(local_free_list, e);
+    }
+    if (e && e->scanline_id == scanline_id) {
+        *phead = e->next;
+        e->next = NULL;
+    } else {
+        e = NULL;
+    }
+    if (!*phead) {
+        q->generated.occupied &= ~(1u << slot);
+    }
+    return e;
+}
+
+// --- queue operations
+
+/**
+ * Initialize an empty queue
+ *
+ * \param scanline_lock the back-end's scanline lock, which protects the generated ring
+ */
+static inline void scanvideo_scanline_queue_init(scanvideo_scanline_queue_t *q, spin_lock_t *scanline_lock,
+                                                 spin_lock_t *in_use_lock, spin_lock_t *free_list_lock) {
+    __builtin_memset(q, 0, sizeof(*q));
+    q->generated.lock = scanline_lock;
+    q->in_use.lock = in_use_lock;
+    q->free_list.lock = free_list_lock;
+}
+
+/**
+ * Add a buffer to the free list during initialization (no locks are taken)
+ */
+static inline void scanvideo_scanline_queue_add_buffer(scanvideo_scanline_queue_t *q,
+                                                       scanvideo_scanline_queue_entry_t *e) {
+    e->next = NULL;
+    scanvideo_scanline_list_prepend(&q->free_list.head, e);
+}
+
+/**
+ * Take buffers from the free list
+ *
+ * \param n the number of buffers wanted
+ * \return a list of n buffers (linked via next), or NULL if fewer than n are free
+ */
+static inline scanvideo_scanline_queue_entry_t *scanvideo_scanline_queue_take_free(scanvideo_scanline_queue_t *q,
+                                                                                   uint n) {
+    uint32_t save = spin_lock_blocking(q->free_list.lock);
+    scanvideo_scanline_queue_entry_t *e = q->free_list.head;
+    scanvideo_scanline_queue_entry_t *tail = e;
+    for (uint i = 1; i < n && tail; i++) {
+        tail = tail->next;
+    }
+    if (tail) {
+        q->free_list.head = tail->next;
+        tail->next = NULL;
+    } else {
+        e = NULL;
+    }
+    spin_unlock(q->free_list.lock, save);
+    return e;
+}
+
+/**
+ * Return a list of buffers (as gathered by latch and release) to the free list, waking anyone waiting for one
+ */
+static inline void scanvideo_scanline_queue_free_irqs_enabled(scanvideo_scanline_queue_t *q,
+                                                              scanvideo_scanline_queue_entry_t *local_free_list) {
+    if (local_free_list) {
+        uint32_t save = spin_lock_blocking(q->free_list.lock);
+        scanvideo_scanline_list_prepend_all(&q->free_list.head, local_free_list);
+        spin_unlock(q->free_list.lock, save);
+        // note also this is useful for triggering scanvideo_wait_for_scanline_complete check
+        __sev();
+    }
+}
+
+/**
+ * Note a buffer (taken from the free list) as being handed to the application for generation
+ *
+ * Caller must own the scanline lock
+ */
+static inline void scanvideo_scanline_queue_locked_begin_generation(scanvideo_scanline_queue_t *q,
+                                                                    scanvideo_scanline_queue_entry_t *e) {
+#if PICO_SCANVIDEO_ENABLE_SCANLINE_ASSERTIONS
+    scanvideo_scanline_list_prepend(&q->generated.generating, e);
+#else
+    (void) q;
+    (void) e;
+#endif
+}
+
+/**
+ * Add a generated buffer to the generated ring
+ *
+ * Caller must own the scanline lock
+ *
+ * \return e if its scanline has already been passed by the display (in which case it should be freed), otherwise NULL
+ */
+static inline scanvideo_scanline_queue_entry_t *scanvideo_scanline_queue_locked_add_generated(
+        scanvideo_scanline_queue_t *q, scanvideo_scanline_queue_entry_t *e, uint32_t scanline_id) {
+#if PICO_SCANVIDEO_ENABLE_SCANLINE_ASSERTIONS
+    scanvideo_scanline_list_remove(&q->generated.generating, e);
+#endif
+    e->scanline_id = scanline_id;
+    if (scanvideo_scanline_id_is_after(q->generated.display_id, scanline_id)) {
+        // too late
+        return e;
+    }
+    uint slot = scanvideo_scanline_queue_slot(scanline_id);
+    scanvideo_scanline_queue_entry_t **prev = &q->generated.slots[slot];
+    // almost always empty
+    while (*prev && scanvideo_scanline_id_is_after(scanline_id, (*prev)->scanline_id)) {
+        prev = &(*prev)->next;
+    }
+    e->next = *prev;
+    *prev = e;
+    q->generated.occupied |= 1u << slot;
+    return NULL;
+}
+
+/**
+ * Latch the buffer for scanline_id from the generated ring into the in use queue, if it has been generated
+ *
+ * Any generated buffers for scanlines before scanline_id are removed to local_free_list. scanline_id must not be
+ * before the scanline_id of the previous call.
+ *
+ * Caller must own the scanline lock
+ *
+ * \return the buffer for scanline_id or NULL if it hasn't been generated (yet)
+ */
+static inline scanvideo_scanline_queue_entry_t *scanvideo_scanline_queue_locked_try_latch(
+        scanvideo_scanline_queue_t *q, uint32_t scanline_id, scanvideo_scanline_queue_entry_t **local_free_list) {
+    // note this just checks that someone owns it not necessarily this core.
+    scanline_queue_assert(is_spin_locked(q->generated.lock));
+    uint32_t last_id = q->generated.display_id;
+    q->generated.display_id = scanline_id;
+    // buffers for the scanlines passed since last time (including last_id, which may have been generated after it
+    // was asked for) are now stale, so check their slots as well as the one wanted
+    uint32_t sweep;
+    if ((scanline_id ^ last_id) >> 16u) {
+        // a new frame; we don't know the height so check every slot. This happens once per frame
+        sweep = q->generated.occupied;
+    } else {
+        sweep = q->generated.occupied & scanvideo_scanline_queue_slot_range(last_id, scanline_id - last_id + 1);
+    }
+    uint slot = scanvideo_scanline_queue_slot(scanline_id);
+    scanvideo_scanline_queue_entry_t *e = NULL;
+    if (q->generated.occupied & (1u << slot)) {
+        e = scanvideo_scanline_queue_sweep_slot(q, slot, scanline_id, local_free_list);
+        sweep &= ~(1u << slot);
+    }
+    while (sweep) {
+        uint s = (uint) __builtin_ctz(sweep);
+        sweep &= sweep - 1;
+        // buffers for scanline_id itself can only be in its own slot
+        scanvideo_scanline_queue_sweep_slot(q, s, scanline_id, local_free_list);
+    }
+    if (e) {
+        spin_lock_unsafe_blocking(q->in_use.lock);
+        scanline_queue_assert(!q->in_use.tail || !scanvideo_scanline_id_is_after(q->in_use.tail->scanline_id,
+                                                                                   scanline_id));
+        scanvideo_scanline_list_append(&q->in_use.head, &q->in_use.tail, e);
+        spin_unlock_unsafe(q->in_use.lock);
+    }
+    return e;
+}
+
+/**
+ * Insert a buffer into the in use queue immediately after one which is already in it, with the same scanline_id
+ *
+ * This is used to display a buffer linked to the current one without it being separately generated
+ *
+ * Caller must own the scanline lock
+ */
+static inline void scanvideo_scanline_queue_locked_insert_in_use_after(scanvideo_scanline_queue_t *q,
+                                                                       scanvideo_scanline_queue_entry_t *after,
+                                                                       scanvideo_scanline_queue_entry_t *e) {
+    spin_lock_unsafe_blocking(q->in_use.lock);
+    e->scanline_id = after->scanline_id;
+    e->next = after->next;
+    after->next = e;
+    if (after == q->in_use.tail) {
+        q->in_use.tail = e;
+    }
+    spin_unlock_unsafe(q->in_use.lock);
+}
+
+/**
+ * Release the oldest count buffers from the in use queue to local_free_list
+ */
+static inline void scanvideo_scanline_queue_release_irqs_enabled(scanvideo_scanline_queue_t *q, int count,
+                                                                 scanvideo_scanline_queue_entry_t **local_free_list) {
+    if (count) {
+        uint32_t save = spin_lock_blocking(q->in_use.lock);
+        while (count--) {
+            // We always discard the head which is the oldest
+            scanvideo_scanline_queue_entry_t *e = scanvideo_scanline_list_remove_head(&q->in_use.head, &q->in_use.tail);
+            scanline_queue_assert(e);
+            scanvideo_scanline_list_prepend(local_free_list, e);
+        }
+        spin_unlock(q->in_use.lock, save);
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
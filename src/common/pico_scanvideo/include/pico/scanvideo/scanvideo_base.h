@@ -86,8 +86,13 @@ extern "C" {
 #define PICO_SCANVIDEO_COLOR_PIN_BASE 0
 #endif
 
+// PICO_CONFIG: PICO_SCANVIDEO_BPP, Pixel depth of the composable scanline program; 8 (8 bit tokens e.g. RGB332 or grayscale), 16 or 24 (32 bit tokens), type=int, default=16, group=video
+#ifndef PICO_SCANVIDEO_BPP
+#define PICO_SCANVIDEO_BPP 16
+#endif
+
 #ifndef PICO_SCANVIDEO_COLOR_PIN_COUNT
-#define PICO_SCANVIDEO_COLOR_PIN_COUNT 16
+#define PICO_SCANVIDEO_COLOR_PIN_COUNT PICO_SCANVIDEO_BPP
 #endif
 
 #ifndef PICO_SCANVIDEO_SYNC_PIN_BASE
@@ -119,7 +124,7 @@ extern "C" {
 
 // ======================
 
-#define BPP 16
+#define BPP PICO_SCANVIDEO_BPP
 
 // most likely 24000000
 extern const uint32_t video_clock_freq;
@@ -145,6 +150,14 @@ typedef struct scanvideo_timing {
     uint8_t clock_polarity;
 
     uint8_t enable_den;
+
+    // interlaced output: the v_ values describe the first (even) field, and the second (odd) field is one line
+    // longer with its vsync pulse starting and ending half way along a line. Each field carries every other line
+    // of the frame, and scanline numbers are frame lines (see scanvideo_scanline_field)
+    uint8_t interlaced;
+    // every line is output twice, so the v_ values are half the physical line counts (which must therefore be even);
+    // to repeat lines of a standard timing use the mode's yscale instead. Can't be combined with interlaced
+    uint8_t doublescan;
 } scanvideo_timing_t;
 
 typedef struct scanvideo_pio_program scanvideo_pio_program_t;
@@ -163,6 +176,13 @@ typedef struct scanvideo_mode {
     // if > 1 then yscale is divided by this to provide the effective yscale;
     // note that yscale must be > yscale_denominator; i.e. only stretching is supported
     uint16_t yscale_denominator;
+    // if > 1 then xscale is divided by this to provide the effective xscale (e.g. 3/2 to show 426 pixels across 640);
+    // this requires PICO_SCANVIDEO_ENABLE_FRACTIONAL_XSCALE, lines made of COMPOSABLE_SCALED_RUN tokens, a width which
+    // is a multiple of xscale_denominator (at most 4), and xscale >= xscale_denominator
+    uint8_t xscale_denominator;
+    // pixel depth (8, 16 or 24; 0 means 16), which must match PICO_SCANVIDEO_BPP; at 8bpp twice as many pixels fit
+    // in the same scanline buffer words and DMA bandwidth as at 16bpp
+    uint8_t bpp;
 } scanvideo_mode_t;
 
 extern bool scanvideo_setup(const scanvideo_mode_t *mode);
@@ -170,8 +190,28 @@ extern bool scanvideo_setup_with_timing(const scanvideo_mode_t *mode, const scan
 extern void scanvideo_timing_enable(bool enable);
 // these take effect after the next vsync
 extern void scanvideo_display_enable(bool enable);
-// doesn't exist yet!
-// extern void video_set_display_mode(const struct scanvideo_mode *mode);
+
+/**
+ * Switch to a different mode without tearing down and setting up again.
+ *
+ * The switch happens at the start of the next vertical blanking interval: only the delays in the scanline PIO program
+ * (as set by its adapt_for_mode) and the timing state words change, so the PIO programs stay loaded and the DMA
+ * channels stay claimed. If the timing differs, the new timing starts with the next frame (and the pixel clock
+ * divider is changed then too), so at worst the last scanlines of that vertical blanking interval have odd lengths.
+ *
+ * The frame number skips one at the switch, so that any scanlines generated for the old mode are discarded rather
+ * than displayed; scanvideo_get_mode() returns the new mode for scanlines in frames after the switch.
+ *
+ * \param mode the new mode, which must use the same pio_program as the current one
+ * \return false if the mode can't be switched to this way (different pio_program or clock polarity, the pixel clock
+ * isn't possible from the current system clock, or the mode doesn't fit the timing)
+ */
+extern bool scanvideo_set_display_mode(const scanvideo_mode_t *mode);
+extern bool scanvideo_set_display_mode_with_timing(const scanvideo_mode_t *mode, const scanvideo_timing_t *timing);
+/**
+ * \return true if a mode passed to scanvideo_set_display_mode is still waiting for vblank
+ */
+extern bool scanvideo_display_mode_change_pending();
 
 // --- scanline management ---
 
@@ -216,6 +256,12 @@ static inline uint16_t scanvideo_scanline_number(uint32_t scanline_id) {
     return (uint16_t) scanline_id;
 }
 
+// for interlaced timing, the field the scanline is displayed in (0 for even lines, 1 for odd); the frame number
+// advances every field, so only the lines of one field need rendering per frame number
+static inline uint scanvideo_scanline_field(uint32_t scanline_id) {
+    return scanline_id & 1u;
+}
+
 /**
  * @return the current vga mode (if there is one)
  */
@@ -275,6 +321,7 @@ extern const scanvideo_timing_t vga_timing_640x480_60_default;
 extern const scanvideo_timing_t vga_timing_1280x1024_60_default;
 extern const scanvideo_timing_t vga_timing_wide_480_50;
 extern const scanvideo_timing_t vga_timing_648x480_60_alt1;
+extern const scanvideo_timing_t vga_timing_1920x1080i_60;
 
 extern const scanvideo_mode_t vga_mode_160x120_60; // 3d monster maze anyone :-)
 extern const scanvideo_mode_t vga_mode_213x160_60;
@@ -288,6 +335,7 @@ extern const scanvideo_mode_t vga_mode_1024x768_60;
 extern const scanvideo_mode_t vga_mode_1280x1024_60;
 extern const scanvideo_mode_t vga_mode_720p_60;
 extern const scanvideo_mode_t vga_mode_1080p_60;
+extern const scanvideo_mode_t vga_mode_1080i_60;
 extern const scanvideo_mode_t vga_mode_1440p_60;
 
 extern const scanvideo_mode_t vga_mode_tft_800x480_50;
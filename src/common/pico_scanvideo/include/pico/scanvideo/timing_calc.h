@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef SCANVIDEO_TIMING_CALC_H_
+#define SCANVIDEO_TIMING_CALC_H_
+
+#include "pico/scanvideo/scanvideo_base.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file timing_calc.h
+ *
+ * Generation of scanvideo_timing_t from a resolution and refresh rate, using the VESA Coordinated Video Timings
+ * (CVT) formulas, either with standard CRT blanking or with reduced blanking (CVT-RB) for digital displays.
+ *
+ * The DPI back-end can only produce pixel clocks of clk_sys / n for integer n >= 2, so alongside the timing a
+ * clk_sys is recommended, chosen from those the RP2040 PLL can produce exactly, which gets the pixel clock as
+ * close as possible to the one CVT asks for. The remaining pixel clock error (which shows up as a slightly off
+ * refresh rate) is reported.
+ *
+ * This is pure calculation with no hardware access, so may be used from the host too.
+ */
+
+#ifndef PARAM_ASSERTIONS_ENABLED_SCANVIDEO_TIMING_CALC
+#define PARAM_ASSERTIONS_ENABLED_SCANVIDEO_TIMING_CALC 0
+#endif
+
+// the crystal frequency the PLL is fed from
+#ifndef SCANVIDEO_TIMING_CALC_XOSC_KHZ
+#define SCANVIDEO_TIMING_CALC_XOSC_KHZ 12000
+#endif
+
+// the largest pixel clock error accepted when choosing clk_sys; VESA allows +/- 0.5%
+#ifndef SCANVIDEO_TIMING_CALC_MAX_CLOCK_ERROR_PPM
+#define SCANVIDEO_TIMING_CALC_MAX_CLOCK_ERROR_PPM 5000
+#endif
+
+enum scanvideo_timing_blanking {
+    // CVT blanking for CRTs (and monitors which expect it)
+    SCANVIDEO_TIMING_CVT = 0,
+    // CVT reduced blanking; a much shorter (and hence lower pixel clock) blanking period for flat panels
+    SCANVIDEO_TIMING_CVT_RB,
+};
+
+enum scanvideo_timing_status {
+    SCANVIDEO_TIMING_OK = 0,
+    // the resolution or refresh rate is out of range
+    SCANVIDEO_TIMING_ERR_PARAMS,
+    // no clk_sys within the limit gives a pixel clock of clk_sys / n (for integer n >= 2) close enough to the ideal
+    SCANVIDEO_TIMING_ERR_CLOCK,
+    // the horizontal sync pulse is too short for the timing state machine
+    SCANVIDEO_TIMING_ERR_H_PULSE,
+    // the horizontal back porch is too short for the timing state machine
+    SCANVIDEO_TIMING_ERR_H_BACK_PORCH,
+    // the horizontal active period (including the front porch) is too short for the timing state machine
+    SCANVIDEO_TIMING_ERR_H_ACTIVE,
+    // a horizontal state is too long to encode in a timing instruction
+    SCANVIDEO_TIMING_ERR_H_TOTAL,
+    // the vertical front porch, sync pulse and back porch must each be at least one line
+    SCANVIDEO_TIMING_ERR_V_BLANK,
+};
+
+typedef struct scanvideo_timing_calc_result {
+    scanvideo_timing_t timing;
+    // the recommended clk_sys; timing.clock_freq is exactly sys_clock_khz * 1000 / clock_divisor
+    uint32_t sys_clock_khz;
+    uint32_t clock_divisor;
+    // the pixel clock the CVT formula asked for
+    uint32_t ideal_clock_freq;
+    // (timing.clock_freq - ideal_clock_freq) in parts per million of ideal_clock_freq
+    int32_t clock_error_ppm;
+    // the actual refresh rate in mHz
+    uint32_t refresh_mhz;
+} scanvideo_timing_calc_result_t;
+
+/**
+ * Calculate CVT (or CVT-RB) timing for a mode
+ *
+ * The width is rounded up to a multiple of 8 pixels as CVT requires. Sync polarities follow CVT so that the
+ * display can tell which timing is in use.
+ *
+ * \param width the horizontal resolution
+ * \param height the vertical resolution
+ * \param refresh_hz the vertical refresh rate
+ * \param blanking SCANVIDEO_TIMING_CVT or SCANVIDEO_TIMING_CVT_RB
+ * \param max_sys_clock_khz the highest clk_sys to consider
+ * \param result filled in with the timing, recommended clk_sys and clock error
+ * \return SCANVIDEO_TIMING_OK, or the reason no usable timing could be produced
+ */
+enum scanvideo_timing_status scanvideo_timing_calc_cvt(uint width, uint height, uint refresh_hz,
+                                                       enum scanvideo_timing_blanking blanking,
+                                                       uint32_t max_sys_clock_khz,
+                                                       scanvideo_timing_calc_result_t *result);
+
+/**
+ * Choose the clk_sys (from those the PLL can produce exactly) which gets clk_sys / n closest to a pixel clock
+ *
+ * Of equally good choices the highest clk_sys is picked, as that leaves the most cycles for generating scanlines; pass
+ * a lower max_sys_clock_khz to get a slower one.
+ *
+ * \param clock_freq the wanted pixel clock in Hz
+ * \param max_sys_clock_khz the highest clk_sys to consider
+ * \param sys_clock_khz set to the chosen clk_sys
+ * \param divisor set to n; the pixel clock is sys_clock_khz * 1000 / n
+ * \return false if no clk_sys within the limit gets within SCANVIDEO_TIMING_CALC_MAX_CLOCK_ERROR_PPM of the
+ * pixel clock
+ */
+bool scanvideo_timing_calc_sys_clock(uint32_t clock_freq, uint32_t max_sys_clock_khz, uint32_t *sys_clock_khz,
+                                     uint32_t *divisor);
+
+/**
+ * Check a timing (generated or hand written) against the constraints of the DPI back-end's PIO programs
+ *
+ * \param timing the timing
+ * \param sys_clock_khz the clk_sys it is to be used with, or 0 not to check the pixel clock
+ * \return SCANVIDEO_TIMING_OK, or the first constraint violated
+ */
+enum scanvideo_timing_status scanvideo_timing_check(const scanvideo_timing_t *timing, uint32_t sys_clock_khz);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "pico.h"
+#include "pico/scanvideo/palette.h"
+#include "pico/scanvideo/composable_scanline.h"
+#if !PICO_NO_HARDWARE
+#include "hardware/interp.h"
+#endif
+
+void scanvideo_palette_init(scanvideo_palette_t *pal, uint bpp, const uint16_t *colors, uint32_t *table) {
+    invalid_params_if(SCANVIDEO_PALETTE, bpp != 1 && bpp != 2 && bpp != 4 && bpp != 8);
+    uint pixels_per_byte = 8 / bpp;
+    uint index_mask = (1u << bpp) - 1;
+    pal->colors = colors;
+    pal->table = (uint16_t *) table;
+    pal->bpp = (uint8_t) bpp;
+    // entries are pixels_per_byte half words
+    pal->entry_shift = (uint8_t) (1 + __builtin_ctz(pixels_per_byte));
+    uint16_t *entry = pal->table;
+    for (uint b = 0; b < 256; b++) {
+        for (uint i = 0; i < pixels_per_byte; i++) {
+            *entry++ = colors[(b >> (i * bpp)) & index_mask];
+        }
+    }
+}
+
+void scanvideo_palette_expand_row_portable(const scanvideo_palette_t *pal, uint32_t *dest, const void *src, uint width) {
+    const uint8_t *s = (const uint8_t *) src;
+    uint16_t *d = (uint16_t *) dest;
+    uint bpp = pal->bpp;
+    uint index_mask = (1u << bpp) - 1;
+    // expand a whole number of bytes to match the table based version
+    uint pixels = ((width * bpp + 7) / 8) * (8 / bpp);
+    for (uint x = 0; x < pixels; x++) {
+        uint bit = x * bpp;
+        *d++ = pal->colors[(s[bit >> 3u] >> (bit & 7u)) & index_mask];
+    }
+}
+
+// expand trailing bytes which don't make up a whole source word
+static uint32_t *expand_bytes(const scanvideo_palette_t *pal, uint32_t *dest, const uint8_t *s, uint count) {
+    uint pixels_per_byte = 8u / pal->bpp;
+    uint16_t *d = (uint16_t *) dest;
+    while (count--) {
+        const uint16_t *entry = pal->table + *s++ * pixels_per_byte;
+        for (uint i = 0; i < pixels_per_byte; i++) {
+            *d++ = entry[i];
+        }
+    }
+    return (uint32_t *) d;
+}
+
+#if !PICO_NO_HARDWARE
+void scanvideo_palette_configure_interp(const scanvideo_palette_t *pal) {
+    uint shift = pal->entry_shift;
+    // each lane produces the address of the table entry for one byte of the source word
+    interp_config c = interp_default_config();
+    interp_config_set_mask(&c, shift, shift + 7);
+    interp_config_set_shift(&c, 8 - shift);
+    interp_set_config(interp0, 0, &c); // byte 1
+    interp_config_set_shift(&c, 16 - shift);
+    interp_config_set_cross_input(&c, true);
+    interp_set_config(interp0, 1, &c); // byte 2 (from accum0)
+    c = interp_default_config();
+    interp_config_set_mask(&c, shift, shift + 7);
+    interp_config_set_shift(&c, 24 - shift);
+    interp_set_config(interp1, 0, &c); // byte 3
+    // we can't shift left, so accum1 is written pre-shifted
+    interp_config_set_shift(&c, 0);
+    interp_set_config(interp1, 1, &c); // byte 0 (from accum1)
+    interp0->base[0] = interp0->base[1] = (uintptr_t) pal->table;
+    interp1->base[0] = interp1->base[1] = (uintptr_t) pal->table;
+}
+
+static __force_inline uint32_t *expand_words(uint32_t *d, const uint32_t *s, uint count, uint bpp, uint shift) {
+    while (count--) {
+        uint32_t w = *s++;
+        interp0->accum[0] = w;
+        interp1->accum[0] = w;
+        interp1->accum[1] = w << shift;
+        if (bpp == 8) {
+            *d++ = *(const uint16_t *) interp1->peek[1] | (*(const uint16_t *) interp0->peek[0] << 16u);
+            *d++ = *(const uint16_t *) interp0->peek[1] | (*(const uint16_t *) interp1->peek[0] << 16u);
+        } else {
+            const uint32_t *e0 = (const uint32_t *) interp1->peek[1];
+            const uint32_t *e1 = (const uint32_t *) interp0->peek[0];
+            const uint32_t *e2 = (const uint32_t *) interp0->peek[1];
+            const uint32_t *e3 = (const uint32_t *) interp1->peek[0];
+            // each entry is 4 / bpp words
+            for (uint i = 0; i < 4 / bpp; i++) d[i] = e0[i];
+            d += 4 / bpp;
+            for (uint i = 0; i < 4 / bpp; i++) d[i] = e1[i];
+            d += 4 / bpp;
+            for (uint i = 0; i < 4 / bpp; i++) d[i] = e2[i];
+            d += 4 / bpp;
+            for (uint i = 0; i < 4 / bpp; i++) d[i] = e3[i];
+            d += 4 / bpp;
+        }
+    }
+    return d;
+}
+
+void __not_in_flash_func(scanvideo_palette_expand_row)(const scanvideo_palette_t *pal, uint32_t *dest, const void *src, uint width) {
+    uint bytes = (width * pal->bpp + 7) / 8;
+    const uint32_t *s = (const uint32_t *) src;
+    switch (pal->bpp) {
+        case 8: dest = expand_words(dest, s, bytes / 4, 8, 1); break;
+        case 4: dest = expand_words(dest, s, bytes / 4, 4, 2); break;
+        case 2: dest = expand_words(dest, s, bytes / 4, 2, 3); break;
+        default: dest = expand_words(dest, s, bytes / 4, 1, 4); break;
+    }
+    expand_bytes(pal, dest, (const uint8_t *) (s + bytes / 4), bytes & 3u);
+}
+#else
+void scanvideo_palette_expand_row(const scanvideo_palette_t *pal, uint32_t *dest, const void *src, uint width) {
+    expand_bytes(pal, dest, (const uint8_t *) src, (width * pal->bpp + 7) / 8);
+}
+#endif
+
+void __time_critical_func(scanvideo_palette_expand_scanline)(const scanvideo_palette_t *pal, scanvideo_scanline_buffer_t *buffer,
+                                                              const void *src, uint width) {
+    invalid_params_if(SCANVIDEO_PALETTE, width < 3);
+    invalid_params_if(SCANVIDEO_PALETTE, scanvideo_palette_scanline_words(pal->bpp, width) > buffer->data_max);
+    uint32_t *data = buffer->data;
+    // expand at word 1, then make room for the raw run's token and count by moving the first pixel down
+    // | jmp raw_run | p0 | width-3 | p1 | p2 ...
+    scanvideo_palette_expand_row(pal, data + 1, src, width);
+    uint32_t p0p1 = data[1];
+    data[0] = COMPOSABLE_RAW_RUN | (p0p1 << 16u);
+    data[1] = (width - 3) | (p0p1 & 0xffff0000u);
+    // pixel n >= 1 is at half word n + 2, and the line must end with a black pixel
+    if (width & 1u) {
+        uint16_t *d16 = (uint16_t *) data;
+        d16[width + 2] = COMPOSABLE_RAW_1P;
+        data[(width + 3) / 2] = 0u | (COMPOSABLE_EOL_ALIGN << 16u);
+        buffer->data_used = (uint16_t) ((width + 5) / 2);
+    } else {
+        data[(width + 2) / 2] = COMPOSABLE_RAW_1P | (0u << 16u);
+        data[(width + 4) / 2] = COMPOSABLE_EOL_SKIP_ALIGN;
+        buffer->data_used = (uint16_t) ((width + 6) / 2);
+    }
+    buffer->status = SCANLINE_OK;
+}
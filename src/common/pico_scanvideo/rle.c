@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <string.h>
+#include "pico.h"
+#include "pico/scanvideo/rle.h"
+#include "pico/scanvideo/composable_scanline.h"
+
+uint32_t scanvideo_rle_token_signature() {
+    // program offsets are all < 32
+    return COMPOSABLE_COLOR_RUN | (COMPOSABLE_RAW_RUN << 5u) | (COMPOSABLE_RAW_1P << 10u) |
+           (COMPOSABLE_RAW_2P << 15u) | (COMPOSABLE_EOL_ALIGN << 20u) | (COMPOSABLE_EOL_SKIP_ALIGN << 25u);
+}
+
+typedef struct {
+    uint16_t *p;
+    uint16_t *end;
+} token_writer_t;
+
+static inline bool put(token_writer_t *w, uint v) {
+    if (w->p == w->end) return false;
+    *w->p++ = (uint16_t) v;
+    return true;
+}
+
+static bool put_raw(token_writer_t *w, const uint16_t *pixels, uint count) {
+    if (!count) return true;
+    if (count == 1) {
+        return put(w, COMPOSABLE_RAW_1P) && put(w, pixels[0]);
+    }
+    if (count == 2) {
+        return put(w, COMPOSABLE_RAW_2P) && put(w, pixels[0]) && put(w, pixels[1]);
+    }
+    // | jmp raw_run | color | n-3 | n-1 colors |
+    if (!put(w, COMPOSABLE_RAW_RUN) || !put(w, pixels[0]) || !put(w, count - 3)) return false;
+    for (uint i = 1; i < count; i++) {
+        if (!put(w, pixels[i])) return false;
+    }
+    return true;
+}
+
+int scanvideo_rle_encode_line(const uint16_t *pixels, uint width, uint32_t *out, uint max_words) {
+    token_writer_t w = {
+            .p = (uint16_t *) out,
+            .end = (uint16_t *) (out + max_words)
+    };
+    uint raw_start = 0;
+    uint x = 0;
+    while (x < width) {
+        uint run = 1;
+        while (x + run < width && pixels[x + run] == pixels[x]) run++;
+        if (run >= SCANVIDEO_RLE_MIN_COLOR_RUN) {
+            // | jmp color_run | color | n-3 |
+            if (!put_raw(&w, pixels + raw_start, x - raw_start) ||
+                !put(&w, COMPOSABLE_COLOR_RUN) || !put(&w, pixels[x]) || !put(&w, run - 3)) {
+                return -1;
+            }
+            raw_start = x + run;
+        }
+        x += run;
+    }
+    if (!put_raw(&w, pixels + raw_start, width - raw_start)) return -1;
+    // the line must end with a black pixel
+    if (!put(&w, COMPOSABLE_RAW_1P) || !put(&w, 0)) return -1;
+    if (1u & (uintptr_t) (w.p - (uint16_t *) out)) {
+        if (!put(&w, COMPOSABLE_EOL_ALIGN)) return -1;
+    } else {
+        if (!put(&w, COMPOSABLE_EOL_SKIP_ALIGN) || !put(&w, 0)) return -1;
+    }
+    return (int) ((uint32_t *) w.p - out);
+}
+
+size_t scanvideo_rle_encode_image(const uint16_t *pixels, uint width, uint height, uint stride, uint32_t *out,
+                                  size_t max_words) {
+    size_t data_start = SCANVIDEO_RLE_HEADER_WORDS + height + 1;
+    if (max_words < data_start) return 0;
+    out[0] = SCANVIDEO_RLE_MAGIC;
+    out[1] = scanvideo_rle_token_signature();
+    out[2] = width | (height << 16u);
+    uint32_t *offsets = out + SCANVIDEO_RLE_HEADER_WORDS;
+    uint32_t *data = out + data_start;
+    size_t pos = 0;
+    for (uint y = 0; y < height; y++) {
+        offsets[y] = (uint32_t) pos;
+        size_t remaining = max_words - data_start - pos;
+        int words = scanvideo_rle_encode_line(pixels + y * stride, width, data + pos,
+                                              (uint) MIN(remaining, scanvideo_rle_max_line_words(width)));
+        if (words < 0) return 0;
+        pos += (uint) words;
+    }
+    offsets[height] = (uint32_t) pos;
+    return data_start + pos;
+}
+
+int scanvideo_rle_decode_line(const uint32_t *tokens, uint words, uint16_t *pixels, uint max_pixels) {
+    const uint16_t *t = (const uint16_t *) tokens;
+    const uint16_t *end = t + words * 2;
+    uint n = 0;
+    while (t < end) {
+        uint token = *t++;
+        uint count;
+        if (token == COMPOSABLE_EOL_ALIGN || token == COMPOSABLE_EOL_SKIP_ALIGN) {
+            if (token == COMPOSABLE_EOL_SKIP_ALIGN) t++;
+            // must finish on a word boundary
+            return (1u & (uintptr_t) (t - (const uint16_t *) tokens)) ? -1 : (int) n;
+        } else if (token == COMPOSABLE_COLOR_RUN) {
+            if (end - t < 2) return -1;
+            uint color = *t++;
+            count = *t++ + 3u;
+            if (n + count > max_pixels) return -1;
+            while (count--) pixels[n++] = (uint16_t) color;
+            continue;
+        } else if (token == COMPOSABLE_RAW_RUN) {
+            if (end - t < 2) return -1;
+            if (n + 1 > max_pixels) return -1;
+            pixels[n++] = *t++;
+            count = *t++ + 2u;
+        } else if (token == COMPOSABLE_RAW_2P) {
+            count = 2;
+        } else if (token == COMPOSABLE_RAW_1P) {
+            count = 1;
+        } else {
+            return -1;
+        }
+        if (end - t < (int) count || n + count > max_pixels) return -1;
+        while (count--) pixels[n++] = *t++;
+    }
+    return -1;
+}
+
+bool scanvideo_rle_image_init(scanvideo_rle_image_t *image, const uint32_t *encoded) {
+    if (encoded[0] != SCANVIDEO_RLE_MAGIC || encoded[1] != scanvideo_rle_token_signature()) {
+        return false;
+    }
+    image->width = (uint16_t) encoded[2];
+    image->height = (uint16_t) (encoded[2] >> 16u);
+    image->line_offsets = encoded + SCANVIDEO_RLE_HEADER_WORDS;
+    image->data = image->line_offsets + image->height + 1;
+    return true;
+}
+
+bool __time_critical_func(scanvideo_rle_image_copy_line)(const scanvideo_rle_image_t *image, uint y,
+                                                         scanvideo_scanline_buffer_t *buffer) {
+    invalid_params_if(SCANVIDEO_RLE, y >= image->height);
+    uint words;
+    const uint32_t *line = scanvideo_rle_image_line(image, y, &words);
+    if (words > buffer->data_max) return false;
+    memcpy(buffer->data, line, words * sizeof(uint32_t));
+    buffer->data_used = (uint16_t) words;
+    buffer->status = SCANLINE_OK;
+    return true;
+}
+
+#if PICO_SCANVIDEO_PLANE1_VARIABLE_FRAGMENT_DMA
+void __time_critical_func(scanvideo_rle_image_fragment_line)(const scanvideo_rle_image_t *image, uint y,
+                                                             scanvideo_scanline_buffer_t *buffer) {
+    invalid_params_if(SCANVIDEO_RLE, y >= image->height);
+    invalid_params_if(SCANVIDEO_RLE, buffer->data_max < 4);
+    uint words;
+    const uint32_t *line = scanvideo_rle_image_line(image, y, &words);
+    buffer->data[0] = words;
+    buffer->data[1] = (uintptr_t) line;
+    buffer->data[2] = 0;
+    buffer->data[3] = 0;
+    buffer->data_used = 4;
+    buffer->status = SCANLINE_OK;
+}
+#endif
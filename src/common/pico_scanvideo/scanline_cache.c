@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "pico.h"
+#include "pico/time.h"
+#include "pico/scanvideo/scanline_cache.h"
+
+#define SLOT_NONE 0xffffu
+
+static inline uint32_t *slot_data(scanvideo_scanline_cache_t *cache, uint slot, uint plane) {
+    return cache->slot_data + (slot * PICO_SCANVIDEO_PLANE_COUNT + plane) * cache->slot_words;
+}
+
+typedef struct {
+    uint32_t *data;
+    uint16_t *used;
+    uint16_t max;
+} buffer_plane_t;
+
+static void get_buffer_planes(const scanvideo_scanline_buffer_t *buffer, buffer_plane_t planes[PICO_SCANVIDEO_PLANE_COUNT]) {
+    scanvideo_scanline_buffer_t *b = (scanvideo_scanline_buffer_t *) buffer;
+    planes[0] = (buffer_plane_t) {b->data, &b->data_used, b->data_max};
+#if PICO_SCANVIDEO_PLANE_COUNT > 1
+    planes[1] = (buffer_plane_t) {b->data2, &b->data2_used, b->data2_max};
+#if PICO_SCANVIDEO_PLANE_COUNT > 2
+    planes[2] = (buffer_plane_t) {b->data3, &b->data3_used, b->data3_max};
+#endif
+#endif
+}
+
+static void lru_unlink(scanvideo_scanline_cache_t *cache, uint slot) {
+    scanvideo_scanline_cache_slot_t *s = &cache->slots[slot];
+    if (s->prev != SLOT_NONE) {
+        cache->slots[s->prev].next = s->next;
+    } else {
+        cache->lru_head = s->next;
+    }
+    if (s->next != SLOT_NONE) {
+        cache->slots[s->next].prev = s->prev;
+    } else {
+        cache->lru_tail = s->prev;
+    }
+}
+
+static void lru_push_head(scanvideo_scanline_cache_t *cache, uint slot) {
+    scanvideo_scanline_cache_slot_t *s = &cache->slots[slot];
+    s->prev = SLOT_NONE;
+    s->next = cache->lru_head;
+    if (cache->lru_head != SLOT_NONE) {
+        cache->slots[cache->lru_head].prev = (uint16_t) slot;
+    } else {
+        cache->lru_tail = (uint16_t) slot;
+    }
+    cache->lru_head = (uint16_t) slot;
+}
+
+static void lru_push_tail(scanvideo_scanline_cache_t *cache, uint slot) {
+    scanvideo_scanline_cache_slot_t *s = &cache->slots[slot];
+    s->next = SLOT_NONE;
+    s->prev = cache->lru_tail;
+    if (cache->lru_tail != SLOT_NONE) {
+        cache->slots[cache->lru_tail].next = (uint16_t) slot;
+    } else {
+        cache->lru_head = (uint16_t) slot;
+    }
+    cache->lru_tail = (uint16_t) slot;
+}
+
+bool scanvideo_scanline_cache_init(scanvideo_scanline_cache_t *cache, uint height, uint slot_count, uint slot_words) {
+    invalid_params_if(SCANVIDEO_SCANLINE_CACHE, !slot_count || slot_count >= SLOT_NONE);
+    invalid_params_if(SCANVIDEO_SCANLINE_CACHE, !slot_words || slot_words > 0xffffu);
+    invalid_params_if(SCANVIDEO_SCANLINE_CACHE, height > 0xffffu);
+    memset(cache, 0, sizeof(scanvideo_scanline_cache_t));
+    cache->slots = (scanvideo_scanline_cache_slot_t *) calloc(slot_count, sizeof(scanvideo_scanline_cache_slot_t));
+    cache->slot_data = (uint32_t *) calloc(slot_count * slot_words * PICO_SCANVIDEO_PLANE_COUNT, sizeof(uint32_t));
+    cache->lines = (scanvideo_scanline_cache_line_t *) calloc(height, sizeof(scanvideo_scanline_cache_line_t));
+    if (!cache->slots || !cache->slot_data || !cache->lines) {
+        scanvideo_scanline_cache_deinit(cache);
+        return false;
+    }
+    cache->height = (uint16_t) height;
+    cache->slot_count = (uint16_t) slot_count;
+    cache->slot_words = (uint16_t) slot_words;
+    cache->lru_head = cache->lru_tail = SLOT_NONE;
+    for (uint i = 0; i < height; i++) {
+        cache->lines[i].slot = SLOT_NONE;
+    }
+    // unused slots live at the LRU end, so they are picked before anything is evicted
+    for (uint i = 0; i < slot_count; i++) {
+        cache->slots[i].line = SLOT_NONE;
+        lru_push_tail(cache, i);
+    }
+    return true;
+}
+
+void scanvideo_scanline_cache_deinit(scanvideo_scanline_cache_t *cache) {
+    free(cache->slots);
+    free(cache->slot_data);
+    free(cache->lines);
+    memset(cache, 0, sizeof(scanvideo_scanline_cache_t));
+}
+
+void scanvideo_scanline_cache_invalidate(scanvideo_scanline_cache_t *cache, uint first_line, uint line_count) {
+    if (first_line >= cache->height) return;
+    uint end = MIN(first_line + line_count, cache->height);
+    for (uint i = first_line; i < end; i++) {
+        // the stale slot is left where it is; it is reused when the line is next stored, or evicted in LRU order
+        cache->lines[i].generation++;
+    }
+}
+
+bool scanvideo_scanline_cache_lookup(scanvideo_scanline_cache_t *cache, scanvideo_scanline_buffer_t *buffer) {
+    uint line = scanvideo_scanline_number(buffer->scanline_id);
+    if (line >= cache->height) {
+        cache->stats.misses++;
+        return false;
+    }
+    scanvideo_scanline_cache_line_t *l = &cache->lines[line];
+    if (l->slot != SLOT_NONE) {
+        scanvideo_scanline_cache_slot_t *s = &cache->slots[l->slot];
+        buffer_plane_t planes[PICO_SCANVIDEO_PLANE_COUNT];
+        get_buffer_planes(buffer, planes);
+        bool fits = true;
+        for (uint p = 0; p < PICO_SCANVIDEO_PLANE_COUNT; p++) {
+            fits &= s->data_used[p] <= planes[p].max;
+        }
+        if (s->generation == l->generation && fits) {
+            uint32_t t0 = time_us_32();
+            for (uint p = 0; p < PICO_SCANVIDEO_PLANE_COUNT; p++) {
+                memcpy(planes[p].data, slot_data(cache, l->slot, p), s->data_used[p] * sizeof(uint32_t));
+                *planes[p].used = s->data_used[p];
+            }
+#if PICO_SCANVIDEO_PLANE1_FIXED_FRAGMENT_DMA
+            buffer->fragment_words = s->fragment_words;
+#endif
+            buffer->status = SCANLINE_OK;
+            lru_unlink(cache, l->slot);
+            lru_push_head(cache, l->slot);
+            l->generating = false;
+            cache->stats.hits++;
+            cache->stats.hit_us += time_us_32() - t0;
+            return true;
+        }
+    }
+    cache->stats.misses++;
+    l->generating = true;
+    l->miss_time = time_us_32();
+    return false;
+}
+
+void scanvideo_scanline_cache_store(scanvideo_scanline_cache_t *cache, const scanvideo_scanline_buffer_t *buffer) {
+    uint line = scanvideo_scanline_number(buffer->scanline_id);
+    if (line >= cache->height) return;
+    scanvideo_scanline_cache_line_t *l = &cache->lines[line];
+    if (l->generating) {
+        cache->stats.generate_us += time_us_32() - l->miss_time;
+        cache->stats.generated++;
+        l->generating = false;
+    }
+    if (buffer->status != SCANLINE_OK) return;
+    buffer_plane_t planes[PICO_SCANVIDEO_PLANE_COUNT];
+    get_buffer_planes(buffer, planes);
+    for (uint p = 0; p < PICO_SCANVIDEO_PLANE_COUNT; p++) {
+        if (*planes[p].used > cache->slot_words) {
+            cache->stats.uncacheable++;
+            return;
+        }
+    }
+    uint slot = l->slot;
+    if (slot == SLOT_NONE) {
+        slot = cache->lru_tail;
+        scanvideo_scanline_cache_slot_t *victim = &cache->slots[slot];
+        if (victim->line != SLOT_NONE) {
+            cache->lines[victim->line].slot = SLOT_NONE;
+            cache->stats.evictions++;
+        }
+        victim->line = (uint16_t) line;
+        l->slot = (uint16_t) slot;
+    }
+    scanvideo_scanline_cache_slot_t *s = &cache->slots[slot];
+    for (uint p = 0; p < PICO_SCANVIDEO_PLANE_COUNT; p++) {
+        memcpy(slot_data(cache, slot, p), planes[p].data, *planes[p].used * sizeof(uint32_t));
+        s->data_used[p] = *planes[p].used;
+    }
+#if PICO_SCANVIDEO_PLANE1_FIXED_FRAGMENT_DMA
+    s->fragment_words = buffer->fragment_words;
+#endif
+    s->generation = l->generation;
+    lru_unlink(cache, slot);
+    lru_push_head(cache, slot);
+}
+
+void scanvideo_scanline_cache_end_scanline_generation(scanvideo_scanline_cache_t *cache, scanvideo_scanline_buffer_t *buffer) {
+    uint line = scanvideo_scanline_number(buffer->scanline_id);
+    if (line < cache->height && cache->lines[line].generating) {
+        scanvideo_scanline_cache_store(cache, buffer);
+    }
+    scanvideo_end_scanline_generation(buffer);
+}
+
+void scanvideo_scanline_cache_get_stats(scanvideo_scanline_cache_t *cache, scanvideo_scanline_cache_stats_t *stats, bool reset) {
+    *stats = cache->stats;
+    if (reset) {
+        memset(&cache->stats, 0, sizeof(cache->stats));
+    }
+}
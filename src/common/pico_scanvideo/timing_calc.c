@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "pico.h"
+#include "pico/scanvideo/timing_calc.h"
+
+// PLL limits (see the RP2040 datasheet)
+#define VCO_MIN_KHZ 750000u
+#define VCO_MAX_KHZ 1600000u
+#define FBDIV_MIN 16u
+#define FBDIV_MAX 320u
+#define POSTDIV_MAX 7u
+
+// PIO clock divider (in half steps, see scanvideo_setup_with_timing)
+#define CLOCK_DIVISOR_MIN 2u
+#define CLOCK_DIVISOR_MAX 0xffffu
+
+// constraints of the DPI timing program (see compute_timing_state)
+#define HTIMING_MIN 8
+#define TIMING_CYCLE 3
+#define TIMING_LENGTH_MAX (0x1fff + TIMING_CYCLE)
+
+// CVT 1.2 constants
+#define CELL_GRAN 8u
+#define CLOCK_STEP 250000u
+#define MIN_V_PORCH 3u
+#define MIN_V_BPORCH 6u
+// minimum vertical sync + back porch time in us
+#define MIN_VSYNC_BP 550.0
+// blanking formula gradient and offset (M' and C')
+#define M_PRIME 300.0
+#define C_PRIME 30.0
+#define H_SYNC_PERCENT 8u
+// reduced blanking: fixed horizontal blanking, and minimum vertical blanking time in us
+#define RB_H_BLANK 160u
+#define RB_H_SYNC 32u
+#define RB_MIN_V_BLANK 460.0
+#define RB_V_FPORCH 3u
+
+// the vsync width tells the display the aspect ratio
+static uint cvt_vsync_lines(uint h, uint v) {
+    if (!(v % 3) && v * 4 / 3 == h) return 4;
+    if (!(v % 9) && v * 16 / 9 == h) return 5;
+    if (!(v % 10) && v * 16 / 10 == h) return 6;
+    if (!(v % 4) && v * 5 / 4 == h) return 7;
+    if (!(v % 9) && v * 15 / 9 == h) return 7;
+    return 10;
+}
+
+bool scanvideo_timing_calc_sys_clock(uint32_t clock_freq, uint32_t max_sys_clock_khz, uint32_t *sys_clock_khz,
+                                     uint32_t *divisor) {
+    invalid_params_if(SCANVIDEO_TIMING_CALC, !clock_freq);
+    uint32_t best_error = UINT32_MAX;
+    uint32_t best_khz = 0;
+    uint32_t best_divisor = 0;
+    for (uint fbdiv = FBDIV_MIN; fbdiv <= FBDIV_MAX; fbdiv++) {
+        uint32_t vco_khz = fbdiv * SCANVIDEO_TIMING_CALC_XOSC_KHZ;
+        if (vco_khz < VCO_MIN_KHZ || vco_khz > VCO_MAX_KHZ) continue;
+        for (uint postdiv1 = 1; postdiv1 <= POSTDIV_MAX; postdiv1++) {
+            for (uint postdiv2 = 1; postdiv2 <= postdiv1; postdiv2++) {
+                uint postdiv = postdiv1 * postdiv2;
+                // set_sys_clock_khz only takes clocks which are an exact number of kHz
+                if (vco_khz % postdiv) continue;
+                uint32_t khz = vco_khz / postdiv;
+                if (khz > max_sys_clock_khz) continue;
+                uint32_t hz = khz * 1000u;
+                uint32_t n = hz / clock_freq;
+                // try the divisors either side
+                for (uint32_t d = n; d <= n + 1; d++) {
+                    if (d < CLOCK_DIVISOR_MIN || d > CLOCK_DIVISOR_MAX) continue;
+                    uint32_t freq = hz / d;
+                    // the back-end recomputes the divisor from the (integer) pixel clock
+                    if (hz / freq != d) continue;
+                    uint32_t error = freq > clock_freq ? freq - clock_freq : clock_freq - freq;
+                    // of equally good clocks the fastest leaves the most cycles for generating scanlines
+                    if (error < best_error || (error == best_error && khz > best_khz)) {
+                        best_error = error;
+                        best_khz = khz;
+                        best_divisor = d;
+                    }
+                }
+            }
+        }
+    }
+    if (!best_divisor ||
+        (uint64_t) best_error * 1000000 > (uint64_t) clock_freq * SCANVIDEO_TIMING_CALC_MAX_CLOCK_ERROR_PPM) {
+        return false;
+    }
+    *sys_clock_khz = best_khz;
+    *divisor = best_divisor;
+    return true;
+}
+
+enum scanvideo_timing_status scanvideo_timing_calc_cvt(uint width, uint height, uint refresh_hz,
+                                                       enum scanvideo_timing_blanking blanking,
+                                                       uint32_t max_sys_clock_khz,
+                                                       scanvideo_timing_calc_result_t *result) {
+    if (width < HTIMING_MIN || width > 0x8000 || !height || height > 0x8000 || !refresh_hz) {
+        return SCANVIDEO_TIMING_ERR_PARAMS;
+    }
+    uint h_active = (width + CELL_GRAN - 1) & ~(CELL_GRAN - 1);
+    uint v_sync = cvt_vsync_lines(h_active, height);
+    double frame_us = 1000000.0 / refresh_hz;
+    scanvideo_timing_t *timing = &result->timing;
+    uint h_total, h_sync, h_back_porch, v_back_porch;
+    uint32_t ideal_clock_freq;
+    if (blanking == SCANVIDEO_TIMING_CVT_RB) {
+        if (frame_us <= RB_MIN_V_BLANK) return SCANVIDEO_TIMING_ERR_PARAMS;
+        double h_period_us = (frame_us - RB_MIN_V_BLANK) / height;
+        uint v_blank = (uint) (RB_MIN_V_BLANK / h_period_us) + 1;
+        v_blank = MAX(v_blank, RB_V_FPORCH + v_sync + MIN_V_BPORCH);
+        h_total = h_active + RB_H_BLANK;
+        h_sync = RB_H_SYNC;
+        h_back_porch = RB_H_BLANK / 2;
+        v_back_porch = v_blank - RB_V_FPORCH - v_sync;
+        ideal_clock_freq = (uint32_t) ((double) refresh_hz * (height + v_blank) * h_total);
+        timing->h_sync_polarity = 0;
+        timing->v_sync_polarity = 1;
+    } else {
+        if (frame_us <= MIN_VSYNC_BP) return SCANVIDEO_TIMING_ERR_PARAMS;
+        double h_period_us = (frame_us - MIN_VSYNC_BP) / (height + MIN_V_PORCH);
+        uint v_sync_bp = (uint) (MIN_VSYNC_BP / h_period_us) + 1;
+        v_sync_bp = MAX(v_sync_bp, v_sync + MIN_V_BPORCH);
+        double duty_cycle = C_PRIME - M_PRIME * h_period_us / 1000.0;
+        if (duty_cycle < 20.0) duty_cycle = 20.0;
+        uint h_blank = (uint) (h_active * duty_cycle / (100.0 - duty_cycle) / (2 * CELL_GRAN)) * 2 * CELL_GRAN;
+        h_total = h_active + h_blank;
+        h_sync = (H_SYNC_PERCENT * h_total / 100) / CELL_GRAN * CELL_GRAN;
+        h_back_porch = h_blank / 2;
+        v_back_porch = v_sync_bp - v_sync;
+        ideal_clock_freq = (uint32_t) (h_total / h_period_us * 1000000.0);
+        timing->h_sync_polarity = 1;
+        timing->v_sync_polarity = 0;
+    }
+    // CVT pixel clocks are a multiple of 0.25MHz
+    ideal_clock_freq -= ideal_clock_freq % CLOCK_STEP;
+    if (!ideal_clock_freq || h_total > 0xffff) return SCANVIDEO_TIMING_ERR_PARAMS;
+
+    timing->h_active = (uint16_t) h_active;
+    timing->h_pulse = (uint16_t) h_sync;
+    timing->h_front_porch = (uint16_t) (h_total - h_active - h_sync - h_back_porch);
+    timing->h_total = (uint16_t) h_total;
+    timing->v_active = (uint16_t) height;
+    timing->v_front_porch = (uint16_t) MIN_V_PORCH;
+    timing->v_pulse = (uint16_t) v_sync;
+    timing->v_total = (uint16_t) (height + MIN_V_PORCH + v_sync + v_back_porch);
+    timing->enable_clock = 0;
+    timing->clock_polarity = 0;
+    timing->enable_den = 0;
+    timing->interlaced = 0;
+    timing->doublescan = 0;
+    timing->clock_freq = 0;
+    result->ideal_clock_freq = ideal_clock_freq;
+
+    if (!scanvideo_timing_calc_sys_clock(ideal_clock_freq, max_sys_clock_khz, &result->sys_clock_khz,
+                                         &result->clock_divisor)) {
+        return SCANVIDEO_TIMING_ERR_CLOCK;
+    }
+    timing->clock_freq = result->sys_clock_khz * 1000u / result->clock_divisor;
+    result->clock_error_ppm = (int32_t) (((int64_t) timing->clock_freq - ideal_clock_freq) * 1000000 /
+                                         ideal_clock_freq);
+    uint64_t frame_clocks = (uint64_t) timing->h_total * timing->v_total;
+    result->refresh_mhz = (uint32_t) ((timing->clock_freq * 1000ull + frame_clocks / 2) / frame_clocks);
+    return scanvideo_timing_check(timing, result->sys_clock_khz);
+}
+
+enum scanvideo_timing_status scanvideo_timing_check(const scanvideo_timing_t *timing, uint32_t sys_clock_khz) {
+    if (sys_clock_khz) {
+        uint32_t hz = sys_clock_khz * 1000u;
+        uint32_t n = timing->clock_freq ? hz / timing->clock_freq : 0;
+        if (n < CLOCK_DIVISOR_MIN || n > CLOCK_DIVISOR_MAX || timing->clock_freq != hz / n) {
+            return SCANVIDEO_TIMING_ERR_CLOCK;
+        }
+    }
+    // the horizontal timing is four states: 4 cycles (the start of the sync pulse), the rest of the sync pulse,
+    // the back porch, then the active period and front porch
+    int h_back_porch = timing->h_total - timing->h_front_porch - timing->h_pulse - timing->h_active;
+    int h_active_and_front_porch = timing->h_active + timing->h_front_porch;
+    if (timing->h_pulse - 4 < HTIMING_MIN) return SCANVIDEO_TIMING_ERR_H_PULSE;
+    if (h_back_porch < HTIMING_MIN) return SCANVIDEO_TIMING_ERR_H_BACK_PORCH;
+    if (timing->h_active < HTIMING_MIN) return SCANVIDEO_TIMING_ERR_H_ACTIVE;
+    if (timing->h_pulse - 4 > TIMING_LENGTH_MAX || h_back_porch > TIMING_LENGTH_MAX ||
+        h_active_and_front_porch > TIMING_LENGTH_MAX) {
+        return SCANVIDEO_TIMING_ERR_H_TOTAL;
+    }
+    // interlaced timing splits the active period half way along the line for the odd field's vsync edges
+    if (timing->interlaced) {
+        if (timing->doublescan) return SCANVIDEO_TIMING_ERR_PARAMS;
+        int half1 = timing->h_total / 2 - timing->h_pulse - h_back_porch;
+        if (half1 < HTIMING_MIN || h_active_and_front_porch - half1 < HTIMING_MIN) return SCANVIDEO_TIMING_ERR_H_ACTIVE;
+    }
+    // the vsync pulse is only started by a line after the last active one, and the frame must wrap after it ends
+    if (!timing->v_active || !timing->v_front_porch || !timing->v_pulse ||
+        timing->v_total <= timing->v_active + timing->v_front_porch + timing->v_pulse) {
+        return SCANVIDEO_TIMING_ERR_V_BLANK;
+    }
+    return SCANVIDEO_TIMING_OK;
+}
@@ -583,6 +583,42 @@ const scanvideo_mode_t vga_mode_1080p_60 =
                 .yscale = 1,
         };
 
+// each field is 540 lines (of 1080), with 562.5 lines per field on average
+const scanvideo_timing_t vga_timing_1920x1080i_60 =
+        {
+                .clock_freq = 74250000,
+
+                .h_active = 1920,
+                .v_active = 540,
+
+                .h_front_porch = 88,
+                .h_pulse = 44,
+                .h_total = 2200,
+                .h_sync_polarity = 1,
+
+                .v_front_porch = 2,
+                .v_pulse = 5,
+                .v_total = 562,
+                .v_sync_polarity = 1,
+
+                .enable_clock = 0,
+                .clock_polarity = 0,
+
+                .enable_den = 0,
+
+                .interlaced = 1
+        };
+
+const scanvideo_mode_t vga_mode_1080i_60 =
+        {
+                .default_timing = &vga_timing_1920x1080i_60,
+                .pio_program = &video_24mhz_composable,
+                .width = 1920,
+                .height = 1080,
+                .xscale = 1,
+                .yscale = 1,
+        };
+
 const scanvideo_timing_t vga_timing_1280x1024_60_default =
         {
                 .clock_freq = 108000000,
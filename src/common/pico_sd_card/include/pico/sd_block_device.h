@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _PICO_SD_BLOCK_DEVICE_H
+#define _PICO_SD_BLOCK_DEVICE_H
+
+#include "pico.h"
+#include "pico/sd_card.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file sd_block_device.h
+ *
+ * A minimal synchronous interface to a device of SD_SECTOR_SIZE byte sectors, for filesystems (and usb_device_msc)
+ * to use without caring whether they are talking to the card directly, or through a cache.
+ *
+ * All functions return SD_OK or one of the SD_ERR_ values.
+ */
+
+typedef struct sd_block_device sd_block_device_t;
+
+struct sd_block_device {
+    int (*read)(const sd_block_device_t *device, uint32_t sector, uint sector_count, uint32_t *buf);
+    int (*write)(const sd_block_device_t *device, uint32_t sector, uint sector_count, const uint32_t *buf);
+    // make sure everything written has reached the underlying storage (may be NULL if there is nothing to do)
+    int (*sync)(const sd_block_device_t *device);
+    // the number of sectors on the device (may be NULL if not known)
+    uint32_t (*get_sector_count)(const sd_block_device_t *device);
+    void *context;
+};
+
+static inline int sd_block_device_read(const sd_block_device_t *device, uint32_t sector, uint sector_count,
+                                       uint32_t *buf) {
+    return device->read(device, sector, sector_count, buf);
+}
+
+static inline int sd_block_device_write(const sd_block_device_t *device, uint32_t sector, uint sector_count,
+                                        const uint32_t *buf) {
+    return device->write(device, sector, sector_count, buf);
+}
+
+static inline int sd_block_device_sync(const sd_block_device_t *device) {
+    return device->sync ? device->sync(device) : SD_OK;
+}
+
+// returns 0 if not known
+static inline uint32_t sd_block_device_sector_count(const sd_block_device_t *device) {
+    return device->get_sector_count ? device->get_sector_count(device) : 0;
+}
+
+/**
+ * The card driven by pico_sd_card (which must already be initialized)
+ */
+extern const sd_block_device_t sd_card_block_device;
+
+#ifdef __cplusplus
+}
+#endif
+#endif
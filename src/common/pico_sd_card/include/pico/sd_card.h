@@ -39,14 +39,56 @@ int sd_init_1pin();
 #define SD_SECTOR_SIZE 512
 int sd_readblocks_sync(uint32_t *buf, uint32_t block, uint block_count);
 int sd_readblocks_async(uint32_t *buf, uint32_t block, uint block_count);
+// as sd_readblocks_async, but with a separate buffer for each block
+int sd_readblocks_gather_async(uint32_t *const *bufs, uint32_t block, uint block_count);
 int sd_readblocks_scatter_async(uint32_t *control_words, uint32_t block, uint block_count);
 void sd_set_byteswap_on_read(bool swap);
 bool sd_scatter_read_complete(int *status);
+// writes are sent in 1 bit mode (switching back afterwards); each block's CRC status is checked on completion
 int sd_writeblocks_async(const uint32_t *data, uint32_t sector_num, uint sector_count);
 bool sd_write_complete(int *status);
 int sd_read_sectors_1bit_crc_async(uint32_t *sector_buf, uint32_t sector, uint sector_count);
 int sd_set_wide_bus(bool wide);
+// the SD clock is clk_sys / (2 * div)
 int sd_set_clock_divider(uint div);
+// the card's capacity in sectors, from its CSD register at init (0 if not known)
+uint32_t sd_get_sector_count(void);
+
+// The card is switched to high speed mode (CMD6) at init if it supports it, and the clock is then tuned with
+// sd_tune_clock(0). The fastest clock tried is the maximum for the card's bus speed mode; these may be raised for boards
+// known to cope (tuning still checks the data read).
+#ifndef PICO_SD_DEFAULT_SPEED_MAX_HZ
+#define PICO_SD_DEFAULT_SPEED_MAX_HZ 25000000
+#endif
+#ifndef PICO_SD_HIGH_SPEED_MAX_HZ
+#define PICO_SD_HIGH_SPEED_MAX_HZ 50000000
+#endif
+// the clock at which the test sectors are read for reference while tuning
+#ifndef PICO_SD_TUNE_REFERENCE_HZ
+#define PICO_SD_TUNE_REFERENCE_HZ 10000000
+#endif
+// choose the fastest clock divider at which test_sector and those following read back correctly (with good CRCs) at
+// every attempt, and measure the read rate; this should be called again if clk_sys changes
+int sd_tune_clock(uint32_t test_sector);
+uint sd_get_clock_hz(void);
+bool sd_is_high_speed(void);
+// bytes per second read by the last sd_tune_clock (multi-block reads of a few sectors, so an underestimate for
+// longer reads)
+uint sd_get_measured_read_rate(void);
+
+// Streaming reads of any number of consecutive sectors (an open ended CMD18) into a ring of buffer_sector_count
+// sectors (2 to PICO_SD_MAX_STREAM_SECTORS) at buf. Sectors are acquired in order once received, and must be released
+// (in the same order) for their space to be reused; when the ring is full the clock is stopped between blocks until
+// a sector is released. Nothing else may use the card until sd_stream_stop. In 4 bit mode the CRCs are checked when
+// each sector is acquired.
+#ifndef PICO_SD_MAX_STREAM_SECTORS
+#define PICO_SD_MAX_STREAM_SECTORS 64
+#endif
+int sd_stream_start(uint32_t *buf, uint buffer_sector_count, uint32_t sector);
+// returns the next sector, or NULL if it hasn't been received yet (or on error, with *status set)
+uint32_t *sd_stream_acquire(int *status);
+void sd_stream_release(void);
+int sd_stream_stop(void);
 
 #endif
 
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _PICO_SD_CARD_CACHE_H
+#define _PICO_SD_CARD_CACHE_H
+
+#include "pico.h"
+#include "pico/sd_block_device.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file sd_card_cache.h
+ *
+ * A write-back sector cache in front of an sd_block_device_t, which is itself an sd_block_device_t.
+ *
+ * All of the cache's memory comes from an arena supplied by the caller; as many sectors are cached as fit (after the
+ * read ahead window). Sectors are evicted least recently used first, except that pinned sectors (e.g. the FAT, or a
+ * directory which is in use) are never evicted. Dirty sectors are written back when evicted, or by sd_cache_sync.
+ *
+ * Reads which continue on from where the previous read finished are taken to be sequential; once there have been
+ * enough of them in a row, misses read a whole read ahead window of sectors in one go (stopping at the end of the
+ * device, if the backing device knows where that is). Sectors read through the window are not added to the cache, so
+ * that streaming through a file doesn't evict everything else.
+ */
+
+#ifndef PARAM_ASSERTIONS_ENABLED_SD_CARD_CACHE
+#define PARAM_ASSERTIONS_ENABLED_SD_CARD_CACHE 0
+#endif
+
+typedef struct {
+    uint read_ahead_sectors;    // size of the read ahead window (0 to disable read ahead)
+    uint read_ahead_trigger;    // number of sequential reads in a row after which to read ahead
+    uint bypass_sectors;        // reads and writes of at least this many sectors aren't cached (0 for no limit)
+    bool write_through;         // write to the device straight away, rather than when evicted or synced
+} sd_cache_config_t;
+
+typedef struct {
+    uint32_t read_sectors;          // sectors read from the cache
+    uint32_t read_hits;             // ... which were in the cache
+    uint32_t read_ahead_hits;       // ... which were in the read ahead window
+    uint32_t write_sectors;         // sectors written to the cache
+    uint32_t write_hits;            // ... which were already in the cache
+    uint32_t evictions;
+    uint32_t device_reads;          // read commands sent to the device
+    uint32_t device_read_sectors;
+    uint32_t device_writes;         // write commands sent to the device
+    uint32_t device_write_sectors;
+} sd_cache_stats_t;
+
+typedef struct {
+    uint32_t sector;
+    uint16_t hash_next;
+    uint16_t lru_prev;
+    uint16_t lru_next;
+    uint8_t flags;
+    uint8_t pin_count;
+} sd_cache_entry_t;
+
+typedef struct {
+    sd_block_device_t device;
+    const sd_block_device_t *backing;
+    sd_cache_config_t config;
+    sd_cache_entry_t *entries;
+    uint16_t *buckets;
+    uint32_t (*sectors)[SD_SECTOR_SIZE / 4];
+    uint32_t (*window)[SD_SECTOR_SIZE / 4];
+    uint entry_count;
+    uint pinned_count;
+    uint bucket_mask;
+    uint16_t lru_head;          // most recently used
+    uint16_t lru_tail;
+    uint32_t window_sector;
+    uint window_count;
+    uint32_t next_sequential_sector;
+    uint sequential_count;
+    sd_cache_stats_t stats;
+} sd_cache_t;
+
+/**
+ * The number of bytes of arena needed to cache sector_count sectors (with a read ahead window of read_ahead_sectors)
+ */
+#define SD_CACHE_ARENA_SIZE(sector_count, read_ahead_sectors) \
+    (((sector_count) + (read_ahead_sectors)) * SD_SECTOR_SIZE + \
+     (sector_count) * (sizeof(sd_cache_entry_t) + sizeof(uint16_t)) + 8)
+
+sd_cache_config_t sd_cache_get_default_config(void);
+
+/**
+ * Initialize a cache in front of backing
+ *
+ * \param arena memory for the cache (see SD_CACHE_ARENA_SIZE), which must remain valid while it is in use
+ * \return SD_OK, or SD_ERR_BAD_PARAM if the arena doesn't have room for at least one sector after the window
+ */
+int sd_cache_init(sd_cache_t *cache, const sd_block_device_t *backing, void *arena, size_t arena_size,
+                  const sd_cache_config_t *config);
+
+/**
+ * The cache as a block device (reads and writes go through the cache, sync writes back all dirty sectors)
+ */
+static inline const sd_block_device_t *sd_cache_device(const sd_cache_t *cache) {
+    return &cache->device;
+}
+
+int sd_cache_read(sd_cache_t *cache, uint32_t sector, uint sector_count, uint32_t *buf);
+int sd_cache_write(sd_cache_t *cache, uint32_t sector, uint sector_count, const uint32_t *buf);
+int sd_cache_sync(sd_cache_t *cache);
+
+/**
+ * Read sectors into the cache (if not already there) and keep them there until unpinned
+ *
+ * Pins nest. At least one sector of the cache is always left unpinned.
+ */
+int sd_cache_pin(sd_cache_t *cache, uint32_t sector, uint sector_count);
+void sd_cache_unpin(sd_cache_t *cache, uint32_t sector, uint sector_count);
+
+/**
+ * Write back and forget everything (e.g. when the card is changed)
+ */
+int sd_cache_invalidate(sd_cache_t *cache);
+
+static inline uint sd_cache_sector_count(const sd_cache_t *cache) {
+    return cache->entry_count;
+}
+
+static inline const sd_cache_stats_t *sd_cache_get_stats(const sd_cache_t *cache) {
+    return &cache->stats;
+}
+
+void sd_cache_reset_stats(sd_cache_t *cache);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _PICO_SD_CARD_CRC_H
+#define _PICO_SD_CARD_CRC_H
+
+#include "pico.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file sd_card_crc.h
+ *
+ * CRC16 (CRC-ITU-T, i.e. x^16 + x^12 + x^5 + 1) verification of data blocks received in 4 bit mode.
+ *
+ * In 4 bit mode each of DAT0-3 carries its own CRC16 of the bits sent on that line, so the data is received as 4
+ * interleaved lanes, each nibble holding one bit of each (DAT0 in bit 0), with the first nibble in the high bits of
+ * each byte. The lanes are separated a word (8 bits of each lane) at a time with a bit matrix transpose, and then each
+ * lane's CRC is updated 16 bits at a time from tables.
+ *
+ * The words may be byte swapped, as they are when read with the sd_card DMA byte swapping enabled (the default, which
+ * stores the bytes in the order they were received); otherwise the first nibble is in the high bits of each word.
+ */
+
+/**
+ * Calculate the CRC16 of each data line for data received in 4 bit mode
+ *
+ * \param data the data
+ * \param word_count the number of words of data
+ * \param byteswapped true if the data words are byte swapped
+ * \param crcs filled with the CRCs of DAT0 to DAT3
+ */
+void sd_crc16_4bit(const uint32_t *data, uint word_count, bool byteswapped, uint16_t crcs[4]);
+
+/**
+ * Check data received in 4 bit mode against the CRC16s which followed it
+ *
+ * \param data the data
+ * \param word_count the number of words of data
+ * \param suffix the 2 words which followed the data (the 16 CRC bits of each line, interleaved the same way)
+ * \param byteswapped true if the data and suffix words are byte swapped
+ * \return true if the CRCs of all 4 lines match
+ */
+bool sd_crc16_4bit_check(const uint32_t *data, uint word_count, const uint32_t *suffix, bool byteswapped);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
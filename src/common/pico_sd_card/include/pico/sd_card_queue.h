@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _PICO_SD_CARD_QUEUE_H
+#define _PICO_SD_CARD_QUEUE_H
+
+#include "pico.h"
+#include "pico/sd_card.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file sd_card_queue.h
+ *
+ * A queue of sector reads and writes, each with a completion callback, run one command at a time on a card.
+ *
+ * Requests are issued in the order they were submitted, but runs of consecutive requests in the same direction for
+ * adjacent sectors are merged into a single multi-block command (writes only when their data is also contiguous in
+ * memory), and requests larger than the card can take in one command are split. When a command completes the next
+ * one is issued before any callbacks are made, so the card is kept busy while they run. A callback may submit more
+ * requests.
+ *
+ * The card is driven through an sd_queue_card_t, so the queue logic can be run against something other than real
+ * hardware; pico_sd_card provides sd_card_queue_card.
+ */
+
+#ifndef PARAM_ASSERTIONS_ENABLED_SD_CARD_QUEUE
+#define PARAM_ASSERTIONS_ENABLED_SD_CARD_QUEUE 0
+#endif
+
+typedef struct sd_queue_request sd_queue_request_t;
+
+/**
+ * Called when a request has completed, with SD_OK or the error from the (first failing) command it was part of
+ */
+typedef void (*sd_queue_callback_t)(sd_queue_request_t *request, int status);
+
+struct sd_queue_request {
+    uint32_t *buf; // SD_SECTOR_SIZE bytes per sector; only read from for writes
+    uint32_t sector;
+    uint sector_count;
+    bool write;
+    sd_queue_callback_t callback;
+    void *user_data;
+    // private
+    sd_queue_request_t *next;
+    uint issued;
+    int status;
+};
+
+typedef struct {
+    // start a read of sector_count sectors into bufs[0] ... bufs[sector_count - 1]
+    int (*start_read)(uint32_t *const *bufs, uint32_t sector, uint sector_count);
+    // start a write of sector_count sectors from data
+    int (*start_write)(const uint32_t *data, uint32_t sector, uint sector_count);
+    bool (*read_complete)(int *status);
+    bool (*write_complete)(int *status);
+    uint max_read_sectors;  // at most PICO_SD_MAX_BLOCK_COUNT
+    uint max_write_sectors;
+} sd_queue_card_t;
+
+typedef struct {
+    const sd_queue_card_t *card;
+    // requests not yet completed, in order; the first command_request_count of these are part of the command in
+    // flight
+    sd_queue_request_t *head;
+    sd_queue_request_t *tail;
+    uint command_request_count;
+    bool command_write;
+    uint32_t *read_bufs[PICO_SD_MAX_BLOCK_COUNT];
+} sd_queue_t;
+
+/**
+ * The card driven by pico_sd_card (which must already be initialized)
+ */
+extern const sd_queue_card_t sd_card_queue_card;
+
+void sd_queue_init(sd_queue_t *queue, const sd_queue_card_t *card);
+
+/**
+ * Add a request to the queue, issuing it straight away if the card is idle
+ *
+ * The request (and its buffer) must remain valid until its callback has been called.
+ */
+void sd_queue_submit(sd_queue_t *queue, sd_queue_request_t *request);
+
+/**
+ * Check for the completion of the command in flight, issuing the next and calling the callbacks of any requests
+ * which have finished
+ *
+ * \return true if there are no requests left
+ */
+bool sd_queue_poll(sd_queue_t *queue);
+
+/**
+ * Poll until every request (including any submitted by callbacks meanwhile) has completed
+ */
+void sd_queue_wait(sd_queue_t *queue);
+
+static inline bool sd_queue_is_idle(const sd_queue_t *queue) {
+    return !queue->head;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif
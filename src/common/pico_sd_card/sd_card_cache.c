@@ -0,0 +1,377 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <string.h>
+#include "pico/sd_card_cache.h"
+
+#define SECTOR_WORDS (SD_SECTOR_SIZE / 4)
+#define NONE 0xffffu
+#define MAX_ENTRIES 0xfffeu
+
+#define ENTRY_VALID 1u
+#define ENTRY_DIRTY 2u
+
+sd_cache_config_t sd_cache_get_default_config(void) {
+    sd_cache_config_t config = {
+            .read_ahead_sectors = 8,
+            .read_ahead_trigger = 3,
+            .bypass_sectors = 16,
+            .write_through = false,
+    };
+    return config;
+}
+
+static int backing_read(sd_cache_t *cache, uint32_t sector, uint sector_count, uint32_t *buf) {
+    cache->stats.device_reads++;
+    cache->stats.device_read_sectors += sector_count;
+    return sd_block_device_read(cache->backing, sector, sector_count, buf);
+}
+
+static int backing_write(sd_cache_t *cache, uint32_t sector, uint sector_count, const uint32_t *buf) {
+    cache->stats.device_writes++;
+    cache->stats.device_write_sectors += sector_count;
+    return sd_block_device_write(cache->backing, sector, sector_count, buf);
+}
+
+static inline uint16_t *bucket(sd_cache_t *cache, uint32_t sector) {
+    // sectors near each other (which is most of them) land in different buckets
+    return &cache->buckets[sector & cache->bucket_mask];
+}
+
+static uint find(sd_cache_t *cache, uint32_t sector) {
+    uint i = *bucket(cache, sector);
+    while (i != NONE && cache->entries[i].sector != sector) {
+        i = cache->entries[i].hash_next;
+    }
+    return i;
+}
+
+static bool is_dirty(sd_cache_t *cache, uint32_t sector) {
+    uint i = find(cache, sector);
+    return i != NONE && (cache->entries[i].flags & ENTRY_DIRTY);
+}
+
+static void hash_remove(sd_cache_t *cache, uint i) {
+    uint16_t *p = bucket(cache, cache->entries[i].sector);
+    while (*p != i) p = &cache->entries[*p].hash_next;
+    *p = cache->entries[i].hash_next;
+}
+
+static void lru_unlink(sd_cache_t *cache, uint i) {
+    sd_cache_entry_t *e = &cache->entries[i];
+    if (e->lru_prev != NONE) cache->entries[e->lru_prev].lru_next = e->lru_next; else cache->lru_head = e->lru_next;
+    if (e->lru_next != NONE) cache->entries[e->lru_next].lru_prev = e->lru_prev; else cache->lru_tail = e->lru_prev;
+}
+
+static void lru_touch(sd_cache_t *cache, uint i) {
+    if (cache->lru_head == i) return;
+    lru_unlink(cache, i);
+    sd_cache_entry_t *e = &cache->entries[i];
+    e->lru_prev = NONE;
+    e->lru_next = cache->lru_head;
+    cache->entries[cache->lru_head].lru_prev = i;
+    cache->lru_head = i;
+}
+
+static void lru_to_tail(sd_cache_t *cache, uint i) {
+    if (cache->lru_tail == i) return;
+    lru_unlink(cache, i);
+    sd_cache_entry_t *e = &cache->entries[i];
+    e->lru_next = NONE;
+    e->lru_prev = cache->lru_tail;
+    cache->entries[cache->lru_tail].lru_next = i;
+    cache->lru_tail = i;
+}
+
+static void forget(sd_cache_t *cache, uint i) {
+    hash_remove(cache, i);
+    cache->entries[i].flags = 0;
+    lru_to_tail(cache, i);
+}
+
+static void reset_entries(sd_cache_t *cache) {
+    for (uint i = 0; i <= cache->bucket_mask; i++) {
+        cache->buckets[i] = NONE;
+    }
+    for (uint i = 0; i < cache->entry_count; i++) {
+        sd_cache_entry_t *e = &cache->entries[i];
+        e->flags = 0;
+        e->pin_count = 0;
+        e->hash_next = NONE;
+        e->lru_prev = i ? i - 1 : NONE;
+        e->lru_next = i + 1 < cache->entry_count ? i + 1 : NONE;
+    }
+    cache->lru_head = 0;
+    cache->lru_tail = cache->entry_count - 1;
+    cache->pinned_count = 0;
+    cache->window_count = 0;
+    cache->sequential_count = 0;
+}
+
+// write back the run of consecutive dirty sectors containing entry i, as few commands as the window buffer allows
+static int write_back_run(sd_cache_t *cache, uint i) {
+    uint32_t sector = cache->entries[i].sector;
+    while (sector && is_dirty(cache, sector - 1)) sector--;
+    uint max = cache->config.read_ahead_sectors;
+    if (max <= 1) {
+        // nowhere to gather a run, so the sectors are written back as they are evicted
+        int rc = backing_write(cache, cache->entries[i].sector, 1, cache->sectors[i]);
+        if (!rc) cache->entries[i].flags &= ~ENTRY_DIRTY;
+        return rc;
+    }
+    // the window is about to be overwritten
+    cache->window_count = 0;
+    do {
+        uint n = 0;
+        uint j;
+        while (n < max && (j = find(cache, sector + n)) != NONE && (cache->entries[j].flags & ENTRY_DIRTY)) {
+            memcpy(cache->window[n++], cache->sectors[j], SD_SECTOR_SIZE);
+        }
+        int rc = backing_write(cache, sector, n, cache->window[0]);
+        if (rc) return rc;
+        for (uint k = 0; k < n; k++) {
+            cache->entries[find(cache, sector + k)].flags &= ~ENTRY_DIRTY;
+        }
+        sector += n;
+    } while (is_dirty(cache, sector));
+    return SD_OK;
+}
+
+// get an entry for sector (which must not be cached already), evicting the least recently used unpinned sector
+static int allocate(sd_cache_t *cache, uint32_t sector, uint *entry) {
+    uint i = cache->lru_tail;
+    while (cache->entries[i].pin_count) {
+        i = cache->entries[i].lru_prev;
+    }
+    sd_cache_entry_t *e = &cache->entries[i];
+    if (e->flags & ENTRY_VALID) {
+        if (e->flags & ENTRY_DIRTY) {
+            int rc = write_back_run(cache, i);
+            if (rc) return rc;
+        }
+        cache->stats.evictions++;
+        hash_remove(cache, i);
+    }
+    e->sector = sector;
+    e->flags = ENTRY_VALID;
+    uint16_t *b = bucket(cache, sector);
+    e->hash_next = *b;
+    *b = i;
+    lru_touch(cache, i);
+    *entry = i;
+    return SD_OK;
+}
+
+static inline bool in_window(sd_cache_t *cache, uint32_t sector) {
+    return sector - cache->window_sector < cache->window_count;
+}
+
+static inline bool bypass(sd_cache_t *cache, uint sector_count) {
+    return cache->config.bypass_sectors && sector_count >= cache->config.bypass_sectors;
+}
+
+// the read ahead window starting at sector, which stops at the end of the device
+static uint window_size(sd_cache_t *cache, uint32_t sector) {
+    uint window = cache->config.read_ahead_sectors;
+    uint32_t device_sectors = sd_block_device_sector_count(cache->backing);
+    if (device_sectors && device_sectors - sector < window) {
+        window = sector < device_sectors ? device_sectors - sector : 0;
+    }
+    return window;
+}
+
+int sd_cache_read(sd_cache_t *cache, uint32_t sector, uint sector_count, uint32_t *buf) {
+    cache->sequential_count = sector == cache->next_sequential_sector ? cache->sequential_count + 1 : 0;
+    cache->next_sequential_sector = sector + sector_count;
+    bool read_ahead = cache->config.read_ahead_sectors && cache->sequential_count >= cache->config.read_ahead_trigger;
+    cache->stats.read_sectors += sector_count;
+    for (uint n = 0; n < sector_count;) {
+        uint32_t s = sector + n;
+        uint32_t *dest = buf + n * SECTOR_WORDS;
+        uint i = find(cache, s);
+        if (i != NONE) {
+            memcpy(dest, cache->sectors[i], SD_SECTOR_SIZE);
+            lru_touch(cache, i);
+            cache->stats.read_hits++;
+            n++;
+            continue;
+        }
+        if (in_window(cache, s)) {
+            memcpy(dest, cache->window[s - cache->window_sector], SD_SECTOR_SIZE);
+            cache->stats.read_ahead_hits++;
+            n++;
+            continue;
+        }
+        uint run = 1;
+        while (n + run < sector_count && find(cache, s + run) == NONE && !in_window(cache, s + run)) run++;
+        uint window = read_ahead ? window_size(cache, s) : 0;
+        if (window > run) {
+            // (cached sectors which are also read into the window are still read from the cache, so dirty ones win)
+            cache->window_count = 0;
+            if (!backing_read(cache, s, window, cache->window[0])) {
+                cache->window_sector = s;
+                cache->window_count = window;
+                continue;
+            }
+            // the device may not have said how big it is, so the window may have run off the end; just read the run
+        }
+        // read the whole run of missing sectors in one command straight into buf; it is only worth keeping if this
+        // isn't a stream, or a single big read
+        int rc = backing_read(cache, s, run, dest);
+        if (rc) return rc;
+        if (!read_ahead && !bypass(cache, run)) {
+            for (uint k = 0; k < run; k++) {
+                rc = allocate(cache, s + k, &i);
+                if (rc) return rc;
+                memcpy(cache->sectors[i], dest + k * SECTOR_WORDS, SD_SECTOR_SIZE);
+            }
+        }
+        n += run;
+    }
+    return SD_OK;
+}
+
+int sd_cache_write(sd_cache_t *cache, uint32_t sector, uint sector_count, const uint32_t *buf) {
+    cache->stats.write_sectors += sector_count;
+    bool direct = cache->config.write_through || bypass(cache, sector_count);
+    if (direct) {
+        int rc = backing_write(cache, sector, sector_count, buf);
+        if (rc) return rc;
+    }
+    for (uint n = 0; n < sector_count; n++) {
+        uint32_t s = sector + n;
+        const uint32_t *src = buf + n * SECTOR_WORDS;
+        if (in_window(cache, s)) {
+            memcpy(cache->window[s - cache->window_sector], src, SD_SECTOR_SIZE);
+        }
+        uint i = find(cache, s);
+        if (i != NONE) {
+            cache->stats.write_hits++;
+        } else if (bypass(cache, sector_count)) {
+            continue;
+        } else {
+            int rc = allocate(cache, s, &i);
+            if (rc) return rc;
+        }
+        memcpy(cache->sectors[i], src, SD_SECTOR_SIZE);
+        if (direct) {
+            cache->entries[i].flags &= ~ENTRY_DIRTY;
+        } else {
+            cache->entries[i].flags |= ENTRY_DIRTY;
+        }
+        lru_touch(cache, i);
+    }
+    return SD_OK;
+}
+
+int sd_cache_sync(sd_cache_t *cache) {
+    for (uint i = 0; i < cache->entry_count; i++) {
+        if (cache->entries[i].flags & ENTRY_DIRTY) {
+            int rc = write_back_run(cache, i);
+            if (rc) return rc;
+        }
+    }
+    return sd_block_device_sync(cache->backing);
+}
+
+int sd_cache_pin(sd_cache_t *cache, uint32_t sector, uint sector_count) {
+    for (uint n = 0; n < sector_count; n++) {
+        uint i = find(cache, sector + n);
+        if (i == NONE || !cache->entries[i].pin_count) {
+            if (cache->pinned_count + 1 >= cache->entry_count) return SD_ERR_BAD_PARAM;
+        } else if (cache->entries[i].pin_count == 0xff) {
+            return SD_ERR_BAD_PARAM;
+        }
+        if (i == NONE) {
+            int rc = allocate(cache, sector + n, &i);
+            if (rc) return rc;
+            rc = backing_read(cache, sector + n, 1, cache->sectors[i]);
+            if (rc) {
+                forget(cache, i);
+                return rc;
+            }
+        }
+        if (!cache->entries[i].pin_count++) cache->pinned_count++;
+    }
+    return SD_OK;
+}
+
+void sd_cache_unpin(sd_cache_t *cache, uint32_t sector, uint sector_count) {
+    for (uint n = 0; n < sector_count; n++) {
+        uint i = find(cache, sector + n);
+        invalid_params_if(SD_CARD_CACHE, i == NONE || !cache->entries[i].pin_count);
+        if (i != NONE && cache->entries[i].pin_count) {
+            if (!--cache->entries[i].pin_count) cache->pinned_count--;
+        }
+    }
+}
+
+int sd_cache_invalidate(sd_cache_t *cache) {
+    int rc = sd_cache_sync(cache);
+    if (rc) return rc;
+    reset_entries(cache);
+    return SD_OK;
+}
+
+void sd_cache_reset_stats(sd_cache_t *cache) {
+    memset(&cache->stats, 0, sizeof(cache->stats));
+}
+
+static int cache_device_read(const sd_block_device_t *device, uint32_t sector, uint sector_count, uint32_t *buf) {
+    return sd_cache_read((sd_cache_t *) device->context, sector, sector_count, buf);
+}
+
+static int cache_device_write(const sd_block_device_t *device, uint32_t sector, uint sector_count,
+                              const uint32_t *buf) {
+    return sd_cache_write((sd_cache_t *) device->context, sector, sector_count, buf);
+}
+
+static int cache_device_sync(const sd_block_device_t *device) {
+    return sd_cache_sync((sd_cache_t *) device->context);
+}
+
+static uint32_t cache_device_get_sector_count(const sd_block_device_t *device) {
+    return sd_block_device_sector_count(((sd_cache_t *) device->context)->backing);
+}
+
+int sd_cache_init(sd_cache_t *cache, const sd_block_device_t *backing, void *arena, size_t arena_size,
+                  const sd_cache_config_t *config) {
+    invalid_params_if(SD_CARD_CACHE, ((uintptr_t) arena) & 3u);
+    memset(cache, 0, sizeof(*cache));
+    cache->device.read = cache_device_read;
+    cache->device.write = cache_device_write;
+    cache->device.sync = cache_device_sync;
+    cache->device.get_sector_count = cache_device_get_sector_count;
+    cache->device.context = cache;
+    cache->backing = backing;
+    cache->config = config ? *config : sd_cache_get_default_config();
+    cache->next_sequential_sector = ~0u;
+
+    // the arena holds the window, then the sectors, then their entries, then the hash buckets
+    size_t window_size = cache->config.read_ahead_sectors * SD_SECTOR_SIZE;
+    if (arena_size < window_size) return SD_ERR_BAD_PARAM;
+    size_t available = arena_size - window_size;
+    uint count = (uint) MIN(MAX_ENTRIES, available / (SD_SECTOR_SIZE + sizeof(sd_cache_entry_t) + sizeof(uint16_t)));
+    uint bucket_count;
+    for (;; count--) {
+        if (!count) return SD_ERR_BAD_PARAM;
+        bucket_count = 1;
+        while (bucket_count * 2 <= count) bucket_count *= 2;
+        if (count * (SD_SECTOR_SIZE + sizeof(sd_cache_entry_t)) + bucket_count * sizeof(uint16_t) <= available) break;
+    }
+    uint8_t *p = (uint8_t *) arena;
+    cache->window = (uint32_t (*)[SECTOR_WORDS]) p;
+    p += window_size;
+    cache->sectors = (uint32_t (*)[SECTOR_WORDS]) p;
+    p += count * SD_SECTOR_SIZE;
+    cache->entries = (sd_cache_entry_t *) p;
+    p += count * sizeof(sd_cache_entry_t);
+    cache->buckets = (uint16_t *) p;
+    cache->entry_count = count;
+    cache->bucket_mask = bucket_count - 1;
+    reset_entries(cache);
+    return SD_OK;
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "pico/sd_card_crc.h"
+
+#define CRC16_POLY 0x1021u
+
+// The lane transpose leaves the 8 bits of each lane in a byte, but not in order: the bit received c nibbles before the
+// last of the word (i.e. the bit which would be bit c if the byte were in order) ends up at bit lane_bit(c). Rather
+// than spend more time putting them in order, the tables are indexed, and the CRCs kept, with this order in each byte.
+static inline uint lane_bit(uint c) {
+    return ((c & 1u) << 2u) | ((c >> 2u) << 1u) | ((c >> 1u) & 1u);
+}
+
+static uint lane_byte_from_byte(uint b) {
+    uint l = 0;
+    for (uint c = 0; c < 8; c++) {
+        l |= ((b >> c) & 1u) << lane_bit(c);
+    }
+    return l;
+}
+
+static uint byte_from_lane_byte(uint l) {
+    uint b = 0;
+    for (uint c = 0; c < 8; c++) {
+        b |= ((l >> lane_bit(c)) & 1u) << c;
+    }
+    return b;
+}
+
+static inline uint lane_halfword_from_halfword(uint h) {
+    return (lane_byte_from_byte(h >> 8u) << 8u) | lane_byte_from_byte(h & 0xffu);
+}
+
+static inline uint halfword_from_lane_halfword(uint h) {
+    return (byte_from_lane_byte(h >> 8u) << 8u) | byte_from_lane_byte(h & 0xffu);
+}
+
+// the CRC update for the low (0) and high (1) byte of 16 bits of a lane, indexed and valued in lane bit order
+static uint16_t crc_tables[2][256];
+static bool crc_tables_initialized;
+
+static void init_crc_tables(void) {
+    for (uint i = 0; i < 256; i++) {
+        uint crc = byte_from_lane_byte(i) << 8u;
+        for (uint t = 0; t < 2; t++) {
+            for (uint bit = 0; bit < 8; bit++) {
+                crc = (crc << 1u) ^ ((crc & 0x8000u) ? CRC16_POLY : 0);
+            }
+            crc_tables[t][i] = (uint16_t) lane_halfword_from_halfword(crc & 0xffffu);
+        }
+    }
+    crc_tables_initialized = true;
+}
+
+// bit matrix transpose of the 8 nibbles (first received in the high bits) of a word, so that byte n holds the 8 bits
+// of DAT<n> (in lane bit order)
+static inline uint32_t transpose_lanes(uint32_t w) {
+    uint32_t t = (w ^ (w >> 14u)) & 0x0000ccccu;
+    w ^= t ^ (t << 14u);
+    t = (w ^ (w >> 7u)) & 0x00aa00aau;
+    w ^= t ^ (t << 7u);
+    return w;
+}
+
+static inline uint32_t received_word(const uint32_t *p, bool byteswapped) {
+    return byteswapped ? __builtin_bswap32(*p) : *p;
+}
+
+static inline uint crc_update16(uint crc, uint bits) {
+    uint x = crc ^ bits;
+    return crc_tables[1][x >> 8u] ^ crc_tables[0][x & 0xffu];
+}
+
+static inline uint crc_update8(uint crc, uint bits) {
+    return ((crc << 8u) & 0xff00u) ^ crc_tables[0][(crc >> 8u) ^ bits];
+}
+
+void __time_critical_func(sd_crc16_4bit)(const uint32_t *data, uint word_count, bool byteswapped, uint16_t crcs[4]) {
+    if (!crc_tables_initialized) init_crc_tables();
+    uint crc0 = 0, crc1 = 0, crc2 = 0, crc3 = 0;
+    const uint32_t *end = data + (word_count & ~1u);
+    while (data < end) {
+        uint32_t a = transpose_lanes(received_word(data, byteswapped));
+        uint32_t b = transpose_lanes(received_word(data + 1, byteswapped));
+        data += 2;
+        // 16 bits of DAT0 and DAT2, then of DAT1 and DAT3
+        uint32_t even = ((a & 0x00ff00ffu) << 8u) | (b & 0x00ff00ffu);
+        uint32_t odd = (a & 0xff00ff00u) | ((b >> 8u) & 0x00ff00ffu);
+        crc0 = crc_update16(crc0, even & 0xffffu);
+        crc2 = crc_update16(crc2, even >> 16u);
+        crc1 = crc_update16(crc1, odd & 0xffffu);
+        crc3 = crc_update16(crc3, odd >> 16u);
+    }
+    if (word_count & 1u) {
+        uint32_t a = transpose_lanes(received_word(data, byteswapped));
+        crc0 = crc_update8(crc0, a & 0xffu);
+        crc1 = crc_update8(crc1, (a >> 8u) & 0xffu);
+        crc2 = crc_update8(crc2, (a >> 16u) & 0xffu);
+        crc3 = crc_update8(crc3, a >> 24u);
+    }
+    crcs[0] = (uint16_t) halfword_from_lane_halfword(crc0);
+    crcs[1] = (uint16_t) halfword_from_lane_halfword(crc1);
+    crcs[2] = (uint16_t) halfword_from_lane_halfword(crc2);
+    crcs[3] = (uint16_t) halfword_from_lane_halfword(crc3);
+}
+
+bool __time_critical_func(sd_crc16_4bit_check)(const uint32_t *data, uint word_count, const uint32_t *suffix,
+                                               bool byteswapped) {
+    uint16_t crcs[4];
+    sd_crc16_4bit(data, word_count, byteswapped, crcs);
+    uint32_t hi = transpose_lanes(received_word(suffix, byteswapped));
+    uint32_t lo = transpose_lanes(received_word(suffix + 1, byteswapped));
+    for (uint lane = 0; lane < 4; lane++) {
+        uint received = (byte_from_lane_byte((hi >> (lane * 8u)) & 0xffu) << 8u) |
+                        byte_from_lane_byte((lo >> (lane * 8u)) & 0xffu);
+        if (received != crcs[lane]) return false;
+    }
+    return true;
+}
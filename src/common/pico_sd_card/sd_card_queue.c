@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "pico/sd_card_queue.h"
+
+#define SECTOR_WORDS (SD_SECTOR_SIZE / 4)
+
+typedef struct {
+    sd_queue_request_t *head;
+    sd_queue_request_t *tail;
+} request_list_t;
+
+void sd_queue_init(sd_queue_t *queue, const sd_queue_card_t *card) {
+    invalid_params_if(SD_CARD_QUEUE, !card->max_read_sectors || card->max_read_sectors > PICO_SD_MAX_BLOCK_COUNT);
+    invalid_params_if(SD_CARD_QUEUE, !card->max_write_sectors);
+    queue->card = card;
+    queue->head = queue->tail = NULL;
+    queue->command_request_count = 0;
+}
+
+// whether r can follow (all of) prev in the same command
+static bool can_merge(const sd_queue_request_t *prev, const sd_queue_request_t *r) {
+    return r->write == prev->write && r->sector == prev->sector + prev->sector_count &&
+           (!r->write || r->buf == prev->buf + prev->sector_count * SECTOR_WORDS);
+}
+
+// start a command for as many sectors as possible from the head of the queue
+static int issue(sd_queue_t *queue) {
+    sd_queue_request_t *first = queue->head;
+    bool write = first->write;
+    uint max = write ? queue->card->max_write_sectors : queue->card->max_read_sectors;
+    uint32_t sector = first->sector + first->issued;
+    const uint32_t *data = first->buf + first->issued * SECTOR_WORDS;
+    uint count = 0;
+    uint request_count = 0;
+    sd_queue_request_t *prev = NULL;
+    for (sd_queue_request_t *r = first; r && count < max && (!prev || can_merge(prev, r)); prev = r, r = r->next) {
+        uint n = MIN(r->sector_count - r->issued, max - count);
+        if (!write) {
+            for (uint i = 0; i < n; i++) {
+                queue->read_bufs[count + i] = r->buf + (r->issued + i) * SECTOR_WORDS;
+            }
+        }
+        r->issued += n;
+        count += n;
+        request_count++;
+        // only the first request of a command can have been partly issued already, and only the last left so
+        if (r->issued < r->sector_count) break;
+    }
+    queue->command_request_count = request_count;
+    queue->command_write = write;
+    return write ? queue->card->start_write(data, sector, count) : queue->card->start_read(queue->read_bufs, sector, count);
+}
+
+// move the requests which are finished with the command in flight to done
+static void finish_command(sd_queue_t *queue, int status, request_list_t *done) {
+    for (uint i = 0; i < queue->command_request_count; i++) {
+        sd_queue_request_t *r = queue->head;
+        if (!r->status) r->status = status;
+        // a request which failed isn't continued
+        if (r->issued < r->sector_count && !r->status) break;
+        queue->head = r->next;
+        r->next = NULL;
+        if (done->tail) {
+            done->tail->next = r;
+        } else {
+            done->head = r;
+        }
+        done->tail = r;
+    }
+    if (!queue->head) queue->tail = NULL;
+    queue->command_request_count = 0;
+}
+
+static void start_next(sd_queue_t *queue, request_list_t *done) {
+    while (queue->head) {
+        int rc = issue(queue);
+        if (!rc) break;
+        finish_command(queue, rc, done);
+    }
+}
+
+static void call_callbacks(request_list_t *done) {
+    sd_queue_request_t *r = done->head;
+    while (r) {
+        // the callback may reuse the request
+        sd_queue_request_t *next = r->next;
+        if (r->callback) r->callback(r, r->status);
+        r = next;
+    }
+}
+
+void sd_queue_submit(sd_queue_t *queue, sd_queue_request_t *request) {
+    invalid_params_if(SD_CARD_QUEUE, !request->sector_count);
+    request->next = NULL;
+    request->issued = 0;
+    request->status = SD_OK;
+    if (queue->tail) {
+        queue->tail->next = request;
+    } else {
+        queue->head = request;
+    }
+    queue->tail = request;
+    if (!queue->command_request_count) {
+        request_list_t done = {NULL, NULL};
+        start_next(queue, &done);
+        call_callbacks(&done);
+    }
+}
+
+bool sd_queue_poll(sd_queue_t *queue) {
+    if (!queue->command_request_count) return !queue->head;
+    int status = SD_OK;
+    bool complete = queue->command_write ? queue->card->write_complete(&status) : queue->card->read_complete(&status);
+    if (!complete) return false;
+    request_list_t done = {NULL, NULL};
+    finish_command(queue, status, &done);
+    // keep the card busy while the callbacks run
+    start_next(queue, &done);
+    call_callbacks(&done);
+    return !queue->head;
+}
+
+void sd_queue_wait(sd_queue_t *queue) {
+    while (!sd_queue_poll(queue)) {
+        tight_loop_contents();
+    }
+}
@@ -2,7 +2,6 @@
 
 #include "pico.h"
 #include "platypus.h"
-#include "pico/scanvideo.h"
 #if PICO_ON_DEVICE
 #include "hardware/interp.h"
 #endif
@@ -0,0 +1,435 @@
+#include <string.h>
+
+#include "pico.h"
+#include "platypus_encode.h"
+
+// per pixel deltas (top left, top right, bottom left, bottom right) added to one color channel, in the order of the
+// decoder's row_5_table; 3 byte blocks can use the first 4, 4 byte blocks all 32
+static const uint8_t delta_patterns[32][4] = {
+        {0, 0, 0, 0}, {0, 0, 1, 0}, {0, 1, 1, 1}, {0, 1, 1, 0}, {1, 1, 1, 0}, {0, 1, 0, 0}, {0, 0, 1, 1}, {0, 1, 2, 1},
+        {0, 0, 2, 1}, {0, 2, 1, 1}, {0, 1, 2, 2}, {0, 1, 0, 1}, {1, 0, 1, 0}, {1, 1, 2, 0}, {1, 1, 0, 0}, {1, 2, 1, 0},
+        {0, 2, 1, 2}, {1, 0, 2, 0}, {2, 2, 1, 0}, {1, 2, 0, 0}, {0, 0, 2, 0}, {1, 0, 2, 1}, {0, 1, 1, 2}, {0, 2, 0, 1},
+        {0, 2, 2, 2}, {0, 0, 2, 2}, {2, 1, 2, 0}, {0, 1, 3, 2}, {0, 0, 3, 2}, {0, 1, 3, 3}, {0, 1, 2, 0}, {1, 0, 1, 1},
+};
+
+static const uint8_t channel_shifts[3] = {PLATYPUS_PIXEL_RSHIFT, PLATYPUS_PIXEL_GSHIFT, PLATYPUS_PIXEL_BSHIFT};
+
+// find a base value and delta pattern which give a channel of the block exactly
+static bool match_channel(const uint16_t px[4], uint shift, uint pattern_count, uint *base, uint *pattern) {
+    uint v[4];
+    for (uint i = 0; i < 4; i++) v[i] = (px[i] >> shift) & 0x1fu;
+    for (uint p = 0; p < pattern_count; p++) {
+        const uint8_t *d = delta_patterns[p];
+        if (v[0] < d[0]) continue;
+        uint b = v[0] - d[0];
+        if (v[1] == b + d[1] && v[2] == b + d[2] && v[3] == b + d[3]) {
+            *base = b;
+            *pattern = p;
+            return true;
+        }
+    }
+    return false;
+}
+
+// a base color plus delta patterns, as a 3 (short) or 4 byte block; returns 0 if the block can't be encoded exactly
+static uint encode_delta_block(const uint16_t px[4], bool short_form, uint8_t *d) {
+    uint color = 0, v = 0;
+    for (uint c = 0; c < 3; c++) {
+        uint base, pattern;
+        if (!match_channel(px, channel_shifts[c], short_form ? 4 : 32, &base, &pattern)) return 0;
+        color |= base << channel_shifts[c];
+        v |= pattern << (c * (short_form ? 2 : 5));
+    }
+    d[0] = (uint8_t) color;
+    d[1] = (uint8_t) (color >> 8);
+#ifndef PLATYPUS_565
+    if (short_form) {
+        d[2] = (uint8_t) v;
+        return 3;
+    }
+    d[2] = (uint8_t) (0x80u | (v >> 8));
+    d[3] = (uint8_t) v;
+#else
+    if (short_form) {
+        d[2] = (uint8_t) (v << 2);
+        return 3;
+    }
+    d[2] = (uint8_t) ((v << 1) | 1u);
+    d[3] = (uint8_t) (v >> 7);
+#endif
+    return 4;
+}
+
+// the top right and bottom pixels of a 7 byte block, as decoded by platypus_decompress_row (P1 in bits 0-15, P2 in
+// 16-31 and P3 in 32-47)
+static uint64_t literal7_decode(const uint8_t *s) {
+    uint32_t row0 = (uint32_t) (s[2] | (s[3] << 8)) << 16;
+    uint32_t row1 = (uint32_t) ((s[6] << 16) | (s[5] << 8) | s[4]);
+#ifndef PLATYPUS_565
+    uint32_t mask = 0xff018401;
+    uint32_t hi_bits = row1 & mask;
+    row1 ^= hi_bits;
+    uint32_t lo_bits = row0 & (mask << 16u);
+    row0 ^= lo_bits;
+    hi_bits |= lo_bits >> 15u;
+    row1 |= (hi_bits >> 10u) << 24u;
+    row1 |= hi_bits << 27u;
+#else
+    uint32_t mask = 0xff210821;
+    uint32_t hi_bits = row1 & mask;
+    row1 ^= hi_bits;
+    uint32_t lo_bits = row0 & (mask << 16u);
+    row0 ^= lo_bits;
+    lo_bits >>= 13u;
+    hi_bits |= lo_bits;
+    hi_bits ^= (hi_bits >> 10u);
+    hi_bits = (hi_bits * 2) + ((hi_bits >> 11u) & 1u);
+    row1 |= hi_bits << 24u;
+#endif
+    return (row0 >> 16u) | ((uint64_t) row1 << 16u);
+}
+
+// the free bits of a 7 byte block are the top right pixel (but for the spare bit, which must be clear) and the 24
+// bits of the bottom row; the decode of those is linear (over GF(2)), so is modelled as a matrix
+#define LITERAL7_VARS 39
+#define LITERAL7_OUTPUTS 48
+
+static uint64_t literal7_matrix[LITERAL7_OUTPUTS];
+static bool literal7_matrix_valid;
+
+static void literal7_set_var(uint8_t *s, uint var) {
+    // the top right pixel's bits are numbered first, skipping the spare bit
+    if (var < 15) {
+        uint bit = var;
+        if ((1u << bit) >= PLATYPUS_PIXEL_SPARE_BIT) bit++;
+        s[2 + bit / 8] |= (uint8_t) (1u << (bit & 7u));
+    } else {
+        var -= 15;
+        s[4 + var / 8] |= (uint8_t) (1u << (var & 7u));
+    }
+}
+
+static void literal7_init_matrix(void) {
+    for (uint var = 0; var < LITERAL7_VARS; var++) {
+        uint8_t s[7] = {0};
+        literal7_set_var(s, var);
+        uint64_t out = literal7_decode(s);
+        for (uint o = 0; o < LITERAL7_OUTPUTS; o++) {
+            if ((out >> o) & 1u) literal7_matrix[o] |= 1ull << var;
+        }
+    }
+    literal7_matrix_valid = true;
+}
+
+// a 7 byte block matching as many bits of the target as possible, most significant bits of each channel first
+static void encode_literal7_block(const uint16_t px[4], uint8_t *d) {
+    if (!literal7_matrix_valid) literal7_init_matrix();
+    uint64_t target = px[1] | ((uint64_t) px[2] << 16u) | ((uint64_t) px[3] << 32u);
+    // Gaussian elimination, with each pivot row's lowest set bit being its pivot variable
+    uint64_t pivot_rows[LITERAL7_VARS];
+    uint8_t pivot_values[LITERAL7_VARS];
+    uint64_t have_pivot = 0;
+    for (int bit = 4; bit >= 0; bit--) {
+        for (uint p = 0; p < 3; p++) {
+            for (uint c = 0; c < 3; c++) {
+                uint o = p * 16 + channel_shifts[c] + (uint) bit;
+                uint64_t row = literal7_matrix[o];
+                uint value = (uint) (target >> o) & 1u;
+                for (uint var = 0; var < LITERAL7_VARS && row; var++) {
+                    if (((row >> var) & 1u) && ((have_pivot >> var) & 1u)) {
+                        row ^= pivot_rows[var];
+                        value ^= pivot_values[var];
+                    }
+                }
+                // if the row reduced to nothing, this bit is already decided (rightly or wrongly)
+                if (row) {
+                    uint var = (uint) __builtin_ctzll(row);
+                    pivot_rows[var] = row;
+                    pivot_values[var] = (uint8_t) value;
+                    have_pivot |= 1ull << var;
+                }
+            }
+        }
+    }
+    // back substitute, with variables which aren't pivots left clear
+    uint64_t vars = 0;
+    for (int var = LITERAL7_VARS - 1; var >= 0; var--) {
+        if ((have_pivot >> var) & 1u) {
+            uint value = pivot_values[var] ^ (uint) (__builtin_popcountll(pivot_rows[var] & vars) & 1);
+            vars |= (uint64_t) value << var;
+        }
+    }
+    uint16_t c0 = (uint16_t) (px[0] | PLATYPUS_PIXEL_SPARE_BIT);
+    memset(d, 0, 7);
+    d[0] = (uint8_t) c0;
+    d[1] = (uint8_t) (c0 >> 8);
+    for (uint var = 0; var < LITERAL7_VARS; var++) {
+        if ((vars >> var) & 1u) literal7_set_var(d, var);
+    }
+}
+
+static bool literal7_exact(const uint16_t px[4], const uint8_t *d) {
+    uint64_t out = literal7_decode(d);
+    for (uint p = 1; p < 4; p++) {
+        if ((uint16_t) ((out >> ((p - 1) * 16)) ^ px[p]) & PLATYPUS_PIXEL_MASK) return false;
+    }
+    return true;
+}
+
+// encode a block as the smallest form allowed, returning its size; px is updated to the block as decoded
+static uint encode_block(uint16_t px[4], bool lossless, uint8_t *block, platypus_encode_stats_t *stats) {
+    for (uint i = 0; i < 4; i++) px[i] &= PLATYPUS_PIXEL_MASK;
+    uint n = encode_delta_block(px, true, block);
+    if (n) {
+        stats->blocks_3++;
+        return n;
+    }
+    if ((n = encode_delta_block(px, false, block))) {
+        stats->blocks_4++;
+        return n;
+    }
+    encode_literal7_block(px, block);
+    if (literal7_exact(px, block)) {
+        stats->blocks_7++;
+        return 7;
+    }
+    if (!lossless) {
+        stats->blocks_7++;
+        stats->lossy_blocks++;
+        uint64_t out = literal7_decode(block);
+        for (uint p = 1; p < 4; p++) {
+            px[p] = (uint16_t) (out >> ((p - 1) * 16)) & PLATYPUS_PIXEL_MASK;
+        }
+        return 7;
+    }
+    // the top right pixel has the spare bit set too, and the bottom row is as is
+    uint16_t c1 = (uint16_t) (px[1] | PLATYPUS_PIXEL_SPARE_BIT);
+    block[2] = (uint8_t) c1;
+    block[3] = (uint8_t) (c1 >> 8);
+    block[4] = (uint8_t) px[2];
+    block[5] = (uint8_t) (px[2] >> 8);
+    block[6] = (uint8_t) px[3];
+    block[7] = (uint8_t) (px[3] >> 8);
+    stats->blocks_8++;
+    return 8;
+}
+
+// encode a row pair, optionally also writing the pixels as they will be decoded (without the spare bit)
+static size_t encode_row_pair(const uint16_t *row0, const uint16_t *row1, uint width, bool lossless,
+                              uint32_t *dest, platypus_encode_stats_t *stats, uint16_t *decoded0,
+                              uint16_t *decoded1) {
+    uint8_t *d = (uint8_t *) dest;
+    size_t bytes = 0;
+    platypus_encode_stats_t local_stats;
+    if (!stats) stats = &local_stats;
+    for (uint x = 0; x < width; x += 2) {
+        uint16_t px[4] = {row0[x], row0[x + 1], row1[x], row1[x + 1]};
+        uint8_t block[8];
+        uint n = encode_block(px, lossless, block, stats);
+        if (d) memcpy(d + bytes, block, n);
+        bytes += n;
+        if (decoded0) {
+            decoded0[x] = px[0];
+            decoded0[x + 1] = px[1];
+            decoded1[x] = px[2];
+            decoded1[x + 1] = px[3];
+        }
+    }
+    // the decoder rounds up to a word boundary after each row pair; the padding looks like the start of a 7 byte
+    // block, which is what the PLATYPUS_GATED_EOL_CHECK decoder relies on to find the end of the row
+    while (bytes & 3u) {
+        if (d) d[bytes] = 0xa0;
+        bytes++;
+    }
+    return bytes / 4;
+}
+
+size_t platypus_encode_row_pair(const uint16_t *row0, const uint16_t *row1, uint width, bool lossless,
+                                uint32_t *dest, platypus_encode_stats_t *stats) {
+    return encode_row_pair(row0, row1, width, lossless, dest, stats, NULL, NULL);
+}
+
+size_t platypus_encode_image(const uint16_t *pixels, uint width, uint height, uint stride, bool lossless,
+                             uint32_t *dest, size_t max_words, platypus_encode_stats_t *stats) {
+    if (!width || (width & 1u) || !height || (height & 1u) || stride < width) return 0;
+    size_t words = 0;
+    for (uint y = 0; y < height; y += 2) {
+        const uint16_t *row0 = pixels + y * stride;
+        const uint16_t *row1 = row0 + stride;
+        // near the end of the buffer, size the row pair first so as not to overrun it
+        if (words + PLATYPUS_MAX_ROW_PAIR_WORDS(width) > max_words &&
+            words + platypus_encode_row_pair(row0, row1, width, lossless, NULL, NULL) > max_words) {
+            return 0;
+        }
+        words += platypus_encode_row_pair(row0, row1, width, lossless, dest + words, stats);
+    }
+    return words;
+}
+
+size_t platypus_encode_indexed_image(const uint16_t *pixels, uint width, uint height, uint stride, bool lossless,
+                                     uint32_t *dest, size_t max_words, platypus_encode_stats_t *stats) {
+    if (!width || (width & 1u) || width > 0xffff || !height || (height & 1u) || height > 0xffff) return 0;
+    uint row_pairs = height / 2;
+    size_t index_words = PLATYPUS_IMAGE_HEADER_WORDS + row_pairs + 1;
+    if (max_words <= index_words) return 0;
+    dest[0] = PLATYPUS_IMAGE_MAGIC;
+    dest[1] = PLATYPUS_IMAGE_FORMAT;
+    dest[2] = width | (height << 16);
+    uint32_t *offsets = dest + PLATYPUS_IMAGE_HEADER_WORDS;
+    uint32_t *data = offsets + row_pairs + 1;
+    offsets[0] = 0;
+    for (uint i = 0; i < row_pairs; i++) {
+        // each row pair is encoded on its own so its offset can be recorded
+        size_t words = platypus_encode_image(pixels + i * 2 * stride, width, 2, stride, lossless, data + offsets[i],
+                                             max_words - index_words - offsets[i], stats);
+        if (!words) return 0;
+        offsets[i + 1] = offsets[i] + (uint32_t) words;
+    }
+    return index_words + offsets[row_pairs];
+}
+
+#if PLATYPUS_ENCODE_MAX_MOTION > 32
+#error PLATYPUS_ENCODE_MAX_MOTION must be at most 32
+#endif
+
+// the number of blocks of a row pair which differ from a row pair of the reference
+static uint count_changed_blocks(const uint16_t *row0, const uint16_t *row1, const uint16_t *ref0,
+                                 const uint16_t *ref1, uint width) {
+    uint count = 0;
+    for (uint x = 0; x < width; x += 2) {
+        if (((row0[x] ^ ref0[x]) | (row0[x + 1] ^ ref0[x + 1]) | (row1[x] ^ ref1[x]) | (row1[x + 1] ^ ref1[x + 1])) &
+            PLATYPUS_PIXEL_MASK) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// whether encoding a block would leave the reference as it is
+static bool block_unchanged(const uint16_t *row0, const uint16_t *row1, const uint16_t *ref0, const uint16_t *ref1,
+                            bool lossless) {
+    uint16_t px[4] = {row0[0], row0[1], row1[0], row1[1]};
+    if (!(((px[0] ^ ref0[0]) | (px[1] ^ ref0[1]) | (px[2] ^ ref1[0]) | (px[3] ^ ref1[1])) & PLATYPUS_PIXEL_MASK)) {
+        return true;
+    }
+    if (lossless) return false;
+    // a lossily encoded block never matches its source, so would otherwise be encoded again every frame
+    uint8_t block[8];
+    platypus_encode_stats_t stats;
+    encode_block(px, false, block, &stats);
+    return !(((px[0] ^ ref0[0]) | (px[1] ^ ref0[1]) | (px[2] ^ ref1[0]) | (px[3] ^ ref1[1])) & PLATYPUS_PIXEL_MASK);
+}
+
+size_t platypus_encode_frame(const uint16_t *pixels, uint width, uint height, uint stride, bool key_frame,
+                             bool lossless, uint16_t *reference, uint32_t *dest, size_t max_words,
+                             platypus_encode_stats_t *stats) {
+    if (!width || (width & 1u) || width > 0xffff || !height || (height & 1u) || height > 0xffff || stride < width ||
+        max_words < PLATYPUS_FRAME_HEADER_WORDS) {
+        return 0;
+    }
+    platypus_encode_stats_t local_stats;
+    if (!stats) stats = &local_stats;
+    uint row_pairs = height / 2;
+    uint blocks = width / 2;
+    // row pairs can only be copied from those not decoded yet (or left as they were), so content moving down the
+    // screen is decoded bottom up; the direction is picked from where the best matches for each row pair are
+    bool bottom_up = false;
+    if (!key_frame) {
+        int votes = 0;
+        for (uint r = 0; r < row_pairs; r++) {
+            const uint16_t *row0 = pixels + r * 2 * stride;
+            const uint16_t *ref0 = reference + r * 2 * width;
+            uint best = count_changed_blocks(row0, row0 + stride, ref0, ref0 + width, width);
+            int best_d = 0;
+            for (int d = -PLATYPUS_ENCODE_MAX_MOTION; d <= PLATYPUS_ENCODE_MAX_MOTION && best; d++) {
+                uint s = r + (uint) d;
+                if (!d || s >= row_pairs) continue;
+                const uint16_t *src0 = reference + s * 2 * width;
+                uint count = count_changed_blocks(row0, row0 + stride, src0, src0 + width, width);
+                if (count < best) {
+                    best = count;
+                    best_d = d;
+                }
+            }
+            votes += best_d < 0 ? 1 : best_d > 0 ? -1 : 0;
+        }
+        bottom_up = votes > 0;
+    }
+    dest[0] = PLATYPUS_FRAME_MAGIC;
+    dest[1] = PLATYPUS_IMAGE_FORMAT | (bottom_up ? PLATYPUS_FRAME_FLAG_BOTTOM_UP : 0);
+    dest[2] = width | (height << 16);
+    size_t words = PLATYPUS_FRAME_HEADER_WORDS;
+    // bit n is set if the row pair decoded n + 1 before this one was left as it was, so may still be copied from
+    uint32_t unchanged_row_pairs = 0;
+    // the reference is updated as each row pair is encoded, just as the decoder updates its framebuffer
+    for (uint i = 0; i < row_pairs; i++) {
+        uint r = bottom_up ? row_pairs - 1 - i : i;
+        const uint16_t *row0 = pixels + r * 2 * stride;
+        const uint16_t *row1 = row0 + stride;
+        uint16_t *ref0 = reference + r * 2 * width;
+        uint16_t *ref1 = ref0 + width;
+        uint source = 0;
+        if (!key_frame) {
+            uint best = count_changed_blocks(row0, row1, ref0, ref1, width);
+            for (uint d = 1; d <= PLATYPUS_ENCODE_MAX_MOTION && best; d++) {
+                // ahead (in decode order) is still the previous frame; behind may only be used if left as it was
+                uint ahead = bottom_up ? r - d : r + d;
+                uint behind = bottom_up ? r + d : r - d;
+                uint candidates[2] = {ahead, behind};
+                for (uint c = 0; c < 2; c++) {
+                    uint s = candidates[c];
+                    if (s >= row_pairs || (s == behind && !(unchanged_row_pairs & (1u << (d - 1))))) continue;
+                    const uint16_t *src0 = reference + s * 2 * width;
+                    uint count = count_changed_blocks(row0, row1, src0, src0 + width, width);
+                    if (count < best) {
+                        best = count;
+                        source = s + 1;
+                    }
+                }
+            }
+            if (source) {
+                const uint16_t *src0 = reference + (source - 1) * 2 * width;
+                memcpy(ref0, src0, width * 2 * sizeof(uint16_t));
+                stats->row_pairs_copied++;
+            }
+        }
+        if (words == max_words) return 0;
+        uint32_t *header = dest + words++;
+        uint runs = 0;
+        uint x = 0;
+        while (x < blocks) {
+            uint start = x;
+            while (x < blocks && !key_frame &&
+                   block_unchanged(row0 + x * 2, row1 + x * 2, ref0 + x * 2, ref1 + x * 2, lossless)) {
+                x++;
+            }
+            stats->blocks_unchanged += x - start;
+            if (x == blocks) break;
+            // a run continues over single unchanged blocks, which are cheaper to encode than a new run
+            uint end = x + 1;
+            uint gap = 0;
+            for (uint i = end; i < blocks; i++) {
+                if (key_frame || !block_unchanged(row0 + i * 2, row1 + i * 2, ref0 + i * 2, ref1 + i * 2, lossless)) {
+                    end = i + 1;
+                    gap = 0;
+                } else if (++gap == 2) {
+                    break;
+                }
+            }
+            uint n = end - x;
+            size_t run_words = 1 + encode_row_pair(row0 + x * 2, row1 + x * 2, n * 2, lossless, NULL, NULL, NULL,
+                                                   NULL);
+            if (words + run_words > max_words) return 0;
+            dest[words] = (x - start) | (n << 16);
+            encode_row_pair(row0 + x * 2, row1 + x * 2, n * 2, lossless, dest + words + 1, stats, ref0 + x * 2,
+                            ref1 + x * 2);
+            words += run_words;
+            runs++;
+            x = end;
+        }
+        *header = source | (runs << 16);
+        unchanged_row_pairs = (unchanged_row_pairs << 1) | (!source && !runs);
+    }
+    dest[3] = (uint32_t) words;
+    return words;
+}
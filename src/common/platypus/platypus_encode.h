@@ -0,0 +1,164 @@
+#ifndef _PLATYPUS_ENCODE_H
+#define _PLATYPUS_ENCODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "platypus_frame.h"
+#include "platypus_image.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file platypus_encode.h
+ *
+ * Encoder for the platypus image format decoded by platypus_decompress_row (normally run on the host to prepare
+ * assets, although it has no host dependencies).
+ *
+ * An image is a sequence of row pairs, each padded to a word boundary. A row pair is a sequence of 2x2 pixel blocks,
+ * each of which is one of:
+ *
+ * - 3 bytes: a base color, plus one of 4 patterns of 0/1 deltas per color channel
+ * - 4 bytes: a base color, plus one of 32 patterns of 0-3 deltas per color channel
+ * - 7 bytes: the top left pixel as is, with the other three packed into the remaining 39 bits, which loses the low
+ *   bit of some of their color channels
+ * - 8 bytes: all four pixels as is
+ *
+ * Pixels are 15 bit RGB with a spare bit; RGB555 (red in the low bits, spare bit 15) by default, or with
+ * PLATYPUS_565 defined green at bit 6 and blue at bit 11 (spare bit 5). The spare bit is used to tell the blocks
+ * apart, so isn't preserved; the decoder sets it in some pixels of 7 and 8 byte blocks.
+ */
+
+#ifdef PLATYPUS_565
+#define PLATYPUS_PIXEL_GSHIFT 6
+#define PLATYPUS_PIXEL_BSHIFT 11
+#define PLATYPUS_PIXEL_SPARE_BIT 0x0020u
+#else
+#define PLATYPUS_PIXEL_GSHIFT 5
+#define PLATYPUS_PIXEL_BSHIFT 10
+#define PLATYPUS_PIXEL_SPARE_BIT 0x8000u
+#endif
+#define PLATYPUS_PIXEL_RSHIFT 0
+// the bits of a pixel which are preserved (i.e. all but the spare bit)
+#define PLATYPUS_PIXEL_MASK ((uint16_t) ~PLATYPUS_PIXEL_SPARE_BIT)
+
+// the most words a row pair of the given (even) width can take
+#define PLATYPUS_MAX_ROW_PAIR_WORDS(width) (width)
+
+// the furthest (in row pairs, up or down) platypus_encode_frame looks for a row pair to copy; 0 disables copying
+#ifndef PLATYPUS_ENCODE_MAX_MOTION
+#define PLATYPUS_ENCODE_MAX_MOTION 8
+#endif
+
+typedef struct platypus_encode_stats {
+    uint32_t blocks_3;
+    uint32_t blocks_4;
+    uint32_t blocks_7;
+    uint32_t blocks_8;
+    // blocks which weren't encoded exactly (only with lossless == false)
+    uint32_t lossy_blocks;
+    // blocks left as they were in the previous frame (platypus_encode_frame only)
+    uint32_t blocks_unchanged;
+    // row pairs copied from elsewhere in the previous frame (platypus_encode_frame only)
+    uint32_t row_pairs_copied;
+} platypus_encode_stats_t;
+
+/**
+ * Encode one row pair
+ *
+ * Each block is encoded as the smallest of the 3 or 4 byte forms which is exact, or else a 7 byte block. If that
+ * isn't exact, then with lossless an 8 byte block is used instead; otherwise the 7 byte block is kept, with the
+ * unrepresentable low bits chosen to keep the more significant bits of each channel.
+ *
+ * \param row0 the top row of pixels
+ * \param row1 the bottom row of pixels
+ * \param width the number of pixels in each row, which must be even
+ * \param lossless true to only use exact encodings
+ * \param dest the destination, which must have room for PLATYPUS_MAX_ROW_PAIR_WORDS(width) words, or NULL
+ * just to size the row pair
+ * \param stats if not NULL, the counts of each type of block are added to this
+ * \return the number of words written (or which would be)
+ */
+size_t platypus_encode_row_pair(const uint16_t *row0, const uint16_t *row1, uint width, bool lossless,
+                                uint32_t *dest, platypus_encode_stats_t *stats);
+
+/**
+ * Encode an image, as row pairs one after the other (so it can be decoded by calling platypus_decompress_row with
+ * the returned pointer each time)
+ *
+ * \param pixels the top left pixel
+ * \param width the width in pixels, which must be even
+ * \param height the height in pixels, which must be even
+ * \param stride the distance between rows in pixels
+ * \param lossless true to only use exact encodings
+ * \param dest the destination
+ * \param max_words the size of dest
+ * \param stats if not NULL, the counts of each type of block are added to this
+ * \return the number of words written, or 0 if the image size is invalid or it doesn't fit
+ */
+size_t platypus_encode_image(const uint16_t *pixels, uint width, uint height, uint stride, bool lossless,
+                             uint32_t *dest, size_t max_words, platypus_encode_stats_t *stats);
+
+/**
+ * \return the maximum number of words an indexed image (see platypus_image.h) of the given size can take
+ */
+static inline size_t platypus_encode_max_indexed_image_words(uint width, uint height) {
+    return PLATYPUS_IMAGE_HEADER_WORDS + height / 2 + 1 + (size_t) (height / 2) * PLATYPUS_MAX_ROW_PAIR_WORDS(width);
+}
+
+/**
+ * Encode an image with a header and row pair index, for use with platypus_image_init
+ *
+ * \param pixels the top left pixel
+ * \param width the width in pixels, which must be even
+ * \param height the height in pixels, which must be even
+ * \param stride the distance between rows in pixels
+ * \param lossless true to only use exact encodings
+ * \param dest the destination
+ * \param max_words the size of dest (platypus_encode_max_indexed_image_words is always enough)
+ * \param stats if not NULL, the counts of each type of block are added to this
+ * \return the number of words written, or 0 if the image size is invalid or it doesn't fit
+ */
+size_t platypus_encode_indexed_image(const uint16_t *pixels, uint width, uint height, uint stride, bool lossless,
+                                     uint32_t *dest, size_t max_words, platypus_encode_stats_t *stats);
+
+/**
+ * \return the maximum number of words a frame (see platypus_frame.h) of the given size can take
+ */
+static inline size_t platypus_encode_max_frame_words(uint width, uint height) {
+    // each run but the last covers at least 3 blocks, and costs a word plus at most a word of padding
+    return PLATYPUS_FRAME_HEADER_WORDS + (size_t) (height / 2) * (3 + PLATYPUS_MAX_ROW_PAIR_WORDS(width) + width / 2);
+}
+
+/**
+ * Encode a video frame as the changes from the previous one
+ *
+ * The encoder keeps its own copy of the decoder's framebuffer (reference), which it compares the frame against
+ * and then updates by decoding the frame into it. Blocks which would decode the same as they are in the reference
+ * are skipped, and each row pair may first be copied from one up to PLATYPUS_ENCODE_MAX_MOTION row pairs away if
+ * that leaves fewer blocks to encode.
+ *
+ * \param pixels the top left pixel
+ * \param width the width in pixels, which must be even
+ * \param height the height in pixels, which must be even
+ * \param stride the distance between rows in pixels
+ * \param key_frame true to encode every block (e.g. for the first frame, or to allow seeking), in which case the
+ * reference needn't have been initialized
+ * \param lossless true to only use exact encodings
+ * \param reference the previous frame as decoded (width x height pixels, with a stride of width, word aligned),
+ * which is updated to this frame as decoded
+ * \param dest the destination
+ * \param max_words the size of dest (platypus_encode_max_frame_words is always enough)
+ * \param stats if not NULL, the counts of each type of block are added to this
+ * \return the number of words written, or 0 if the image size is invalid or it doesn't fit
+ */
+size_t platypus_encode_frame(const uint16_t *pixels, uint width, uint height, uint stride, bool key_frame,
+                             bool lossless, uint16_t *reference, uint32_t *dest, size_t max_words,
+                             platypus_encode_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
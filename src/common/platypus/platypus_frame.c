@@ -0,0 +1,43 @@
+#include <string.h>
+
+#include "platypus_frame.h"
+
+bool platypus_frame_check(const uint32_t *frame, uint width, uint height) {
+    return frame[0] == PLATYPUS_FRAME_MAGIC && (frame[1] & 0xffu) == PLATYPUS_IMAGE_FORMAT &&
+           frame[2] == (width | (height << 16)) && frame[3] >= PLATYPUS_FRAME_HEADER_WORDS;
+}
+
+uint platypus_frame_decode(const uint32_t *frame, uint16_t *framebuffer, uint stride) {
+    uint width = frame[2] & 0xffffu;
+    uint height = frame[2] >> 16;
+    const uint32_t *s = frame + PLATYPUS_FRAME_HEADER_WORDS;
+    uint row_stride = stride / 2;
+    uint32_t *row0 = (uint32_t *) framebuffer;
+    int row_pair_step = (int) row_stride * 2;
+    if (frame[1] & PLATYPUS_FRAME_FLAG_BOTTOM_UP) {
+        row0 += (height - 2) * row_stride;
+        row_pair_step = -row_pair_step;
+    }
+    uint blocks = 0;
+    for (uint y = 0; y < height; y += 2, row0 += row_pair_step) {
+        uint32_t header = *s++;
+        uint source = header & 0xffffu;
+        uint runs = header >> 16;
+        if (source) {
+            const uint32_t *src = (const uint32_t *) framebuffer + (source - 1) * 2 * row_stride;
+            memcpy(row0, src, width * 2);
+            memcpy(row0 + row_stride, src + row_stride, width * 2);
+        }
+        // each block is a word in each row
+        uint32_t *d0 = row0;
+        for (uint i = 0; i < runs; i++) {
+            uint32_t run = *s++;
+            uint changed = run >> 16;
+            d0 += run & 0xffffu;
+            s = platypus_decompress_row_a(d0, d0 + row_stride, s, changed * 2);
+            d0 += changed;
+            blocks += changed;
+        }
+    }
+    return blocks;
+}
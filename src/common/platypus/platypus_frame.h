@@ -0,0 +1,77 @@
+#ifndef _PLATYPUS_FRAME_H
+#define _PLATYPUS_FRAME_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "pico.h"
+#include "platypus_image.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file platypus_frame.h
+ *
+ * Platypus video frames, each of which only holds what changed since the frame before. They are decoded into a
+ * framebuffer which is retained from one frame to the next, so unchanged 2x2 blocks cost neither space in the
+ * stream nor decode time.
+ *
+ * Frame layout (one 32 bit word per field; fields packed into the same word are shown added together):
+ *
+ *     | magic | pixel format + (flags << 8) | width + (height << 16) | frame words | row pair ... |
+ *
+ * "frame words" is the size of the whole frame including the header, so frames can be streamed (e.g. from SD)
+ * by reading the header and then the rest. The row pairs are in decode order, which is top to bottom unless the
+ * PLATYPUS_FRAME_FLAG_BOTTOM_UP flag is set. Each row pair is:
+ *
+ *     | (source row pair + 1) + (run count << 16) | run ... |
+ *
+ * If the source is not 0, the row pair is first copied from that row pair of the framebuffer (e.g. for vertical
+ * scrolling); the encoder only uses sources which still hold the previous frame when they are copied (hence bottom
+ * up frames for content moving down the screen). Each run then is:
+ *
+ *     | unchanged blocks + (changed blocks << 16) | changed block data ... |
+ *
+ * where the changed block data is platypus row pair data (as read by platypus_decompress_row) for the
+ * 2 * changed blocks pixels, padded to a word boundary. A key frame is simply one whose runs cover every block.
+ *
+ * Frames are usually encoded at build time by the platypus_encode host tool (see platypus_encode.h).
+ */
+
+#define PLATYPUS_FRAME_MAGIC 0x46594c50u // "PLYF"
+#define PLATYPUS_FRAME_HEADER_WORDS 4u
+#define PLATYPUS_FRAME_FLAG_BOTTOM_UP 0x100u
+
+/**
+ * \return the size of the frame in words (including the header)
+ */
+static inline uint32_t platypus_frame_words(const uint32_t *frame) {
+    return frame[3];
+}
+
+/**
+ * Check a frame header
+ *
+ * \return false if the data is not an encoded frame, was encoded for a different pixel format, or is not of the
+ * given size
+ */
+bool platypus_frame_check(const uint32_t *frame, uint width, uint height);
+
+/**
+ * Decode a frame into a framebuffer holding the previous frame
+ *
+ * Only the blocks which changed are written. This uses platypus_decompress_row_a, so on device the interpolators
+ * must be configured with platypus_decompress_configure_interp(false)
+ *
+ * \param frame the frame, whose header must have been checked with platypus_frame_check
+ * \param framebuffer the framebuffer (word aligned)
+ * \param stride the distance between framebuffer rows in pixels (even)
+ * \return the number of blocks decoded
+ */
+uint platypus_frame_decode(const uint32_t *frame, uint16_t *framebuffer, uint stride);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,22 @@
+#include "platypus_image.h"
+
+bool platypus_image_init(platypus_image_t *image, const uint32_t *encoded) {
+    if (encoded[0] != PLATYPUS_IMAGE_MAGIC || encoded[1] != PLATYPUS_IMAGE_FORMAT) return false;
+    image->width = (uint16_t) encoded[2];
+    image->height = (uint16_t) (encoded[2] >> 16);
+    if (!image->width || (image->width & 1u) || !image->height || (image->height & 1u)) return false;
+    image->row_pair_offsets = encoded + PLATYPUS_IMAGE_HEADER_WORDS;
+    image->data = image->row_pair_offsets + platypus_image_row_pair_count(image) + 1;
+    return true;
+}
+
+uint platypus_image_decoder_next(platypus_image_decoder_t *decoder, uint32_t *d0, uint32_t *d1) {
+    const platypus_image_t *image = decoder->image;
+    uint row_pair = decoder->row_pair;
+    decoder->next = platypus_decompress_row_a(d0, d1, decoder->next, image->width);
+    if (++decoder->row_pair == platypus_image_row_pair_count(image)) {
+        decoder->row_pair = 0;
+        decoder->next = image->data;
+    }
+    return row_pair;
+}
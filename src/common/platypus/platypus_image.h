@@ -0,0 +1,98 @@
+#ifndef _PLATYPUS_IMAGE_H
+#define _PLATYPUS_IMAGE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "pico.h"
+#include "platypus.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file platypus_image.h
+ *
+ * Platypus images with a row pair index, so decoding can start at any row pair rather than only at the top; a
+ * vertically scrolled (or partially redrawn) display only has to decode the rows it shows.
+ *
+ * Image layout (one 32 bit word per field, except that width and height share a word):
+ *
+ *     | magic | pixel format | width + (height << 16) | row pair offsets (height / 2 + 1) | row pair data ... |
+ *
+ * Row pair offsets are in words from the start of the row pair data; row pair n (rows 2n and 2n + 1) is from
+ * offsets[n] to offsets[n + 1]. The row pair data is exactly what platypus_decompress_row reads, one row pair after
+ * the other, so may also be decoded sequentially without the index.
+ *
+ * Images are usually encoded at build time by the platypus_encode host tool (see platypus_encode.h).
+ */
+
+#define PLATYPUS_IMAGE_MAGIC 0x50594c50u // "PLYP"
+#define PLATYPUS_IMAGE_HEADER_WORDS 3u
+
+#define PLATYPUS_IMAGE_FORMAT_555 0u
+#define PLATYPUS_IMAGE_FORMAT_565 1u
+#ifdef PLATYPUS_565
+#define PLATYPUS_IMAGE_FORMAT PLATYPUS_IMAGE_FORMAT_565
+#else
+#define PLATYPUS_IMAGE_FORMAT PLATYPUS_IMAGE_FORMAT_555
+#endif
+
+typedef struct platypus_image {
+    uint16_t width;
+    uint16_t height;
+    const uint32_t *row_pair_offsets;
+    const uint32_t *data;
+} platypus_image_t;
+
+// a position in an image; decoding continues from one row pair to the next without using the index
+typedef struct platypus_image_decoder {
+    const platypus_image_t *image;
+    const uint32_t *next;
+    uint row_pair;
+} platypus_image_decoder_t;
+
+/**
+ * Initialize an image from its encoded form
+ *
+ * \return false if the data is not an encoded image, or was encoded for a different pixel format
+ */
+bool platypus_image_init(platypus_image_t *image, const uint32_t *encoded);
+
+static inline uint platypus_image_row_pair_count(const platypus_image_t *image) {
+    return image->height / 2u;
+}
+
+static inline const uint32_t *platypus_image_row_pair(const platypus_image_t *image, uint row_pair) {
+    return image->data + image->row_pair_offsets[row_pair];
+}
+
+/**
+ * Start decoding at the row pair containing row y
+ *
+ * y may be beyond the bottom of the image, in which case it wraps (e.g. for vertical scrolling)
+ */
+static inline void platypus_image_decoder_seek(platypus_image_decoder_t *decoder, const platypus_image_t *image,
+                                               uint y) {
+    decoder->image = image;
+    decoder->row_pair = (y % image->height) / 2u;
+    decoder->next = platypus_image_row_pair(image, decoder->row_pair);
+}
+
+/**
+ * Decode the next row pair, moving on to the one after (wrapping back to the top of the image after the bottom)
+ *
+ * This uses platypus_decompress_row_a, so on device the interpolators must be configured with
+ * platypus_decompress_configure_interp(false)
+ *
+ * \param decoder the decoder
+ * \param d0 the destination for the top row (width / 2 words)
+ * \param d1 the destination for the bottom row (width / 2 words)
+ * \return the index of the row pair decoded
+ */
+uint platypus_image_decoder_next(platypus_image_decoder_t *decoder, uint32_t *d0, uint32_t *d1);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "pico/multicore.h"
+#include "pico/scanvideo/composable_scanline.h"
+#include "platypus_scanvideo.h"
+
+static const platypus_image_t *volatile current_image;
+
+// for the row of a scanline which isn't decoded along with its row pair partner (one for each core)
+static uint32_t other_row[2][PLATYPUS_SCANVIDEO_MAX_WIDTH / 2];
+
+void platypus_scanvideo_set_image(const platypus_image_t *image) {
+    invalid_params_if(PLATYPUS_SCANVIDEO, image->width > PLATYPUS_SCANVIDEO_MAX_WIDTH);
+    current_image = image;
+}
+
+// the pixels are decoded one word into the buffer, and then the first becomes part of the raw run token
+static inline void __time_critical_func(finish_line)(scanvideo_scanline_buffer_t *buffer, uint width) {
+    uint16_t *p = (uint16_t *) buffer->data;
+    p[0] = COMPOSABLE_RAW_RUN;
+    p[1] = p[2];
+    p[2] = (uint16_t) (width - 3);
+    p += width + 2;
+    *p++ = COMPOSABLE_RAW_1P;
+    *p++ = 0;
+    // width is even, so the end of line needs a skip to finish on a word boundary
+    *p++ = COMPOSABLE_EOL_SKIP_ALIGN;
+    *p++ = 0;
+    buffer->data_used = (uint16_t) (width / 2 + 3);
+    buffer->status = SCANLINE_OK;
+}
+
+static inline const uint32_t *__time_critical_func(decode_row_pair)(uint32_t *d0, uint32_t *d1, const uint32_t *s,
+                                                                   uint width, bool is_b) {
+    return is_b ? platypus_decompress_row_b(d0, d1, s, width) : platypus_decompress_row_a(d0, d1, s, width);
+}
+
+// decode the row pair containing a single scanline
+static void __time_critical_func(generate_line)(const platypus_image_t *image, scanvideo_scanline_buffer_t *buffer,
+                                                bool is_b) {
+    uint y = scanvideo_scanline_number(buffer->scanline_id) % image->height;
+    uint32_t *d = buffer->data + 1;
+    uint32_t *other = other_row[is_b];
+    decode_row_pair((y & 1u) ? other : d, (y & 1u) ? d : other, platypus_image_row_pair(image, y / 2),
+                    image->width, is_b);
+    finish_line(buffer, image->width);
+}
+
+void __time_critical_func(platypus_scanvideo_generate)(const platypus_image_t *image,
+                                                       scanvideo_scanline_buffer_t *buffer0,
+                                                       scanvideo_scanline_buffer_t *buffer1, bool is_b) {
+    uint width = image->width;
+    if (buffer0->data_max < width / 2 + 3 || buffer1->data_max < width / 2 + 3) {
+        buffer0->status = buffer1->status = SCANLINE_ERROR;
+        return;
+    }
+    uint y0 = scanvideo_scanline_number(buffer0->scanline_id) % image->height;
+    uint y1 = scanvideo_scanline_number(buffer1->scanline_id) % image->height;
+    if (!(y0 & 1u) && y1 == y0 + 1) {
+        decode_row_pair(buffer0->data + 1, buffer1->data + 1, platypus_image_row_pair(image, y0 / 2), width, is_b);
+        finish_line(buffer0, width);
+        finish_line(buffer1, width);
+    } else {
+        // not a row pair (generation skipped ahead by an odd number of lines, or interlaced timing)
+        generate_line(image, buffer0, is_b);
+        generate_line(image, buffer1, is_b);
+    }
+}
+
+void __time_critical_func(platypus_scanvideo_run)(bool is_b) {
+#if PICO_ON_DEVICE
+    platypus_decompress_configure_interp(is_b);
+#endif
+    while (true) {
+        scanvideo_scanline_buffer_t *buffer1;
+        scanvideo_scanline_buffer_t *buffer0 = scanvideo_begin_scanline_generation2(&buffer1, true);
+        const platypus_image_t *image = current_image;
+        if (image) {
+            platypus_scanvideo_generate(image, buffer0, buffer1, is_b);
+        } else {
+            buffer0->status = buffer1->status = SCANLINE_SKIPPED;
+        }
+        scanvideo_end_scanline_generation(buffer0);
+        scanvideo_end_scanline_generation(buffer1);
+    }
+}
+
+static void core1_entry(void) {
+    platypus_scanvideo_run(true);
+}
+
+void platypus_scanvideo_launch_core1(void) {
+    multicore_launch_core1(core1_entry);
+}
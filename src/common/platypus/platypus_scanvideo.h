@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _PLATYPUS_SCANVIDEO_H
+#define _PLATYPUS_SCANVIDEO_H
+
+#include "pico.h"
+#include "pico/scanvideo.h"
+#include "platypus_image.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file platypus_scanvideo.h
+ *
+ * Display of indexed platypus images (see platypus_image.h) via scanvideo, with decoding on one or both cores.
+ *
+ * Each core takes scanlines two at a time with scanvideo_begin_scanline_generation2, which are normally a row
+ * pair, so are decoded together. The two cores use separate decoder instances: core 0 runs
+ * platypus_decompress_row_asm_a with its tables in scratch X, and core 1 platypus_decompress_row_asm_b with its
+ * tables in scratch Y, each with its own interpolators configured for its tables, so neither waits on the other
+ * for memory.
+ *
+ * The image is displayed 1:1, with rows beyond the bottom of the image wrapping to the top. Each scanline buffer
+ * needs room for width / 2 + 3 words.
+ */
+
+#ifndef PARAM_ASSERTIONS_ENABLED_PLATYPUS_SCANVIDEO
+#define PARAM_ASSERTIONS_ENABLED_PLATYPUS_SCANVIDEO 0
+#endif
+
+// the widest image which can be displayed; scanlines which aren't in the same row pair are decoded via a
+// per core buffer of this many pixels
+#ifndef PLATYPUS_SCANVIDEO_MAX_WIDTH
+#define PLATYPUS_SCANVIDEO_MAX_WIDTH 1280
+#endif
+
+/**
+ * Set the image to display, from the next pair of scanlines generated
+ *
+ * \param image the image, which must be no wider than PLATYPUS_SCANVIDEO_MAX_WIDTH
+ */
+void platypus_scanvideo_set_image(const platypus_image_t *image);
+
+/**
+ * Decode the scanlines for two scanline buffers (as returned by scanvideo_begin_scanline_generation2)
+ *
+ * The calling core's interpolators must have been configured with platypus_decompress_configure_interp(is_b)
+ *
+ * \param image the image
+ * \param buffer0 the first scanline buffer
+ * \param buffer1 the second scanline buffer
+ * \param is_b false to use the core 0 decoder instance, true the core 1 one
+ */
+void platypus_scanvideo_generate(const platypus_image_t *image, scanvideo_scanline_buffer_t *buffer0,
+                                 scanvideo_scanline_buffer_t *buffer1, bool is_b);
+
+/**
+ * Generate scanlines from the image set with platypus_scanvideo_set_image forever
+ *
+ * \param is_b false when called on core 0, true on core 1
+ */
+void platypus_scanvideo_run(bool is_b) __attribute__((noreturn));
+
+/**
+ * Start core 1 generating scanlines (i.e. calling platypus_scanvideo_run(true)); core 0 may then call
+ * platypus_scanvideo_run(false) too, or carry on with other work
+ */
+void platypus_scanvideo_launch_core1(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
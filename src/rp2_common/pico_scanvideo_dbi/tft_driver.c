@@ -97,6 +97,13 @@ static struct __packed {
     uint16_t exec_skip;
 } __aligned(4) switch_buffer_control_sequence;
 
+static struct __packed {
+    uint16_t exec_wait_te_low;
+    uint16_t skip_cmd;
+    uint16_t exec_wait_te_high;
+    uint16_t skip_cmd_2;
+} __aligned(4) te_wait_sequence;
+
 //These define the ports and port bits used for the write, chip select (CS) and data/command (RS) lines
 #define WR_L gpio_put(WR_PIN, false)
 
@@ -170,7 +177,7 @@ void writedata(uint8_t c)
     SETUP_CS_H;
 }
 
-#ifdef NO_SETUP
+// used for the NO_SETUP case, and as the bit-banged baseline for tft_benchmark_partial_update
 void setAddrWindow(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1)
 {
     //if((x1 >= _width) || (y1 >= _height)) return;
@@ -187,7 +194,6 @@ void setAddrWindow(uint16_t x0, uint16_t y0, uint16_t x1, uint16_t y1)
     set_data_pins8(y1); WR_STB;
     RS_L; set_data_pins8(HX8357_RAMWR); WR_STB; RS_H;
 }
-#endif
 
 
 void tft_panel_init() {
@@ -477,6 +483,8 @@ void tft_panel_init() {
 #endif
 }
 
+static void command_dma_init();
+
 void tft_driver_init()
 {
     for(int i = 0; i < 16; i++)
@@ -517,6 +525,7 @@ void tft_driver_init()
 #define DOH_PROGRAM_OFFSET 16
 #define EXEC_SKIP pio_encode_with_sideset_opt(pio_encode_jmp(DOH_PROGRAM_OFFSET + video_dbi_control_offset_new_state_wait), 2, 1)
 
+#define EXEC_WAIT_TE(polarity) pio_encode_with_sideset_opt(pio_encode_wait_gpio((polarity), TE_PIN), 2, 1)
 #define WR_CMD(n) MAKE_CMD( (n)-1, DOH_PROGRAM_OFFSET + video_dbi_control_offset_data_run_out)
 #define SKIP_CMD MAKE_CMD( 0, DOH_PROGRAM_OFFSET + video_dbi_control_offset_new_state_wait)
 #define CLOCK_CMD(n) MAKE_CMD((w)-1, DOH_PROGRAM_OFFSET + video_dbi_control_offset_clock_run)
@@ -561,6 +570,14 @@ void tft_driver_init()
     switch_buffer_control_sequence.exec_csrs_h = EXEC_CSH_RSH;
     switch_buffer_control_sequence.skip_cmd = SKIP_CMD;
     switch_buffer_control_sequence.exec_skip = EXEC_SKIP;
+
+    te_wait_sequence.exec_wait_te_low = EXEC_WAIT_TE(false);
+    te_wait_sequence.skip_cmd = SKIP_CMD;
+    te_wait_sequence.exec_wait_te_high = EXEC_WAIT_TE(true);
+    te_wait_sequence.skip_cmd_2 = SKIP_CMD;
+    gpio_init(TE_PIN);
+    gpio_set_dir(TE_PIN, false);
+    command_dma_init();
     tft_panel_init();
 }
 
@@ -571,11 +588,13 @@ void tft_driver_init()
 #define SM_CONTROL 3
 #define PICO_SCANVIDEO_SCANLINE_DMA_CHANNEL 0
 
-uint32_t *get_control_sequence(uint w, uint y, uint *count, bool buffer) {
+uint32_t *get_control_sequence(uint x, uint w, uint y, uint *count, bool buffer) {
    y += buffer ? 240 : 0;
 #ifndef NO_SETUP
-    scanline_control_sequence.x1_h = w>>8;
-    scanline_control_sequence.x1_l = w&0xff;
+    scanline_control_sequence.x0_h = x>>8;
+    scanline_control_sequence.x0_l = x&0xff;
+    scanline_control_sequence.x1_h = (x+w-1)>>8;
+    scanline_control_sequence.x1_l = (x+w-1)&0xff;
     scanline_control_sequence.y0_h = y>>8;
     scanline_control_sequence.y0_l = y&0xff;
     scanline_control_sequence.y1_h = (y+1)>>8;
@@ -588,6 +607,11 @@ uint32_t *get_control_sequence(uint w, uint y, uint *count, bool buffer) {
     return (uint32_t *)&scanline_control_sequence;
 }
 
+uint32_t *get_te_wait_sequence(uint *count) {
+    *count = sizeof(te_wait_sequence) / 4;
+    return (uint32_t *)&te_wait_sequence;
+}
+
 extern uint32_t *get_switch_buffer_sequence(uint *count, bool buffer) {
 //    switch_buffer_control_sequence.y0_h = 0;
 //    switch_buffer_control_sequence.y0_l = buffer?240:0;
@@ -597,4 +621,212 @@ extern uint32_t *get_switch_buffer_sequence(uint *count, bool buffer) {
     switch_buffer_control_sequence.y_l = buffer?240:0;
     *count = sizeof(switch_buffer_control_sequence) / 4;
     return (uint32_t *)&switch_buffer_control_sequence;
-}
\ No newline at end of file
+}
+
+// == PIO command engine ==
+
+// chained pair of DMA channels feeding DMA lists to the control state machine
+#ifndef TFT_COMMAND_DMA_CHANNEL
+#define TFT_COMMAND_DMA_CHANNEL 7u
+#endif
+#ifndef TFT_COMMAND_DMA_CB_CHANNEL
+#define TFT_COMMAND_DMA_CB_CHANNEL 8u
+#endif
+// PIO irq flag set at the end of each sequence
+#define TFT_COMMAND_DONE_IRQ 1u
+
+static uint32_t command_start_time;
+
+static inline uint16_t *put_command(uint16_t *p, uint8_t cmd, uint data_count) {
+    *p++ = EXEC_CSL_RSL;
+    *p++ = WR_CMD(1);
+    *p++ = cmd;
+    *p++ = EXEC_CSL_RSH;
+    *p++ = data_count ? WR_CMD(data_count) : SKIP_CMD;
+    return p;
+}
+
+static inline uint16_t *put_end(uint16_t *p, uint16_t *buffer) {
+    *p++ = EXEC_CSH_RSH;
+    *p++ = SKIP_CMD;
+    *p++ = EXEC_SET_IRQ(TFT_COMMAND_DONE_IRQ);
+    *p++ = SKIP_CMD;
+    // to align on word boundary
+    if ((p - buffer) & 1) *p++ = EXEC_SKIP;
+    return p;
+}
+
+uint tft_build_command_sequence(const tft_command_t *cmds, uint count, uint16_t *buffer, uint max_halfwords) {
+    uint16_t *p = buffer;
+    uint16_t *end = buffer + max_halfwords;
+    for (uint i = 0; i < count; i++) {
+        // the command itself, its data, and the end of sequence
+        if (end - p < 5 + cmds[i].data_count + 5) return 0;
+        p = put_command(p, cmds[i].cmd, cmds[i].data_count);
+        for (uint j = 0; j < cmds[i].data_count; j++) {
+            *p++ = cmds[i].data[j];
+        }
+    }
+    if (end - p < 5) return 0;
+    p = put_end(p, buffer);
+    return (p - buffer) / 2;
+}
+
+uint tft_build_window_sequence(uint16_t *buffer, uint x0, uint y0, uint x1, uint y1) {
+    uint16_t *p = put_command(buffer, HX8357_CASET, 4);
+    *p++ = x0 >> 8;
+    *p++ = x0 & 0xff;
+    *p++ = x1 >> 8;
+    *p++ = x1 & 0xff;
+    p = put_command(p, HX8357_PASET, 4);
+    *p++ = y0 >> 8;
+    *p++ = y0 & 0xff;
+    *p++ = y1 >> 8;
+    *p++ = y1 & 0xff;
+    p = put_command(p, HX8357_RAMWR, 0);
+    *p++ = EXEC_SKIP;
+    assert(p - buffer == TFT_WINDOW_SEQUENCE_HALFWORDS);
+    return TFT_WINDOW_SEQUENCE_HALFWORDS / 2;
+}
+
+uint tft_build_region_dma_list(tft_dma_fragment_t *fragments, uint16_t *sequence_buffer, uint x, uint y,
+                               uint width, uint height, const uint16_t *pixels, uint stride) {
+    assert(!(width & 1u) && width && width <= TFT_MAX_WRITE_COUNT && height);
+    assert(!(((uintptr_t)pixels) & 3u) && !(stride & 1u));
+    uint16_t *row_header = sequence_buffer + TFT_WINDOW_SEQUENCE_HALFWORDS;
+    uint16_t *end_sequence = row_header + 2;
+    tft_dma_fragment_t *f = fragments;
+    f->word_count = tft_build_window_sequence(sequence_buffer, x, y, x + width - 1, y + height - 1);
+    f->data = sequence_buffer;
+    f++;
+    // every row is the same single word header followed by the row's pixels
+    row_header[0] = EXEC_CSL_RSH;
+    row_header[1] = WR_CMD(width);
+    for (uint i = 0; i < height; i++) {
+        f->word_count = 1;
+        f->data = row_header;
+        f++;
+        f->word_count = width / 2;
+        f->data = pixels + i * stride;
+        f++;
+    }
+    f->word_count = (put_end(end_sequence, end_sequence) - end_sequence) / 2;
+    f->data = end_sequence;
+    f++;
+    f->word_count = 0;
+    f->data = NULL;
+    return f - fragments;
+}
+
+static void command_dma_init() {
+    dma_configure(
+            TFT_COMMAND_DMA_CHANNEL,
+            0,                        // src
+            (uint32_t) & video_pio->txf[SM_CONTROL],  // dest
+            SIZE_32,
+            DMA_INCR,
+            DMA_NOINCR,
+            0, // len (set by the control block channel)
+            DREQ_PIO0_TX0 + SM_CONTROL
+    );
+    dma_chain_to(TFT_COMMAND_DMA_CHANNEL, TFT_COMMAND_DMA_CB_CHANNEL); // each fragment chains back to the control block channel
+    dma_set_quiet(TFT_COMMAND_DMA_CHANNEL, true);
+    dma_configure_full(
+            0, // src
+            (uintptr_t) &dma_channel_hw_addr(TFT_COMMAND_DMA_CHANNEL)->al3_transfer_count,  // (transfer_count, read_addr trigger)
+            SIZE_32,
+            DMA_INCR,
+            DMA_INCR,
+            2, // send 2 words to ctrl block of data chain per transfer
+            DREQ_FORCE,
+            TFT_COMMAND_DMA_CB_CHANNEL, // no chain as we trigger the data channel via _trig reg
+            1,
+            3, // wrap the write at 8 bytes (so each transfer writes the same 2 word ctrl registers)
+            true, // enable
+            dma_channel_hw_addr(TFT_COMMAND_DMA_CB_CHANNEL)
+    );
+}
+
+void tft_command_dma_start(const tft_dma_fragment_t *fragments) {
+    assert(!tft_command_dma_busy());
+    if (!(video_pio->ctrl & (1u << SM_CONTROL))) {
+        // video timing isn't running, so the control state machine is ours
+        pio_sm_exec(video_pio, SM_CONTROL, pio_encode_jmp(DOH_PROGRAM_OFFSET + video_dbi_control_offset_entry_point));
+        pio_sm_enable_mask(video_pio, 1u << SM_CONTROL, true);
+    }
+    video_pio->irq = 1u << TFT_COMMAND_DONE_IRQ;
+    command_start_time = time_us_32();
+    dma_channel_hw_addr(TFT_COMMAND_DMA_CB_CHANNEL)->al3_read_addr_trig = (uintptr_t) fragments;
+}
+
+bool tft_command_dma_busy() {
+    return dma_busy(TFT_COMMAND_DMA_CB_CHANNEL) || dma_busy(TFT_COMMAND_DMA_CHANNEL) ||
+           (command_start_time && !(video_pio->irq & (1u << TFT_COMMAND_DONE_IRQ)));
+}
+
+uint32_t tft_command_dma_wait() {
+    while (tft_command_dma_busy()) {}
+    uint32_t elapsed = command_start_time ? time_us_32() - command_start_time : 0;
+    command_start_time = 0;
+    return elapsed;
+}
+
+void tft_write_commands(const tft_command_t *cmds, uint count) {
+    static uint32_t sequence[64];
+    tft_dma_fragment_t fragments[2];
+    while (count) {
+        // send as many commands as fit (up to and including one with a delay) in one go
+        uint n = 0;
+        uint halfwords = 5 + 1; // end of sequence and alignment
+        while (n < count && halfwords + 5 + cmds[n].data_count <= count_of(sequence) * 2) {
+            halfwords += 5 + cmds[n].data_count;
+            if (cmds[n++].delay_ms) break;
+        }
+        assert(n); // a single command is too big
+        fragments[0].word_count = tft_build_command_sequence(cmds, n, (uint16_t *) sequence, count_of(sequence) * 2);
+        fragments[0].data = sequence;
+        fragments[1].word_count = 0;
+        fragments[1].data = NULL;
+        tft_command_dma_start(fragments);
+        tft_command_dma_wait();
+        if (cmds[n - 1].delay_ms) sleep_ms(cmds[n - 1].delay_ms);
+        cmds += n;
+        count -= n;
+    }
+}
+
+void tft_benchmark_partial_update(uint x, uint y, uint width, uint height, const uint16_t *pixels, uint stride,
+                                  uint32_t *bitbang_us, uint32_t *pio_us) {
+    static uint16_t __aligned(4) sequence_buffer[TFT_REGION_SEQUENCE_HALFWORDS];
+    static tft_dma_fragment_t fragments[2 * 64 + 3];
+    assert(height <= 64);
+    // before: bit-banged window setup and pixels
+    for (uint i = 0; i < 16; i++) {
+        gpio_funcsel(i, GPIO_FUNC_SIO);
+    }
+    gpio_funcsel(WR_PIN, GPIO_FUNC_SIO);
+    gpio_funcsel(CS_PIN, GPIO_FUNC_SIO);
+    gpio_funcsel(RS_PIN, GPIO_FUNC_SIO);
+    uint32_t t0 = time_us_32();
+    setAddrWindow(x, y, x + width - 1, y + height - 1);
+    for (uint i = 0; i < height; i++) {
+        for (uint j = 0; j < width; j++) {
+            set_data_pins16(pixels[i * stride + j]);
+            WR_STB;
+        }
+    }
+    CS_H;
+    *bitbang_us = time_us_32() - t0;
+    for (uint i = 0; i < 16; i++) {
+        gpio_funcsel(i, GPIO_FUNC_PIO0);
+    }
+    gpio_funcsel(WR_PIN, GPIO_FUNC_PIO0);
+    gpio_funcsel(CS_PIN, GPIO_FUNC_PIO0);
+    gpio_funcsel(RS_PIN, GPIO_FUNC_PIO0);
+    // after: one DMA list through the PIO command engine (including building the list)
+    t0 = time_us_32();
+    tft_build_region_dma_list(fragments, sequence_buffer, x, y, width, height, pixels, stride);
+    tft_command_dma_start(fragments);
+    tft_command_dma_wait();
+    *pio_us = time_us_32() - t0;
+}
@@ -38,6 +38,7 @@
 #define HX8357_RAMRD   0x2E
 
 #define HX8357B_PTLAR   0x30
+#define HX8357_TEOFF  0x34
 #define HX8357_TEON  0x35
 #define HX8357_TEARLINE  0x44
 #define HX8357_MADCTL  0x36
@@ -87,8 +88,100 @@
 // don't care
 #define FCS_PIN 0 //23
 
+// tearing effect output from the panel (for TE synchronized scanout)
+#ifndef TE_PIN
+#define TE_PIN 28u
+#endif
+
 extern void tft_driver_init();
 extern uint32_t *get_switch_buffer_sequence(uint *count, bool buffer);
-extern uint32_t *get_control_sequence(uint w, uint y, uint *count, bool buffer);
+// the sequence writing w pixels of row y starting at column x
+extern uint32_t *get_control_sequence(uint x, uint w, uint y, uint *count, bool buffer);
+// a sequence which stalls the control state machine until the next rising edge of TE
+extern uint32_t *get_te_wait_sequence(uint *count);
+
+// == PIO command engine ==
+//
+// Commands (and pixel data) are sent to the panel by the control state machine (see control.pio), which consumes a
+// stream of 16 bit values: an instruction to exec (used to set CS/RS), then an 11 bit count and 5 bit jump target
+// (e.g. to write that many following 16 bit values to the bus). Sequences of these are built in memory, and a list
+// of them is fed to the state machine by a pair of chained DMA channels, so a window setup followed by the
+// pixels for that window needs no CPU involvement at all.
+
+// a panel command and its parameter bytes
+typedef struct tft_command {
+    uint8_t cmd;
+    uint8_t data_count;
+    // delay after the command (e.g. for sleep out); a command with a delay ends a DMA sequence
+    uint16_t delay_ms;
+    const uint8_t *data;
+} tft_command_t;
+
+// one piece of a DMA list; a list is terminated by {0, NULL}
+typedef struct tft_dma_fragment {
+    uint32_t word_count;
+    const void *data;
+} tft_dma_fragment_t;
+
+// maximum number of 16 bit values which can follow a single write
+#define TFT_MAX_WRITE_COUNT 2048u
+
+// the number of 16 bit values in a CASET/PASET/RAMWR window setup sequence
+#define TFT_WINDOW_SEQUENCE_HALFWORDS 24u
+// the size of the sequence buffer needed by tft_build_region_dma_list (window setup, row header and end)
+#define TFT_REGION_SEQUENCE_HALFWORDS (TFT_WINDOW_SEQUENCE_HALFWORDS + 6u)
+
+/**
+ * Build a control sequence sending the given commands
+ *
+ * \param cmds the commands; delays are ignored
+ * \param count the number of commands
+ * \param buffer the destination, which must be word aligned
+ * \param max_halfwords the size of buffer
+ * \return the size of the sequence in words, or 0 if it didn't fit
+ */
+extern uint tft_build_command_sequence(const tft_command_t *cmds, uint count, uint16_t *buffer, uint max_halfwords);
+
+/**
+ * Build a control sequence setting the panel's address window to (x0, y0)-(x1, y1) inclusive and starting a
+ * RAMWR; it leaves CS low and RS high ready for pixel data
+ *
+ * \param buffer the destination (TFT_WINDOW_SEQUENCE_HALFWORDS long), which must be word aligned
+ * \return the size of the sequence in words
+ */
+extern uint tft_build_window_sequence(uint16_t *buffer, uint x0, uint y0, uint x1, uint y1);
+
+/**
+ * Build a DMA list which sets the address window and then streams a rectangle of pixels to it
+ *
+ * \param fragments the destination for the list, which needs 2 * height + 3 entries
+ * \param sequence_buffer buffer for the control sequences (TFT_REGION_SEQUENCE_HALFWORDS long, word aligned), which
+ * must remain valid until the list has been sent
+ * \param pixels the first pixel of the rectangle
+ * \param stride the distance between rows of pixels in pixels
+ * \param width the width of the rectangle, which must be even
+ * \return the number of fragments used (excluding the terminator)
+ */
+extern uint tft_build_region_dma_list(tft_dma_fragment_t *fragments, uint16_t *sequence_buffer, uint x, uint y,
+                                      uint width, uint height, const uint16_t *pixels, uint stride);
+
+/**
+ * Start sending a DMA list to the control state machine; this must not be called while the video timing is
+ * enabled (the control state machine is then busy sequencing scanlines)
+ */
+extern void tft_command_dma_start(const tft_dma_fragment_t *fragments);
+
+extern bool tft_command_dma_busy();
+
+// wait for the last list to complete, and return the time it took in microseconds
+extern uint32_t tft_command_dma_wait();
+
+// send commands via the PIO command engine (handling delays), waiting for completion
+extern void tft_write_commands(const tft_command_t *cmds, uint count);
+
+// time a partial update of a rectangle bit-banged via GPIO vs via the PIO command engine (pixels and stride are as
+// for tft_build_region_dma_list); this must not be called while the video timing is enabled
+extern void tft_benchmark_partial_update(uint x, uint y, uint width, uint height, const uint16_t *pixels,
+                                         uint stride, uint32_t *bitbang_us, uint32_t *pio_us);
 
 #endif //SOFTWARE_TFT_DRIVER_H
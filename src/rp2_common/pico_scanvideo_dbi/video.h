@@ -111,6 +111,71 @@ extern void video_display_enable(bool enable);
 // doesn't exist yet!
 // extern void video_set_display_mode(const struct video_mode *mode);
 
+// --- partial (dirty rectangle) updates ---
+
+// maximum mode height supported by partial updates
+#ifndef PICO_SCANVIDEO_DBI_MAX_HEIGHT
+#define PICO_SCANVIDEO_DBI_MAX_HEIGHT 480
+#endif
+
+/**
+ * Enable or disable partial updates.
+ *
+ * The panel keeps its own copy of the frame, so in this mode only the rows covered by dirty rectangles are requested
+ * via video_begin_scanline_generation (whose scanline_id says which row as usual) and written to the panel, and
+ * only the columns spanned by the dirty rectangles (see video_dbi_get_scanline_window). Frames with nothing dirty
+ * write nothing. Frames still start at the refresh rate (so video_wait_for_vblank paces as usual), and each picks up
+ * the rectangles added before it started. GRAM double buffering is not used in this mode.
+ *
+ * Enabling marks the whole screen dirty.
+ */
+extern void video_dbi_set_partial_updates(bool enable);
+
+/**
+ * Mark a rectangle as needing to be written to the panel in the next frame (only used for partial updates)
+ */
+extern void video_dbi_add_dirty_rect(uint x, uint y, uint width, uint height);
+
+/**
+ * Get the columns written for a scanline: the scanline's pixels should start at column x and be width pixels wide.
+ * This is the whole width of the mode unless partial updates are enabled.
+ */
+extern void video_dbi_get_scanline_window(uint32_t scanline_id, uint *x, uint *width);
+
+/**
+ * @return the total number of pixels written to the panel since video_setup
+ */
+extern uint64_t video_dbi_get_pixels_written();
+
+// --- tearing effect (TE) synchronized scanout ---
+
+struct video_dbi_te_stats
+{
+    uint32_t frames;
+    // frames where the write pointer passed (or was lapped by) the panel's refresh pointer
+    uint32_t torn_frames;
+    // measured refresh period (shortest time between frame starts)
+    uint32_t te_period_us;
+    // closest approach of the write pointer to the refresh pointer (in rows) in the last frame; negative if it tore
+    int16_t last_margin_rows;
+    // smallest last_margin_rows seen
+    int16_t min_margin_rows;
+    // scanlines held back because they would have overtaken the refresh pointer
+    uint32_t held_lines;
+};
+
+/**
+ * Enable or disable TE synchronized scanout. Rather than free running, the first scanline of each frame is held
+ * until the rising edge of the panel's TE output, which is configured to fire when the panel's refresh reaches
+ * te_line; the frame is then written behind the refresh pointer, holding back any scanline which would overtake it
+ * (based on the measured refresh period).
+ *
+ * This sends commands to the panel, so must be called while video timing is disabled.
+ */
+extern void video_dbi_set_te_sync(bool enable, uint te_line);
+
+extern void video_dbi_get_te_stats(struct video_dbi_te_stats *stats);
+
 // --- scanline management ---
 
 struct scanline_buffer
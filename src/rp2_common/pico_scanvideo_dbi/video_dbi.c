@@ -5,6 +5,7 @@
  */
 
 #include <assert.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include "platform.h"
 #include "debug.h"
@@ -13,8 +14,10 @@
 #include "dma.h"
 #include "dreq.h"
 #include "pio.h"
+#include "timer.h"
 #include "tft_driver.h"
 #include "control.pio.h"
+#include "pico/scanvideo/scanline_queue.h"
 
 // todo add ability to shift scanline back a bit (we already have the timing, but it should be a post mode set adjustment)
 //  we can use this to allow some initial work in the scanline b4 the first pixel (e.g. a dummy black pixel)
@@ -74,7 +77,7 @@
 //
 // todo note, it should eventually be difficult to get the display into a bad state (even
 //  with things like runaway scanline program; incomplete DMA etc.. which currently break it).
-//#define ENABLE_SCANLINE_ASSERTIONS
+//#define PICO_SCANVIDEO_ENABLE_SCANLINE_ASSERTIONS 1
 
 //#define PICO_SCANVIDEO_ENABLE_VIDEO_RECOVERY
 
@@ -101,7 +104,7 @@ CU_SELECT_DEBUG_PINS(video_timing)
 #define video_assert(x)  (void)0
 #endif
 
-#ifdef ENABLE_SCANLINE_ASSERTIONS
+#if PICO_SCANVIDEO_ENABLE_SCANLINE_ASSERTIONS
 #define scanline_assert(x) assert(x)
 #else
 #define scanline_assert(x) (void)0
@@ -162,20 +165,23 @@ static uint16_t video_clock_down;
 struct semaphore vblank_begin;
 
 // --- scanline stuff
-// private representation of scanline buffer (adds link for one list this scanline buffer is currently in)
+// private representation of scanline buffer (adds the entry for the scanline_queue list it is currently in)
 struct full_scanline_buffer {
+    scanvideo_scanline_queue_entry_t entry;
     struct scanline_buffer core;
-    struct full_scanline_buffer *next;
 };
 
 #ifndef PICO_SCANVIDEO_SCANLINE_BUFFER_COUNT
 #define PICO_SCANVIDEO_SCANLINE_BUFFER_COUNT 8
 #endif
-// each scanline_buffer should be in exactly one of the shared_state lists below
-// (unless we don't have USE_SCANLINE_DEBUG in which case we don't keep the generating list,
+// each scanline_buffer should be in exactly one of the scanline_queue lists
+// (unless we don't have PICO_SCANVIDEO_ENABLE_SCANLINE_ASSERTIONS in which case we don't keep the generating list,
 // in which case the scanline is entirely trusted to the client when generating)
 struct full_scanline_buffer scanline_buffers[PICO_SCANVIDEO_SCANLINE_BUFFER_COUNT];
 
+// the generated queue is protected by shared_state.scanline.lock
+static scanvideo_scanline_queue_t scanline_queue;
+
 // This state is sensitive as it it accessed by either core, and multiple IRQ handlers which may be re-entrant
 // Nothing in here should be touched except when protected by the appropriate spin lock.
 //
@@ -183,14 +189,6 @@ struct full_scanline_buffer scanline_buffers[PICO_SCANVIDEO_SCANLINE_BUFFER_COUN
 // safe concurrent operation by both cores, client, IRQ and nested IRQ (pre-emption) where desirable due
 // to timing concerns.
 static struct {
-    struct {
-        spin_lock_t *lock;
-        // note in_use is a list as we are lazy in removing buffers from it
-        struct full_scanline_buffer *in_use_ascending_scanline_id_list;
-        // pointer to the tail element of the list for making appending by ascending scanline id quick
-        struct full_scanline_buffer *in_use_ascending_scanline_id_list_tail;
-    } in_use;
-
     struct {
         spin_lock_t *lock;
         struct full_scanline_buffer *current_scanline_buffer;
@@ -199,23 +197,10 @@ static struct {
         // 0 based index of y repeat... goes 0, 0, 0 in non scaled mode, 0, 1, 0, 1 in doubled etc.
         uint y_repeat_index;
         bool in_vblank;
-        // This generated list is in this struct because it is accessed together in fsb latching
-        // and the only other place it is used in video_end_scanline_generation which needs no other
-        // locks (i.e. we are saving an extra lock in the latch case by not placing in a separate struct)
-        struct full_scanline_buffer *generated_ascending_scanline_id_list;
-        struct full_scanline_buffer *generated_ascending_scanline_id_list_tail;
         bool vblank_pending;
         bool need_prepare_for_active_scanline;
-#ifdef ENABLE_SCANLINE_ASSERTIONS
-        struct full_scanline_buffer *generating_list;
-#endif
     } scanline;
 
-    struct {
-        spin_lock_t *lock;
-        struct full_scanline_buffer *free_list;
-    } free_list;
-
     // This is access by DMA IRQ and by SM IRQs
     struct {
         spin_lock_t *lock;
@@ -266,10 +251,6 @@ uint32_t missing_scanline_data_overlay[] = {
 
 static struct full_scanline_buffer missing_scanline_buffer;
 
-static inline bool is_scanline_after(uint32_t scanline_id1, uint32_t scanline_id2) {
-    return ((int32_t)(scanline_id1 - scanline_id2)) > 0;
-}
-
 static void prepare_for_active_scanline_irqs_enabled();
 
 static void setup_sm(int sm);
@@ -279,76 +260,151 @@ static struct video_mode video_mode;
 static bool video_timing_enabled = false;
 static bool display_enabled = true;
 
-inline static void list_prepend(struct full_scanline_buffer **phead, struct full_scanline_buffer *fsb) {
-    scanline_assert(fsb->next == NULL);
-    scanline_assert(fsb != *phead);
-    fsb->next = *phead;
-    *phead = fsb;
-}
+// --- partial update stuff
 
-inline static void list_prepend_all(struct full_scanline_buffer **phead, struct full_scanline_buffer *to_prepend) {
-    struct full_scanline_buffer *fsb = to_prepend;
+struct partial_frame_set {
+    uint32_t rows[(PICO_SCANVIDEO_DBI_MAX_HEIGHT + 31) / 32];
+    // columns left to right - 1 are written (both are even); nothing is dirty if right is 0
+    uint16_t left;
+    uint16_t right;
+};
 
-    // todo should this be assumed?
-    if (fsb) {
-        while (fsb->next) {
-            fsb = fsb->next;
-        }
+// protected by shared_state.scanline.lock
+//
+// only the dirty rows of a frame are sent; once they have all been sent the frame is done, and the next frame only
+// starts (from the alarm) a refresh period after the current one started, so frame numbers (and vblank) advance at the
+// refresh rate even when nothing, or very little, is dirty
+static struct {
+    bool enabled;
+    uint16_t frame;
+    // the dirty rows/columns of frame
+    struct partial_frame_set current;
+    // rectangles added since frame started
+    struct partial_frame_set pending;
+    bool frame_done;
+    bool next_frame_scheduled;
+    uint64_t frame_start_us;
+    uint32_t frame_period_us;
+} partial;
 
-        fsb->next = *phead;
-        *phead = to_prepend;
-    }
-}
+static int partial_alarm_num = -1;
 
-inline static struct full_scanline_buffer *list_remove_head(struct full_scanline_buffer **phead) {
-    struct full_scanline_buffer *fsb = *phead;
+static uint64_t pixels_written;
 
-    if (fsb) {
-        *phead = fsb->next;
-        fsb->next = NULL;
-    }
+// --- TE sync stuff
 
-    return fsb;
+// only accessed from the display side (other than when enabling); stats is protected by shared_state.scanline.lock
+static struct {
+    bool enabled;
+    uint16_t te_line;
+    uint16_t last_frame;
+    // a scanline has been sent whose completion we haven't seen
+    bool line_pending;
+    bool line_starts_frame;
+    uint16_t line_row;
+    bool frame_in_progress;
+    uint32_t frame_start_time;
+    int32_t frame_min_margin;
+    struct video_dbi_te_stats stats;
+} te_sync;
+
+static int te_alarm_num = -1;
+
+// the number of rows the panel's refresh pointer has moved since the current frame started (at te_line)
+static inline int32_t te_refresh_travel(uint32_t now) {
+    return (int32_t) (((uint64_t) (now - te_sync.frame_start_time) * video_mode.height) / te_sync.stats.te_period_us);
 }
 
-inline static struct full_scanline_buffer *list_remove_head_ascending(struct full_scanline_buffer **phead,
-                                                                      struct full_scanline_buffer **ptail) {
-    struct full_scanline_buffer *fsb = *phead;
-
-    if (fsb) {
-        *phead = fsb->next;
+// the number of rows the refresh pointer moves from te_line until it reaches row (wrapping at the bottom of the panel)
+static inline int32_t te_row_distance(uint row) {
+    int32_t distance = (int32_t) row - te_sync.te_line;
+    return distance < 0 ? distance + video_mode.height : distance;
+}
 
-        if (!fsb->next) {
-            scanline_assert(*ptail == fsb);
-            *ptail = NULL;
-        } else {
-            fsb->next = NULL;
-        }
+// called before sending a scanline (while TE synced): a line which would overtake the refresh pointer is held back,
+// and sent from the alarm once the pointer has passed its row. returns true if the line is held
+static bool te_hold_line() {
+    if (!te_sync.enabled || !te_sync.frame_in_progress || !te_sync.stats.te_period_us) return false;
+    uint32_t scanline_id = *(volatile uint32_t *) &shared_state.scanline.next_scanline_id;
+    // the first line of a frame waits for TE anyway
+    if (frame_number(scanline_id) != te_sync.last_frame) return false;
+    int32_t rows = te_row_distance(scanline_number(scanline_id)) + 1;
+    uint32_t now = time_us_32();
+    if (te_refresh_travel(now) >= rows) return false;
+    uint32_t send_time = te_sync.frame_start_time +
+                         (uint32_t) (((uint64_t) rows * te_sync.stats.te_period_us + video_mode.height - 1) /
+                                     video_mode.height);
+    if (hardware_alarm_set_target(te_alarm_num, delayed_by_us(get_absolute_time(), send_time - now))) {
+        // already missed
+        return false;
     }
+    uint32_t save = spin_lock_blocking(shared_state.scanline.lock);
+    te_sync.stats.held_lines++;
+    spin_unlock(shared_state.scanline.lock, save);
+    return true;
+}
 
-    return fsb;
+static void te_alarm_callback(uint alarm_num) {
+    prepare_for_active_scanline_irqs_enabled();
 }
 
-inline static void list_remove(struct full_scanline_buffer **phead, struct full_scanline_buffer *fsb) {
-    scanline_assert(*phead);
-    struct full_scanline_buffer *prev = *phead;
+static inline bool partial_set_empty(const struct partial_frame_set *set) {
+    return !set->right;
+}
 
-    if (prev == fsb) {
-        *phead = fsb->next;
-    } else {
-        while (prev->next && prev->next != fsb) {
-            prev = prev->next;
+// the first dirty row after y, or -1 if there isn't one
+static int partial_next_row(const struct partial_frame_set *set, int y) {
+    for (uint i = (y + 1) / 32; i < count_of(set->rows); i++) {
+        uint32_t bits = set->rows[i];
+        if (i == (y + 1) / 32) bits &= ~0u << ((y + 1) & 31u);
+        if (bits) {
+            int row = i * 32 + __builtin_ctz(bits);
+            return row < video_mode.height ? row : -1;
         }
+    }
+    return -1;
+}
 
-        scanline_assert(prev->next == fsb);
-        prev->next = fsb->next;
+// Caller must own scanline_state_spin_lock
+static uint32_t partial_scanline_id_after(uint32_t scanline_id) {
+    int y = -1;
+    if (frame_number(scanline_id) == partial.frame) {
+        y = partial_next_row(&partial.current, scanline_number(scanline_id));
+    }
+    if (y >= 0) {
+        return ((uint32_t) partial.frame << 16u) | (uint) y;
     }
+    // nothing more is sent until the next frame is started by partial_start_next_frame
+    partial.frame_done = true;
+    return ((uint32_t) partial.frame + 1u) << 16u;
+}
 
-    // todo do we need this without assertions?
-    fsb->next = NULL;
+// Caller must own scanline_state_spin_lock. The scanline to hand to the application next with partial updates
+// enabled, which is always a dirty row of the current frame; returns false if there are none left to generate
+static bool partial_next_generation_id(uint32_t *scanline_id) {
+    uint32_t last_scanline_id = shared_state.scanline.last_scanline_id;
+    int y = -1;
+    if (frame_number(last_scanline_id) == partial.frame) {
+        y = scanline_number(last_scanline_id);
+    } else if (scanvideo_scanline_id_is_after(last_scanline_id, (uint32_t) partial.frame << 16u)) {
+        // already generated ahead (before partial updates were enabled)
+        return false;
+    }
+    y = partial_next_row(&partial.current, y);
+    if (y < 0) return false;
+    uint32_t id = ((uint32_t) partial.frame << 16u) | (uint) y;
+    if (!partial.frame_done && scanvideo_scanline_id_is_after(shared_state.scanline.next_scanline_id, id)) {
+        // the display has already moved on
+        id = shared_state.scanline.next_scanline_id;
+    }
+    *scanline_id = id;
+    return true;
 }
 
 static inline uint32_t scanline_id_after(uint32_t scanline_id) {
+    if (partial.enabled) {
+        return partial_scanline_id_after(scanline_id);
+    }
     uint32_t tmp = scanline_id & 0xffffu;
 
     if (tmp < video_mode.height - 1) {
@@ -358,113 +414,31 @@ static inline uint32_t scanline_id_after(uint32_t scanline_id) {
     }
 }
 
-// todo add a tail for these already sorted lists as we generally insert on the end
-inline static void list_insert_ascending(struct full_scanline_buffer **phead, struct full_scanline_buffer **ptail,
-                                         struct full_scanline_buffer *fsb) {
-    scanline_assert(fsb->next == NULL);
-    scanline_assert(fsb != *phead);
-    scanline_assert(fsb != *ptail);
-
-    if (!*phead || !is_scanline_after(fsb->core.scanline_id, (*phead)->core.scanline_id)) {
-        if (!*phead) {
-            scanline_assert(!*ptail);
-            *ptail = fsb;
-        }
-
-        // insert at the beginning
-        list_prepend(phead, fsb);
-    } else {
-        if (is_scanline_after(fsb->core.scanline_id, (*ptail)->core.scanline_id)) {
-            // insert at end
-            (*ptail)->next = fsb;
-            *ptail = fsb;
-        } else {
-            // not after
-            struct full_scanline_buffer *prev = *phead;
-
-            while (prev->next && is_scanline_after(fsb->core.scanline_id, prev->next->core.scanline_id)) {
-                prev = prev->next;
-            }
-
-            scanline_assert(prev != *ptail); // we should have already inserted at the end in this case
-            fsb->next = prev->next;
-            prev->next = fsb;
-        }
-    }
-}
-
-inline static void free_local_free_list_irqs_enabled(struct full_scanline_buffer *local_free_list) {
-    if (local_free_list) {
-        uint32_t save = spin_lock_blocking(shared_state.free_list.lock);
-//        DEBUG_PINS_SET(video_timing, 4);
-        list_prepend_all(&shared_state.free_list.free_list, local_free_list);
-//        DEBUG_PINS_CLR(video_timing, 4);
-        spin_unlock(shared_state.free_list.lock, save);
-        // note also this is useful for triggering video_wait_for_scanline_complete check
-        __sev();
-    }
+inline static void free_local_free_list_irqs_enabled(scanvideo_scanline_queue_entry_t *local_free_list) {
+//    DEBUG_PINS_SET(video_timing, 4);
+    scanvideo_scanline_queue_free_irqs_enabled(&scanline_queue, local_free_list);
+//    DEBUG_PINS_CLR(video_timing, 4);
 }
 
 // Caller must own scanline_state_spin_lock
 inline static struct full_scanline_buffer *scanline_locked_try_latch_fsb_if_null_irqs_disabled(
-        struct full_scanline_buffer **local_free_list) {
-    // note this just checks that someone owns it not necessarily this core.
-    scanline_assert(is_spin_locked(shared_state.scanline.lock));
+        scanvideo_scanline_queue_entry_t **local_free_list) {
     struct full_scanline_buffer *fsb = shared_state.scanline.current_scanline_buffer;
-
     if (!fsb) {
-        // peek the head
-        while (NULL != (fsb = shared_state.scanline.generated_ascending_scanline_id_list)) {
-            if (!is_scanline_after(shared_state.scanline.next_scanline_id, fsb->core.scanline_id)) {
-                if (shared_state.scanline.next_scanline_id == fsb->core.scanline_id) {
-                    int c1 = 0;
-                    for (struct full_scanline_buffer *x = shared_state.scanline.generated_ascending_scanline_id_list; x; x = x->next) c1++;
-                    struct full_scanline_buffer __unused
-                    *dbg = list_remove_head_ascending(&shared_state.scanline.generated_ascending_scanline_id_list,
-                                                      &shared_state.scanline.generated_ascending_scanline_id_list_tail);
-                    scanline_assert(dbg == fsb);
-                    int c2 = 0;
-                    for (struct full_scanline_buffer *x = shared_state.scanline.generated_ascending_scanline_id_list; x; x = x->next) c2++;
-                    unprotected_spin_lock(shared_state.in_use.lock);
-//                    DEBUG_PINS_SET(video_timing, 2);
-                    list_insert_ascending(&shared_state.in_use.in_use_ascending_scanline_id_list,
-                                          &shared_state.in_use.in_use_ascending_scanline_id_list_tail, fsb);
-//                    DEBUG_PINS_CLR(video_timing, 2);
-                    spin_unlock_unsafe(shared_state.in_use.lock);
-                }
-
-                shared_state.scanline.current_scanline_buffer = fsb;
-                break;
-            } else {
-                // scanline is in the past
-                struct full_scanline_buffer __unused
-                *dbg = list_remove_head_ascending(&shared_state.scanline.generated_ascending_scanline_id_list,
-                                                  &shared_state.scanline.generated_ascending_scanline_id_list_tail);
-                scanline_assert(dbg == fsb);
-                list_prepend(local_free_list, fsb);
-            }
-        }
+//        DEBUG_PINS_SET(video_timing, 2);
+        fsb = (struct full_scanline_buffer *) scanvideo_scanline_queue_locked_try_latch(
+                &scanline_queue, shared_state.scanline.next_scanline_id, local_free_list);
+//        DEBUG_PINS_CLR(video_timing, 2);
+        shared_state.scanline.current_scanline_buffer = fsb;
     }
-
     return fsb;
 }
 
 static inline void release_scanline_irqs_enabled(int buffers_to_free_count,
-                                                 struct full_scanline_buffer **local_free_list) {
-    if (buffers_to_free_count) {
-        uint32_t save = spin_lock_blocking(shared_state.in_use.lock);
-        while (buffers_to_free_count--) {
-            DEBUG_PINS_SET(video_dma_buffer, 2);
-            // We always discard the head which is the oldest
-            struct full_scanline_buffer *fsb = list_remove_head_ascending(
-                    &shared_state.in_use.in_use_ascending_scanline_id_list,
-                    &shared_state.in_use.in_use_ascending_scanline_id_list_tail);
-            scanline_assert(fsb);
-            list_prepend(local_free_list, fsb);
-            DEBUG_PINS_CLR(video_dma_buffer, 2);
-        }
-        spin_unlock(shared_state.in_use.lock, save);
-    }
+                                                 scanvideo_scanline_queue_entry_t **local_free_list) {
+    DEBUG_PINS_SET(video_dma_buffer, 2);
+    scanvideo_scanline_queue_release_irqs_enabled(&scanline_queue, buffers_to_free_count, local_free_list);
+    DEBUG_PINS_CLR(video_dma_buffer, 2);
 }
 
 static inline bool update_dma_transfer_state_irqs_enabled(bool cancel_if_not_complete,
@@ -529,8 +503,9 @@ void __video_most_time_critical("irq")
 
 prepare_for_active_scanline_irqs_enabled() {
     // note we are now only called in active display lines..
+    if (te_hold_line()) return;
     DEBUG_PINS_SET(video_timing, 1);
-    struct full_scanline_buffer *local_free_list = NULL;
+    scanvideo_scanline_queue_entry_t *local_free_list = NULL;
     int buffers_to_free_count = 0;
     uint32_t save = spin_lock_blocking(shared_state.scanline.lock);
     // VERY IMPORTANT: THIS CODE CAN ONLY TAKE ABOUT 4.5 us BEFORE LAUNCHING DMA...
@@ -629,8 +604,33 @@ prepare_for_active_scanline_irqs_enabled() {
     DEBUG_PINS_SET(sequence, 4);
     uint count;
     assert(!dma_busy(TIMING_DMA_CHANNEL));
-    uint32_t *control = get_control_sequence(video_mode.width & ~1u, scanline_number(fsb->core.scanline_id), &count,
-                                             shared_state.which_buffer);
+    uint x = 0;
+    uint w = video_mode.width & ~1u;
+    bool buffer = shared_state.which_buffer;
+    save = spin_lock_blocking(shared_state.scanline.lock);
+    if (partial.enabled) {
+        // only the dirty columns are written, to the displayed buffer in place
+        x = partial.current.left;
+        w = partial.current.right - partial.current.left;
+        buffer = !buffer;
+    }
+    spin_unlock(shared_state.scanline.lock, save);
+    pixels_written += w;
+    uint32_t *control = get_control_sequence(x, w, scanline_number(fsb->core.scanline_id), &count, buffer);
+    if (te_sync.enabled) {
+        te_sync.line_starts_frame = frame_number(fsb->core.scanline_id) != te_sync.last_frame;
+        if (te_sync.line_starts_frame) {
+            // hold the first scanline until TE; the FIFO is empty as the last sequence has completed
+            uint te_count;
+            uint32_t *te_wait = get_te_wait_sequence(&te_count);
+            for (uint i = 0; i < te_count; i++) {
+                video_pio->txf[TIMING_SM] = te_wait[i];
+            }
+            te_sync.last_frame = frame_number(fsb->core.scanline_id);
+        }
+        te_sync.line_row = scanline_number(fsb->core.scanline_id);
+        te_sync.line_pending = true;
+    }
 //    printf("pants %p %d\n", control, count);
     DEBUG_PINS_SET(video_dma_buffer, 3);
     dma_transfer_from_buffer_now(TIMING_DMA_CHANNEL, (uintptr_t) control, count);
@@ -654,8 +654,11 @@ prepare_for_active_scanline_irqs_enabled() {
             free_scanline = true;
         }
 
-        shared_state.scanline.next_scanline_id = scanline_id_after(shared_state.scanline.next_scanline_id);
-        if (!scanline_number(shared_state.scanline.next_scanline_id)) {
+        uint32_t scanline_id = shared_state.scanline.next_scanline_id;
+        shared_state.scanline.next_scanline_id = scanline_id_after(scanline_id);
+        // with partial updates, the next frame is started by partial_start_next_frame instead
+        if (!partial.frame_done &&
+            frame_number(shared_state.scanline.next_scanline_id) != frame_number(scanline_id)) {
             shared_state.scanline.vblank_pending = true;
         }
         shared_state.scanline.y_repeat_index = 0;
@@ -680,12 +683,153 @@ prepare_for_active_scanline_irqs_enabled() {
     free_local_free_list_irqs_enabled(local_free_list);
 }
 
+static void partial_start_next_frame();
+
+static void partial_schedule_next_frame(uint64_t start_us) {
+    if (hardware_alarm_set_target(partial_alarm_num, from_us_since_boot(start_us))) {
+        // already missed
+        partial_start_next_frame();
+    }
+}
+
+// called at the end of each scanline sequence; returns true if the current partial frame has been written, in which
+// case nothing is sent until the next frame starts
+static bool partial_hold_until_next_frame() {
+    uint32_t save = spin_lock_blocking(shared_state.scanline.lock);
+    bool hold = partial.frame_done;
+    bool schedule = hold && !partial.next_frame_scheduled;
+    if (schedule) {
+        partial.next_frame_scheduled = true;
+        shared_state.scanline.in_vblank = true;
+    }
+    uint64_t start_us = partial.frame_start_us + partial.frame_period_us;
+    spin_unlock(shared_state.scanline.lock, save);
+    if (schedule) {
+        partial_schedule_next_frame(start_us);
+    }
+    return hold;
+}
+
+// start the frame after a completed partial frame (which is a full frame if partial updates have since been disabled)
+static void partial_start_next_frame() {
+    uint64_t now = time_us_64();
+    uint32_t save = spin_lock_blocking(shared_state.scanline.lock);
+    partial.next_frame_scheduled = false;
+    partial.frame_start_us += partial.frame_period_us;
+    if (partial.frame_start_us + partial.frame_period_us <= now) {
+        // writing the last frame took more than a whole period
+        partial.frame_start_us = now;
+    }
+    partial.frame++;
+    partial.current = partial.pending;
+    __builtin_memset(&partial.pending, 0, sizeof(partial.pending));
+    int y = partial.enabled ? partial_next_row(&partial.current, -1) : 0;
+    partial.frame_done = y < 0;
+    if (partial.frame_done) {
+        shared_state.scanline.next_scanline_id = ((uint32_t) partial.frame + 1u) << 16u;
+    } else {
+        shared_state.scanline.next_scanline_id = ((uint32_t) partial.frame << 16u) | (uint) y;
+    }
+    uint64_t start_us = partial.frame_start_us + partial.frame_period_us;
+    spin_unlock(shared_state.scanline.lock, save);
+    sem_release(&vblank_begin);
+    // wake the generation side, which may be waiting for dirty rows
+    __sev();
+    if (partial.frame_done) {
+        // nothing is dirty, but the frame number still advances at the refresh rate
+        uint32_t save = spin_lock_blocking(shared_state.scanline.lock);
+        partial.next_frame_scheduled = true;
+        spin_unlock(shared_state.scanline.lock, save);
+        partial_schedule_next_frame(start_us);
+    } else if (display_enabled) {
+        prepare_for_active_scanline_irqs_enabled();
+    }
+}
+
+static void partial_alarm_callback(uint alarm_num) {
+    partial_start_next_frame();
+}
+
+static void te_frame_complete() {
+    if (te_sync.frame_in_progress) {
+        int16_t margin = (int16_t) MAX(INT16_MIN, MIN(INT16_MAX, te_sync.frame_min_margin));
+        te_sync.stats.last_margin_rows = margin;
+        if (!te_sync.stats.frames || margin < te_sync.stats.min_margin_rows) {
+            te_sync.stats.min_margin_rows = margin;
+        }
+        if (margin < 0) te_sync.stats.torn_frames++;
+        te_sync.stats.frames++;
+    }
+}
+
+// called at the end of each scanline (while TE synced) to measure the margin between the row just written and
+// the panel's refresh pointer
+static void __video_time_critical("te") te_scanline_complete() {
+    uint32_t now = time_us_32();
+    if (te_sync.line_starts_frame) {
+        te_frame_complete();
+        if (te_sync.frame_in_progress) {
+            uint32_t period = now - te_sync.frame_start_time;
+            // missed TEs make the interval a multiple of the period
+            if (!te_sync.stats.te_period_us || period < te_sync.stats.te_period_us) {
+                te_sync.stats.te_period_us = period;
+            }
+        }
+        te_sync.frame_in_progress = true;
+        te_sync.frame_start_time = now;
+        te_sync.frame_min_margin = INT32_MAX;
+    }
+    if (te_sync.stats.te_period_us) {
+        // the refresh pointer started at te_line when the frame started, and wraps at the bottom of the panel, so it
+        // is at row (te_line + travel) % height; compare in terms of distance moved since the frame started
+        int32_t height = video_mode.height;
+        int32_t behind = te_refresh_travel(now) - te_row_distance(te_sync.line_row);
+        // the write must stay behind the refresh pointer, but not so far that the next refresh catches it
+        int32_t margin = MIN(behind, height - behind);
+        te_sync.frame_min_margin = MIN(te_sync.frame_min_margin, margin);
+    }
+}
+
+void video_dbi_set_te_sync(bool enable, uint te_line) {
+    video_assert(!video_timing_enabled);
+    video_assert(te_line < video_mode.height);
+    uint8_t tearline[2] = {te_line >> 8, te_line & 0xff};
+    uint8_t v_blank_only = 0;
+    const tft_command_t cmds[] = {
+            {.cmd = HX8357_TEARLINE, .data_count = 2, .data = tearline},
+            {.cmd = HX8357_TEON, .data_count = 1, .data = &v_blank_only},
+    };
+    if (enable) {
+        tft_write_commands(cmds, count_of(cmds));
+    } else {
+        const tft_command_t te_off = {.cmd = HX8357_TEOFF};
+        tft_write_commands(&te_off, 1);
+    }
+    __builtin_memset(&te_sync, 0, sizeof(te_sync));
+    te_sync.te_line = te_line;
+    // make sure the next scanline sent waits for TE
+    te_sync.last_frame = frame_number(shared_state.scanline.next_scanline_id) - 1;
+    te_sync.enabled = enable;
+}
+
+void video_dbi_get_te_stats(struct video_dbi_te_stats *stats) {
+    uint32_t save = spin_lock_blocking(shared_state.scanline.lock);
+    *stats = te_sync.stats;
+    spin_unlock(shared_state.scanline.lock, save);
+}
+
 void __isr __video_most_time_critical("irq") isr_pio0_0() {
 #if PICO_SCANVIDEO_ADJUST_BUS_PRIORITY
     bus_ctrl_hw->priority = VIDEO_ADJUST_BUS_PRIORITY_VAL;
 #endif
     if (video_pio->irq & 1u) {
         video_pio->irq = 1;
+        if (te_sync.enabled && te_sync.line_pending) {
+            te_sync.line_pending = false;
+            uint32_t save = spin_lock_blocking(shared_state.scanline.lock);
+            te_scanline_complete();
+            spin_unlock(shared_state.scanline.lock, save);
+        }
         DEBUG_PINS_SET(video_timing, 4);
         scanline_assert(!dma_busy(TIMING_DMA_CHANNEL));
         scanline_assert(video_pio->sm[TIMING_SM].addr ==
@@ -697,11 +841,14 @@ void __isr __video_most_time_critical("irq") isr_pio0_0() {
         shared_state.scanline.vblank_pending = false;
         spin_unlock(shared_state.scanline.lock, save);
         if (signal) {
-            uint count;
-            uint32_t *control = get_switch_buffer_sequence(&count, shared_state.which_buffer);
-            shared_state.which_buffer = !shared_state.which_buffer;
-            dma_transfer_from_buffer_now(TIMING_DMA_CHANNEL, (uintptr_t) control, count);
-            while (dma_busy(TIMING_DMA_CHANNEL));
+            // partial updates are written to the displayed buffer, so there is nothing to switch
+            if (!partial.enabled) {
+                uint count;
+                uint32_t *control = get_switch_buffer_sequence(&count, shared_state.which_buffer);
+                shared_state.which_buffer = !shared_state.which_buffer;
+                dma_transfer_from_buffer_now(TIMING_DMA_CHANNEL, (uintptr_t) control, count);
+                while (dma_busy(TIMING_DMA_CHANNEL));
+            }
             sem_release(&vblank_begin);
         }
 
@@ -709,11 +856,10 @@ void __isr __video_most_time_critical("irq") isr_pio0_0() {
         if (display_enabled) {
             if (!scanline_number(shared_state.scanline.next_scanline_id)) {
             }
-            bool too_soon = false;
+            // nothing is sent between the end of a partial frame and the start of the next
+            bool too_soon = partial_hold_until_next_frame();
             if (!too_soon) {
                 prepare_for_active_scanline_irqs_enabled();
-            } else {
-                assert(false); // not handled yet
             }
         }
         DEBUG_PINS_CLR(video_timing, 4);
@@ -791,79 +937,75 @@ extern bool video_in_vblank() {
 }
 
 extern struct scanline_buffer __video_time_critical("begin_scanline") *
-video_begin_scanline_generation(bool
-block)
-{
-struct full_scanline_buffer *fsb;
-
-DEBUG_PINS_SET(video_generation,
-1);
-do
-{
-uint32_t save = spin_lock_blocking(shared_state.free_list.lock);
+video_begin_scanline_generation(bool block) {
+    struct full_scanline_buffer *fsb;
+
+    DEBUG_PINS_SET(video_generation, 1);
+    do {
+        uint32_t scanline_id;
+        bool have_scanline = true;
+        uint32_t save = spin_lock_blocking(shared_state.scanline.lock);
+        if (partial.enabled) {
+            // only dirty rows of the current frame are generated
+            have_scanline = partial_next_generation_id(&scanline_id);
+        }
+        spin_unlock(shared_state.scanline.lock, save);
+
 //        DEBUG_PINS_SET(video_timing, 4);
-fsb = list_remove_head(&shared_state.free_list.free_list);
+        fsb = have_scanline ? (struct full_scanline_buffer *) scanvideo_scanline_queue_take_free(&scanline_queue, 1) : NULL;
 //        DEBUG_PINS_CLR(video_timing, 4);
-spin_unlock(shared_state
-.free_list.lock, save);
-
-if (fsb)
-{
-save = spin_lock_blocking(shared_state.scanline.lock);
-#ifdef ENABLE_SCANLINE_ASSERTIONS
-list_prepend(&shared_state.scanline.generating_list, fsb);
-#endif
-// todo improve this algorithm... how far ahead should we be
-// todo i.e. should we skip ahead a bit further if we are perpetually behind - doesn't really help because we'd
-// todo be skipping some scanlines anyway; doesn't really matter which ones at that point
-uint32_t scanline_id = shared_state.scanline.next_scanline_id;
-
-if (!
-is_scanline_after(scanline_id, shared_state
-.scanline.last_scanline_id))
-{
-// we are buffering ahead of the display
-scanline_id = scanline_id_after(shared_state.scanline.last_scanline_id);
-}
 
-fsb->core.
-scanline_id = shared_state.scanline.last_scanline_id = scanline_id;
-spin_unlock(shared_state
-.scanline.lock, save);
-break;
-}
+        if (fsb) {
+            save = spin_lock_blocking(shared_state.scanline.lock);
+            if (partial.enabled) {
+                // the frame may have moved on since we looked
+                have_scanline = partial_next_generation_id(&scanline_id);
+            } else {
+                // todo improve this algorithm... how far ahead should we be
+                // todo i.e. should we skip ahead a bit further if we are perpetually behind - doesn't really help because we'd
+                // todo be skipping some scanlines anyway; doesn't really matter which ones at that point
+                scanline_id = shared_state.scanline.next_scanline_id;
+
+                if (!scanvideo_scanline_id_is_after(scanline_id, shared_state.scanline.last_scanline_id)) {
+                    // we are buffering ahead of the display
+                    scanline_id = scanline_id_after(shared_state.scanline.last_scanline_id);
+                }
+            }
+            if (have_scanline) {
+                scanvideo_scanline_queue_locked_begin_generation(&scanline_queue, &fsb->entry);
+                fsb->core.scanline_id = shared_state.scanline.last_scanline_id = scanline_id;
+            }
+            spin_unlock(shared_state.scanline.lock, save);
+            if (have_scanline) break;
+            free_local_free_list_irqs_enabled(&fsb->entry);
+            fsb = NULL;
+        }
 
-if (block)
-{
-DEBUG_PINS_SET(video_generation,
-4);
-__wfe();
-DEBUG_PINS_CLR(video_generation,
-4);
-}
-}
-while (block);
+        if (block) {
+            DEBUG_PINS_SET(video_generation, 4);
+            __wfe();
+            DEBUG_PINS_CLR(video_generation, 4);
+        }
+    } while (block);
 
-DEBUG_PINS_CLR(video_generation,
-1);
-return (struct scanline_buffer *)
-fsb;
+    DEBUG_PINS_CLR(video_generation, 1);
+    return fsb ? &fsb->core : NULL;
 }
 
 extern void __video_time_critical("end_scanline")
 
 video_end_scanline_generation(struct scanline_buffer *scanline_buffer) {
     DEBUG_PINS_SET(video_generation, 2);
-    struct full_scanline_buffer *fsb = (struct full_scanline_buffer *) scanline_buffer;
+    struct full_scanline_buffer *fsb = (struct full_scanline_buffer *)
+            ((uintptr_t) scanline_buffer - offsetof(struct full_scanline_buffer, core));
     uint32_t save = spin_lock_blocking(shared_state.scanline.lock);
-#ifdef ENABLE_SCANLINE_ASSERTIONS
-    list_remove(&shared_state.scanline.generating_list, fsb);
-#endif
-    list_insert_ascending(&shared_state.scanline.generated_ascending_scanline_id_list,
-                          &shared_state.scanline.generated_ascending_scanline_id_list_tail, fsb);
+    // the buffer comes straight back if the display has already passed its scanline
+    scanvideo_scanline_queue_entry_t *too_late = scanvideo_scanline_queue_locked_add_generated(
+            &scanline_queue, &fsb->entry, scanline_buffer->scanline_id);
     bool prepare = shared_state.scanline.need_prepare_for_active_scanline;
     shared_state.scanline.need_prepare_for_active_scanline = false;
     spin_unlock(shared_state.scanline.lock, save);
+    free_local_free_list_irqs_enabled(too_late);
     if (prepare) {
         prepare_for_active_scanline_irqs_enabled();
     }
@@ -872,18 +1014,89 @@ video_end_scanline_generation(struct scanline_buffer *scanline_buffer) {
 
 #pragma GCC pop_options
 
+static void partial_mark_all_dirty(struct partial_frame_set *set) {
+    __builtin_memset(set->rows, 0xff, sizeof(set->rows));
+    set->left = 0;
+    set->right = video_mode.width & ~1u;
+}
+
+void video_dbi_set_partial_updates(bool enable) {
+    video_assert(video_mode.height <= PICO_SCANVIDEO_DBI_MAX_HEIGHT);
+    uint32_t save = spin_lock_blocking(shared_state.scanline.lock);
+    if (enable && !partial.enabled) {
+        // the rest of the frame in progress, and the next (which may already be being generated), are written in full
+        if (!partial.frame_done) {
+            partial_mark_all_dirty(&partial.current);
+            partial.frame = frame_number(shared_state.scanline.next_scanline_id);
+            partial.frame_start_us = time_us_64();
+        }
+        partial_mark_all_dirty(&partial.pending);
+    }
+    partial.enabled = enable;
+    spin_unlock(shared_state.scanline.lock, save);
+}
+
+void video_dbi_add_dirty_rect(uint x, uint y, uint width, uint height) {
+    if (x >= video_mode.width || y >= video_mode.height || !width || !height) return;
+    uint right = MIN(x + width, video_mode.width);
+    uint bottom = MIN(y + height, video_mode.height);
+    // the panel window must be an even number of pixels wide (and the row sequences clock pixels in pairs)
+    uint left = x & ~1u;
+    right = MIN((right + 1) & ~1u, video_mode.width & ~1u);
+    if (right <= left) return;
+    uint32_t save = spin_lock_blocking(shared_state.scanline.lock);
+    for (uint row = y; row < bottom; row++) {
+        partial.pending.rows[row / 32] |= 1u << (row & 31u);
+    }
+    if (partial_set_empty(&partial.pending)) {
+        partial.pending.left = left;
+        partial.pending.right = right;
+    } else {
+        partial.pending.left = MIN(partial.pending.left, left);
+        partial.pending.right = MAX(partial.pending.right, right);
+    }
+    spin_unlock(shared_state.scanline.lock, save);
+}
+
+void video_dbi_get_scanline_window(uint32_t scanline_id, uint *x, uint *width) {
+    uint32_t save = spin_lock_blocking(shared_state.scanline.lock);
+    if (partial.enabled && frame_number(scanline_id) == partial.frame) {
+        *x = partial.current.left;
+        *width = partial.current.right - partial.current.left;
+    } else {
+        *x = 0;
+        *width = video_mode.width & ~1u;
+    }
+    spin_unlock(shared_state.scanline.lock, save);
+}
+
+uint64_t video_dbi_get_pixels_written() {
+    return pixels_written;
+}
+
 bool video_setup(const struct video_mode *mode) {
     return video_setup_with_timing(mode, mode->default_timing);
 }
 
 bool video_setup_with_timing(const struct video_mode *mode, const struct video_timing *timing) {
     __builtin_memset(&shared_state, 0, sizeof(shared_state));
+    __builtin_memset(&partial, 0, sizeof(partial));
+    partial.frame_period_us = (uint32_t) (((uint64_t) timing->h_total * timing->v_total * 1000000u) /
+                                          timing->clock_freq);
+    if (partial_alarm_num < 0) {
+        partial_alarm_num = hardware_alarm_claim_unused(true);
+        hardware_alarm_set_callback(partial_alarm_num, partial_alarm_callback);
+        te_alarm_num = hardware_alarm_claim_unused(true);
+        hardware_alarm_set_callback(te_alarm_num, te_alarm_callback);
+    }
+    pixels_written = 0;
     // init non zero members
     // todo pass scanline buffers and size, or allow client to allocate
     shared_state.scanline.lock = spin_lock_init(PICO_SPINLOCK_ID_VIDEO_SCANLINE_LOCK);
     shared_state.dma.lock = spin_lock_init(PICO_SPINLOCK_ID_VIDEO_DMA_LOCK);
-    shared_state.free_list.lock = spin_lock_init(PICO_SPINLOCK_ID_VIDEO_FREE_LIST_LOCK);
-    shared_state.in_use.lock = spin_lock_init(PICO_SPINLOCK_ID_VIDEO_IN_USE_LOCK);
+    scanvideo_scanline_queue_init(&scanline_queue, shared_state.scanline.lock,
+                                  spin_lock_init(PICO_SPINLOCK_ID_VIDEO_IN_USE_LOCK),
+                                  spin_lock_init(PICO_SPINLOCK_ID_VIDEO_FREE_LIST_LOCK));
     shared_state.scanline.last_scanline_id = 0xffffffff;
     shared_state.scanline.need_prepare_for_active_scanline = true;
 
@@ -916,10 +1129,10 @@ bool video_setup_with_timing(const struct video_mode *mode, const struct video_t
         scanline_buffers[i].core.data3_max = PICO_SCANVIDEO_MAX_SCANLINE_BUFFER3_WORDS;
 #endif
 #endif
-        scanline_buffers[i].next = i != PICO_SCANVIDEO_SCANLINE_BUFFER_COUNT - 1 ? &scanline_buffers[i + 1] : NULL;
     }
-
-    shared_state.free_list.free_list = &scanline_buffers[0];
+    for (int i = PICO_SCANVIDEO_SCANLINE_BUFFER_COUNT - 1; i >= 0; i--) {
+        scanvideo_scanline_queue_add_buffer(&scanline_queue, &scanline_buffers[i].entry);
+    }
     // shared state init complete - probably overkill
     __mem_fence_release();
 
@@ -21,6 +21,57 @@
 #define PICO_SCANVIDEO_DPI_ALPHA_PIN 5u
 #endif
 
+// the default pixel formats are RGB332 at 8bpp, RGB555 (with a spare bit between red and green) at 16bpp, and
+// RGB888 at 24bpp
+#if PICO_SCANVIDEO_BPP == 8
+#ifndef PICO_SCANVIDEO_DPI_PIXEL_RSHIFT
+#define PICO_SCANVIDEO_DPI_PIXEL_RSHIFT 0u
+#endif
+
+#ifndef PICO_SCANVIDEO_DPI_PIXEL_GSHIFT
+#define PICO_SCANVIDEO_DPI_PIXEL_GSHIFT 3u
+#endif
+
+#ifndef PICO_SCANVIDEO_DPI_PIXEL_BSHIFT
+#define PICO_SCANVIDEO_DPI_PIXEL_BSHIFT 6u
+#endif
+
+#ifndef PICO_SCANVIDEO_DPI_PIXEL_RCOUNT
+#define PICO_SCANVIDEO_DPI_PIXEL_RCOUNT 3
+#endif
+
+#ifndef PICO_SCANVIDEO_DPI_PIXEL_GCOUNT
+#define PICO_SCANVIDEO_DPI_PIXEL_GCOUNT 3
+#endif
+
+#ifndef PICO_SCANVIDEO_DPI_PIXEL_BCOUNT
+#define PICO_SCANVIDEO_DPI_PIXEL_BCOUNT 2
+#endif
+#elif PICO_SCANVIDEO_BPP == 24
+#ifndef PICO_SCANVIDEO_DPI_PIXEL_RSHIFT
+#define PICO_SCANVIDEO_DPI_PIXEL_RSHIFT 0u
+#endif
+
+#ifndef PICO_SCANVIDEO_DPI_PIXEL_GSHIFT
+#define PICO_SCANVIDEO_DPI_PIXEL_GSHIFT 8u
+#endif
+
+#ifndef PICO_SCANVIDEO_DPI_PIXEL_BSHIFT
+#define PICO_SCANVIDEO_DPI_PIXEL_BSHIFT 16u
+#endif
+
+#ifndef PICO_SCANVIDEO_DPI_PIXEL_RCOUNT
+#define PICO_SCANVIDEO_DPI_PIXEL_RCOUNT 8
+#endif
+
+#ifndef PICO_SCANVIDEO_DPI_PIXEL_GCOUNT
+#define PICO_SCANVIDEO_DPI_PIXEL_GCOUNT 8
+#endif
+
+#ifndef PICO_SCANVIDEO_DPI_PIXEL_BCOUNT
+#define PICO_SCANVIDEO_DPI_PIXEL_BCOUNT 8
+#endif
+#else
 #ifndef PICO_SCANVIDEO_DPI_PIXEL_RSHIFT
 #define PICO_SCANVIDEO_DPI_PIXEL_RSHIFT 0u
 #endif
@@ -44,6 +95,7 @@
 #ifndef PICO_SCANVIDEO_DPI_PIXEL_BCOUNT
 #define PICO_SCANVIDEO_DPI_PIXEL_BCOUNT 5
 #endif
+#endif
 
 #ifndef PICO_SCANVIDEO_ALPHA_PIN
 #define PICO_SCANVIDEO_ALPHA_PIN PICO_SCANVIDEO_DPI_ALPHA_PIN
@@ -73,6 +125,99 @@
 #define PICO_SCANVIDEO_PIXEL_BCOUNT PICO_SCANVIDEO_DPI_PIXEL_BCOUNT
 #endif
 
+// PICO_CONFIG: PICO_SCANVIDEO_FRAMEBUFFER_SCANOUT, Enable/disable direct scan out of a 16bpp framebuffer via chained plane 1 DMA fragments (requires PICO_SCANVIDEO_PLANE1_VARIABLE_FRAGMENT_DMA), type=bool, default=0, group=video
+#ifndef PICO_SCANVIDEO_FRAMEBUFFER_SCANOUT
+#define PICO_SCANVIDEO_FRAMEBUFFER_SCANOUT 0
+#endif
+
+#if PICO_SCANVIDEO_FRAMEBUFFER_SCANOUT
+#if !PICO_SCANVIDEO_PLANE1_VARIABLE_FRAGMENT_DMA
+#error PICO_SCANVIDEO_FRAMEBUFFER_SCANOUT requires PICO_SCANVIDEO_PLANE1_VARIABLE_FRAGMENT_DMA
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// (count, address) pairs per framebuffer row: header, pixels, trailer and the terminating null pair
+#define PICO_SCANVIDEO_FRAMEBUFFER_CHAIN_WORDS_PER_ROW 8u
+
+/**
+ * A 16bpp framebuffer which is scanned out directly by DMA.
+ *
+ * Each row is described by a small precomputed DMA fragment chain (a COMPOSABLE_RAW_RUN header, the row's pixels
+ * straight from the framebuffer, and a black pixel/EOL trailer), so once set up almost no CPU time is spent generating
+ * scanlines; the only per row work is copying the row's first two pixels into the shared header (the raw run's first
+ * pixel has to come before its length).
+ *
+ * Scanlines generated by the application in the usual way still take precedence over the framebuffer for their
+ * scanline_id, which allows for overlays on otherwise static content.
+ */
+typedef struct scanvideo_framebuffer {
+    const uint16_t *pixels;
+    uint32_t *chain;
+    uint16_t width;
+    uint16_t height;
+    uint32_t stride_words;
+} scanvideo_framebuffer_t;
+
+typedef struct scanvideo_framebuffer_stats {
+    // number of scanlines displayed directly from the framebuffer (i.e. scanlines the application did not generate)
+    uint32_t framebuffer_scanlines;
+    // number of scanlines displayed from application generated scanline buffers
+    uint32_t generated_scanlines;
+    // number of page flips performed at vblank
+    uint32_t flips;
+} scanvideo_framebuffer_stats_t;
+
+/**
+ * Initialize a framebuffer for direct scan out
+ *
+ * \param fb the framebuffer to initialize
+ * \param pixels 16bpp pixel data, which must be word aligned
+ * \param width the width in pixels; this must be even and at least 4
+ * \param height the height in (logical) scanlines
+ * \param stride_words the distance between rows in 32-bit words
+ * \param chain storage for the DMA fragment chain of height * PICO_SCANVIDEO_FRAMEBUFFER_CHAIN_WORDS_PER_ROW words,
+ *              which must remain valid while the framebuffer may be displayed
+ */
+void scanvideo_framebuffer_init(scanvideo_framebuffer_t *fb, const uint16_t *pixels, uint width, uint height,
+                                uint stride_words, uint32_t *chain);
+
+/**
+ * Display the given framebuffer from the start of the next frame (i.e. the page flip happens at vblank).
+ *
+ * Passing NULL returns to displaying only generated scanlines.
+ *
+ * \param fb the framebuffer to display
+ */
+void scanvideo_framebuffer_show(const scanvideo_framebuffer_t *fb);
+
+/**
+ * \return true if a framebuffer passed to scanvideo_framebuffer_show is still waiting for vblank
+ */
+bool scanvideo_framebuffer_flip_pending();
+
+/**
+ * \return the framebuffer currently being displayed (or NULL)
+ */
+const scanvideo_framebuffer_t *scanvideo_framebuffer_get_displayed();
+
+/**
+ * Retrieve (and optionally reset) the framebuffer scan out counters.
+ *
+ * The core time freed is framebuffer_scanlines multiplied by the application's own per scanline generation cost
+ *
+ * \param stats the stats to fill in
+ * \param reset true to zero the counters afterwards
+ */
+void scanvideo_framebuffer_get_stats(scanvideo_framebuffer_stats_t *stats, bool reset);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
+
 
 /** \file scanvideo.h
  *  \defgroup pico_scanvideo_dpi pico_scanvideo_dpi
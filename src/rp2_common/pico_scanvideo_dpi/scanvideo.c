@@ -4,6 +4,7 @@
  * SPDX-License-Identifier: BSD-3-Clause
  */
 
+#include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include "pico.h"
@@ -26,6 +27,7 @@ GCC_Pragma("GCC optimize(\"O3\")")
 #include "timing.pio.h"
 #include "pico/scanvideo.h"
 #include "pico/scanvideo/composable_scanline.h"
+#include "pico/scanvideo/scanline_queue.h"
 #include "hardware/structs/bus_ctrl.h"
 #include "pico/binary_info.h"
 
@@ -131,7 +133,6 @@ CU_REGISTER_DEBUG_PINS(video_timing, video_dma_buffer, video_irq, video_dma_comp
 
 // ======================
 
-#define GENERATING_LIST 1
 //#define PICO_SCANVIDEO_ENABLE_SCANLINE_ASSERTIONS 1
 #if PICO_SCANVIDEO_ENABLE_SCANLINE_ASSERTIONS
 // we want some sort of assertion even in release builds
@@ -194,7 +195,7 @@ enum {
     CLEAR_IRQ_SCANLINE = 3u,
 };
 
-static struct {
+struct timing_state {
     int32_t v_active;
     int32_t v_total;
     int32_t v_pulse_start;
@@ -204,13 +205,37 @@ static struct {
     uint32_t vsync_bits_no_pulse;
 
     uint32_t a, a_vblank, b1, b2, c, c_vblank;
+    // c_vblank split half way along the line, for the vsync edges of the odd field of interlaced timing; the
+    // second half has the vsync bit set, which toggles vsync (see top_up_timing_pio_fifo)
+    uint32_t c_vblank_half1, c_vblank_half2;
+    uint8_t interlaced;
+    uint8_t doublescan;
+    // everything above is derived from the scanvideo_timing_t; everything below is the state of the current frame
     uint32_t vsync_bits;
     uint16_t dma_state_index;
+    uint8_t dma_state_count;
+    // 0 or 1 for interlaced timing; always 0 otherwise
+    uint8_t field;
+    // set while outputting the second copy of a line with doublescan timing
+    uint8_t line_repeat;
     int32_t timing_scanline;
-} timing_state;
+};
+
+#define TIMING_STATE_PARAMS_SIZE offsetof(struct timing_state, vsync_bits)
 
-#define DMA_STATE_COUNT 4
-static uint32_t dma_states[DMA_STATE_COUNT];
+static struct timing_state timing_state;
+
+// new timing handed from the vblank handler to the timing FIFO handler, which switches to it at the start of the
+// next frame
+static struct {
+    struct timing_state state;
+    uint16_t clock_down_times_2;
+    volatile bool pending;
+} timing_change;
+
+// 4 states per line, or 5 for a line with a vsync edge half way along
+#define DMA_STATE_COUNT_MAX 5
+static uint32_t dma_states[DMA_STATE_COUNT_MAX];
 
 // todo get rid of this altogether
 #undef PICO_SCANVIDEO_ENABLE_VIDEO_CLOCK_DOWN
@@ -223,17 +248,20 @@ static uint16_t video_clock_down_times_2;
 semaphore_t vblank_begin;
 
 // --- scanline stuff
-// private representation of scanline buffer (adds link for one list this scanline buffer is currently in)
+// private representation of scanline buffer (adds the entry for the scanline_queue list it is currently in)
 typedef struct full_scanline_buffer {
+    scanvideo_scanline_queue_entry_t entry;
     scanvideo_scanline_buffer_t core;
-    struct full_scanline_buffer *next;
 } full_scanline_buffer_t;
 
-// each scanline_buffer should be in exactly one of the shared_state lists below
-// (unless we don't have USE_SCANLINE_DEBUG in which case we don't keep the generating list,
+// each scanline_buffer should be in exactly one of the scanline_queue lists
+// (unless we don't have PICO_SCANVIDEO_ENABLE_SCANLINE_ASSERTIONS in which case we don't keep the generating list,
 // in which case the scanline is entirely trusted to the client when generating)
 full_scanline_buffer_t scanline_buffers[PICO_SCANVIDEO_SCANLINE_BUFFER_COUNT];
 
+// the generated queue is protected by shared_state.scanline.lock
+static scanvideo_scanline_queue_t scanline_queue;
+
 // This state is sensitive as it it accessed by either core, and multiple IRQ handlers which may be re-entrant
 // Nothing in here should be touched except when protected by the appropriate spin lock.
 //
@@ -241,14 +269,6 @@ full_scanline_buffer_t scanline_buffers[PICO_SCANVIDEO_SCANLINE_BUFFER_COUNT];
 // safe concurrent operation by both cores, client, IRQ and nested IRQ (pre-emption) where desirable due
 // to timing concerns.
 static struct {
-    struct {
-        spin_lock_t *lock;
-        // note in_use is a list as we are lazy in removing buffers from it
-        full_scanline_buffer_t *in_use_ascending_scanline_id_list;
-        // pointer to the tail element of the list for making appending by ascending scanline id quick
-        full_scanline_buffer_t *in_use_ascending_scanline_id_list_tail;
-    } in_use;
-
     struct {
         spin_lock_t *lock;
         full_scanline_buffer_t *current_scanline_buffer;
@@ -258,21 +278,8 @@ static struct {
         uint16_t y_repeat_index;
         uint16_t y_repeat_target;
         bool in_vblank;
-        // This generated list is in this struct because it is accessed together in fsb latching
-        // and the only other place it is used in scanvideo_end_scanline_generation which needs no other
-        // locks (i.e. we are saving an extra lock in the latch case by not placing in a separate struct)
-        full_scanline_buffer_t *generated_ascending_scanline_id_list;
-        full_scanline_buffer_t *generated_ascending_scanline_id_list_tail;
-#if PICO_SCANVIDEO_ENABLE_SCANLINE_ASSERTIONS && GENERATING_LIST
-        full_scanline_buffer_t *generating_list;
-#endif
     } scanline;
 
-    struct {
-        spin_lock_t *lock;
-        full_scanline_buffer_t *free_list;
-    } free_list;
-
     // This is access by DMA IRQ and by SM IRQs
     struct {
         spin_lock_t *lock;
@@ -296,12 +303,50 @@ static struct {
 #ifndef PICO_SCANVIDEO_MISSING_SCANLINE_COLOR
 #define PICO_SCANVIDEO_MISSING_SCANLINE_COLOR PICO_SCANVIDEO_PIXEL_FROM_RGB8(0,0,255)
 #endif
+
+#if PICO_SCANVIDEO_BPP != 16 && (PICO_SCANVIDEO_PLANE_COUNT > 1 || PICO_SCANVIDEO_PLANE1_FRAGMENT_DMA)
+#error PICO_SCANVIDEO_BPP other than 16 is only supported with a single plane, without fragment DMA
+#endif
+
+// the left half of a missing scanline is PICO_SCANVIDEO_MISSING_SCANLINE_COLOR; the run lengths are filled in by
+// set_missing_scanline_width
+#if PICO_SCANVIDEO_BPP == 8
+// a run is at most COMPOSABLE_MAX_RUN_8BPP pixels, so this takes two
+static uint32_t _missing_scanline_data[] =
+        {
+                COMPOSABLE_COLOR_RUN | (PICO_SCANVIDEO_MISSING_SCANLINE_COLOR << 8u) | (/*width/4-3*/ 0u << 16u) | (COMPOSABLE_COLOR_RUN << 24u),
+                PICO_SCANVIDEO_MISSING_SCANLINE_COLOR | (/*width/2-width/4-3*/ 0u << 8u) | (COMPOSABLE_RAW_1P << 16u) | (0u << 24u),
+                COMPOSABLE_EOL_SKIP_ALIGN
+        };
+#elif PICO_SCANVIDEO_BPP == 24
+static uint32_t _missing_scanline_data[] =
+        {
+                COMPOSABLE_COLOR_RUN,
+                PICO_SCANVIDEO_MISSING_SCANLINE_COLOR,
+                /*width/2-3*/ 0u,
+                COMPOSABLE_RAW_1P,
+                0u,
+                COMPOSABLE_EOL_ALIGN
+        };
+#else
 static uint32_t _missing_scanline_data[] =
         {
                 COMPOSABLE_COLOR_RUN | (PICO_SCANVIDEO_MISSING_SCANLINE_COLOR << 16u),
                 /*width-3*/ 0u | (COMPOSABLE_RAW_1P << 16u),
                 0u | (COMPOSABLE_EOL_ALIGN << 16u)
         };
+#endif
+
+static void set_missing_scanline_width(uint width) {
+#if PICO_SCANVIDEO_BPP == 8
+    ((uint8_t *) (_missing_scanline_data))[2] = (uint8_t) (width / 4 - 3);
+    ((uint8_t *) (_missing_scanline_data))[5] = (uint8_t) (width / 2 - width / 4 - 3);
+#elif PICO_SCANVIDEO_BPP == 24
+    _missing_scanline_data[2] = width / 2 - 3;
+#else
+    ((uint16_t *) (_missing_scanline_data))[2] = (uint16_t) (width / 2 - 3);
+#endif
+}
 
 #if PICO_SCANVIDEO_PLANE1_VARIABLE_FRAGMENT_DMA || PICO_SCANVIDEO_PLANE2_VARIABLE_FRAGMENT_DMA
 static uint32_t variable_fragment_missing_scanline_data_chain[] = {
@@ -328,100 +373,73 @@ uint32_t missing_scanline_data_overlay[] = {
 
 static full_scanline_buffer_t _missing_scanline_buffer;
 
-static inline bool is_scanline_after(uint32_t scanline_id1, uint32_t scanline_id2) {
-    return ((int32_t) (scanline_id1 - scanline_id2)) > 0;
-}
+#if PICO_SCANVIDEO_FRAMEBUFFER_SCANOUT
+// shared by all framebuffer rows: | raw_run | pixel 0 || width-3 | pixel 1 |, so the run is exactly the row's pixels
+// (the remaining ones coming straight from the framebuffer). the pixels are filled in for each row just before its DMA
+// is started
+static uint32_t framebuffer_row_header[2];
+
+// shared by all framebuffer rows: black pixel to end the line, then skip the rest of the word
+static uint32_t framebuffer_row_trailer[] = {
+        COMPOSABLE_RAW_1P | (0u << 16u),
+        COMPOSABLE_EOL_SKIP_ALIGN
+};
+
+// protected by the scanline lock (except stats which are only updated by the PIO IRQ handler)
+static struct {
+    const scanvideo_framebuffer_t *displayed;
+    const scanvideo_framebuffer_t *pending;
+    bool flip_pending;
+    scanvideo_framebuffer_stats_t stats;
+} framebuffer_state;
+#endif
 
 static void prepare_for_active_scanline_irqs_enabled();
 
 static void scanline_dma_complete_irqs_enabled();
 
+static void apply_mode_change_locked();
+
 static void setup_sm(int sm, uint offset);
 
 // -- MISC stuff
 static scanvideo_mode_t video_mode;
 static bool video_timing_enabled = false;
 static bool display_enabled = true;
+// the scanline program as loaded (before relocation), so a mode change only rewrites the instructions which differ
+static uint16_t video_program_instructions[32];
+
+// protected by the scanline lock; a mode change waiting for the next vblank
+static struct {
+    scanvideo_mode_t mode;
+    uint16_t instructions[32];
+    scanvideo_scanline_buffer_t missing_scanline_buffer;
+    struct timing_state timing;
+    uint16_t clock_down_times_2;
+    bool pending;
+} mode_change;
 
 static scanvideo_scanline_repeat_count_fn _scanline_repeat_count_fn;
 #if PICO_SCANVIDEO_SCANLINE_RELEASE_FUNCTION
 static scanvideo_scanline_release_fn _scanline_release_fn;
 #endif
 
-inline static void list_prepend(full_scanline_buffer_t **phead, full_scanline_buffer_t *fsb) {
-    scanline_assert(fsb);
-    scanline_assert(fsb->next == NULL);
-    scanline_assert(fsb != *phead);
-    fsb->next = *phead;
-    *phead = fsb;
-}
-
-inline static void list_prepend_all(full_scanline_buffer_t **phead, full_scanline_buffer_t *to_prepend) {
-    full_scanline_buffer_t *fsb = to_prepend;
-
-    // todo should this be assumed?
-    if (fsb) {
-        while (fsb->next) {
-            fsb = fsb->next;
-        }
-
-        fsb->next = *phead;
-        *phead = to_prepend;
-    }
+static inline full_scanline_buffer_t *fsb_from_core(scanvideo_scanline_buffer_t *core) {
+    return (full_scanline_buffer_t *) ((uintptr_t) core - offsetof(full_scanline_buffer_t, core));
 }
 
-inline static full_scanline_buffer_t *list_remove_head(full_scanline_buffer_t **phead) {
-    full_scanline_buffer_t *fsb = *phead;
 
-    if (fsb) {
-        *phead = fsb->next;
-        fsb->next = NULL;
-    }
-
-    return fsb;
-}
-
-inline static full_scanline_buffer_t *list_remove_head_ascending(full_scanline_buffer_t **phead,
-                                                                      full_scanline_buffer_t **ptail) {
-    full_scanline_buffer_t *fsb = *phead;
-
-    if (fsb) {
-        scanline_assert(*ptail);
-        *phead = fsb->next;
+static inline uint32_t scanline_id_after(uint32_t scanline_id) {
+    uint32_t tmp = scanline_id & 0xffffu;
 
-        if (!fsb->next) {
-            scanline_assert(*ptail == fsb);
-            *ptail = NULL;
+    if (video_mode.default_timing->interlaced) {
+        // a field is every other line; the next field (which has a new frame number) starts with the other parity
+        if (tmp + 2 < video_mode.height) {
+            return scanline_id + 2;
         } else {
-            fsb->next = NULL;
+            return scanline_id + 0x10000u - tmp + ((tmp & 1u) ^ 1u);
         }
     }
-
-    return fsb;
-}
-
-inline static void list_remove(full_scanline_buffer_t **phead, full_scanline_buffer_t *fsb) {
-    scanline_assert(*phead);
-    full_scanline_buffer_t *prev = *phead;
-
-    if (prev == fsb) {
-        *phead = fsb->next;
-    } else {
-        while (prev->next && prev->next != fsb) {
-            prev = prev->next;
-        }
-
-        scanline_assert(prev->next == fsb);
-        prev->next = fsb->next;
-    }
-
-    // todo do we need this without assertions?
-    fsb->next = NULL;
-}
-
-static inline uint32_t scanline_id_after(uint32_t scanline_id) {
-    uint32_t tmp = scanline_id & 0xffffu;
-
     if (tmp < video_mode.height - 1) {
         return scanline_id + 1;
     } else {
@@ -429,50 +447,35 @@ static inline uint32_t scanline_id_after(uint32_t scanline_id) {
     }
 }
 
-// todo add a tail for these already sorted lists as we generally insert on the end
-inline static void list_insert_ascending(full_scanline_buffer_t **phead, full_scanline_buffer_t **ptail,
-                                         full_scanline_buffer_t *fsb) {
-    scanline_assert(fsb->next == NULL);
-    scanline_assert(fsb != *phead);
-    scanline_assert(fsb != *ptail);
-
-    if (!*phead || !is_scanline_after(fsb->core.scanline_id, (*phead)->core.scanline_id)) {
-        if (!*phead) {
-            scanline_assert(!*ptail);
-            *ptail = fsb;
-        }
-
-        // insert at the beginning
-        list_prepend(phead, fsb);
-    } else {
-        if (is_scanline_after(fsb->core.scanline_id, (*ptail)->core.scanline_id)) {
-            // insert at end
-            (*ptail)->next = fsb;
-            *ptail = fsb;
-        } else {
-            // not after
-            full_scanline_buffer_t *prev = *phead;
-
-            while (prev->next && is_scanline_after(fsb->core.scanline_id, prev->next->core.scanline_id)) {
-                prev = prev->next;
-            }
+// the first scanline number of the frame (or field for interlaced timing) after the one being displayed
+static inline uint next_frame_first_scanline_number() {
+    return video_mode.default_timing->interlaced ? timing_state.field ^ 1u : 0;
+}
 
-            scanline_assert(prev != *ptail); // we should have already inserted at the end in this case
-            fsb->next = prev->next;
-            prev->next = fsb;
-        }
-    }
+// the number of timing lines each scanline (before yscale) is displayed for
+static inline uint scanline_repeat_scale() {
+    return video_mode.yscale << video_mode.default_timing->doublescan;
 }
 
-inline static void free_local_free_list_irqs_enabled(full_scanline_buffer_t *local_free_list) {
+inline static void free_local_free_list_irqs_enabled(scanvideo_scanline_queue_entry_t *local_free_list) {
     if (local_free_list) {
-        uint32_t save = spin_lock_blocking(shared_state.free_list.lock);
+#if PICO_SCANVIDEO_LINKED_SCANLINE_BUFFERS
+        // buffers linked to those being freed are freed with them (linked buffers are in no list of their own)
+        for (scanvideo_scanline_queue_entry_t *e = local_free_list; e; e = e->next) {
+            full_scanline_buffer_t *fsb = (full_scanline_buffer_t *) e;
+            if (fsb->core.link) {
+                DEBUG_PINS_SET(video_link, 2);
+                full_scanline_buffer_t *fsb2 = fsb_from_core(fsb->core.link);
+                fsb->core.link = NULL;
+                fsb2->entry.next = e->next;
+                e->next = &fsb2->entry;
+                DEBUG_PINS_CLR(video_link, 2);
+            }
+        }
+#endif
         DEBUG_PINS_SET(video_timing, 4);
-        list_prepend_all(&shared_state.free_list.free_list, local_free_list);
+        scanvideo_scanline_queue_free_irqs_enabled(&scanline_queue, local_free_list);
         DEBUG_PINS_CLR(video_timing, 4);
-        spin_unlock(shared_state.free_list.lock, save);
-        // note also this is useful for triggering scanvideo_wait_for_scanline_complete check
-        __sev();
 #if PICO_SCANVIDEO_SCANLINE_RELEASE_FUNCTION
         if (_scanline_release_fn) _scanline_release_fn();
 #endif
@@ -481,83 +484,24 @@ inline static void free_local_free_list_irqs_enabled(full_scanline_buffer_t *loc
 
 // Caller must own scanline_state_spin_lock
 inline static full_scanline_buffer_t *scanline_locked_try_latch_fsb_if_null_irqs_disabled(
-        full_scanline_buffer_t **local_free_list) {
-    // note this just checks that someone owns it not necessarily this core.
-    scanline_assert(is_spin_locked(shared_state.scanline.lock));
+        scanvideo_scanline_queue_entry_t **local_free_list) {
     full_scanline_buffer_t *fsb = shared_state.scanline.current_scanline_buffer;
-
     if (!fsb) {
-        // peek the head
-        while (NULL != (fsb = shared_state.scanline.generated_ascending_scanline_id_list)) {
-            if (!is_scanline_after(shared_state.scanline.next_scanline_id, fsb->core.scanline_id)) {
-                if (shared_state.scanline.next_scanline_id == fsb->core.scanline_id) {
-                    full_scanline_buffer_t __unused *dbg = list_remove_head_ascending(
-                            &shared_state.scanline.generated_ascending_scanline_id_list,
-                            &shared_state.scanline.generated_ascending_scanline_id_list_tail);
-                    scanline_assert(dbg == fsb);
-                    spin_lock_unsafe_blocking(shared_state.in_use.lock);
-                    DEBUG_PINS_SET(video_timing, 2);
-                    DEBUG_PINS_XOR(video_in_use, 1);
-                    list_insert_ascending(&shared_state.in_use.in_use_ascending_scanline_id_list,
-                                          &shared_state.in_use.in_use_ascending_scanline_id_list_tail, fsb);
-                    DEBUG_PINS_CLR(video_timing, 2);
-                    spin_unlock_unsafe(shared_state.in_use.lock);
-                    shared_state.scanline.current_scanline_buffer = fsb;
-                } else {
-                    fsb = NULL;
-                }
-
-                break;
-            } else {
-                // scanline is in the past
-                full_scanline_buffer_t __unused *dbg = list_remove_head_ascending(
-                        &shared_state.scanline.generated_ascending_scanline_id_list,
-                        &shared_state.scanline.generated_ascending_scanline_id_list_tail);
-                scanline_assert(dbg == fsb);
-                list_prepend(local_free_list, fsb);
-#if PICO_SCANVIDEO_LINKED_SCANLINE_BUFFERS
-                full_scanline_buffer_t *fsb2;
-                while(NULL != (fsb2 = (full_scanline_buffer_t *)fsb->core.link)) {
-                    fsb->core.link = NULL;
-                    DEBUG_PINS_SET(video_link, 2);
-                    list_prepend(local_free_list, fsb2);
-                    DEBUG_PINS_CLR(video_link, 2);
-                    fsb = fsb2;
-                }
-#endif
-            }
-        }
+        DEBUG_PINS_SET(video_timing, 2);
+        fsb = (full_scanline_buffer_t *) scanvideo_scanline_queue_locked_try_latch(&scanline_queue,
+                                                                                   shared_state.scanline.next_scanline_id,
+                                                                                   local_free_list);
+        DEBUG_PINS_CLR(video_timing, 2);
+        shared_state.scanline.current_scanline_buffer = fsb;
     }
-
     return fsb;
 }
 
 static inline void release_scanline_irqs_enabled(int buffers_to_free_count,
-                                                 full_scanline_buffer_t **local_free_list) {
-    if (buffers_to_free_count) {
-        uint32_t save = spin_lock_blocking(shared_state.in_use.lock);
-        while (buffers_to_free_count--) {
-            DEBUG_PINS_SET(video_dma_buffer, 2);
-            // We always discard the head which is the oldest
-            DEBUG_PINS_XOR(video_in_use, 2);
-            full_scanline_buffer_t *fsb = list_remove_head_ascending(
-                    &shared_state.in_use.in_use_ascending_scanline_id_list,
-                    &shared_state.in_use.in_use_ascending_scanline_id_list_tail);
-            list_prepend(local_free_list, fsb);
-#if PICO_SCANVIDEO_LINKED_SCANLINE_BUFFERS
-            full_scanline_buffer_t *fsb2;
-            while(NULL != (fsb2 = (full_scanline_buffer_t *)fsb->core.link)) {
-                fsb->core.link = NULL;
-                DEBUG_PINS_SET(video_link, 2);
-                list_prepend(local_free_list, fsb2);
-                DEBUG_PINS_CLR(video_link, 2);
-                fsb = fsb2;
-            }
-#endif
-            DEBUG_PINS_CLR(video_dma_buffer, 2);
-        }
-        spin_unlock(shared_state.in_use.lock, save);
-    }
+                                                 scanvideo_scanline_queue_entry_t **local_free_list) {
+    DEBUG_PINS_SET(video_dma_buffer, 2);
+    scanvideo_scanline_queue_release_irqs_enabled(&scanline_queue, buffers_to_free_count, local_free_list);
+    DEBUG_PINS_CLR(video_dma_buffer, 2);
 }
 
 // Note that this is not a general purpose function. It must be called by a caller
@@ -672,7 +616,7 @@ static inline void scanline_dma_complete_irqs_enabled() {
     DEBUG_PINS_SET(video_dma_completion, 4);
     int buffers_to_free_count = 0;
     bool is_completion_trigger = update_dma_transfer_state_irqs_enabled(false, &buffers_to_free_count);
-    full_scanline_buffer_t *local_free_list = NULL;
+    scanvideo_scanline_queue_entry_t *local_free_list = NULL;
     if (is_completion_trigger) {
         uint32_t save = spin_lock_blocking(shared_state.scanline.lock);
         DEBUG_PINS_SET(video_timing, 1);
@@ -694,15 +638,19 @@ static inline void scanline_dma_complete_irqs_enabled() {
 
 static void set_next_scanline_id(uint32_t scanline_id) {
     shared_state.scanline.next_scanline_id = scanline_id;
-    shared_state.scanline.y_repeat_target = _scanline_repeat_count_fn(scanline_id) * video_mode.yscale;
+    shared_state.scanline.y_repeat_target = _scanline_repeat_count_fn(scanline_id) * scanline_repeat_scale();
 }
 
 void __video_most_time_critical_func(prepare_for_active_scanline_irqs_enabled)() {
     // note we are now only called in active display lines..
     DEBUG_PINS_SET(video_timing, 1);
-    full_scanline_buffer_t *local_free_list = NULL;
+    scanvideo_scanline_queue_entry_t *local_free_list = NULL;
     int buffers_to_free_count = 0;
     uint32_t save = spin_lock_blocking(shared_state.scanline.lock);
+#if PICO_SCANVIDEO_FRAMEBUFFER_SCANOUT
+    const scanvideo_framebuffer_t *fb = framebuffer_state.displayed;
+    uint scanline_number = scanvideo_scanline_number(shared_state.scanline.next_scanline_id);
+#endif
     // VERY IMPORTANT: THIS CODE CAN ONLY TAKE ABOUT 4.5 us BEFORE LAUNCHING DMA...
     // ... otherwise our scanline will be shifted over (because we will have started display)
     //
@@ -787,8 +735,22 @@ void __video_most_time_critical_func(prepare_for_active_scanline_irqs_enabled)()
 #if PICO_SCANVIDEO_PLANE1_FIXED_FRAGMENT_DMA
     dma_channel_hw_addr(PICO_SCANVIDEO_SCANLINE_DMA_CHANNEL)->al3_transfer_count = fsb->core.fragment_words;
 #endif
+#if PICO_SCANVIDEO_FRAMEBUFFER_SCANOUT
+    // with no generated scanline to show, display the row straight from the framebuffer
+    bool from_framebuffer = fsb == &_missing_scanline_buffer && fb && scanline_number < fb->height;
+    if (from_framebuffer) {
+        uint32_t first_pixels = ((const uint32_t *) fb->pixels)[scanline_number * fb->stride_words];
+        framebuffer_row_header[0] = COMPOSABLE_RAW_RUN | (first_pixels << 16u);
+        framebuffer_row_header[1] = (fb->width - 3u) | (first_pixels & 0xffff0000u);
+        dma_channel_hw_addr(PICO_SCANVIDEO_SCANLINE_DMA_CB_CHANNEL)->al3_read_addr_trig =
+                (uintptr_t)(fb->chain + scanline_number * PICO_SCANVIDEO_FRAMEBUFFER_CHAIN_WORDS_PER_ROW);
+    } else {
+        dma_channel_hw_addr(PICO_SCANVIDEO_SCANLINE_DMA_CB_CHANNEL)->al3_read_addr_trig = (uintptr_t)fsb->core.data;
+    }
+#else
     //dma_channel_transfer_from_buffer_now(PICO_SCANVIDEO_SCANLINE_DMA_CB_CHANNEL, (uintptr_t)fsb->core.data, (uint32_t) fsb->core.data_used);
     dma_channel_hw_addr(PICO_SCANVIDEO_SCANLINE_DMA_CB_CHANNEL)->al3_read_addr_trig = (uintptr_t)fsb->core.data;
+#endif
 #else
     dma_channel_transfer_from_buffer_now(PICO_SCANVIDEO_SCANLINE_DMA_CHANNEL, fsb->core.data,
                                          (uint32_t) fsb->core.data_used);
@@ -807,6 +769,13 @@ void __video_most_time_critical_func(prepare_for_active_scanline_irqs_enabled)()
 #endif
 //    scanline_assert(video_pio->sm[PICO_SCANVIDEO_SCANLINE_SM].addr == video_24mhz_composable_offset_end_of_scanline_ALIGN);
 //    DEBUG_PINS_CLR(video_irq, 2);
+#if PICO_SCANVIDEO_FRAMEBUFFER_SCANOUT
+    if (from_framebuffer) {
+        framebuffer_state.stats.framebuffer_scanlines++;
+    } else if (fsb != &_missing_scanline_buffer) {
+        framebuffer_state.stats.generated_scanlines++;
+    }
+#endif
 
     save = spin_lock_blocking(shared_state.scanline.lock);
     DEBUG_PINS_SET(video_timing, 1);
@@ -828,21 +797,14 @@ void __video_most_time_critical_func(prepare_for_active_scanline_irqs_enabled)()
         shared_state.scanline.current_scanline_buffer = NULL;
 #if PICO_SCANVIDEO_LINKED_SCANLINE_BUFFERS
     } else if (fsb->core.link_after && !--fsb->core.link_after) {
-        scanline_assert(fsb->core.link);
-        spin_lock_unsafe_blocking(shared_state.in_use.lock);
         scanline_assert(fsb->core.link);
         DEBUG_PINS_SET(video_link, 1);
-        full_scanline_buffer_t *fsb2 = (full_scanline_buffer_t *)fsb->core.link;
+        full_scanline_buffer_t *fsb2 = fsb_from_core(fsb->core.link);
         fsb->core.link = NULL; // the linkee scanline is now tracked on its own, so shouldn't be freed with the linker
         // we need to insert after the current item in the list, which is after fsb
         fsb2->core.scanline_id = fsb->core.scanline_id;
-        fsb2->next = fsb->next;
-        fsb->next = fsb2;
-        if (fsb == shared_state.in_use.in_use_ascending_scanline_id_list_tail) {
-            shared_state.in_use.in_use_ascending_scanline_id_list_tail = fsb2;
-        }
+        scanvideo_scanline_queue_locked_insert_in_use_after(&scanline_queue, &fsb->entry, &fsb2->entry);
         DEBUG_PINS_CLR(video_link, 1);
-        spin_unlock_unsafe(shared_state.in_use.lock);
         shared_state.scanline.current_scanline_buffer = fsb2;
         free_scanline = true;
 #endif
@@ -875,25 +837,38 @@ static void __video_time_critical_func(prepare_for_vblank_scanline_irqs_enabled)
 
     uint32_t save = spin_lock_blocking(shared_state.scanline.lock);
     DEBUG_PINS_SET(video_timing, 1);
-    full_scanline_buffer_t *local_free_list = NULL;
+    scanvideo_scanline_queue_entry_t *local_free_list = NULL;
 
     if (!shared_state.scanline.in_vblank) {
         shared_state.scanline.in_vblank = true;
         shared_state.scanline.y_repeat_index = 0;
 
         // generally this should already have wrapped, but may not have just after a sync
-        if (scanvideo_scanline_number(shared_state.scanline.next_scanline_id) != 0) {
-            // set up for scanline 0 of the next frame when we come out of vblank
+        uint first_scanline_number = next_frame_first_scanline_number();
+        if (scanvideo_scanline_number(shared_state.scanline.next_scanline_id) != first_scanline_number) {
+            // set up for the first scanline of the next frame when we come out of vblank
             shared_state.scanline.next_scanline_id =
-                    (scanvideo_frame_number(shared_state.scanline.next_scanline_id) + 1u) << 16u;
-            shared_state.scanline.y_repeat_target = _scanline_repeat_count_fn(shared_state.scanline.next_scanline_id) * video_mode.yscale;
+                    ((scanvideo_frame_number(shared_state.scanline.next_scanline_id) + 1u) << 16u) |
+                    first_scanline_number;
+            shared_state.scanline.y_repeat_target = _scanline_repeat_count_fn(shared_state.scanline.next_scanline_id) * scanline_repeat_scale();
+        }
+        if (mode_change.pending) {
+            apply_mode_change_locked();
         }
+#if PICO_SCANVIDEO_FRAMEBUFFER_SCANOUT
+        // the last active scanline is complete, so this is the tear free point to flip
+        if (framebuffer_state.flip_pending) {
+            framebuffer_state.displayed = framebuffer_state.pending;
+            framebuffer_state.flip_pending = false;
+            framebuffer_state.stats.flips++;
+        }
+#endif
 
 
         signal = true;
     }
 
-    if (!shared_state.scanline.current_scanline_buffer || is_scanline_after(shared_state.scanline.next_scanline_id,
+    if (!shared_state.scanline.current_scanline_buffer || scanvideo_scanline_id_is_after(shared_state.scanline.next_scanline_id,
                                                                             shared_state.scanline.current_scanline_buffer->core.scanline_id)) {
         // if we had a scanline buffer still (which was in the past, unset it and make sure it will be freed
         // before we attempt to relatch which only does something when csb == NULL)
@@ -917,8 +892,36 @@ static void __video_time_critical_func(prepare_for_vblank_scanline_irqs_enabled)
     }
 }
 
-#define setup_dma_states_vblank() if (true) { dma_states[0] = timing_state.a_vblank; dma_states[1] = timing_state.b1; dma_states[2] = timing_state.b2; dma_states[3] = timing_state.c_vblank; } else __builtin_unreachable()
-#define setup_dma_states_no_vblank() if (true) { dma_states[0] = timing_state.a; dma_states[1] = timing_state.b1; dma_states[2] = timing_state.b2; dma_states[3] = timing_state.c; } else __builtin_unreachable()
+#define setup_dma_states_vblank() if (true) { dma_states[0] = timing_state.a_vblank; dma_states[1] = timing_state.b1; dma_states[2] = timing_state.b2; dma_states[3] = timing_state.c_vblank; timing_state.dma_state_count = 4; } else __builtin_unreachable()
+#define setup_dma_states_vblank_half_line() if (true) { dma_states[0] = timing_state.a_vblank; dma_states[1] = timing_state.b1; dma_states[2] = timing_state.b2; dma_states[3] = timing_state.c_vblank_half1; dma_states[4] = timing_state.c_vblank_half2; timing_state.dma_state_count = 5; } else __builtin_unreachable()
+#define setup_dma_states_no_vblank() if (true) { dma_states[0] = timing_state.a; dma_states[1] = timing_state.b1; dma_states[2] = timing_state.b2; dma_states[3] = timing_state.c; timing_state.dma_state_count = 4; } else __builtin_unreachable()
+
+static inline void set_clock_down(uint16_t clock_down_times_2) {
+    video_clock_down_times_2 = clock_down_times_2;
+    uint16_t div_int = clock_down_times_2 / 2;
+    uint8_t div_frac = (uint8_t) ((clock_down_times_2 & 1u) << 7u);
+    pio_sm_set_clkdiv_int_frac(video_pio, PICO_SCANVIDEO_TIMING_SM, div_int, div_frac);
+    pio_sm_set_clkdiv_int_frac(video_pio, PICO_SCANVIDEO_SCANLINE_SM, div_int, div_frac);
+#if PICO_SCANVIDEO_PLANE_COUNT > 1
+    pio_sm_set_clkdiv_int_frac(video_pio, PICO_SCANVIDEO_SCANLINE_SM2, div_int, div_frac);
+#if PICO_SCANVIDEO_PLANE_COUNT > 2
+    pio_sm_set_clkdiv_int_frac(video_pio, PICO_SCANVIDEO_SCANLINE_SM3, div_int, div_frac);
+#endif
+#endif
+}
+
+// called at the start of a frame (from the point of view of the timing SM FIFO, so actually a couple of scanlines
+// before the end of vblank); the vsync pulse is over, so the vertical counts can change safely. The lines already
+// in the FIFO are output with the new clock divider, so at worst the last vblank lines have odd lengths
+static inline void apply_timing_change() {
+    __builtin_memcpy(&timing_state, &timing_change.state, TIMING_STATE_PARAMS_SIZE);
+    timing_state.vsync_bits = timing_state.vsync_bits_no_pulse;
+    timing_state.field = 0;
+    if (timing_change.clock_down_times_2 != video_clock_down_times_2) {
+        set_clock_down(timing_change.clock_down_times_2);
+    }
+    timing_change.pending = false;
+}
 
 static inline void top_up_timing_pio_fifo() {
     // todo better irq reset ... we are seeing irq get set again, handled in this loop, then we re-enter here when we don't need to
@@ -926,28 +929,54 @@ static inline void top_up_timing_pio_fifo() {
     while (!(video_pio->fstat & (1u << (PICO_SCANVIDEO_TIMING_SM + PIO_FSTAT_TXFULL_LSB)))) {
         DEBUG_PINS_XOR(video_irq, 1);
         DEBUG_PINS_XOR(video_irq, 1);
-        pio_sm_put(video_pio, PICO_SCANVIDEO_TIMING_SM, dma_states[timing_state.dma_state_index] | timing_state.vsync_bits);
+        // (xor rather than or, so that a state with the vsync bit set toggles vsync)
+        pio_sm_put(video_pio, PICO_SCANVIDEO_TIMING_SM, dma_states[timing_state.dma_state_index] ^ timing_state.vsync_bits);
         // todo simplify this now we have a1, a2, b, c
         // todo display enable (only goes positive on start of screen)
 
         // todo right now we are fixed... make this generic for timing and improve
-        if (++timing_state.dma_state_index >= DMA_STATE_COUNT) {
+        if (++timing_state.dma_state_index >= timing_state.dma_state_count) {
             timing_state.dma_state_index = 0;
+            // doublescan outputs the same states for a second line before moving on
+            if (timing_state.doublescan && (timing_state.line_repeat ^= 1u)) continue;
             timing_state.timing_scanline++;
 
             // todo check code and put these in a current state struct
             if (timing_state.timing_scanline >= timing_state.v_active) {
-                if (timing_state.timing_scanline >= timing_state.v_total) {
+                // the odd field of interlaced timing is one line longer
+                if (timing_state.timing_scanline >= timing_state.v_total + timing_state.field) {
                     timing_state.timing_scanline = 0;
+                    if (timing_change.pending) {
+                        apply_timing_change();
+                    } else {
+                        timing_state.field ^= timing_state.interlaced;
+                    }
                     // active display - gives irq 0 and irq 4
                     setup_dma_states_no_vblank();
-                } else if (timing_state.timing_scanline <= timing_state.v_pulse_end) {
+                } else if (timing_state.timing_scanline <= timing_state.v_pulse_end + timing_state.field) {
                     if (timing_state.timing_scanline == timing_state.v_active) {
                         setup_dma_states_vblank();
-                    } else if (timing_state.timing_scanline == timing_state.v_pulse_start) {
-                        timing_state.vsync_bits = timing_state.vsync_bits_pulse;
-                    } else if (timing_state.timing_scanline == timing_state.v_pulse_end) {
-                        timing_state.vsync_bits = timing_state.vsync_bits_no_pulse;
+                    }
+                    if (!timing_state.field) {
+                        if (timing_state.timing_scanline == timing_state.v_pulse_start) {
+                            timing_state.vsync_bits = timing_state.vsync_bits_pulse;
+                        } else if (timing_state.timing_scanline == timing_state.v_pulse_end) {
+                            timing_state.vsync_bits = timing_state.vsync_bits_no_pulse;
+                        }
+                    } else {
+                        // the odd field's vsync edges are half way along the lines where the even field's are, so
+                        // those lines toggle vsync half way, and the line after carries on with the new level
+                        if (timing_state.timing_scanline == timing_state.v_pulse_start + 1) {
+                            timing_state.vsync_bits = timing_state.vsync_bits_pulse;
+                        } else if (timing_state.timing_scanline == timing_state.v_pulse_end + 1) {
+                            timing_state.vsync_bits = timing_state.vsync_bits_no_pulse;
+                        }
+                        if (timing_state.timing_scanline == timing_state.v_pulse_start ||
+                            timing_state.timing_scanline == timing_state.v_pulse_end) {
+                            setup_dma_states_vblank_half_line();
+                        } else if (timing_state.timing_scanline > timing_state.v_pulse_start) {
+                            setup_dma_states_vblank();
+                        }
                     }
                 }
             }
@@ -955,6 +984,51 @@ static inline void top_up_timing_pio_fifo() {
     }
 }
 
+static inline uint16_t relocate_instruction(uint16_t instr, uint offset) {
+    // as pio_add_program does, jmp targets are relative to the start of the program
+    return (instr & 0xe000u) ? instr : (uint16_t) (instr + offset);
+}
+
+// Caller must own the scanline lock. This is called at the start of vblank (or directly if timing isn't enabled),
+// when the scanline SMs are idle
+static void __video_time_critical_func(apply_mode_change_locked)() {
+    video_mode = mode_change.mode;
+    set_missing_scanline_width(video_mode.width);
+    _missing_scanline_buffer.core = mode_change.missing_scanline_buffer;
+    _missing_scanline_buffer.core.status = SCANLINE_OK;
+    // only the delays differ, so there are just a handful of instructions to rewrite
+    for (uint i = 0; i < video_mode.pio_program->program->length; i++) {
+        if (mode_change.instructions[i] != video_program_instructions[i]) {
+            video_program_instructions[i] = mode_change.instructions[i];
+            video_pio->instr_mem[video_program_load_offset + i] = relocate_instruction(mode_change.instructions[i],
+                                                                                      video_program_load_offset);
+        }
+    }
+    bool timing_changed = __builtin_memcmp(&mode_change.timing, &timing_state, TIMING_STATE_PARAMS_SIZE) ||
+                          mode_change.clock_down_times_2 != video_clock_down_times_2;
+    if (timing_changed) {
+        timing_change.state = mode_change.timing;
+        timing_change.clock_down_times_2 = mode_change.clock_down_times_2;
+        if (video_timing_enabled) {
+            __mem_fence_release();
+            timing_change.pending = true;
+        } else {
+            apply_timing_change();
+            setup_dma_states_vblank();
+        }
+    }
+    if (video_timing_enabled) {
+        // skip a frame number, so that anything generated (or being generated) for the old mode is now in the past
+        // and is discarded. A new timing starts from its even field
+        shared_state.scanline.next_scanline_id =
+                ((scanvideo_frame_number(shared_state.scanline.next_scanline_id) + 1u) << 16u) |
+                (timing_changed ? 0 : next_frame_first_scanline_number());
+    }
+    shared_state.scanline.y_repeat_target =
+            _scanline_repeat_count_fn(shared_state.scanline.next_scanline_id) * scanline_repeat_scale();
+    mode_change.pending = false;
+}
+
 void __isr __video_most_time_critical_func(isr_pio0_0)() {
 #if PICO_SCANVIDEO_ADJUST_BUS_PRIORITY
     bus_ctrl_hw->priority = VIDEO_ADJUST_BUS_PRIORITY_VAL;
@@ -1092,24 +1166,18 @@ extern scanvideo_scanline_buffer_t *__video_time_critical_func(scanvideo_begin_s
     DEBUG_PINS_SET(video_link, 1);
     DEBUG_PINS_SET(video_generation, 1);
     do {
-        uint32_t save = spin_lock_blocking(shared_state.free_list.lock);
-//        DEBUG_PINS_SET(video_timing, 4);
-        fsb = list_remove_head(&shared_state.free_list.free_list);
-//        DEBUG_PINS_CLR(video_timing, 4);
-        spin_unlock(shared_state.free_list.lock, save);
+        fsb = (full_scanline_buffer_t *) scanvideo_scanline_queue_take_free(&scanline_queue, 1);
 
         if (fsb) {
-            save = spin_lock_blocking(shared_state.scanline.lock);
+            uint32_t save = spin_lock_blocking(shared_state.scanline.lock);
             DEBUG_PINS_SET(video_timing, 1);
-#if PICO_SCANVIDEO_ENABLE_SCANLINE_ASSERTIONS && GENERATING_LIST
-            list_prepend(&shared_state.scanline.generating_list, fsb);
-#endif
+            scanvideo_scanline_queue_locked_begin_generation(&scanline_queue, &fsb->entry);
             // todo improve this algorithm... how far ahead should we be
             // todo i.e. should we skip ahead a bit further if we are perpetually behind - doesn't really help because we'd
             // todo be skipping some scanlines anyway; doesn't really matter which ones at that point
             uint32_t scanline_id = shared_state.scanline.next_scanline_id;
 
-            if (!is_scanline_after(scanline_id, shared_state.scanline.last_scanline_id)) {
+            if (!scanvideo_scanline_id_is_after(scanline_id, shared_state.scanline.last_scanline_id)) {
                 // we are buffering ahead of the display
                 scanline_id = scanline_id_after(shared_state.scanline.last_scanline_id);
             }
@@ -1127,13 +1195,12 @@ extern scanvideo_scanline_buffer_t *__video_time_critical_func(scanvideo_begin_s
 
     DEBUG_PINS_CLR(video_link, 1);
     DEBUG_PINS_CLR(video_generation, 1);
+    if (!fsb) return NULL;
 #if PICO_SCANVIDEO_LINKED_SCANLINE_BUFFERS
-    if (fsb) {
-        fsb->core.link = 0;
-        fsb->core.link_after = 0;
-    }
+    fsb->core.link = 0;
+    fsb->core.link_after = 0;
 #endif
-    return (scanvideo_scanline_buffer_t *) fsb;
+    return &fsb->core;
 }
 
 // todo remove this in favor of using scanvideo_begin_scanline_generation_link
@@ -1144,39 +1211,24 @@ scanvideo_scanline_buffer_t *__video_time_critical_func(scanvideo_begin_scanline
     DEBUG_PINS_SET(video_generation, 1);
     do
     {
-        uint32_t save = spin_lock_blocking(shared_state.free_list.lock);
         DEBUG_PINS_SET(video_timing, 4);
-        fsb = shared_state.free_list.free_list;
-        full_scanline_buffer_t *fsb2;
-        if (fsb) {
-            fsb2 = fsb->next;
-            if (fsb2) {
-                // unlink both
-                shared_state.free_list.free_list = fsb->next->next;
-                fsb->next = NULL;
-                fsb2->next = NULL;
-            } else {
-                fsb = NULL;
-            }
-        } else {
-            fsb = NULL;
-        }
+        fsb = (full_scanline_buffer_t *) scanvideo_scanline_queue_take_free(&scanline_queue, 2);
         DEBUG_PINS_CLR(video_timing, 4);
-        spin_unlock(shared_state.free_list.lock, save);
         if (fsb)
         {
-            save = spin_lock_blocking(shared_state.scanline.lock);
+            // unlink both
+            full_scanline_buffer_t *fsb2 = (full_scanline_buffer_t *) fsb->entry.next;
+            fsb->entry.next = NULL;
+            uint32_t save = spin_lock_blocking(shared_state.scanline.lock);
             DEBUG_PINS_SET(video_timing, 1);
-#if PICO_SCANVIDEO_ENABLE_SCANLINE_ASSERTIONS && GENERATING_LIST
-            list_prepend(&shared_state.scanline.generating_list, fsb);
-            list_prepend(&shared_state.scanline.generating_list, fsb2);
-#endif
+            scanvideo_scanline_queue_locked_begin_generation(&scanline_queue, &fsb->entry);
+            scanvideo_scanline_queue_locked_begin_generation(&scanline_queue, &fsb2->entry);
             // todo improve this algorithm... how far ahead should we be
             // todo i.e. should we skip ahead a bit further if we are perpetually behind - doesn't really help because we'd
             // todo be skipping some scanlines anyway; doesn't really matter which ones at that point
             uint32_t scanline_id = shared_state.scanline.next_scanline_id;
 
-            if (!is_scanline_after(scanline_id, shared_state.scanline.last_scanline_id))
+            if (!scanvideo_scanline_id_is_after(scanline_id, shared_state.scanline.last_scanline_id))
             {
                 // we are buffering ahead of the display
                 scanline_id = scanline_id_after(shared_state.scanline.last_scanline_id);
@@ -1201,7 +1253,7 @@ scanvideo_scanline_buffer_t *__video_time_critical_func(scanvideo_begin_scanline
     while (block);
 
     DEBUG_PINS_CLR(video_generation, 1);
-    return (scanvideo_scanline_buffer_t *) fsb;
+    return fsb ? &fsb->core : NULL;
 }
 
 #if PICO_SCANVIDEO_LINKED_SCANLINE_BUFFERS
@@ -1212,43 +1264,25 @@ scanvideo_scanline_buffer_t *__video_time_critical_func(scanvideo_begin_scanline
     DEBUG_PINS_SET(video_link, 1);
     DEBUG_PINS_SET(video_generation, 1);
     do {
-        uint32_t save = spin_lock_blocking(shared_state.free_list.lock);
-//        DEBUG_PINS_SET(video_timing, 4);
-        fsb = shared_state.free_list.free_list;
-        if (fsb) {
-            full_scanline_buffer_t *fsb_tail = fsb;
-            for(uint i=1; i<n && fsb_tail; i++) {
-                fsb_tail = fsb_tail->next;
-            }
-            if (fsb_tail) {
-                shared_state.free_list.free_list = fsb_tail->next;
-                fsb_tail->next = NULL;
-            } else {
-                fsb = NULL;
-            }
-        }
-//        DEBUG_PINS_CLR(video_timing, 4);
-        spin_unlock(shared_state.free_list.lock, save);
+        fsb = (full_scanline_buffer_t *) scanvideo_scanline_queue_take_free(&scanline_queue, n);
 
         if (fsb) {
             full_scanline_buffer_t *fsb_tail = fsb;
             while (fsb_tail) {
-                full_scanline_buffer_t *fsb_next = fsb_tail->next;
+                full_scanline_buffer_t *fsb_next = (full_scanline_buffer_t *) fsb_tail->entry.next;
                 fsb_tail->core.link = fsb_next ? &fsb_next->core : NULL;
-                fsb_tail->next = NULL;
+                fsb_tail->entry.next = NULL;
                 fsb_tail = fsb_next;
             }
-            save = spin_lock_blocking(shared_state.scanline.lock);
+            uint32_t save = spin_lock_blocking(shared_state.scanline.lock);
             DEBUG_PINS_SET(video_timing, 1);
-#if PICO_SCANVIDEO_ENABLE_SCANLINE_ASSERTIONS && GENERATING_LIST
-            list_prepend(&shared_state.scanline.generating_list, fsb);
-#endif
+            scanvideo_scanline_queue_locked_begin_generation(&scanline_queue, &fsb->entry);
             // todo improve this algorithm... how far ahead should we be
             // todo i.e. should we skip ahead a bit further if we are perpetually behind - doesn't really help because we'd
             // todo be skipping some scanlines anyway; doesn't really matter which ones at that point
             uint32_t scanline_id = shared_state.scanline.next_scanline_id;
 
-            if (!is_scanline_after(scanline_id, shared_state.scanline.last_scanline_id)) {
+            if (!scanvideo_scanline_id_is_after(scanline_id, shared_state.scanline.last_scanline_id)) {
                 // we are buffering ahead of the display
                 scanline_id = scanline_id_after(shared_state.scanline.last_scanline_id);
             }
@@ -1271,22 +1305,22 @@ scanvideo_scanline_buffer_t *__video_time_critical_func(scanvideo_begin_scanline
 
     DEBUG_PINS_CLR(video_link, 1);
     DEBUG_PINS_CLR(video_generation, 1);
-    if (fsb) fsb->core.link_after = 0;
-    return (scanvideo_scanline_buffer_t *) fsb;
+    if (!fsb) return NULL;
+    fsb->core.link_after = 0;
+    return &fsb->core;
 }
 #endif
 
 extern void __video_time_critical_func(scanvideo_end_scanline_generation)(
         scanvideo_scanline_buffer_t *scanline_buffer) {
     DEBUG_PINS_SET(video_generation, 2);
-    full_scanline_buffer_t *fsb = (full_scanline_buffer_t *) scanline_buffer;
+    full_scanline_buffer_t *fsb = fsb_from_core(scanline_buffer);
     uint32_t save = spin_lock_blocking(shared_state.scanline.lock);
-#if PICO_SCANVIDEO_ENABLE_SCANLINE_ASSERTIONS && GENERATING_LIST
-    list_remove(&shared_state.scanline.generating_list, fsb);
-#endif
-    list_insert_ascending(&shared_state.scanline.generated_ascending_scanline_id_list,
-                          &shared_state.scanline.generated_ascending_scanline_id_list_tail, fsb);
+    // the buffer comes straight back if the display has already passed its scanline
+    scanvideo_scanline_queue_entry_t *too_late = scanvideo_scanline_queue_locked_add_generated(
+            &scanline_queue, &fsb->entry, scanline_buffer->scanline_id);
     spin_unlock(shared_state.scanline.lock, save);
+    free_local_free_list_irqs_enabled(too_late);
     DEBUG_PINS_CLR(video_generation, 2);
 }
 
@@ -1316,26 +1350,101 @@ static pio_program_t copy_program(const pio_program_t *program, uint16_t *instru
     return copy;
 }
 
+// fill in the timing words for a timing (everything before vsync_bits)
+static void compute_timing_state(struct timing_state *ts, const scanvideo_timing_t *timing) {
+#if PICO_SCANVIDEO_ENABLE_CLOCK_PIN
+    uint16_t side_set_xor = timing->clock_polarity ? 0x1000 : 0; // flip the top side set bit
+#else
+    const uint16_t side_set_mask = 0xE0FF; // Remove the side set / delay bits
+#endif
+    ts->v_total = timing->v_total;
+    ts->v_active = timing->v_active;
+    ts->v_pulse_start = timing->v_active + timing->v_front_porch;
+    ts->v_pulse_end = ts->v_pulse_start + timing->v_pulse;
+    const uint32_t vsync_bit = 0x40000000;
+    ts->vsync_bits_pulse = timing->v_sync_polarity ? 0 : vsync_bit;
+    ts->vsync_bits_no_pulse = timing->v_sync_polarity ? vsync_bit : 0;
+
+    // these are read bitwise backwards (lsb to msb) by PIO pogram
+
+    // we can probably do smaller
+#define HTIMING_MIN 8
+
+#define TIMING_CYCLE 3u
+#if PICO_SCANVIDEO_ENABLE_CLOCK_PIN
+#define timing_encode(state, length, pins) ((video_htiming_states_program.instructions[state] ^ side_set_xor)| (((uint32_t)(length) - TIMING_CYCLE) << 16u) | ((uint32_t)(pins) << 29u))
+#else
+#define timing_encode(state, length, pins) ((video_htiming_states_program.instructions[state] & side_set_mask)| (((uint32_t)(length) - TIMING_CYCLE) << 16u) | ((uint32_t)(pins) << 29u))
+#endif
+#define A_CMD SET_IRQ_0
+#define A_CMD_VBLANK SET_IRQ_1
+#define B1_CMD CLEAR_IRQ_SCANLINE
+#define B2_CMD CLEAR_IRQ_SCANLINE
+#define C_CMD SET_IRQ_SCANLINE
+#define C_CMD_VBLANK CLEAR_IRQ_SCANLINE
+
+    int h_sync_bit = timing->h_sync_polarity ? 0 : 1;
+    ts->a = timing_encode(A_CMD, 4, h_sync_bit);
+    static_assert(HTIMING_MIN >= 4, "");
+    ts->a_vblank = timing_encode(A_CMD_VBLANK, 4, h_sync_bit);
+    int h_back_porch = timing->h_total - timing->h_front_porch - timing->h_pulse - timing->h_active;
+
+    valid_params_if(SCANVIDEO_DPI, timing->h_pulse - 4 >= HTIMING_MIN);
+    ts->b1 = timing_encode(B1_CMD, timing->h_pulse - 4, h_sync_bit);
+
+    // todo decide on what these should be - we should really be asserting the timings
+    //
+    // todo note that the placement of the active scanline IRQ from the timing program is super important.
+    //  if it gets moved too much (or indeed at all) it may be that there are problems with DMA/SM IRQ
+    //  overlap, which may require the addition of a separate timing state for the prepare for scanline
+    //  (separate from the needs of setting the hsync pulse)
+    valid_params_if(SCANVIDEO_DPI, timing->h_active >= HTIMING_MIN);
+    //assert(timing->h_front_porch >= HTIMING_MIN);
+    valid_params_if(SCANVIDEO_DPI, h_back_porch >= HTIMING_MIN);
+    valid_params_if(SCANVIDEO_DPI, (timing->h_total - h_back_porch - timing->h_pulse) >= HTIMING_MIN);
+    ts->b2 = timing_encode(B2_CMD, h_back_porch, !h_sync_bit);
+    ts->c = timing_encode(C_CMD, timing->h_total - h_back_porch - timing->h_pulse, 4 | !h_sync_bit);
+    ts->c_vblank = timing_encode(C_CMD_VBLANK, timing->h_total - h_back_porch - timing->h_pulse, !h_sync_bit);
+
+    valid_params_if(SCANVIDEO_DPI, !(timing->interlaced && timing->doublescan));
+    ts->interlaced = timing->interlaced ? 1 : 0;
+    ts->doublescan = timing->doublescan ? 1 : 0;
+    if (ts->interlaced) {
+        int half1 = timing->h_total / 2 - timing->h_pulse - h_back_porch;
+        int half2 = timing->h_total - h_back_porch - timing->h_pulse - half1;
+        valid_params_if(SCANVIDEO_DPI, half1 >= HTIMING_MIN && half2 >= HTIMING_MIN);
+        ts->c_vblank_half1 = timing_encode(C_CMD_VBLANK, half1, !h_sync_bit);
+        ts->c_vblank_half2 = timing_encode(C_CMD_VBLANK, half2, 2 | !h_sync_bit);
+    } else {
+        ts->c_vblank_half1 = ts->c_vblank_half2 = 0;
+    }
+}
+
 bool scanvideo_setup_with_timing(const scanvideo_mode_t *mode, const scanvideo_timing_t *timing) {
     __builtin_memset(&shared_state, 0, sizeof(shared_state));
     // init non zero members
     // todo pass scanline buffers and size, or allow client to allocate
     shared_state.scanline.lock = spin_lock_init(PICO_SPINLOCK_ID_VIDEO_SCANLINE_LOCK);
     shared_state.dma.lock = spin_lock_init(PICO_SPINLOCK_ID_VIDEO_DMA_LOCK);
-    shared_state.free_list.lock = spin_lock_init(PICO_SPINLOCK_ID_VIDEO_FREE_LIST_LOCK);
-    shared_state.in_use.lock = spin_lock_init(PICO_SPINLOCK_ID_VIDEO_IN_USE_LOCK);
+    scanvideo_scanline_queue_init(&scanline_queue, shared_state.scanline.lock,
+                                  spin_lock_init(PICO_SPINLOCK_ID_VIDEO_IN_USE_LOCK),
+                                  spin_lock_init(PICO_SPINLOCK_ID_VIDEO_FREE_LIST_LOCK));
     shared_state.scanline.last_scanline_id = 0xffffffff;
+#if PICO_SCANVIDEO_FRAMEBUFFER_SCANOUT
+    __builtin_memset(&framebuffer_state, 0, sizeof(framebuffer_state));
+#endif
+    mode_change.pending = false;
+    timing_change.pending = false;
 
     video_mode = *mode;
     video_mode.default_timing = timing;
 
-    static_assert(BPP == 16, ""); // can't do 8 bit now because of pixel count
     // this is no longer necessary
     //assert(!(mode->width & 1));
     if (!video_mode.yscale_denominator) video_mode.yscale_denominator = 1;
     // todo is this still necessary?
     //invalid_params_if(SCANVIDEO_DPI, (timing->v_active % mode->yscale));
-    ((uint16_t *) (_missing_scanline_data))[2] = mode->width / 2 - 3;
+    set_missing_scanline_width(mode->width);
 #if PICO_SCANVIDEO_PLANE1_VARIABLE_FRAGMENT_DMA || PICO_SCANVIDEO_PLANE2_VARIABLE_FRAGMENT_DMA
     variable_fragment_missing_scanline_data_chain[1] = native_safe_hw_ptr(_missing_scanline_data);
 #endif
@@ -1358,10 +1467,10 @@ bool scanvideo_setup_with_timing(const scanvideo_mode_t *mode, const scanvideo_t
         scanline_buffers[i].core.data3_max = PICO_SCANVIDEO_MAX_SCANLINE_BUFFER3_WORDS;
 #endif
 #endif
-        scanline_buffers[i].next = i != PICO_SCANVIDEO_SCANLINE_BUFFER_COUNT - 1 ? &scanline_buffers[i + 1] : NULL;
     }
-
-    shared_state.free_list.free_list = &scanline_buffers[0];
+    for (int i = PICO_SCANVIDEO_SCANLINE_BUFFER_COUNT - 1; i >= 0; i--) {
+        scanvideo_scanline_queue_add_buffer(&scanline_queue, &scanline_buffers[i].entry);
+    }
     // shared state init complete - probably overkill
     __mem_fence_release();
 
@@ -1415,8 +1524,11 @@ bool scanvideo_setup_with_timing(const scanvideo_mode_t *mode, const scanvideo_t
 #endif
 #endif
 
-    valid_params_if(SCANVIDEO_DPI, mode->width * mode->xscale <= timing->h_active);
-    valid_params_if(SCANVIDEO_DPI, mode->height * mode->yscale <= timing->v_active * video_mode.yscale_denominator);
+    valid_params_if(SCANVIDEO_DPI, mode->width * mode->xscale <=
+                                   timing->h_active * (mode->xscale_denominator ? mode->xscale_denominator : 1u));
+    // an interlaced frame has the lines of both fields
+    valid_params_if(SCANVIDEO_DPI, mode->height * mode->yscale <=
+                                   (timing->v_active << timing->interlaced) * video_mode.yscale_denominator);
 
     uint16_t instructions[32];
     pio_program_t modified_program = copy_program(mode->pio_program->program, instructions,
@@ -1426,6 +1538,7 @@ bool scanvideo_setup_with_timing(const scanvideo_mode_t *mode, const scanvideo_t
         valid_params_if(SCANVIDEO_DPI, false);
     }
     valid_params_if(SCANVIDEO_DPI, _missing_scanline_buffer.core.data && _missing_scanline_buffer.core.data_used);
+    __builtin_memcpy(video_program_instructions, instructions, sizeof(video_program_instructions));
     video_program_load_offset = pio_add_program(video_pio, &modified_program);
 
 #if PICO_SCANVIDEO_ENABLE_VIDEO_RECOVERY
@@ -1601,84 +1714,83 @@ bool scanvideo_setup_with_timing(const scanvideo_mode_t *mode, const scanvideo_t
     //assert(timing->v_pulse == 2);
     //assert(timing->v_total == 500);
 
-    timing_state.v_total = timing->v_total;
-    timing_state.v_active = timing->v_active;
-    timing_state.v_pulse_start = timing->v_active + timing->v_front_porch;
-    timing_state.v_pulse_end = timing_state.v_pulse_start + timing->v_pulse;
-    const uint32_t vsync_bit = 0x40000000;
-    timing_state.vsync_bits_pulse = timing->v_sync_polarity ? 0 : vsync_bit;
-    timing_state.vsync_bits_no_pulse = timing->v_sync_polarity ? vsync_bit : 0;
-
-    // these are read bitwise backwards (lsb to msb) by PIO pogram
-
-    // we can probably do smaller
-#define HTIMING_MIN 8
-
-#define TIMING_CYCLE 3u
-#if PICO_SCANVIDEO_ENABLE_CLOCK_PIN
-#define timing_encode(state, length, pins) ((video_htiming_states_program.instructions[state] ^ side_set_xor)| (((uint32_t)(length) - TIMING_CYCLE) << 16u) | ((uint32_t)(pins) << 29u))
-#else
-#define timing_encode(state, length, pins) ((video_htiming_states_program.instructions[state] & side_set_mask)| (((uint32_t)(length) - TIMING_CYCLE) << 16u) | ((uint32_t)(pins) << 29u))
-#endif
-#define A_CMD SET_IRQ_0
-#define A_CMD_VBLANK SET_IRQ_1
-#define B1_CMD CLEAR_IRQ_SCANLINE
-#define B2_CMD CLEAR_IRQ_SCANLINE
-#define C_CMD SET_IRQ_SCANLINE
-#define C_CMD_VBLANK CLEAR_IRQ_SCANLINE
-
-    int h_sync_bit = timing->h_sync_polarity ? 0 : 1;
-    timing_state.a = timing_encode(A_CMD, 4, h_sync_bit);
-    static_assert(HTIMING_MIN >= 4, "");
-    timing_state.a_vblank = timing_encode(A_CMD_VBLANK, 4, h_sync_bit);
-    int h_back_porch = timing->h_total - timing->h_front_porch - timing->h_pulse - timing->h_active;
-
-    valid_params_if(SCANVIDEO_DPI, timing->h_pulse - 4 >= HTIMING_MIN);
-    timing_state.b1 = timing_encode(B1_CMD, timing->h_pulse - 4, h_sync_bit);
-
-    // todo decide on what these should be - we should really be asserting the timings
-    //
-    // todo note that the placement of the active scanline IRQ from the timing program is super important.
-    //  if it gets moved too much (or indeed at all) it may be that there are problems with DMA/SM IRQ
-    //  overlap, which may require the addition of a separate timing state for the prepare for scanline
-    //  (separate from the needs of setting the hsync pulse)
-    valid_params_if(SCANVIDEO_DPI, timing->h_active >= HTIMING_MIN);
-    //assert(timing->h_front_porch >= HTIMING_MIN);
-    valid_params_if(SCANVIDEO_DPI, h_back_porch >= HTIMING_MIN);
-    valid_params_if(SCANVIDEO_DPI, (timing->h_total - h_back_porch - timing->h_pulse) >= HTIMING_MIN);
-    timing_state.b2 = timing_encode(B2_CMD, h_back_porch, !h_sync_bit);
-    timing_state.c = timing_encode(C_CMD, timing->h_total - h_back_porch - timing->h_pulse, 4 | !h_sync_bit);
-    timing_state.c_vblank = timing_encode(C_CMD_VBLANK, timing->h_total - h_back_porch - timing->h_pulse, !h_sync_bit);
+    compute_timing_state(&timing_state, timing);
 
     // this is two scanlines in vblank
     setup_dma_states_vblank();
     timing_state.vsync_bits = timing_state.vsync_bits_no_pulse;
+    timing_state.field = 0;
+    timing_state.line_repeat = 0;
     scanvideo_set_scanline_repeat_fn(NULL);
     return true;
 }
 
+bool scanvideo_set_display_mode(const scanvideo_mode_t *mode) {
+    return scanvideo_set_display_mode_with_timing(mode, mode->default_timing);
+}
+
+bool scanvideo_set_display_mode_with_timing(const scanvideo_mode_t *mode, const scanvideo_timing_t *timing) {
+    // the PIO programs stay loaded, and DMA channels claimed, so only the delays in the scanline program and the
+    // timing state words may change
+    if (mode->pio_program != video_mode.pio_program) return false;
+    if (timing->clock_polarity != video_mode.default_timing->clock_polarity) return false;
+    uint16_t yscale_denominator = mode->yscale_denominator ? mode->yscale_denominator : 1;
+    uint xscale_denominator = mode->xscale_denominator ? mode->xscale_denominator : 1;
+    if (mode->width * mode->xscale > timing->h_active * xscale_denominator ||
+        mode->height * mode->yscale > (timing->v_active << timing->interlaced) * yscale_denominator) {
+        return false;
+    }
+    uint sys_clk = clock_get_hz(clk_sys);
+    uint clock_down_times_2 = sys_clk / timing->clock_freq;
+    if (!clock_down_times_2 || clock_down_times_2 > 0xffff || timing->clock_freq != sys_clk / clock_down_times_2) {
+        return false;
+    }
+
+    uint16_t instructions[count_of(video_program_instructions)];
+    copy_program(mode->pio_program->program, instructions, count_of(instructions));
+    scanvideo_scanline_buffer_t missing_scanline_buffer;
+    __builtin_memset(&missing_scanline_buffer, 0, sizeof(missing_scanline_buffer));
+    if (!mode->pio_program->adapt_for_mode(mode->pio_program, mode, &missing_scanline_buffer, instructions)) {
+        return false;
+    }
+    struct timing_state new_timing;
+    compute_timing_state(&new_timing, timing);
+
+    uint32_t save = spin_lock_blocking(shared_state.scanline.lock);
+    mode_change.mode = *mode;
+    mode_change.mode.default_timing = timing;
+    mode_change.mode.yscale_denominator = yscale_denominator;
+    __builtin_memcpy(mode_change.instructions, instructions, sizeof(instructions));
+    mode_change.missing_scanline_buffer = missing_scanline_buffer;
+    mode_change.timing = new_timing;
+    mode_change.clock_down_times_2 = (uint16_t) clock_down_times_2;
+    mode_change.pending = true;
+    if (!video_timing_enabled) {
+        // no vblank to wait for
+        apply_mode_change_locked();
+    }
+    spin_unlock(shared_state.scanline.lock, save);
+    return true;
+}
+
+bool scanvideo_display_mode_change_pending() {
+    return *(volatile bool *) &mode_change.pending;
+}
+
 bool video_24mhz_composable_adapt_for_mode(const scanvideo_pio_program_t *program, const scanvideo_mode_t *mode,
                                            scanvideo_scanline_buffer_t *missing_scanline_buffer,
                                            uint16_t *modifiable_instructions) {
-    int delay0 = 2 * mode->xscale - 2;
-    int delay1 = delay0 + 1;
-    valid_params_if(SCANVIDEO_DPI, delay0 <= 31);
-    valid_params_if(SCANVIDEO_DPI, delay1 <= 31);
-
-    // todo macro-ify this
-    modifiable_instructions[video_24mhz_composable_program_extern(delay_a_1)] |= (unsigned) delay1 << 8u;
-    modifiable_instructions[video_24mhz_composable_program_extern(delay_b_1)] |= (unsigned) delay1 << 8u;
-    modifiable_instructions[video_24mhz_composable_program_extern(delay_c_0)] |= (unsigned) delay0 << 8u;
-    modifiable_instructions[video_24mhz_composable_program_extern(delay_d_0)] |= (unsigned) delay0 << 8u;
-    modifiable_instructions[video_24mhz_composable_program_extern(delay_e_0)] |= (unsigned) delay0 << 8u;
-    modifiable_instructions[video_24mhz_composable_program_extern(delay_f_1)] |= (unsigned) delay1 << 8u;
-#if !PICO_SCANVIDEO_USE_RAW1P_2CYCLE
-    modifiable_instructions[video_24mhz_composable_program_extern(delay_g_0)] |= (unsigned) delay0 << 8u;
-#else
-    int delay_half = mode->xscale - 2;
-    modifiable_instructions[video_24mhz_composable_program_extern(delay_g_0)] |= (unsigned)delay_half << 8u;
-#endif
-    modifiable_instructions[video_24mhz_composable_program_extern(delay_h_0)] |= (unsigned) delay0 << 8u;
+    // the token size is fixed when the program is built
+    if ((mode->bpp ? mode->bpp : 16) != PICO_SCANVIDEO_BPP) return false;
+#if PICO_SCANVIDEO_BPP == 8
+    // the missing scanline is two color runs covering half the width
+    if (mode->width < 24 || mode->width / 2 - mode->width / 4 > COMPOSABLE_MAX_RUN_8BPP) return false;
+#endif
+    uint xscale_denominator = mode->xscale_denominator ? mode->xscale_denominator : 1;
+    if (mode->width % xscale_denominator ||
+        !composable_set_program_delays(modifiable_instructions, mode->xscale, xscale_denominator)) {
+        return false;
+    }
 
 #if !PICO_SCANVIDEO_PLANE1_FRAGMENT_DMA
     missing_scanline_buffer->data = _missing_scanline_data;
@@ -1801,13 +1913,72 @@ void scanvideo_wait_for_vblank() {
     sem_acquire_blocking(&vblank_begin);
 }
 
+#if PICO_SCANVIDEO_FRAMEBUFFER_SCANOUT
+void scanvideo_framebuffer_init(scanvideo_framebuffer_t *fb, const uint16_t *pixels, uint width, uint height,
+                                uint stride_words, uint32_t *chain) {
+    invalid_params_if(SCANVIDEO_DPI, width < 4 || (width & 1u));
+    invalid_params_if(SCANVIDEO_DPI, stride_words < width / 2);
+    invalid_params_if(SCANVIDEO_DPI, 3u & (uintptr_t)pixels);
+    fb->pixels = pixels;
+    fb->chain = chain;
+    fb->width = (uint16_t) width;
+    fb->height = (uint16_t) height;
+    fb->stride_words = stride_words;
+    // | jmp raw_run | pixel 0 || width-3 | pixel 1 || <the other width-2 pixels from the framebuffer>
+    // the header holds the first word of the row, so the pixels taken from the framebuffer are still word aligned
+    const uint32_t *row = (const uint32_t *) pixels;
+    for (uint y = 0; y < height; y++) {
+        chain[0] = count_of(framebuffer_row_header);
+        chain[1] = native_safe_hw_ptr(framebuffer_row_header);
+        chain[2] = width / 2 - 1;
+        chain[3] = native_safe_hw_ptr(row + 1);
+        chain[4] = count_of(framebuffer_row_trailer);
+        chain[5] = native_safe_hw_ptr(framebuffer_row_trailer);
+        chain[6] = 0;
+        chain[7] = 0;
+        chain += PICO_SCANVIDEO_FRAMEBUFFER_CHAIN_WORDS_PER_ROW;
+        row += stride_words;
+    }
+}
+
+void scanvideo_framebuffer_show(const scanvideo_framebuffer_t *fb) {
+    uint32_t save = spin_lock_blocking(shared_state.scanline.lock);
+    if (video_timing_enabled) {
+        framebuffer_state.pending = fb;
+        framebuffer_state.flip_pending = true;
+    } else {
+        // no vblank to wait for
+        framebuffer_state.displayed = fb;
+        framebuffer_state.flip_pending = false;
+    }
+    spin_unlock(shared_state.scanline.lock, save);
+}
+
+bool scanvideo_framebuffer_flip_pending() {
+    return *(volatile bool *) &framebuffer_state.flip_pending;
+}
+
+const scanvideo_framebuffer_t *scanvideo_framebuffer_get_displayed() {
+    return *(const scanvideo_framebuffer_t * volatile *) &framebuffer_state.displayed;
+}
+
+void scanvideo_framebuffer_get_stats(scanvideo_framebuffer_stats_t *stats, bool reset) {
+    uint32_t save = spin_lock_blocking(shared_state.scanline.lock);
+    *stats = framebuffer_state.stats;
+    if (reset) {
+        __builtin_memset(&framebuffer_state.stats, 0, sizeof(framebuffer_state.stats));
+    }
+    spin_unlock(shared_state.scanline.lock, save);
+}
+#endif
+
 #ifndef NDEBUG
 // todo this is for composable only atm
 void validate_scanline(const uint32_t *dma_data, uint dma_data_size,
                        uint max_pixels, uint expected_width) {
-    const uint16_t *it = (uint16_t *)dma_data;
+    const scanvideo_composable_token_t *it = (const scanvideo_composable_token_t *)dma_data;
     assert(!(3u&(uintptr_t)dma_data));
-    const uint16_t *const dma_data_end = (uint16_t *)(dma_data + dma_data_size);
+    const scanvideo_composable_token_t *const dma_data_end = (const scanvideo_composable_token_t *)(dma_data + dma_data_size);
     uint16_t *pixel_buffer = 0;
     const uint16_t *const pixels_end = (uint16_t *)(pixel_buffer + max_pixels);
     uint16_t *pixels = pixel_buffer;
@@ -1815,10 +1986,12 @@ void validate_scanline(const uint32_t *dma_data, uint dma_data_size,
     bool done = false;
     bool had_black = false;
     do {
-        uint16_t cmd = *it++;
+        uint32_t cmd = *it++;
         switch (cmd) {
             case video_24mhz_composable_program_extern(end_of_scanline_skip_ALIGN):
+                // the rest of the word (or the next word, if there is none) is skipped
                 it++;
+                while (3u & (uintptr_t) it) it++;
                 // fall thru
             case video_24mhz_composable_program_extern(end_of_scanline_ALIGN):
                 done = ok = true;
@@ -1826,8 +1999,8 @@ void validate_scanline(const uint32_t *dma_data, uint dma_data_size,
             case video_24mhz_composable_program_extern(color_run):
             {
                 it++;
-                uint16_t len = *it++;
-                for(int i=0; i<len+3; i++) {
+                uint32_t len = *it++;
+                for(uint i=0; i<len+3; i++) {
                     assert(pixels < pixels_end);
                     pixels++;
                 }
@@ -1837,8 +2010,8 @@ void validate_scanline(const uint32_t *dma_data, uint dma_data_size,
             {
                 assert(pixels < pixels_end);
                 pixels++; it++;
-                uint16_t len = *it++;
-                for(int i=0; i<len+2; i++) {
+                uint32_t len = *it++;
+                for(uint i=0; i<len+2; i++) {
                     assert(pixels < pixels_end);
                     pixels++; it++;
                 }
@@ -1872,6 +2045,17 @@ void validate_scanline(const uint32_t *dma_data, uint dma_data_size,
                 had_black= !c;
                 break;
             }
+#endif
+#if PICO_SCANVIDEO_ENABLE_FRACTIONAL_XSCALE
+            case video_24mhz_composable_program_extern(scaled_run):
+            {
+                uint count = (*it++ + 1u) * MAX(1u, video_mode.xscale_denominator);
+                for(uint i=0; i<count; i++) {
+                    assert(pixels < pixels_end);
+                    pixels++; it++;
+                }
+                break;
+            }
 #endif
             default:
                 assert(false);
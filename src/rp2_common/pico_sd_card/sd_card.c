@@ -10,9 +10,13 @@
 #include <stdio.h>
 #include "pico/stdlib.h"
 #include "pico/sd_card.h"
+#include "pico/sd_card_crc.h"
+#include "pico/sd_card_queue.h"
+#include "pico/sd_block_device.h"
 #include "hardware/pio.h"
 #include "hardware/gpio.h"
 #include "hardware/dma.h"
+#include "hardware/clocks.h"
 #include "sd_card.pio.h"
 #include "crc7.h"
 #include "crc-itu-t.h"
@@ -48,6 +52,7 @@ PIO sd_pio = pio1;
 static uint sd_dat_pin_base; // todo remove me
 // todo struct these
 static uint8_t rca_high, rca_low;
+static uint32_t card_sector_count;
 static enum bus_width {bw_unknown, bw_narrow, bw_wide} bus_width;
 
 const int sd_cmd_dma_channel = 11;
@@ -370,6 +375,7 @@ int __noinline sd_command(uint64_t packed_command, uint32_t *receive_buf, uint b
             switch (cmd)
             {
                 case 2:
+                case 9:
                     break;
                 case 41:
                     ok = (w0 & 0xff1e0000) == 0x3f000000;
@@ -388,7 +394,8 @@ int __noinline sd_command(uint64_t packed_command, uint32_t *receive_buf, uint b
                     crc = crc7_table[crc ^ (uint8_t) (w1 >> 24u)];
                     if ((crc | 1u) != (uint8_t) (w1 >> 16u))
                     {
-                        panic("bad crc %02x != %02x\n", crc | 1u, (uint8_t) (w1 >> 16u));
+                        // not a panic, as sd_tune_clock tries clock speeds which may not work
+                        sd_debug("bad crc %02x != %02x\n", crc | 1u, (uint8_t) (w1 >> 16u));
                         ok = false;
                     }
                 }
@@ -428,6 +435,18 @@ static inline void fixup_cmd_response_48(uint32_t *buf)
     buf[0] = __builtin_bswap32(b0 >> 1u);
 }
 
+// bits hi to lo of the CSD from the raw response to CMD9: as for other responses the start bit isn't received, and the
+// CSD follows the first byte
+static uint32_t csd_bits(const uint32_t *response, uint hi, uint lo)
+{
+    uint32_t v = 0;
+    for(int bit = (int)hi; bit >= (int)lo; bit--) {
+        uint i = 134 - bit;
+        v = (v << 1) | ((response[i / 32] >> (31 - i % 32)) & 1u);
+    }
+    return v;
+}
+
 const char *states[] = {
         "idle", "ready", "ident", "stby", "tran", "data", "rcv", "prg", "dis", "(9)", "(a)", "(b)", "(c)", "(d)", "(e)", "(f)"
 };
@@ -490,7 +509,7 @@ void read_status(bool dump)
 
 int sd_set_wide_bus(bool wide)
 {
-  printf("Set bus width: %d\n", (wide ? 4 : 1));
+    sd_debug("Set bus width: %d\n", (wide ? 4 : 1));
     if (bus_width == bw_unknown || bus_width == (wide ? bw_narrow : bw_wide)) {
         if (wide && !allow_four_data_pins) {
             printf("May not select wide pus without 4 data pins\n");
@@ -512,10 +531,15 @@ int sd_set_wide_bus(bool wide)
     return SD_OK;
 }
 
+static uint clock_divider;
+static bool high_speed;
+static uint measured_read_rate;
+
 int sd_set_clock_divider(uint div) {
 #ifdef PICO_SD_CARD_EXTRA_CLOCK_DIVIDER
     div *= PICO_SD_CARD_EXTRA_CLOCK_DIVIDER;
 #endif
+    clock_divider = div;
     pio_sm_set_clkdiv_int_frac(sd_pio, SD_CLK_SM, div, 0);
     pio_sm_set_clkdiv_int_frac(sd_pio, SD_CMD_SM, div, 0);
     pio_sm_set_clkdiv_int_frac(sd_pio, SD_DAT_SM, div, 0);
@@ -523,6 +547,69 @@ int sd_set_clock_divider(uint div) {
     return SD_OK;
 }
 
+uint sd_get_clock_hz(void) {
+    // the clock program takes 2 cycles per SD clock
+    return clock_divider ? clock_get_hz(clk_sys) / (2 * clock_divider) : 0;
+}
+
+bool sd_is_high_speed(void) {
+    return high_speed;
+}
+
+uint32_t sd_get_sector_count(void) {
+    return card_sector_count;
+}
+
+uint sd_get_measured_read_rate(void) {
+    return measured_read_rate;
+}
+
+static uint16_t crc16_1bit(const uint8_t *data, uint byte_length, bool byteswapped) {
+    // without the byte swap the bytes of each word were received most significant first
+    uint swizzle = byteswapped ? 0 : 3;
+    uint16_t crc = 0;
+    for (uint i = 0; i < byte_length; i++) {
+        crc = (uint16_t) ((crc << 8u) ^ crc_itu_t_table[((crc >> 8u) ^ data[i ^ swizzle]) & 0xffu]);
+    }
+    return crc;
+}
+
+// CMD6 (SWITCH_FUNC) in mode 0 (check) or 1 (switch) for function group 1 (access mode), which is followed by a 512 bit
+// status on DAT0 (so this must be done before switching to the wide bus)
+static int switch_function(bool set, uint function, uint8_t status[64]) {
+    assert(bus_width != bw_wide);
+    uint32_t *buf = (uint32_t *) status;
+    uint32_t response_buffer[5];
+    uint16_t suffixed_crc;
+    int rc = acquiesce_sm(SD_DAT_SM);
+    if (!rc) rc = start_single_dma(sd_data_dma_channel, SD_DAT_SM, buf, 64, true, false);
+    if (!rc) rc = start_read(SD_DAT_SM, buf, 64, false);
+    if (!rc) rc = sd_command(sd_make_command(6, set ? 0x80 : 0, 0xff, 0xff, 0xf0 | function), response_buffer, 6);
+    if (!rc) rc = finish_read(sd_data_dma_channel, SD_DAT_SM, &suffixed_crc, NULL);
+    if (!rc && crc16_1bit(status, 64, true) != suffixed_crc) rc = SD_ERR_CRC;
+    return rc;
+}
+
+// switch to high speed (50MHz) if the card supports it; it remains in default speed (25MHz) otherwise
+static int switch_to_high_speed(void) {
+    uint32_t status_words[16];
+    uint8_t *status = (uint8_t *) status_words;
+    high_speed = false;
+    int rc = switch_function(false, 1, status);
+    if (rc) return rc;
+    // bits 415:400 are the functions supported in group 1, and bits 379:376 the function which would be selected
+    if (!(status[13] & 2u) || (status[16] & 0xfu) != 1) {
+        sd_debug("High speed not supported\n");
+        return SD_OK;
+    }
+    rc = switch_function(true, 1, status);
+    if (rc) return rc;
+    if ((status[16] & 0xfu) != 1) return SD_ERR_BAD_RESPONSE;
+    sd_debug("High speed\n");
+    high_speed = true;
+    return SD_OK;
+}
+
 // todo fixup error handling
 static int sd_init( bool _allow_four_data_pins)
 {
@@ -638,16 +725,30 @@ static int sd_init( bool _allow_four_data_pins)
     fixup_cmd_response_48(response_buffer);
     rca_high = byte_buf[1];
     rca_low = byte_buf[2];
+    card_sector_count = 0;
+    if (!sd_command(sd_make_command(9, rca_high, rca_low, 0, 0), response_buffer, 17)) {
+        switch (csd_bits(response_buffer, 127, 126)) {
+            case 0: {
+                // standard capacity
+                uint32_t c_size = csd_bits(response_buffer, 73, 62);
+                uint shift = csd_bits(response_buffer, 49, 47) + 2 + csd_bits(response_buffer, 83, 80);
+                card_sector_count = ((c_size + 1) << shift) / SD_SECTOR_SIZE;
+                break;
+            }
+            case 1:
+                // high or extended capacity, in units of 512K
+                card_sector_count = (csd_bits(response_buffer, 69, 48) + 1) * 1024;
+                break;
+        }
+    }
     sd_command(sd_make_command(7, rca_high, rca_low, 0, 0), response_buffer, 6);
 
     // wait for not busy after CMD7
     sd_wait();
 
-    int rc = sd_set_wide_bus(allow_four_data_pins);
-    if (!rc)
-    {
-        rc = sd_set_clock_divider(1); // as fast as possible please
-    }
+    int rc = switch_to_high_speed();
+    if (!rc) rc = sd_set_wide_bus(allow_four_data_pins);
+    if (!rc) rc = sd_tune_clock(0);
     return rc;
 }
 
@@ -670,8 +771,13 @@ void sd_set_byteswap_on_read(bool swap)
 static uint32_t crcs[PICO_SD_MAX_BLOCK_COUNT * 2];
 static uint32_t ctrl_words[(PICO_SD_MAX_BLOCK_COUNT + 1) * 4];
 static uint32_t pio_cmd_buf[PICO_SD_MAX_BLOCK_COUNT * 3];
+// the buffers of the blocks read by sd_readblocks_async or sd_readblocks_gather_async, which in 4 bit mode are checked
+// against their CRCs on completion
+static uint32_t *read_bufs[PICO_SD_MAX_BLOCK_COUNT];
+static uint crc_check_block_count;
+static bool crc_check_byteswapped;
 
-int sd_readblocks_async(uint32_t *buf, uint32_t block, uint block_count)
+static int start_readblocks(uint32_t block, uint block_count)
 {
     assert(block_count <= PICO_SD_MAX_BLOCK_COUNT);
 
@@ -679,7 +785,7 @@ int sd_readblocks_async(uint32_t *buf, uint32_t block, uint block_count)
     uint crc_words = bus_width == bw_wide ? 2 : 1;
     for(int i = 0; i < block_count; i++)
     {
-        *p++ = (uintptr_t) (buf + i * 128);
+        *p++ = (uintptr_t) read_bufs[i];
         *p++ = 128;
         // for now we read the CRCs also
         *p++ = (uintptr_t)(crcs + i * crc_words);
@@ -687,40 +793,42 @@ int sd_readblocks_async(uint32_t *buf, uint32_t block, uint block_count)
     }
     *p++ = 0;
     *p++ = 0;
-    return sd_readblocks_scatter_async(ctrl_words, block, block_count);
+    int rc = sd_readblocks_scatter_async(ctrl_words, block, block_count);
+    if (!rc && bus_width == bw_wide) {
+        crc_check_block_count = block_count;
+        // the data DMA byte swaps unless asked not to
+        crc_check_byteswapped = !bytes_swap_on_read;
+    }
+    return rc;
 }
 
-int sd_readblocks_sync(uint32_t *buf, uint32_t block, uint block_count)
+int sd_readblocks_async(uint32_t *buf, uint32_t block, uint block_count)
 {
     assert(block_count <= PICO_SD_MAX_BLOCK_COUNT);
+    for(uint i = 0; i < block_count; i++) {
+        read_bufs[i] = buf + i * 128;
+    }
+    return start_readblocks(block, block_count);
+}
 
-    uint32_t *p = ctrl_words;
-    uint crc_words = bus_width == bw_wide ? 2 : 1;
-    for(int i=0;i<block_count;i++)
-    {
-        *p++ = (uintptr_t)(buf + i * 128);
-        *p++ = 128;
-        // for now we read the CRCs also
-        *p++ = (uintptr_t)(crcs + i * crc_words);
-//        printf("%08x\n", (uint)(uint32_t)(crcs + i * crc_words));
-        *p++ = crc_words;
+int sd_readblocks_gather_async(uint32_t *const *bufs, uint32_t block, uint block_count)
+{
+    assert(block_count <= PICO_SD_MAX_BLOCK_COUNT);
+    for(uint i = 0; i < block_count; i++) {
+        read_bufs[i] = bufs[i];
     }
-    *p++ = 0;
-    *p++ = 0;
-    int rc = sd_readblocks_scatter_async(ctrl_words, block, block_count);
+    return start_readblocks(block, block_count);
+}
+
+int sd_readblocks_sync(uint32_t *buf, uint32_t block, uint block_count)
+{
+    int rc = sd_readblocks_async(buf, block, block_count);
     if (!rc)
     {
-//        printf("waiting for finish\n");
         while (!sd_scatter_read_complete(&rc))
         {
             tight_loop_contents();
         }
-//        for(int i=0;i<block_count;i++)
-//        {
-//            printf("y %08x\n", (uint) crcs[i * crc_words]);
-//        }
-
-        //printf("finished\n");
     }
     return rc;
 }
@@ -754,6 +862,8 @@ int sd_readblocks_scatter_async(uint32_t *control_words, uint32_t block, uint bl
 {
     uint32_t response_buffer[5];
 
+    // the caller decides where the CRCs go, so only sd_readblocks_async knows to check them
+    crc_check_block_count = 0;
     assert(pio_sm_is_rx_fifo_empty(sd_pio, SD_DAT_SM));
     uint32_t total = 0;
     uint32_t *p = control_words;
@@ -833,6 +943,13 @@ bool sd_scatter_read_complete(int *status) {
             }
         }
         check_crc_count = 0;
+        for(uint i=0;i<crc_check_block_count && s == SD_OK;i++) {
+            if (!sd_crc16_4bit_check(read_bufs[i], 128, crcs + i * 2, crc_check_byteswapped)) {
+                printf("CRC error on block %d\n", i);
+                s = SD_ERR_CRC;
+            }
+        }
+        crc_check_block_count = 0;
     }
     if (status) *status = s;
     return rc;
@@ -861,8 +978,6 @@ static void __time_critical_func(start_chain_dma_write)(uint sm, uint32_t *buf)
     gpio_clr_mask(1);
 }
 
-static __unused uint8_t flapulent[1024];
-static __unused uint32_t flap_count;
 uint32_t zeroes;
 uint32_t start_bit = 0xfffffffe;
 
@@ -878,168 +993,309 @@ static uint32_t dma_ctrl_for(enum dma_channel_transfer_size size, bool src_incr,
     channel_config_set_enable(&c, enable);
     return c.ctrl;
 }
-//#define CRC_FIRST
-// note caller must make space for CRC (2 word) in 4 bit mode
+static void build_cb(uint32_t *cb, const volatile void *read_addr, volatile void *write_addr, uint count, uint32_t ctrl)
+{
+    cb[0] = (uintptr_t) read_addr;
+    cb[1] = (uintptr_t) write_addr;
+    cb[2] = count;
+    cb[3] = ctrl;
+}
+
+// stop the data transfer DMA (clearing EN first, so an abort doesn't trigger a chain)
+static void stop_dat_dma(void)
+{
+    uint channels[] = {sd_chain_dma_channel, sd_data_dma_channel, sd_pio_dma_channel};
+    for(uint i = 0; i < count_of(channels); i++) {
+        hw_clear_bits(&dma_hw->ch[channels[i]].al1_ctrl, DMA_CH0_CTRL_TRIG_EN_BITS);
+        dma_channel_abort(channels[i]);
+    }
+}
+
+// return the data state machine to waiting for a command, with the bus released, from wherever it was part way
+static void reset_dat_sm(void)
+{
+    pio_sm_set_enabled(sd_pio, SD_DAT_SM, false);
+    pio_sm_clear_fifos(sd_pio, SD_DAT_SM);
+    pio_sm_restart(sd_pio, SD_DAT_SM);
+    pio_sm_exec(sd_pio, SD_DAT_SM, pio_encode_set(pio_pindirs, 0));
+    pio_sm_exec(sd_pio, SD_DAT_SM, pio_encode_jmp(sd_cmd_or_dat_offset_no_arg_state_waiting_for_cmd));
+    pio_sm_set_enabled(sd_pio, SD_DAT_SM, true);
+}
+
+static inline bool dat_transfer_finished(void)
+{
+    return !dma_channel_is_busy(sd_chain_dma_channel) && !dma_channel_is_busy(sd_data_dma_channel) &&
+           sd_pio->sm[SD_DAT_SM].addr == sd_cmd_or_dat_offset_no_arg_state_waiting_for_cmd &&
+           pio_sm_is_tx_fifo_empty(sd_pio, SD_DAT_SM);
+}
+
+// Writes are sent entirely by DMA, including waiting for the card between blocks: for each block the data state
+// machine is sent the block (start bit, data and the CRC16 calculated by the DMA sniffer on the way through) and
+// receives the card's CRC status token as part of the same state (which the token DMA collects), then waits for DAT0
+// to go high at the end of the card's busy period before the next.
+//
+// Since the CRC comes from the sniffer, which can only calculate it for a single line, writes are sent in 1 bit mode
+// (switching with ACMD6 either side of the write if the bus is otherwise wide). The 4 extra commands take about 450
+// clocks; 4 bit writes would save about 3000 clocks per block sent, but need the 4 per line CRCs calculated by the CPU
+// before the DMA can start, and another send loop which doesn't fit in the PIO's instruction memory alongside the rest.
+//
+// Each block has control blocks to:
+enum {
+    WRITE_CB_RESET_CRC, // zero the sniffer
+    WRITE_CB_PREFIX,    // drive the bus high, then the send_block command and the start bit
+    WRITE_CB_DATA,      // the data
+    WRITE_CB_CRC,       // copy the CRC from the sniffer into write_crc_word
+    WRITE_CB_SEND_CRC,  // send write_crc_word
+    WRITE_CB_SUFFIX,    // push the CRC status token, and wait while busy
+    WRITE_CB_COUNT
+};
+
+static uint32_t write_cbs[PICO_SD_MAX_BLOCK_COUNT * WRITE_CB_COUNT + 2][4];
+static uint32_t write_block_prefix[3];
+static uint32_t write_block_suffix[2];
+static uint32_t write_end;
+// the CRC in the high half, and in the low half the instruction the data state machine executes after the block
+static uint32_t write_crc_word;
+static uint32_t write_tokens[PICO_SD_MAX_BLOCK_COUNT];
+static uint write_block_count;
+static uint write_tokens_checked;
+static int write_status;
+static bool write_restore_wide;
+static enum {
+    write_idle, write_sending, write_stopping
+} write_state;
+
+
+static int check_write_token(uint32_t token)
+{
+    // the 3 status bits which followed the token's start bit
+    switch ((token >> 29u) & 7u) {
+        case 2:
+            return SD_OK;
+        case 5:
+            return SD_ERR_CRC;
+        default:
+            return SD_ERR_BAD_RESPONSE;
+    }
+}
+
 int sd_writeblocks_async(const uint32_t *data, uint32_t sector_num, uint sector_count)
 {
     uint32_t response_buffer[5];
 
-#ifdef CRC_FIRST
-    // lets crc the first sector
-    dma_channel_config c = dma_channel_get_default_config(sd_data_dma_channel);
-    if (true)
-    {
-        channel_config_set_bswap(&c, true);
-        dma_sniffer_enable(sd_data_dma_channel, DMA_SNIFF_CTRL_CALC_VALUE_CRC16, true);
-        dma_sniffer_set_byte_swap_enabled(true);
-    } else {
-        dma_sniffer_enable(sd_data_dma_channel, DMA_SNIFF_CTRL_CALC_VALUE_CRC16, true);
+    if (!sector_count || sector_count > PICO_SD_MAX_BLOCK_COUNT) return SD_ERR_BAD_PARAM;
+    assert(write_state == write_idle);
+    assert(dat_transfer_finished());
+
+    write_restore_wide = bus_width == bw_wide;
+    int rc = sd_set_wide_bus(false);
+    if (rc) return rc;
+    pio_sm_set_wrap(sd_pio, SD_DAT_SM, sd_cmd_or_dat_wrap_target, sd_cmd_or_dat_wrap);
+
+    write_block_prefix[0] = sd_pio_cmd(sd_cmd_or_dat_offset_state_inline_instruction, pio_encode_jmp(sd_cmd_or_dat_offset_no_arg_state_wait_high));
+    write_block_prefix[1] = sd_pio_cmd(sd_cmd_or_dat_offset_state_send_block, 32 + 512 * 8 + 16 - 1);
+    write_block_prefix[2] = start_bit;
+    write_crc_word = pio_encode_jmp(sd_cmd_or_dat_offset_no_arg_state_waiting_for_cmd);
+    // state_send_block has already received the 8 bits of the token (by which time busy, DAT0 low, has started)
+    write_block_suffix[0] = sd_pio_cmd(sd_cmd_or_dat_offset_state_inline_instruction, pio_encode_in(pio_null, 24));
+    write_block_suffix[1] = sd_pio_cmd(sd_cmd_or_dat_offset_state_inline_instruction, pio_encode_wait_pin(true, 0));
+    write_end = sd_pio_cmd(sd_cmd_or_dat_offset_state_inline_instruction, pio_encode_jmp(sd_cmd_or_dat_offset_no_arg_state_waiting_for_cmd));
+
+    uint dreq = DREQ_PIO1_TX0 + SD_DAT_SM;
+    io_wo_32 *txf = &sd_pio->txf[SD_DAT_SM];
+    uint32_t (*cb)[4] = write_cbs;
+    for(uint i = 0; i < sector_count; i++) {
+        build_cb(*cb++, &zeroes, &dma_hw->sniff_data, 1,
+                 dma_ctrl_for(DMA_SIZE_32, false, false, DREQ_FORCE, sd_chain_dma_channel, 0, 0, true));
+        build_cb(*cb++, write_block_prefix, txf, 3,
+                 dma_ctrl_for(DMA_SIZE_32, true, false, dreq, sd_chain_dma_channel, 0, 0, true));
+        build_cb(*cb++, data + i * 128, txf, 128,
+                 dma_ctrl_for(DMA_SIZE_32, true, false, dreq, sd_chain_dma_channel, 0, 0, true) |
+                 DMA_CH0_CTRL_TRIG_BSWAP_BITS | DMA_CH0_CTRL_TRIG_SNIFF_EN_BITS);
+        build_cb(*cb++, &dma_hw->sniff_data, ((uint16_t *) &write_crc_word) + 1, 1,
+                 dma_ctrl_for(DMA_SIZE_16, false, false, DREQ_FORCE, sd_chain_dma_channel, 0, 0, true));
+        build_cb(*cb++, &write_crc_word, txf, 1,
+                 dma_ctrl_for(DMA_SIZE_32, false, false, dreq, sd_chain_dma_channel, 0, 0, true));
+        build_cb(*cb++, write_block_suffix, txf, 2,
+                 dma_ctrl_for(DMA_SIZE_32, true, false, dreq, sd_chain_dma_channel, 0, 0, true));
     }
-    channel_config_set_read_increment(&c, true);
-    channel_config_set_write_increment(&c, false);
-    channel_config_set_dreq(&c, DREQ_FORCE);
+    build_cb(*cb++, &write_end, txf, 1,
+             dma_ctrl_for(DMA_SIZE_32, false, false, dreq, sd_chain_dma_channel, 0, 0, true));
+    // a control block with EN clear ends the chain
+    build_cb(*cb, NULL, NULL, 0, 0);
+
+    write_block_count = sector_count;
+    write_tokens_checked = 0;
+    write_status = SD_OK;
+    dma_channel_config c = dma_channel_get_default_config(sd_pio_dma_channel);
+    channel_config_set_read_increment(&c, false);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_dreq(&c, DREQ_PIO1_RX0 + SD_DAT_SM);
     dma_channel_configure(
-            sd_data_dma_channel,
+            sd_pio_dma_channel,
             &c,
-            flapulent,                  // dest
-            data,        // src
-            128,
-            false
+            write_tokens,               // dest
+            &sd_pio->rxf[SD_DAT_SM],    // src
+            sector_count,
+            true
     );
-    hw_set_bits(&dma_hw->ch[sd_data_dma_channel].al1_ctrl, DMA_CH0_CTRL_TRIG_BSWAP_BITS);
-    dma_hw->sniff_data = 0;
-    dma_channel_start(sd_data_dma_channel);
-    dma_channel_wait_for_finish_blocking(sd_data_dma_channel);
-    printf("Sniff raw %08x, word %04x\n", (uint)dma_hw->sniff_data, __bswap16(dma_hw->sniff_data));
-    // todo we need to be able to reset the sniff data correctly
-    crcs[0] = __bswap16(dma_hw->sniff_data);
-#endif
 
-    uint32_t *buf = pio_cmd_buf;
-    for(int i=0; i < sector_count; i++)
-    {
-        // we send an extra word even though the CRC is only 16 bits to make life easy... the receiver doesn't care
-        // todo that would need to work anyway for inline CRC (which can't include a pio_cmd)
-        *buf++ = sd_pio_cmd(sd_cmd_or_dat_offset_state_send_bits, 512 * 8 + 32 + 32 - 1);
+    if (sector_count == 1) {
+        rc = sd_command(sd_make_command(24, sector_num >> 24, sector_num >> 16, sector_num >> 8, sector_num & 0xffu), response_buffer, 6);
+    } else {
+        // ACMD23 (always supported, unlike CMD23) lets the card pre-erase the blocks; the write is ended with CMD12
+        rc = sd_command(sd_make_command(55, rca_high, rca_low, 0, 0), response_buffer, 6);
+        if (!rc) rc = sd_command(sd_make_command(23, sector_count >> 24, sector_count >> 16, sector_count >> 8, sector_count & 0xffu), response_buffer, 6);
+        if (!rc) rc = sd_command(sd_make_command(25, sector_num >> 24, sector_num >> 16, sector_num >> 8, sector_num & 0xffu), response_buffer, 6);
     }
-    *buf++ = sd_pio_cmd(sd_cmd_or_dat_offset_state_inline_instruction, pio_encode_jmp(sd_cmd_or_dat_offset_no_arg_state_wait_high));
-
-    if (sector_count > (PICO_SD_MAX_BLOCK_COUNT - 1) / 4) {
-        panic("too many blocks for now");
+    if (rc) {
+        dma_channel_abort(sd_pio_dma_channel);
+        if (write_restore_wide) sd_set_wide_bus(true);
+        return rc;
     }
+    dma_sniffer_enable(sd_data_dma_channel, DMA_SNIFF_CTRL_CALC_VALUE_CRC16, true);
+    dma_sniffer_set_byte_swap_enabled(true);
+    write_state = write_sending;
+    start_chain_dma_write(SD_DAT_SM, (uint32_t *) write_cbs);
+    return SD_OK;
+}
 
-    assert(pio_sm_is_tx_fifo_empty(sd_pio, SD_DAT_SM));
-
-    uint32_t *p = ctrl_words;
-//#define SEND_TO_BUFFER
-#ifdef SEND_TO_BUFFER
-    uint32_t *output_buffer = flapulent;
-    uint32_t offset = 0;
-    #define build_transfer(src, words, size, flags) \
-        *p++ = (uintptr_t)(src); \
-        *p++ = output_buffer + offset; \
-        *p++ = words; \
-        offset += words; \
-        *p++ = dma_ctrl_for(size, true, true, DREQ_FORCE, sd_chain_dma_channel, 0, 0, true) | (flags);
-#else
-#define build_transfer(src, words, size, flags) \
-        *p++ = (uintptr_t)(src); \
-        *p++ = (uintptr_t)(&sd_pio->txf[SD_DAT_SM]); \
-        *p++ = words; \
-        *p++ = dma_ctrl_for(size, true, false, DREQ_PIO1_TX0 + SD_DAT_SM, sd_chain_dma_channel, 0, 0, true) | (flags);
-
-#endif
-    for(int i=0;i<sector_count;i++) {
-        // first cb - zero out sniff data
-#ifndef CRC_FIRST
-        *p++ = (uintptr_t)&zeroes;
-        *p++ = (uintptr_t)(&dma_hw->sniff_data);
-        *p++ = 1;
-        *p++ = dma_ctrl_for(DMA_SIZE_32, false, false, DREQ_FORCE, sd_chain_dma_channel, 0, 0, true);
-#endif
-        // second cb - send bits command
-        build_transfer(pio_cmd_buf + i, 1, DMA_SIZE_32, 0);
-        build_transfer(&start_bit, 1, DMA_SIZE_32, 0);
-        // third cb - 128 words of sector data
-        build_transfer(data + i * 128, 128, DMA_SIZE_32, DMA_CH0_CTRL_TRIG_BSWAP_BITS | DMA_CH0_CTRL_TRIG_SNIFF_EN_BITS);
-//        // fourth cb - transfer sniff
-#ifdef CRC_FIRST
-        build_transfer( crcs, 1, DMA_SIZE_32, DMA_CH0_CTRL_TRIG_BSWAP_BITS);
-#else
-        // note offset of 2, since we bswap the data
-        build_transfer( (uintptr_t)&dma_hw->sniff_data, 1, DMA_SIZE_16, 0);//DMA_CH0_CTRL_TRIG_BSWAP_BITS);
-#endif
+bool sd_write_complete(int *status) {
+    if (write_state == write_sending) {
+        uint received = write_block_count - dma_channel_hw_addr(sd_pio_dma_channel)->transfer_count;
+        __compiler_memory_barrier();
+        while (write_tokens_checked < received && !write_status) {
+            write_status = check_write_token(write_tokens[write_tokens_checked++]);
+        }
+        bool finished = !write_status && received == write_block_count && dat_transfer_finished();
+        if (write_status || finished) {
+            if (write_status) {
+                // the card is no longer accepting the data, so stop where we are
+                stop_dat_dma();
+                reset_dat_sm();
+            }
+            if (write_block_count > 1) {
+                uint32_t response_buffer[5];
+                int rc = sd_command(sd_make_command(12, 0, 0, 0, 0), response_buffer, 6);
+                if (!write_status) write_status = rc;
+            }
+            // wait (without the CPU) for the card to finish programming
+            pio_sm_put(sd_pio, SD_DAT_SM, sd_pio_cmd(sd_cmd_or_dat_offset_state_inline_instruction, pio_encode_wait_pin(true, 0)));
+            pio_sm_put(sd_pio, SD_DAT_SM, write_end);
+            write_state = write_stopping;
+        }
+    }
+    if (write_state == write_stopping && dat_transfer_finished()) {
+        if (write_restore_wide) {
+            int rc = sd_set_wide_bus(true);
+            if (!write_status) write_status = rc;
+        }
+        write_state = write_idle;
     }
-    // final cb - return to wait state
-    build_transfer(pio_cmd_buf + sector_count, 1, DMA_SIZE_32, 0);
-#ifdef SEND_TO_BUFFER
-    flap_count = offset;
+    if (status) *status = write_status;
+    return write_state == write_idle;
+}
+
+// Clock tuning: the fastest clock divider at which the test sectors read back correctly several times, starting from
+// PICO_SD_TUNE_REFERENCE_HZ (where the data read is taken as the reference) and stepping up to the fastest the card
+// supports in its current bus speed mode
+#define TUNE_SECTORS 4
+#define TUNE_READS 4
+#define TUNE_RATE_READS 16
+#define TUNE_TIMEOUT_MS 100
+
+// the smallest divider which doesn't exceed hz
+static uint clock_divider_for(uint hz) {
+    uint div = (clock_get_hz(clk_sys) + 2 * hz - 1) / (2 * hz);
+#ifdef PICO_SD_CARD_EXTRA_CLOCK_DIVIDER
+    div = (div + PICO_SD_CARD_EXTRA_CLOCK_DIVIDER - 1) / PICO_SD_CARD_EXTRA_CLOCK_DIVIDER;
 #endif
-    *p++ = 0;
-    *p++ = 0;
+    return MAX(div, 1);
+}
 
-    // todo further state checks
-    while (sd_pio->sm[SD_DAT_SM].addr != sd_cmd_or_dat_offset_no_arg_state_waiting_for_cmd) {
-        printf("oops %d\n", (uint)sd_pio->sm[SD_DAT_SM].addr);
+// after a failed read at a speed which doesn't work, the DMA and data state machine may still be waiting for data
+// (even if the command itself failed, they were set up before it was sent), and the card may still be sending
+static void abort_tune_read(void)
+{
+    stop_dat_dma();
+    uint32_t response_buffer[5];
+    sd_command(sd_make_command(12, 0, 0, 0, 0), response_buffer, 6);
+    reset_dat_sm();
+    sd_wait();
+    crc_check_block_count = 0;
+}
 
+// read the test sectors, checking their CRCs (which sd_readblocks_sync only does in 4 bit mode), and hash the data
+static int tune_read(uint32_t *buf, uint32_t sector, uint32_t *hash)
+{
+    int rc = sd_readblocks_async(buf, sector, TUNE_SECTORS);
+    if (!rc) {
+        // at a speed which doesn't work the data state machine may miss a start bit, and wait forever
+        absolute_time_t timeout = make_timeout_time_ms(TUNE_TIMEOUT_MS);
+        while (!sd_scatter_read_complete(&rc)) {
+            if (time_reached(timeout)) {
+                rc = SD_ERR_STUCK;
+                break;
+            }
+        }
     }
-    assert(sd_pio->sm[SD_DAT_SM].addr == sd_cmd_or_dat_offset_no_arg_state_waiting_for_cmd);
-    assert(pio_sm_is_tx_fifo_empty(sd_pio, SD_DAT_SM));
-    pio_sm_put(sd_pio, SD_DAT_SM, sd_pio_cmd(sd_cmd_or_dat_offset_state_inline_instruction, pio_encode_jmp(sd_cmd_or_dat_offset_no_arg_state_wait_high)));
-    while (sd_pio->sm[SD_DAT_SM].addr != sd_cmd_or_dat_offset_no_arg_state_waiting_for_cmd) {
-        printf("reps %d\n", (uint)sd_pio->sm[SD_DAT_SM].addr);
-
+    if (!rc && bus_width != bw_wide) {
+        for (uint i = 0; i < TUNE_SECTORS && !rc; i++) {
+            uint32_t suffix = crcs[i];
+            if (!bytes_swap_on_read) suffix = __builtin_bswap32(suffix);
+            if (crc16_1bit((const uint8_t *) (buf + i * 128), 512, !bytes_swap_on_read) != suffix >> 16u) {
+                rc = SD_ERR_CRC;
+            }
+        }
     }
-
-    assert(sector_count);
-    int rc = sd_set_wide_bus(false); // use 1 bit writes for now
-    if (rc) return rc;
-
-    if (sector_count == 1) {
-        rc = sd_command(sd_make_command(24, sector_num >> 24, (sector_num >> 16) & 0xff, (sector_num >> 8) & 0xff, sector_num & 0xffu), response_buffer, 6);
-    } else
-    {
-        // todo this is only writing the first sector on SanDisk EDGE 16G right now - probably need a delay between sectors... works fine on a SAMSUNG EVO 32G
-
-        // todo can we expect support for 23?
-        rc = sd_command(sd_make_command(23, sector_count >> 24, sector_count >> 16, sector_count >> 8, sector_count & 0xffu),
-                        response_buffer, 6);
-        if (!rc) rc = sd_command(sd_make_command(25, sector_num >> 24, sector_num >> 16, sector_num >> 8, sector_num & 0xffu), response_buffer, 6);
+    if (rc) {
+        abort_tune_read();
+        return rc;
     }
-    read_status(true);
-    if (!rc)
-    {
-        pio_sm_set_enabled(sd_pio, SD_DAT_SM, false);
-        dma_sniffer_enable(sd_data_dma_channel, DMA_SNIFF_CTRL_CALC_VALUE_CRC16, true);
-        dma_sniffer_set_byte_swap_enabled(true);
-        start_chain_dma_write(SD_DAT_SM, ctrl_words);
-        pio_sm_set_enabled(sd_pio, SD_DAT_SM, true);
-        printf("dma chain data (rem %04x @ %08x) data (rem %04x @ %08x) pio data (rem %04x @ %08x) datsm @ %d\n",
-               (uint) dma_hw->ch[sd_chain_dma_channel].transfer_count,
-               (uint) dma_hw->ch[sd_chain_dma_channel].read_addr,
-               (uint) dma_hw->ch[sd_data_dma_channel].transfer_count, (uint) dma_hw->ch[sd_data_dma_channel].read_addr,
-               (uint) dma_hw->ch[sd_pio_dma_channel].transfer_count, (uint) dma_hw->ch[sd_pio_dma_channel].read_addr,
-               (int) sd_pio->sm[SD_DAT_SM].addr);
-
+    uint32_t h = 0;
+    for (uint i = 0; i < TUNE_SECTORS * 128; i++) {
+        h = (h ^ buf[i]) * 0x01000193u;
     }
-    return rc;
+    *hash = h;
+    return SD_OK;
 }
 
-bool sd_write_complete(int *status) {
-    printf("dma chain data (rem %04x @ %08x) data (rem %04x @ %08x) datsm @ %d\n",
-           (uint)dma_hw->ch[sd_chain_dma_channel].transfer_count, (uint)dma_hw->ch[sd_chain_dma_channel].read_addr,
-           (uint)dma_hw->ch[sd_data_dma_channel].transfer_count, (uint)dma_hw->ch[sd_data_dma_channel].read_addr,
-           (int)sd_pio->sm[SD_DAT_SM].addr);
-    // this is a bit half arsed atm
-    bool rc;
-    if (dma_channel_is_busy(sd_chain_dma_channel) || dma_channel_is_busy(sd_data_dma_channel)) rc = false;
-    else rc = sd_pio->sm[SD_DAT_SM].addr == sd_cmd_or_dat_offset_no_arg_state_waiting_for_cmd;
-    if (rc) {
-        read_status(true);
-        printf("sniffo %08x\n", (uint)dma_hw->sniff_data);
+int sd_tune_clock(uint32_t test_sector)
+{
+    static uint32_t buf[TUNE_SECTORS * 128];
+    uint max_hz = high_speed ? PICO_SD_HIGH_SPEED_MAX_HZ : PICO_SD_DEFAULT_SPEED_MAX_HZ;
+    uint min_div = clock_divider_for(max_hz);
+    uint div = MAX(clock_divider_for(PICO_SD_TUNE_REFERENCE_HZ), min_div);
+    // the data read at the reference speed is taken to be correct
+    sd_set_clock_divider(div);
+    uint32_t reference_hash;
+    int rc = tune_read(buf, test_sector, &reference_hash);
+    if (rc) return rc;
+    // then speed up a step at a time until the data read isn't right
+    while (div > min_div) {
+        sd_set_clock_divider(div - 1);
+        for (uint i = 0; i < TUNE_READS && !rc; i++) {
+            uint32_t hash;
+            rc = tune_read(buf, test_sector, &hash);
+            if (!rc && hash != reference_hash) rc = SD_ERR_CRC;
+        }
+        if (rc) {
+            sd_debug("Clock divider %d failed: %d\n", div - 1, rc);
+            break;
+        }
+        div--;
     }
-    if (status) *status = SD_OK;
-    return rc;
+    sd_set_clock_divider(div);
+    // and time some reads at the speed chosen (which are expected to work, so any failure is a real problem)
+    absolute_time_t start = get_absolute_time();
+    for (uint i = 0; i < TUNE_RATE_READS; i++) {
+        rc = sd_readblocks_sync(buf, test_sector, TUNE_SECTORS);
+        if (rc) return rc;
+    }
+    int64_t us = absolute_time_diff_us(start, get_absolute_time());
+    measured_read_rate = us > 0 ? (uint) ((uint64_t) TUNE_RATE_READS * TUNE_SECTORS * 512 * 1000000 / (uint64_t) us) : 0;
+    sd_debug("Clock %dHz, %d bytes/s\n", sd_get_clock_hz(), measured_read_rate);
+    return SD_OK;
 }
 
 #if 1
@@ -1127,3 +1383,231 @@ int sd_read_sectors_1bit_crc_async(uint32_t *sector_buf, uint32_t sector, uint s
 }
 
 #endif
+
+// Streaming reads: an open ended CMD18 into a ring of sectors, with a group of DMA control blocks for each, chained
+// through by the data channel in full control block mode (see start_chain_dma_read_with_full_cb). Each group is:
+//
+// state - marks the previous slot as filled, and arms its gate for the next time around
+// gate  - writes the slot's gate word to the clear alias of the PIO CTRL register. This is SD_CLK_SM's enable bit
+//         while the consumer still holds the sector from the last time around, so the clock (and with it the card)
+//         stops between blocks until the sector is released
+// data  - the 128 words of the sector
+// crc   - the CRC word(s) which follow it
+//
+// and after the last group a control block points the chain back at the first.
+enum {
+    STREAM_CB_STATE,
+    STREAM_CB_GATE,
+    STREAM_CB_DATA,
+    STREAM_CB_CRC,
+    STREAM_CB_COUNT
+};
+
+static uint32_t stream_cbs[PICO_SD_MAX_STREAM_SECTORS * STREAM_CB_COUNT + 1][4];
+static struct {
+    uint32_t gate;
+    uint32_t filled;
+} stream_slots[PICO_SD_MAX_STREAM_SECTORS];
+// the state written by the DMA once a slot is filled
+static const uint32_t stream_slot_filled[2] = {1u << SD_CLK_SM, 1};
+static uint32_t stream_crcs[PICO_SD_MAX_STREAM_SECTORS * 2];
+static uint32_t stream_pio_cmds[4] __attribute__((aligned(16)));
+static const uint32_t *stream_cbs_start = stream_cbs[0];
+static uint32_t *stream_buf;
+static uint stream_sector_count;
+static uint stream_next_acquire;
+static uint stream_next_release;
+static uint stream_acquired;
+static bool stream_byteswapped;
+
+// restart the clock if a gate stopped it for a sector which has since been released (including when the release
+// raced with the DMA reading the gate)
+static void stream_resume_if_released(void) {
+    if (sd_pio->ctrl & (1u << SD_CLK_SM)) return;
+    // while the clock is stopped the chain has loaded the data control block of the group whose gate stopped it
+    uint group = (uint) ((dma_hw->ch[sd_chain_dma_channel].read_addr - (uintptr_t) stream_cbs) / sizeof(stream_cbs[0]))
+                 / STREAM_CB_COUNT;
+    if (group < stream_sector_count && !*(volatile uint32_t *) &stream_slots[group].gate) {
+        hw_set_bits(&sd_pio->ctrl, 1u << SD_CLK_SM);
+    }
+}
+
+int sd_stream_start(uint32_t *buf, uint buffer_sector_count, uint32_t sector)
+{
+    if (buffer_sector_count < 2 || buffer_sector_count > PICO_SD_MAX_STREAM_SECTORS) return SD_ERR_BAD_PARAM;
+    assert(!stream_sector_count);
+    assert(sd_pio->sm[SD_DAT_SM].addr == sd_cmd_or_dat_offset_no_arg_state_waiting_for_cmd);
+    assert(pio_sm_is_rx_fifo_empty(sd_pio, SD_DAT_SM));
+    crc_check_block_count = 0;
+
+    uint crc_words = bus_width == bw_wide ? 2 : 1;
+    stream_byteswapped = !bytes_swap_on_read;
+    uint32_t data_ctrl = dma_ctrl_for(DMA_SIZE_32, false, true, DREQ_PIO1_RX0 + SD_DAT_SM, sd_chain_dma_channel, 0, 0, true);
+    if (stream_byteswapped) data_ctrl |= DMA_CH0_CTRL_TRIG_BSWAP_BITS;
+    uint32_t (*cb)[4] = stream_cbs;
+    for(uint i = 0; i < buffer_sector_count; i++) {
+        stream_slots[i].gate = 0;
+        stream_slots[i].filled = 0;
+        build_cb(*cb++, stream_slot_filled, &stream_slots[i ? i - 1 : buffer_sector_count - 1], 2,
+                 dma_ctrl_for(DMA_SIZE_32, true, true, DREQ_FORCE, sd_chain_dma_channel, 0, 0, true));
+        build_cb(*cb++, &stream_slots[i].gate, hw_clear_alias(&sd_pio->ctrl), 1,
+                 dma_ctrl_for(DMA_SIZE_32, false, false, DREQ_FORCE, sd_chain_dma_channel, 0, 0, true));
+        build_cb(*cb++, &sd_pio->rxf[SD_DAT_SM], buf + i * 128, 128, data_ctrl);
+        build_cb(*cb++, &sd_pio->rxf[SD_DAT_SM], stream_crcs + i * 2, crc_words, data_ctrl);
+    }
+    build_cb(*cb, &stream_cbs_start, &dma_hw->ch[sd_chain_dma_channel].read_addr, 1,
+             dma_ctrl_for(DMA_SIZE_32, false, false, DREQ_FORCE, sd_chain_dma_channel, 0, 0, true));
+    stream_buf = buf;
+    stream_sector_count = buffer_sector_count;
+    stream_next_acquire = stream_next_release = stream_acquired = 0;
+
+    // the data channel's config is loaded from the control blocks; the first time around there is no previous slot
+    // and nothing to gate, so start at the first data control block
+    dma_channel_config c = dma_channel_get_default_config(sd_chain_dma_channel);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_ring(&c, 1, 4);  // wrap the write at 16 bytes
+    dma_channel_configure(
+            sd_chain_dma_channel,
+            &c,
+            &dma_channel_hw_addr(sd_data_dma_channel)->read_addr,
+            stream_cbs[STREAM_CB_DATA],
+            4,
+            true
+    );
+
+    // the commands for each block are the same, so are sent from a ring
+    uint32_t *p = start_read_to_buf(SD_DAT_SM, stream_pio_cmds, 512, true);
+    uint cmd_words = (uint) (p - stream_pio_cmds);
+    if (cmd_words == 3) {
+        // pad to a power of 2 (before the final jmp back to waiting)
+        stream_pio_cmds[3] = stream_pio_cmds[2];
+        stream_pio_cmds[2] = sd_pio_cmd(sd_cmd_or_dat_offset_state_inline_instruction, pio_encode_nop());
+        cmd_words = 4;
+    }
+    c = dma_channel_get_default_config(sd_pio_dma_channel);
+    channel_config_set_read_increment(&c, true);
+    channel_config_set_write_increment(&c, false);
+    channel_config_set_ring(&c, false, cmd_words == 4 ? 4 : 3);
+    channel_config_set_dreq(&c, DREQ_PIO1_TX0 + SD_DAT_SM);
+    dma_channel_configure(
+            sd_pio_dma_channel,
+            &c,
+            &sd_pio->txf[SD_DAT_SM],
+            stream_pio_cmds,
+            0xffffffffu,
+            true
+    );
+
+    uint32_t response_buffer[5];
+    int rc = sd_command(sd_make_command(18, sector >> 24, sector >> 16, sector >> 8, sector & 0xffu), response_buffer, 6);
+    if (rc) sd_stream_stop();
+    return rc;
+}
+
+uint32_t *sd_stream_acquire(int *status)
+{
+    int s = SD_OK;
+    uint32_t *sector = NULL;
+    if (!stream_sector_count) {
+        s = SD_ERR_BAD_PARAM;
+    } else {
+        stream_resume_if_released();
+        uint slot = stream_next_acquire;
+        if (stream_acquired < stream_sector_count && *(volatile uint32_t *) &stream_slots[slot].filled) {
+            __compiler_memory_barrier();
+            sector = stream_buf + slot * 128;
+            if (bus_width == bw_wide && !sd_crc16_4bit_check(sector, 128, stream_crcs + slot * 2, stream_byteswapped)) {
+                printf("CRC error on streamed sector %d\n", slot);
+                s = SD_ERR_CRC;
+                sector = NULL;
+            } else {
+                stream_next_acquire = slot + 1 == stream_sector_count ? 0 : slot + 1;
+                stream_acquired++;
+            }
+        }
+    }
+    if (status) *status = s;
+    return sector;
+}
+
+void sd_stream_release(void)
+{
+    assert(stream_acquired);
+    uint slot = stream_next_release;
+    stream_slots[slot].filled = 0;
+    __compiler_memory_barrier();
+    *(volatile uint32_t *) &stream_slots[slot].gate = 0;
+    stream_resume_if_released();
+    stream_next_release = slot + 1 == stream_sector_count ? 0 : slot + 1;
+    stream_acquired--;
+}
+
+int sd_stream_stop(void)
+{
+    // stop the DMA first, so nothing stops the clock again
+    stop_dat_dma();
+    hw_set_bits(&sd_pio->ctrl, 1u << SD_CLK_SM);
+    uint32_t response_buffer[5];
+    int rc = sd_command(sd_make_command(12, 0, 0, 0, 0), response_buffer, 6);
+    // the data state machine may be part way through a block
+    reset_dat_sm();
+    // wait for the card to be no longer busy after CMD12
+    if (!rc) rc = sd_wait();
+    stream_sector_count = 0;
+    return rc;
+}
+
+const sd_queue_card_t sd_card_queue_card = {
+        .start_read = sd_readblocks_gather_async,
+        .start_write = sd_writeblocks_async,
+        .read_complete = sd_scatter_read_complete,
+        .write_complete = sd_write_complete,
+        .max_read_sectors = PICO_SD_MAX_BLOCK_COUNT,
+        .max_write_sectors = PICO_SD_MAX_BLOCK_COUNT,
+};
+
+static int block_device_read(const sd_block_device_t *device, uint32_t sector, uint sector_count, uint32_t *buf)
+{
+    while (sector_count)
+    {
+        uint n = MIN(sector_count, PICO_SD_MAX_BLOCK_COUNT);
+        int rc = sd_readblocks_sync(buf, sector, n);
+        if (rc) return rc;
+        buf += n * (SD_SECTOR_SIZE / 4);
+        sector += n;
+        sector_count -= n;
+    }
+    return SD_OK;
+}
+
+static int block_device_write(const sd_block_device_t *device, uint32_t sector, uint sector_count, const uint32_t *buf)
+{
+    while (sector_count)
+    {
+        uint n = MIN(sector_count, PICO_SD_MAX_BLOCK_COUNT);
+        int rc = sd_writeblocks_async(buf, sector, n);
+        if (rc) return rc;
+        while (!sd_write_complete(&rc))
+        {
+            tight_loop_contents();
+        }
+        if (rc) return rc;
+        buf += n * (SD_SECTOR_SIZE / 4);
+        sector += n;
+        sector_count -= n;
+    }
+    return SD_OK;
+}
+
+static uint32_t block_device_get_sector_count(const sd_block_device_t *device)
+{
+    return sd_get_sector_count();
+}
+
+// writes have finished (including the card's busy time) by the time sd_write_complete says so, so there is no sync
+const sd_block_device_t sd_card_block_device = {
+        .read = block_device_read,
+        .write = block_device_write,
+        .get_sector_count = block_device_get_sector_count,
+};
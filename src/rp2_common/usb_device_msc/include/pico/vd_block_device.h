@@ -0,0 +1,21 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _VD_BLOCK_DEVICE_H
+#define _VD_BLOCK_DEVICE_H
+
+#include "pico/sd_block_device.h"
+#include "pico/usb_device.h"
+#include "pico/virtual_disk.h"
+
+// A virtual disk (for usb_device_msc) which is the first vd_sector_count() sectors of a block device, e.g.
+// sd_card_block_device, or a cache in front of it (whose dirty sectors are written back on SYNCHRONIZE CACHE).
+//
+// NOTE: the block device is called synchronously from the USB IRQ handler, so must not be used from elsewhere while
+// the device is connected.
+void vd_set_block_device(const sd_block_device_t *device);
+
+#endif
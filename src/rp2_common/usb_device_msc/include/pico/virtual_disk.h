@@ -17,6 +17,8 @@ void vd_reset();
 // return true for async operation
 bool vd_read_block(uint32_t token, uint32_t lba, uint8_t *buf, uint32_t buf_size);
 bool vd_write_block(uint32_t token, uint32_t lba, uint8_t *buf, uint32_t buf_size);
+// called for SYNCHRONIZE CACHE; the default implementation does nothing
+void vd_sync();
 
 // give us ourselves 16M which should strictly be the minimum for FAT16 - Note Win10 doesn't like FAT12 - go figure!
 // upped to 64M which allows us to download a 32M UF2
@@ -129,6 +129,10 @@ static enum scsi_direction _scsi_dir(const struct scsi_cbw *cbw) {
     return (cbw->flags & USB_DIR_IN) ? SCSI_DIR_IN : SCSI_DIR_OUT;
 }
 
+// virtual disks which don't hold on to writes needn't provide this
+void __attribute__((weak)) vd_sync() {
+}
+
 static void _msc_init_for_dn(const struct scsi_cbw *cbw) {
     _msc_state.stall_direction_before_csw = SCSI_DIR_NONE;
     if (cbw->data_transfer_length) {
@@ -425,6 +429,7 @@ static void _msc_cmd_packet_internal(struct usb_endpoint *ep) {
                 return _scsi_handle_start_stop_unit(cbw);
             case SYNCHRONIZE_CACHE:
                 usb_debug("SYNCHRONIZE CACHE(10)\n");
+                vd_sync();
                 return _msc_init_for_dn(cbw);
             case VERIFY:
                 usb_debug("VERIFY\n");
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "pico/vd_block_device.h"
+
+static const sd_block_device_t *vd_device;
+
+void vd_set_block_device(const sd_block_device_t *device) {
+    vd_device = device;
+}
+
+void vd_init() {
+}
+
+void vd_reset() {
+    if (vd_device) sd_block_device_sync(vd_device);
+}
+
+void vd_sync() {
+    if (vd_device) sd_block_device_sync(vd_device);
+}
+
+bool vd_read_block(uint32_t token, uint32_t lba, uint8_t *buf, __unused uint32_t buf_size) {
+    assert(buf_size == SD_SECTOR_SIZE);
+    int rc = vd_device ? sd_block_device_read(vd_device, lba, 1, (uint32_t *) buf) : SD_ERR_STUCK;
+    vd_async_complete(token, rc != SD_OK);
+    return true;
+}
+
+bool vd_write_block(uint32_t token, uint32_t lba, uint8_t *buf, __unused uint32_t buf_size) {
+    assert(buf_size == SD_SECTOR_SIZE);
+    int rc = vd_device ? sd_block_device_write(vd_device, lba, 1, (const uint32_t *) buf) : SD_ERR_STUCK;
+    vd_async_complete(token, rc != SD_OK);
+    return true;
+}
@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Measures how fast platypus_scanvideo_generate fills scanline buffers on core 0 alone, and on both cores at once
+// (each with its own decoder instance and interpolator configuration), and from that the frame rate each can sustain
+// for some common resolutions. Scanvideo itself isn't running, so this is the decode cost only.
+
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "pico/scanvideo/composable_scanline.h"
+#include "hardware/clocks.h"
+#include "platypus_encode.h"
+#include "platypus_scanvideo.h"
+
+#define MAX_WIDTH 1024
+// the image is a band this high, which repeats down the screen
+#define BAND_HEIGHT 16
+// row pairs generated by each core for each measurement
+#define ROW_PAIRS 480
+#define BUFFER_WORDS (MAX_WIDTH / 2 + 3)
+
+static const uint widths[] = {320, 640, 800, 1024};
+
+static const struct {
+    uint width;
+    uint height;
+} modes[] = {
+        {320, 240},
+        {640, 480},
+        {800, 600},
+        {1024, 768},
+};
+
+static uint16_t band[BAND_HEIGHT * MAX_WIDTH];
+static uint32_t encoded[PLATYPUS_IMAGE_HEADER_WORDS + BAND_HEIGHT / 2 + 1 +
+                        BAND_HEIGHT / 2 * PLATYPUS_MAX_ROW_PAIR_WORDS(MAX_WIDTH)];
+// two scanline buffers for each core
+static uint32_t buffer_data[2][2][BUFFER_WORDS];
+static scanvideo_scanline_buffer_t buffers[2][2];
+
+static uint16_t rgb(uint r, uint g, uint b) {
+    return (uint16_t) (((r & 0x1fu) << PLATYPUS_PIXEL_RSHIFT) | ((g & 0x1fu) << PLATYPUS_PIXEL_GSHIFT) |
+                       ((b & 0x1fu) << PLATYPUS_PIXEL_BSHIFT));
+}
+
+// a mix of flat areas, gradients and detail, so all the block sizes are used
+static bool make_image(platypus_image_t *image, uint width) {
+    for (uint y = 0; y < BAND_HEIGHT; y++) {
+        for (uint x = 0; x < width; x++) {
+            uint16_t p;
+            if (x < width / 4) {
+                p = rgb(4, 12, 20);
+            } else if (x < width / 2) {
+                p = rgb(x * 32 / width, y * 2, x / 8);
+            } else {
+                p = rgb((x * x + y * 7) / 61, (x / 3) ^ y, (x * 3 + y * 5) / 7);
+            }
+            band[y * width + x] = p;
+        }
+    }
+    size_t words = platypus_encode_indexed_image(band, width, BAND_HEIGHT, width, true, encoded, count_of(encoded),
+                                                 NULL);
+    return words && platypus_image_init(image, encoded);
+}
+
+static void init_buffers(uint core) {
+    for (uint i = 0; i < 2; i++) {
+        buffers[core][i].data = buffer_data[core][i];
+        buffers[core][i].data_max = BUFFER_WORDS;
+    }
+}
+
+// generate row pairs as if they had come from scanvideo_begin_scanline_generation2, returning the time taken in us
+static int64_t generate(const platypus_image_t *image, uint core) {
+    absolute_time_t start = get_absolute_time();
+    for (uint i = 0; i < ROW_PAIRS; i++) {
+        buffers[core][0].scanline_id = i * 2;
+        buffers[core][1].scanline_id = i * 2 + 1;
+        platypus_scanvideo_generate(image, &buffers[core][0], &buffers[core][1], core);
+    }
+    return absolute_time_diff_us(start, get_absolute_time());
+}
+
+static void core1_benchmark(void) {
+    platypus_decompress_configure_interp(true);
+    while (true) {
+        const platypus_image_t *image = (const platypus_image_t *) (uintptr_t) multicore_fifo_pop_blocking();
+        multicore_fifo_push_blocking((uint32_t) generate(image, 1));
+    }
+}
+
+// check a scanline buffer holds the row of the band, as a raw run (ignoring the spare bit, which the decoder may set)
+static bool check_line(const scanvideo_scanline_buffer_t *buffer, uint width) {
+    const uint16_t *p = (const uint16_t *) buffer->data;
+    const uint16_t *row = band + (scanvideo_scanline_number(buffer->scanline_id) % BAND_HEIGHT) * width;
+    if (buffer->status != SCANLINE_OK || buffer->data_used != width / 2 + 3 || p[0] != COMPOSABLE_RAW_RUN ||
+        ((p[1] ^ row[0]) & PLATYPUS_PIXEL_MASK) || p[2] != width - 3 || p[width + 2] != COMPOSABLE_RAW_1P ||
+        p[width + 4] != COMPOSABLE_EOL_SKIP_ALIGN) {
+        return false;
+    }
+    for (uint x = 1; x < width; x++) {
+        if ((p[x + 2] ^ row[x]) & PLATYPUS_PIXEL_MASK) return false;
+    }
+    return true;
+}
+
+static uint check_generate(const platypus_image_t *image, uint width) {
+    uint failures = 0;
+    // a row pair, then a pair of scanlines from different row pairs (wrapping at the bottom of the band)
+    static const uint ids[][2] = {{2, 3}, {BAND_HEIGHT - 1, BAND_HEIGHT}};
+    for (uint i = 0; i < count_of(ids); i++) {
+        buffers[0][0].scanline_id = ids[i][0];
+        buffers[0][1].scanline_id = ids[i][1];
+        platypus_scanvideo_generate(image, &buffers[0][0], &buffers[0][1], false);
+        if (!check_line(&buffers[0][0], width) || !check_line(&buffers[0][1], width)) {
+            printf("FAILED: %d wide scanlines %d and %d generated wrongly\n", width, ids[i][0], ids[i][1]);
+            failures++;
+        }
+    }
+    buffers[0][1].data_max = width / 2 + 2;
+    platypus_scanvideo_generate(image, &buffers[0][0], &buffers[0][1], false);
+    if (buffers[0][0].status != SCANLINE_ERROR) {
+        printf("FAILED: %d wide scanlines generated into a short buffer\n", width);
+        failures++;
+    }
+    buffers[0][1].data_max = BUFFER_WORDS;
+    return failures;
+}
+
+int main(void) {
+    stdio_init_all();
+    platypus_decompress_configure_interp(false);
+    init_buffers(0);
+    init_buffers(1);
+    multicore_launch_core1(core1_benchmark);
+
+    uint mhz = (uint) (clock_get_hz(clk_sys) / 1000000);
+    printf("platypus scanvideo test (%s) at %d MHz\n", PLATYPUS_IMAGE_FORMAT ? "RGB565" : "RGB555", mhz);
+    uint failures = 0;
+    uint px_per_ms[count_of(widths)][2];
+    for (uint i = 0; i < count_of(widths); i++) {
+        uint width = widths[i];
+        platypus_image_t image;
+        if (!make_image(&image, width)) {
+            printf("FAILED: %d wide image didn't encode\n", width);
+            failures++;
+            continue;
+        }
+        failures += check_generate(&image, width);
+
+        uint64_t pixels = (uint64_t) ROW_PAIRS * 2 * width;
+        int64_t one_us = generate(&image, 0);
+        multicore_fifo_push_blocking((uintptr_t) &image);
+        int64_t core0_us = generate(&image, 0);
+        int64_t core1_us = (int64_t) multicore_fifo_pop_blocking();
+        int64_t two_us = MAX(core0_us, core1_us);
+        px_per_ms[i][0] = (uint) (pixels * 1000 / (uint64_t) MAX(one_us, 1));
+        px_per_ms[i][1] = (uint) (pixels * 2 * 1000 / (uint64_t) MAX(two_us, 1));
+        printf("width %4d: one core %3d px/us (%d.%02d cycles/px), two cores %3d px/us\n", width,
+               px_per_ms[i][0] / 1000, (int) (one_us * mhz / pixels),
+               (int) (one_us * mhz * 100 / pixels % 100), px_per_ms[i][1] / 1000);
+    }
+
+    printf("\nmode        max fps (one core)  max fps (two cores)\n");
+    for (uint m = 0; m < count_of(modes); m++) {
+        for (uint i = 0; i < count_of(widths); i++) {
+            if (widths[i] != modes[m].width) continue;
+            uint pixels_per_frame = modes[m].width * modes[m].height;
+            uint fps[2];
+            for (uint c = 0; c < 2; c++) fps[c] = (uint) ((uint64_t) px_per_ms[i][c] * 1000 / pixels_per_frame);
+            printf("%4dx%-4d   %4d %-3s            %4d %-3s\n", modes[m].width, modes[m].height,
+                   fps[0], fps[0] >= 60 ? "ok" : "", fps[1], fps[1] >= 60 ? "ok" : "");
+        }
+    }
+    printf("(\"ok\" where 60 fps is sustainable; scanvideo's own overhead, and whatever else the cores do, comes "
+           "out of the headroom)\n");
+
+    if (failures) {
+        printf("%d FAILURES\n", failures);
+    } else {
+        printf("PASSED\n");
+    }
+    return 0;
+}
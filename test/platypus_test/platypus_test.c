@@ -0,0 +1,451 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "platypus_encode.h"
+
+#define WIDTH 160
+#define HEIGHT 120
+// times each image is decoded for the benchmark
+#define DECODE_REPEATS 16
+// row pairs decoded at random positions for the seek benchmark
+#define SEEK_COUNT 256
+// size and length of the synthetic video for the frame tests
+#define VIDEO_WIDTH 64
+#define VIDEO_HEIGHT 48
+#define VIDEO_FRAMES 12
+
+static uint16_t image[WIDTH * HEIGHT];
+static uint32_t encoded[HEIGHT / 2 * PLATYPUS_MAX_ROW_PAIR_WORDS(WIDTH)];
+static uint32_t decoded[HEIGHT][WIDTH / 2];
+static uint32_t indexed[PLATYPUS_IMAGE_HEADER_WORDS + HEIGHT / 2 + 1 + HEIGHT / 2 * PLATYPUS_MAX_ROW_PAIR_WORDS(WIDTH)];
+
+enum test_image {
+    IMAGE_FLAT,
+    IMAGE_GRADIENT,
+    IMAGE_SMOOTH,
+    IMAGE_NOISE,
+    IMAGE_COUNT
+};
+
+static const char *const image_names[] = {"flat", "gradient", "smooth", "noise"};
+
+static uint16_t rgb(uint r, uint g, uint b) {
+    return (uint16_t) (((r & 0x1fu) << PLATYPUS_PIXEL_RSHIFT) | ((g & 0x1fu) << PLATYPUS_PIXEL_GSHIFT) |
+                       ((b & 0x1fu) << PLATYPUS_PIXEL_BSHIFT));
+}
+
+static void make_image(enum test_image which) {
+    uint32_t seed = 0x12345678;
+    for (uint y = 0; y < HEIGHT; y++) {
+        for (uint x = 0; x < WIDTH; x++) {
+            uint16_t p;
+            switch (which) {
+                case IMAGE_FLAT:
+                    p = rgb(12, 20, 7);
+                    break;
+                case IMAGE_GRADIENT:
+                    p = rgb(x * 32 / WIDTH, y * 32 / HEIGHT, (x + y) * 32 / (WIDTH + HEIGHT));
+                    break;
+                case IMAGE_SMOOTH: {
+                    // a blurred checkerboard with some diagonal features, i.e. mostly small deltas between pixels
+                    int cx = (int) x - WIDTH / 2, cy = (int) y - HEIGHT / 2;
+                    p = rgb((uint) (cx * cx + cy * cy) / 97, (x / 3) ^ (y / 5), (x * 3 + y * 2) / 17);
+                    break;
+                }
+                default:
+                    seed = seed * 1103515245u + 12345u;
+                    p = (uint16_t) (seed >> 16);
+                    break;
+            }
+            image[y * WIDTH + x] = p;
+        }
+    }
+}
+
+static const uint32_t *decode_row_pair(uint y, const uint32_t *s) {
+    return platypus_decompress_row_a(decoded[y], decoded[y + 1], s, WIDTH);
+}
+
+static uint16_t decoded_pixel(uint x, uint y) {
+    return (uint16_t) (decoded[y][x / 2] >> ((x & 1u) * 16));
+}
+
+static uint channel_error(uint16_t a, uint16_t b, uint shift) {
+    int d = (int) ((a >> shift) & 0x1fu) - (int) ((b >> shift) & 0x1fu);
+    return (uint) abs(d);
+}
+
+static int round_trip_test(enum test_image which, bool lossless) {
+    int failures = 0;
+    make_image(which);
+    platypus_encode_stats_t stats = {0};
+    size_t words = platypus_encode_image(image, WIDTH, HEIGHT, WIDTH, lossless, encoded, count_of(encoded), &stats);
+    if (!words) {
+        printf("FAILED: %s didn't encode\n", image_names[which]);
+        return 1;
+    }
+    const uint32_t *s = encoded;
+    absolute_time_t start = get_absolute_time();
+    for (uint i = 0; i < DECODE_REPEATS; i++) {
+        s = encoded;
+        for (uint y = 0; y < HEIGHT; y += 2) {
+            s = decode_row_pair(y, s);
+        }
+    }
+    int64_t us = absolute_time_diff_us(start, get_absolute_time());
+    if (s != encoded + words) {
+        printf("FAILED: %s decoded %d words, expected %d\n", image_names[which], (int) (s - encoded), (int) words);
+        failures++;
+    }
+    uint max_error = 0, wrong = 0;
+    for (uint y = 0; y < HEIGHT; y++) {
+        for (uint x = 0; x < WIDTH; x++) {
+            uint16_t a = image[y * WIDTH + x], b = decoded_pixel(x, y);
+            if ((a ^ b) & PLATYPUS_PIXEL_MASK) {
+                wrong++;
+                max_error = MAX(max_error, channel_error(a, b, PLATYPUS_PIXEL_RSHIFT));
+                max_error = MAX(max_error, channel_error(a, b, PLATYPUS_PIXEL_GSHIFT));
+                max_error = MAX(max_error, channel_error(a, b, PLATYPUS_PIXEL_BSHIFT));
+            }
+        }
+    }
+    uint blocks = stats.blocks_3 + stats.blocks_4 + stats.blocks_7 + stats.blocks_8;
+    printf("%-8s %-8s ratio %3d.%02d blocks 3:%-5d 4:%-5d 7:%-5d 8:%-5d lossy %-5d max error %d decode %d px/us\n",
+           image_names[which], lossless ? "lossless" : "lossy",
+           (int) (WIDTH * HEIGHT * 2 / (words * 4)), (int) (WIDTH * HEIGHT * 200 / (words * 4) % 100),
+           (int) stats.blocks_3, (int) stats.blocks_4, (int) stats.blocks_7, (int) stats.blocks_8,
+           (int) stats.lossy_blocks, max_error, us ? (int) (WIDTH * HEIGHT * DECODE_REPEATS / us) : -1);
+    if (blocks != WIDTH * HEIGHT / 4) {
+        printf("FAILED: %s has %d blocks\n", image_names[which], blocks);
+        failures++;
+    }
+    if (lossless ? (wrong || stats.lossy_blocks) : (max_error > 1 || (wrong && !stats.lossy_blocks))) {
+        printf("FAILED: %s has %d wrong pixels\n", image_names[which], wrong);
+        failures++;
+    }
+    if (lossless ? stats.blocks_7 + stats.blocks_8 == 0 : stats.blocks_8 != 0) {
+        if (which == IMAGE_NOISE || !lossless) {
+            printf("FAILED: %s used the wrong literal blocks\n", image_names[which]);
+            failures++;
+        }
+    }
+    return failures;
+}
+
+// each delta pattern (and the literal forms) must decode to exactly the block it was chosen for
+static int block_tests(void) {
+    static const uint8_t deltas[][4] = {
+            {0, 0, 0, 0}, {0, 1, 1, 1}, {1, 1, 1, 0}, {0, 1, 3, 3}, {2, 1, 2, 0}, {1, 0, 1, 1}, {0, 3, 0, 0},
+    };
+    int failures = 0;
+    for (uint r = 0; r < count_of(deltas); r++) {
+        for (uint g = 0; g < count_of(deltas); g++) {
+            for (uint b = 0; b < count_of(deltas); b++) {
+                uint16_t row0[2], row1[2];
+                uint16_t *px[4] = {row0, row0 + 1, row1, row1 + 1};
+                for (uint i = 0; i < 4; i++) {
+                    *px[i] = rgb(27 + deltas[r][i], 3 + deltas[g][i], 14 + deltas[b][i]);
+                }
+                uint32_t s[2];
+                platypus_encode_stats_t stats = {0};
+                size_t words = platypus_encode_row_pair(row0, row1, 2, true, s, &stats);
+                uint32_t d0, d1;
+                const uint32_t *end = platypus_decompress_row_a(&d0, &d1, s, 2);
+                if (end != s + words || ((d0 ^ (row0[0] | (row0[1] << 16))) & (PLATYPUS_PIXEL_MASK * 0x10001u)) ||
+                    ((d1 ^ (row1[0] | (row1[1] << 16))) & (PLATYPUS_PIXEL_MASK * 0x10001u))) {
+                    printf("FAILED: block %d %d %d\n", r, g, b);
+                    failures++;
+                }
+                // {0, 3, 0, 0} isn't one of the patterns
+                bool delta = r < count_of(deltas) - 1 && g < count_of(deltas) - 1 && b < count_of(deltas) - 1;
+                bool short_delta = delta && r < 2 && g < 2 && b < 2;
+                if (delta != (stats.blocks_3 + stats.blocks_4 == 1) || short_delta != (stats.blocks_3 == 1)) {
+                    printf("FAILED: block %d %d %d encoded with the wrong size\n", r, g, b);
+                    failures++;
+                }
+            }
+        }
+    }
+    return failures;
+}
+
+static int param_tests(void) {
+    int failures = 0;
+    make_image(IMAGE_NOISE);
+    if (platypus_encode_image(image, WIDTH - 1, HEIGHT, WIDTH, true, encoded, count_of(encoded), NULL) ||
+        platypus_encode_image(image, WIDTH, HEIGHT - 1, WIDTH, true, encoded, count_of(encoded), NULL) ||
+        platypus_encode_image(image, 0, HEIGHT, WIDTH, true, encoded, count_of(encoded), NULL)) {
+        printf("FAILED: odd sizes accepted\n");
+        failures++;
+    }
+    // noise needs more than half the raw size
+    if (platypus_encode_image(image, WIDTH, HEIGHT, WIDTH, true, encoded, count_of(encoded) / 2, NULL)) {
+        printf("FAILED: overflow not detected\n");
+        failures++;
+    }
+    // sizing a row pair must match encoding it
+    size_t sized = platypus_encode_row_pair(image, image + WIDTH, WIDTH, false, NULL, NULL);
+    size_t words = platypus_encode_row_pair(image, image + WIDTH, WIDTH, false, encoded, NULL);
+    if (sized != words || words > PLATYPUS_MAX_ROW_PAIR_WORDS(WIDTH)) {
+        printf("FAILED: row pair size %d, sized as %d\n", (int) words, (int) sized);
+        failures++;
+    }
+    return failures;
+}
+
+// every row pair decoded via the index must match decoding the whole image from the top
+static int indexed_tests(void) {
+    int failures = 0;
+    make_image(IMAGE_SMOOTH);
+    size_t words = platypus_encode_image(image, WIDTH, HEIGHT, WIDTH, false, encoded, count_of(encoded), NULL);
+    size_t indexed_words = platypus_encode_indexed_image(image, WIDTH, HEIGHT, WIDTH, false, indexed,
+                                                         count_of(indexed), NULL);
+    platypus_image_t pimage;
+    if (!indexed_words || !platypus_image_init(&pimage, indexed) || pimage.width != WIDTH ||
+        pimage.height != HEIGHT) {
+        printf("FAILED: indexed image didn't encode\n");
+        return 1;
+    }
+    if (indexed_words != words + PLATYPUS_IMAGE_HEADER_WORDS + HEIGHT / 2 + 1 ||
+        memcmp(pimage.data, encoded, words * sizeof(uint32_t))) {
+        printf("FAILED: indexed image data differs from the sequential encoding\n");
+        failures++;
+    }
+    const uint32_t *s = encoded;
+    for (uint y = 0; y < HEIGHT; y += 2) {
+        s = decode_row_pair(y, s);
+    }
+    uint32_t d0[WIDTH / 2], d1[WIDTH / 2];
+    platypus_image_decoder_t decoder;
+    // seek to each row pair in turn, with the second row of the pair and beyond the bottom (wrapping) too
+    for (uint y = 0; y < HEIGHT * 2; y += 3) {
+        platypus_image_decoder_seek(&decoder, &pimage, y);
+        // decode a few row pairs from there, wrapping at the bottom
+        for (uint i = 0; i < 3; i++) {
+            uint row_pair = platypus_image_decoder_next(&decoder, d0, d1);
+            uint expected = ((y % HEIGHT) / 2 + i) % (HEIGHT / 2);
+            if (row_pair != expected || memcmp(d0, decoded[row_pair * 2], sizeof(d0)) ||
+                memcmp(d1, decoded[row_pair * 2 + 1], sizeof(d1))) {
+                printf("FAILED: seek to row %d, row pair %d (expected %d) differs\n", y, row_pair, expected);
+                failures++;
+            }
+        }
+    }
+    uint32_t bad[PLATYPUS_IMAGE_HEADER_WORDS + 2];
+    memcpy(bad, indexed, sizeof(bad));
+    bad[1] ^= 1;
+    if (platypus_image_init(&pimage, bad)) {
+        printf("FAILED: image with the wrong pixel format accepted\n");
+        failures++;
+    }
+    bad[1] ^= 1;
+    bad[2] = WIDTH | ((HEIGHT - 1) << 16);
+    if (platypus_image_init(&pimage, bad)) {
+        printf("FAILED: image with an odd height accepted\n");
+        failures++;
+    }
+    if (platypus_encode_indexed_image(image, WIDTH, HEIGHT, WIDTH, false, indexed, indexed_words - 1, NULL)) {
+        printf("FAILED: indexed image overflow not detected\n");
+        failures++;
+    }
+    return failures;
+}
+
+// the time to get an arbitrary row pair; with the index, vs decoding down from the top without it
+static void seek_benchmark(void) {
+    make_image(IMAGE_SMOOTH);
+    platypus_encode_indexed_image(image, WIDTH, HEIGHT, WIDTH, false, indexed, count_of(indexed), NULL);
+    platypus_image_t pimage;
+    platypus_image_init(&pimage, indexed);
+    uint16_t rows[SEEK_COUNT];
+    uint32_t seed = 0x87654321;
+    for (uint i = 0; i < SEEK_COUNT; i++) {
+        seed = seed * 1103515245u + 12345u;
+        rows[i] = (uint16_t) ((seed >> 16) % HEIGHT);
+    }
+    platypus_image_decoder_t decoder;
+    absolute_time_t start = get_absolute_time();
+    for (uint i = 0; i < SEEK_COUNT; i++) {
+        platypus_image_decoder_seek(&decoder, &pimage, rows[i]);
+        platypus_image_decoder_next(&decoder, decoded[0], decoded[1]);
+    }
+    int64_t indexed_us = absolute_time_diff_us(start, get_absolute_time());
+    start = get_absolute_time();
+    for (uint i = 0; i < SEEK_COUNT; i++) {
+        const uint32_t *s = pimage.data;
+        for (uint y = 0; y <= rows[i]; y += 2) {
+            s = platypus_decompress_row_a(decoded[0], decoded[1], s, WIDTH);
+        }
+    }
+    int64_t sequential_us = absolute_time_diff_us(start, get_absolute_time());
+    printf("seek to a random row pair and decode it: %d ns with the index, %d ns decoding from the top\n",
+           (int) (indexed_us * 1000 / SEEK_COUNT), (int) (sequential_us * 1000 / SEEK_COUNT));
+}
+
+// a tiny video pinning down the frame format: a key frame, a single changed block, then a copied row pair
+static int frame_vector_tests(void) {
+    static const uint16_t frames[3][4][4] = {
+            {{12, 12, 12, 12}, {12, 12, 12, 12}, {12, 12, 12, 12}, {12, 12, 12, 12}},
+            {{12, 12, 12, 12}, {12, 12, 12, 12}, {12, 12, 12, 13}, {12, 12, 13, 13}},
+            {{12, 12, 12, 13}, {12, 12, 13, 13}, {12, 12, 12, 13}, {12, 12, 13, 13}},
+    };
+#ifndef PLATYPUS_565
+    static const uint32_t delta_block = 0xa002000c;
+#else
+    static const uint32_t delta_block = 0xa008000c;
+#endif
+    static const uint32_t expected_0[] = {
+            PLATYPUS_FRAME_MAGIC, PLATYPUS_IMAGE_FORMAT, 0x00040004, 12,
+            0x00010000, 0x00020000, 0x0c00000c, 0xa0a00000,
+            0x00010000, 0x00020000, 0x0c00000c, 0xa0a00000,
+    };
+    static const uint32_t expected_1[] = {
+            PLATYPUS_FRAME_MAGIC, PLATYPUS_IMAGE_FORMAT, 0x00040004, 8,
+            0x00000000,
+            0x00010000, 0x00010001, delta_block,
+    };
+    static const uint32_t expected_2[] = {
+            PLATYPUS_FRAME_MAGIC, PLATYPUS_IMAGE_FORMAT, 0x00040004, 6,
+            0x00000002,
+            0x00000000,
+    };
+    static const uint32_t *const expected[] = {expected_0, expected_1, expected_2};
+    static const uint expected_words[] = {count_of(expected_0), count_of(expected_1), count_of(expected_2)};
+    int failures = 0;
+    uint16_t reference[16] __attribute__((aligned(4)));
+    uint16_t framebuffer[16] __attribute__((aligned(4)));
+    uint32_t frame[32];
+    for (uint f = 0; f < 3; f++) {
+        size_t words = platypus_encode_frame(&frames[f][0][0], 4, 4, 4, !f, true, reference, frame, count_of(frame),
+                                             NULL);
+        if (words != expected_words[f] || memcmp(frame, expected[f], words * sizeof(uint32_t))) {
+            printf("FAILED: frame vector %d:", f);
+            for (uint i = 0; i < words; i++) printf(" %08x", (unsigned) frame[i]);
+            printf("\n");
+            failures++;
+            continue;
+        }
+        if (!platypus_frame_check(frame, 4, 4) || platypus_frame_check(frame, 4, 2)) {
+            printf("FAILED: frame vector %d header\n", f);
+            failures++;
+        }
+        platypus_frame_decode(frame, framebuffer, 4);
+        for (uint i = 0; i < 16; i++) {
+            if ((framebuffer[i] ^ (&frames[f][0][0])[i]) & PLATYPUS_PIXEL_MASK) {
+                printf("FAILED: frame vector %d decoded wrongly\n", f);
+                failures++;
+                break;
+            }
+        }
+    }
+    return failures;
+}
+
+// a smooth background scrolling 2 rows per frame, with a sprite moving across it
+static void make_video_frame(uint16_t *pixels, uint frame, bool scroll_down) {
+    for (uint y = 0; y < VIDEO_HEIGHT; y++) {
+        for (uint x = 0; x < VIDEO_WIDTH; x++) {
+            uint by = scroll_down ? y + 100 - frame * 2 : y + frame * 2;
+            uint16_t p = rgb(x / 3 + by / 4, (x ^ by) / 3, (x * 3 + by * 2) / 11);
+            if (x - (3 + frame * 3) < 12 && y - (7 + frame) < 12) {
+                p = rgb(31 - x, y * 2, frame * 5);
+            }
+            pixels[y * VIDEO_WIDTH + x] = p;
+        }
+    }
+}
+
+static int video_test(bool lossless, bool scroll_down) {
+    static uint16_t source[VIDEO_WIDTH * VIDEO_HEIGHT];
+    static uint16_t reference[VIDEO_WIDTH * VIDEO_HEIGHT] __attribute__((aligned(4)));
+    static uint16_t framebuffer[VIDEO_WIDTH * VIDEO_HEIGHT] __attribute__((aligned(4)));
+    static uint32_t frame[PLATYPUS_FRAME_HEADER_WORDS + VIDEO_HEIGHT / 2 * (3 + VIDEO_WIDTH + VIDEO_WIDTH / 2)];
+    int failures = 0;
+    size_t key_words = 0, delta_words = 0;
+    uint delta_blocks = 0;
+    platypus_encode_stats_t stats = {0};
+    for (uint f = 0; f < VIDEO_FRAMES; f++) {
+        make_video_frame(source, f, scroll_down);
+        size_t words = platypus_encode_frame(source, VIDEO_WIDTH, VIDEO_HEIGHT, VIDEO_WIDTH, !f, lossless, reference,
+                                             frame, count_of(frame), f ? &stats : NULL);
+        if (!words || words != platypus_frame_words(frame) ||
+            !platypus_frame_check(frame, VIDEO_WIDTH, VIDEO_HEIGHT)) {
+            printf("FAILED: video frame %d didn't encode\n", f);
+            return failures + 1;
+        }
+        // scrolling down can only copy from row pairs above, which have to be decoded first
+        if (f && !(frame[1] & PLATYPUS_FRAME_FLAG_BOTTOM_UP) != !scroll_down) {
+            printf("FAILED: video frame %d decoded in the wrong order\n", f);
+            failures++;
+        }
+        uint blocks = platypus_frame_decode(frame, framebuffer, VIDEO_WIDTH);
+        if (f) {
+            delta_words += words;
+            delta_blocks += blocks;
+        } else {
+            key_words = words;
+        }
+        uint wrong = 0, max_error = 0;
+        for (uint i = 0; i < VIDEO_WIDTH * VIDEO_HEIGHT; i++) {
+            if ((framebuffer[i] ^ reference[i]) & PLATYPUS_PIXEL_MASK) wrong++;
+            max_error = MAX(max_error, channel_error(framebuffer[i], source[i], PLATYPUS_PIXEL_RSHIFT));
+            max_error = MAX(max_error, channel_error(framebuffer[i], source[i], PLATYPUS_PIXEL_GSHIFT));
+            max_error = MAX(max_error, channel_error(framebuffer[i], source[i], PLATYPUS_PIXEL_BSHIFT));
+        }
+        if (wrong || max_error > (lossless ? 0 : 1)) {
+            printf("FAILED: video frame %d has %d pixels differing from the encoder, max error %d\n", f, wrong,
+                   max_error);
+            failures++;
+        }
+    }
+    uint frame_blocks = VIDEO_WIDTH * VIDEO_HEIGHT / 4;
+    printf("video %-8s %-4s key frame %d bytes, delta frames %d bytes (%d%% of key) decoding %d%% of blocks, "
+           "%d unchanged, %d row pairs copied\n", lossless ? "lossless" : "lossy", scroll_down ? "down" : "up",
+           (int) key_words * 4, (int) (delta_words * 4 / (VIDEO_FRAMES - 1)),
+           (int) (delta_words * 100 / (key_words * (VIDEO_FRAMES - 1))),
+           delta_blocks * 100 / (frame_blocks * (VIDEO_FRAMES - 1)), (int) stats.blocks_unchanged,
+           (int) stats.row_pairs_copied);
+    if (!stats.row_pairs_copied || delta_words * 2 > key_words * (VIDEO_FRAMES - 1)) {
+        printf("FAILED: video %s didn't use the previous frames\n", lossless ? "lossless" : "lossy");
+        failures++;
+    }
+    return failures;
+}
+
+int main(void) {
+    stdio_init_all();
+#if PICO_ON_DEVICE
+    platypus_decompress_configure_interp(false);
+#endif
+
+#ifdef PLATYPUS_565
+    printf("platypus test (RGB565)\n");
+#else
+    printf("platypus test (RGB555)\n");
+#endif
+    int failures = block_tests();
+    failures += param_tests();
+    for (uint i = 0; i < IMAGE_COUNT; i++) {
+        failures += round_trip_test((enum test_image) i, true);
+        failures += round_trip_test((enum test_image) i, false);
+    }
+    failures += indexed_tests();
+    seek_benchmark();
+    failures += frame_vector_tests();
+    failures += video_test(true, false);
+    failures += video_test(false, true);
+    if (failures) {
+        printf("%d FAILURES\n", failures);
+    } else {
+        printf("PASSED\n");
+    }
+    return failures != 0;
+}
@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Runs lines encoded by composable_encode_line_8bpp or composable_encode_line_24bpp (whichever PICO_SCANVIDEO_BPP
+// selects) through the matching variant of the composable scanline program, on a model of the PIO state machine with
+// the delays set by composable_set_program_delays, and checks the pixels output. Also checks that both ends of line
+// are used where the token size allows, that long 8bpp lines are split into several runs, and that lines which don't
+// fit in max_words are refused without writing past it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "pico/scanvideo/composable_scanline.h"
+
+#if PICO_SCANVIDEO_BPP != 8 && PICO_SCANVIDEO_BPP != 24
+#error this test requires PICO_SCANVIDEO_BPP 8 or 24
+#endif
+
+#if PICO_SCANVIDEO_BPP == 8
+typedef uint8_t pixel_t;
+// enough for three runs
+#define MAX_WIDTH (COMPOSABLE_MAX_RUN_8BPP * 2 + 4)
+#define PIXEL_MASK 0xffu
+#define encode_line composable_encode_line_8bpp
+// a byte per pixel
+#define DATA_WORDS (MAX_WIDTH / 4 + 8)
+#else
+typedef uint32_t pixel_t;
+#define MAX_WIDTH 300
+#define PIXEL_MASK 0xffffffu
+#define encode_line composable_encode_line_24bpp
+// a word per pixel
+#define DATA_WORDS (MAX_WIDTH + 8)
+#endif
+
+#define MAX_XSCALE 3
+// output pixels looked at for each line (the widest line, its black pixel, and some blanking)
+#define OUTPUT_PIXELS ((MAX_WIDTH + 8) * MAX_XSCALE)
+// written after the space given to the encoder, and checked afterwards
+#define GUARD 0xdeadbeefu
+
+#define PROGRAM(x) __EXTRA_CONCAT(video_24mhz_composable_prefix, __EXTRA_CONCAT(_, x))
+
+static uint16_t program[32];
+static pixel_t pixels[MAX_WIDTH];
+static uint32_t data[DATA_WORDS + 1];
+// the pins on each cycle, starting with the one on which the first token is dispatched
+static uint32_t pins_by_cycle[OUTPUT_PIXELS * 2];
+
+// what the last line run was made of
+static struct {
+    uint runs;          // raw_run, raw_1p and raw_2p tokens
+    uint eol_align;
+    uint eol_skip_align;
+} line_tokens;
+
+// run the state machine from the end of the wait for the scanline IRQ until it waits again (with out shifting right
+// and autopull at 32 bits, as configured by video_24mhz_composable_configure_pio), recording the pins on each cycle
+static bool run_line(const uint32_t *line, uint words) {
+    uint pc = video_24mhz_composable_program_extern(nop_raw);
+    uint32_t osr = 0, x = 0, pins = 0;
+    uint shift_count = 32, next_word = 0, cycle = 0;
+    memset(&line_tokens, 0, sizeof(line_tokens));
+    while (true) {
+        uint instr = program[pc];
+        uint delay = (instr >> 8u) & 0x1fu;
+        uint next_pc = pc == PROGRAM(wrap) ? PROGRAM(wrap_target) : pc + 1;
+        switch (instr >> 13u) {
+            case 0: { // jmp
+                uint condition = (instr >> 5u) & 7u;
+                if (condition == 0) {
+                    next_pc = instr & 0x1fu;
+                } else if (condition == 2) {
+                    if (x) next_pc = instr & 0x1fu;
+                    x--;
+                } else {
+                    return false;
+                }
+                break;
+            }
+            case 1: // wait (for the next scanline)
+                if (next_word != words || shift_count != 32) return false;
+                while (cycle < count_of(pins_by_cycle)) pins_by_cycle[cycle++] = pins;
+                return true;
+            case 3: { // out
+                uint bits = instr & 0x1fu;
+                if (!bits) bits = 32;
+                if (shift_count >= 32) {
+                    if (next_word == words) return false;
+                    osr = line[next_word++];
+                    shift_count = 0;
+                }
+                uint32_t value = bits == 32 ? osr : osr & ((1u << bits) - 1);
+                osr = bits == 32 ? 0 : osr >> bits;
+                shift_count = MIN(32, shift_count + bits);
+                switch ((instr >> 5u) & 7u) {
+                    case 0:
+                        pins = value & PIXEL_MASK;
+                        break;
+                    case 1:
+                        x = value;
+                        break;
+                    case 3:
+                        break;
+                    case 5:
+                        if (value >= count_of(program)) return false;
+                        if (value == COMPOSABLE_RAW_RUN || value == COMPOSABLE_RAW_1P || value == COMPOSABLE_RAW_2P) {
+                            line_tokens.runs++;
+                        } else if (value == COMPOSABLE_EOL_ALIGN) {
+                            line_tokens.eol_align++;
+                        } else if (value == COMPOSABLE_EOL_SKIP_ALIGN) {
+                            line_tokens.eol_skip_align++;
+                        }
+                        next_pc = value;
+                        break;
+                    default:
+                        return false;
+                }
+                break;
+            }
+            default:
+                return false;
+        }
+        for (uint i = 0; i <= delay; i++) {
+            if (cycle == count_of(pins_by_cycle)) return false;
+            pins_by_cycle[cycle++] = pins;
+        }
+        pc = next_pc;
+    }
+}
+
+// the cycle on which the first pixel of a line starts
+static int first_pixel_cycle(void) {
+#if PICO_SCANVIDEO_BPP == 8
+    static const uint8_t tokens[4] = {COMPOSABLE_RAW_1P, 0xff, COMPOSABLE_EOL_SKIP_ALIGN, 0};
+    uint32_t line[1];
+#else
+    static const uint32_t tokens[3] = {COMPOSABLE_RAW_1P, 0xffffff, COMPOSABLE_EOL_ALIGN};
+    uint32_t line[3];
+#endif
+    memcpy(line, tokens, sizeof(line));
+    if (!run_line(line, count_of(line))) return -1;
+    for (uint i = 0; i < count_of(pins_by_cycle); i++) {
+        if (pins_by_cycle[i]) return (int) i;
+    }
+    return -1;
+}
+
+static uint check_xscale(uint xscale) {
+    memcpy(program, PROGRAM(program_instructions), sizeof(PROGRAM(program_instructions)));
+    int origin = composable_set_program_delays(program, xscale, 1) ? first_pixel_cycle() : -1;
+    if (origin < 0) {
+        printf("FAILED: xscale %d: program didn't adapt, or a raw pixel didn't run\n", xscale);
+        return 1;
+    }
+    uint failures = 0;
+    uint eol_align = 0, eol_skip_align = 0;
+    for (uint width = 0; width <= MAX_WIDTH; width++) {
+        for (uint i = 0; i < width; i++) pixels[i] = (pixel_t) ((uint32_t) rand() & PIXEL_MASK);
+        int words = encode_line(pixels, width, data, DATA_WORDS);
+        if (words < 0 || !run_line(data, (uint) words)) {
+            printf("FAILED: xscale %d: %d wide line didn't encode or run\n", xscale, width);
+            failures++;
+            continue;
+        }
+        eol_align += line_tokens.eol_align;
+        eol_skip_align += line_tokens.eol_skip_align;
+#if PICO_SCANVIDEO_BPP == 8
+        uint runs = (width + COMPOSABLE_MAX_RUN_8BPP - 1) / COMPOSABLE_MAX_RUN_8BPP;
+#else
+        uint runs = width ? 1 : 0;
+#endif
+        // plus the black pixel
+        if (line_tokens.runs != runs + 1) {
+            printf("FAILED: xscale %d: %d wide line is %d runs, expected %d\n", xscale, width, line_tokens.runs - 1,
+                   runs);
+            failures++;
+        }
+        // each pixel is xscale pixels wide, and then the line is black
+        for (uint p = 0; p < OUTPUT_PIXELS - 1; p++) {
+            uint32_t expected = p < width * xscale ? pixels[p / xscale] : 0;
+            uint c = (uint) origin + p * 2;
+            if (pins_by_cycle[c] != expected || pins_by_cycle[c + 1] != expected) {
+                printf("FAILED: xscale %d: %d wide line has output pixel %d wrong\n", xscale, width, p);
+                failures++;
+                break;
+            }
+        }
+        // one word fewer must be refused, without anything being written past it
+        for (uint max_words = 0; max_words < (uint) words; max_words += MAX(1u, (uint) words - 1)) {
+            data[max_words] = GUARD;
+            if (encode_line(pixels, width, data, max_words) != -1 || data[max_words] != GUARD) {
+                printf("FAILED: xscale %d: %d wide line in %d words wasn't refused cleanly\n", xscale, width,
+                       max_words);
+                failures++;
+            }
+        }
+    }
+    // both ends of line must be used with byte tokens; word tokens always end aligned
+    if (!eol_align || (PICO_SCANVIDEO_BPP == 8) != (eol_skip_align != 0)) {
+        printf("FAILED: xscale %d: lines ended with %d EOL_ALIGN and %d EOL_SKIP_ALIGN\n", xscale, eol_align,
+               eol_skip_align);
+        failures++;
+    }
+    printf("xscale %d: %d lines, %d ending EOL_ALIGN, %d ending EOL_SKIP_ALIGN\n", xscale, MAX_WIDTH + 1, eol_align,
+           eol_skip_align);
+    return failures;
+}
+
+int main(void) {
+    stdio_init_all();
+
+    printf("scanvideo composable %dbpp test\n", PICO_SCANVIDEO_BPP);
+    uint failures = 0;
+    for (uint xscale = 1; xscale <= MAX_XSCALE; xscale++) {
+        failures += check_xscale(xscale);
+    }
+    if (failures) {
+        printf("%d FAILURES\n", failures);
+    } else {
+        printf("PASSED\n");
+    }
+    return failures != 0;
+}
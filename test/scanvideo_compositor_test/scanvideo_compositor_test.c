@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "pico/scanvideo/compositor.h"
+#include "pico/scanvideo/composable_scanline.h"
+#include "pico/scanvideo/rle.h"
+
+#define WIDTH 320
+#define MAX_SPANS 32
+#define BENCHMARK_LINES 1000
+
+typedef struct {
+    scanvideo_span_t spans[MAX_SPANS];
+    uint count;
+    int16_t priority;
+} test_layer_t;
+
+static uint16_t pixel_data[4096];
+static uint32_t tokens[WIDTH + 8];
+static uint16_t reference[WIDTH];
+static uint16_t decoded[WIDTH + 1];
+static scanvideo_compositor_t comp;
+
+static uint get_spans(void *context, uint line, const scanvideo_span_t **spans) {
+    (void) line;
+    test_layer_t *layer = (test_layer_t *) context;
+    *spans = layer->spans;
+    return layer->count;
+}
+
+// the naive way: paint every layer back to front into a line buffer
+static void paint_naive(const test_layer_t *layers, const uint *order, uint layer_count, uint width,
+                        uint16_t background) {
+    for (uint x = 0; x < width; x++) reference[x] = background;
+    for (uint i = 0; i < layer_count; i++) {
+        const test_layer_t *layer = layers + order[i];
+        for (uint s = 0; s < layer->count; s++) {
+            const scanvideo_span_t *span = layer->spans + s;
+            for (uint x = 0; x < span->width; x++) {
+                if (span->type == SCANVIDEO_SPAN_COLOR) {
+                    reference[span->x + x] = span->color;
+                } else if (span->type == SCANVIDEO_SPAN_PIXELS || span->pixels[x] != span->color) {
+                    reference[span->x + x] = span->pixels[x];
+                }
+            }
+        }
+    }
+}
+
+// ... followed by encoding the line as a single raw run
+static uint encode_naive(uint width) {
+    uint16_t *p = (uint16_t *) tokens;
+    *p++ = COMPOSABLE_RAW_RUN;
+    *p++ = reference[0];
+    *p++ = (uint16_t) (width - 3);
+    memcpy(p, reference + 1, (width - 1) * sizeof(uint16_t));
+    p += width - 1;
+    *p++ = COMPOSABLE_RAW_1P;
+    *p++ = 0;
+    if (1u & (p - (uint16_t *) tokens)) {
+        *p++ = COMPOSABLE_EOL_ALIGN;
+    } else {
+        *p++ = COMPOSABLE_EOL_SKIP_ALIGN;
+        *p++ = 0;
+    }
+    return (uint) ((uint32_t *) p - tokens);
+}
+
+static void random_layer(test_layer_t *layer, uint width) {
+    layer->count = 0;
+    uint x = (uint) rand() % 8;
+    while (layer->count < MAX_SPANS && x < width) {
+        scanvideo_span_t *span = layer->spans + layer->count++;
+        span->x = (uint16_t) x;
+        span->width = (uint16_t) (1 + rand() % MIN(24, width - x));
+        span->type = (uint16_t) (SCANVIDEO_SPAN_COLOR + rand() % 3);
+        span->color = (uint16_t) (rand() & 3);
+        span->pixels = pixel_data + rand() % (count_of(pixel_data) - WIDTH);
+        x += span->width + rand() % 12;
+    }
+}
+
+static bool check_line(uint width) {
+    int words = scanvideo_compositor_compose_line(&comp, 0, tokens, count_of(tokens));
+    if (words < 0) return false;
+    int n = scanvideo_rle_decode_line(tokens, (uint) words, decoded, count_of(decoded));
+    return n == (int) width + 1 && !memcmp(decoded, reference, width * sizeof(uint16_t));
+}
+
+static int random_tests(void) {
+    int failures = 0;
+    test_layer_t layers[4];
+    for (uint pass = 0; pass < 2000 && failures < 10; pass++) {
+        uint width = 8 + rand() % (WIDTH - 8);
+        uint16_t background = (uint16_t) (rand() & 3);
+        scanvideo_compositor_init(&comp, width, background);
+        uint layer_count = 1 + rand() % count_of(layers);
+        // pick distinct priorities, added in random order
+        uint order[count_of(layers)];
+        for (uint i = 0; i < layer_count; i++) {
+            random_layer(layers + i, width);
+            layers[i].priority = (int16_t) ((int) i * 10 - 15);
+            order[i] = i;
+        }
+        for (uint i = 0; i < layer_count; i++) {
+            uint j = i + rand() % (layer_count - i);
+            uint t = order[i];
+            order[i] = order[j];
+            order[j] = t;
+            scanvideo_compositor_add_layer(&comp, layers[order[i]].priority, get_spans, layers + order[i]);
+        }
+        // layer i has the ith lowest priority
+        for (uint i = 0; i < layer_count; i++) order[i] = i;
+        paint_naive(layers, order, layer_count, width, background);
+        if (!check_line(width)) {
+            printf("FAILED: pass %d (%d layers width %d) mismatch\n", pass, layer_count, width);
+            failures++;
+        }
+    }
+    return failures;
+}
+
+// a background, a tile layer, sprites and a text box
+static int benchmark(void) {
+    static test_layer_t layers[4];
+    uint order[4] = {0, 1, 2, 3};
+    layers[0].count = 1;
+    layers[0].spans[0] = (scanvideo_span_t) {.x = 0, .width = WIDTH, .type = SCANVIDEO_SPAN_COLOR, .color = 0x1234};
+    layers[0].priority = 0;
+    layers[1].count = 0;
+    for (uint x = 0; x < WIDTH; x += 16) {
+        // every third tile is empty
+        if ((x / 16) % 3 == 2) continue;
+        layers[1].spans[layers[1].count++] = (scanvideo_span_t) {
+                .x = (uint16_t) x, .width = 16, .type = SCANVIDEO_SPAN_PIXELS, .pixels = pixel_data + x * 4
+        };
+    }
+    layers[1].priority = 1;
+    layers[2].count = 0;
+    for (uint x = 20; x < WIDTH - 16; x += 70) {
+        layers[2].spans[layers[2].count++] = (scanvideo_span_t) {
+                .x = (uint16_t) x, .width = 16, .type = SCANVIDEO_SPAN_PIXELS_KEYED, .color = 0,
+                .pixels = pixel_data + 2048 + x
+        };
+    }
+    layers[2].priority = 2;
+    layers[3].count = 1;
+    layers[3].spans[0] = (scanvideo_span_t) {.x = 40, .width = 240, .type = SCANVIDEO_SPAN_COLOR, .color = 0x7fff};
+    layers[3].priority = 3;
+
+    int failures = 0;
+    scanvideo_compositor_init(&comp, WIDTH, 0);
+    for (uint i = 0; i < count_of(layers); i++) {
+        scanvideo_compositor_add_layer(&comp, layers[i].priority, get_spans, layers + i);
+    }
+    static const char *names[] = {"background+tiles", "+sprites", "+text box"};
+    for (uint visible = 2; visible <= 4; visible++) {
+        for (uint i = 0; i < count_of(layers); i++) {
+            scanvideo_compositor_set_layer_enabled(&comp, i, i < visible);
+        }
+        paint_naive(layers, order, visible, WIDTH, 0);
+        if (!check_line(WIDTH)) {
+            printf("FAILED: benchmark scene %s mismatch\n", names[visible - 2]);
+            failures++;
+        }
+        absolute_time_t t0 = get_absolute_time();
+        uint naive_words = 0;
+        for (uint i = 0; i < BENCHMARK_LINES; i++) {
+            paint_naive(layers, order, visible, WIDTH, 0);
+            naive_words = encode_naive(WIDTH);
+        }
+        absolute_time_t t1 = get_absolute_time();
+        int words = 0;
+        for (uint i = 0; i < BENCHMARK_LINES; i++) {
+            words = scanvideo_compositor_compose_line(&comp, i, tokens, count_of(tokens));
+        }
+        absolute_time_t t2 = get_absolute_time();
+        printf("%-17s %d lines: naive %dus (%d words/line), spans %dus (%d words/line)\n", names[visible - 2],
+               BENCHMARK_LINES, (int) absolute_time_diff_us(t0, t1), naive_words,
+               (int) absolute_time_diff_us(t1, t2), words);
+    }
+    return failures;
+}
+
+int main(void) {
+    stdio_init_all();
+
+    printf("scanvideo compositor test\n");
+    for (uint i = 0; i < count_of(pixel_data); i++) {
+        // plenty of key (0) pixels, in runs
+        pixel_data[i] = (uint16_t) ((rand() % 4) ? rand() & 3 : 0);
+    }
+    int failures = random_tests();
+    for (uint i = 0; i < count_of(pixel_data); i++) {
+        pixel_data[i] = (uint16_t) ((i & 8) ? rand() : 0);
+    }
+    failures += benchmark();
+    if (failures) {
+        printf("%d FAILURES\n", failures);
+    } else {
+        printf("PASSED\n");
+    }
+    return failures != 0;
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "pico/scanvideo/palette.h"
+#include "pico/scanvideo/composable_scanline.h"
+
+#define MAX_WIDTH 640
+
+static uint16_t colors[256];
+static uint32_t table[1024];
+static uint32_t src[MAX_WIDTH / 4];
+static uint32_t expanded[MAX_WIDTH / 2 + 8];
+static uint32_t reference[MAX_WIDTH / 2 + 8];
+static uint32_t scanline_data[MAX_WIDTH / 2 + 8];
+
+// check the token stream is | jmp raw_run | p0 | width-3 | p1 ... | followed by a black pixel
+static bool check_scanline(const scanvideo_scanline_buffer_t *buffer, const uint16_t *pixels, uint width) {
+    const uint16_t *h = (const uint16_t *) buffer->data;
+    if (h[0] != COMPOSABLE_RAW_RUN || h[1] != pixels[0] || h[2] != width - 3) return false;
+    if (memcmp(h + 3, pixels + 1, (width - 1) * sizeof(uint16_t))) return false;
+    if (h[width + 2] != COMPOSABLE_RAW_1P || h[width + 3]) return false;
+    uint eol = h[width + 4];
+    if (eol == COMPOSABLE_EOL_SKIP_ALIGN) return !(width & 1) && buffer->data_used == (width + 6) / 2;
+    return (width & 1) && eol == COMPOSABLE_EOL_ALIGN && buffer->data_used == (width + 5) / 2;
+}
+
+int main(void) {
+    stdio_init_all();
+
+    printf("scanvideo palette test\n");
+    for (uint i = 0; i < count_of(colors); i++) {
+        colors[i] = (uint16_t) rand();
+    }
+    int failures = 0;
+    for (uint bpp = 1; bpp <= 8; bpp <<= 1) {
+        scanvideo_palette_t pal;
+        scanvideo_palette_init(&pal, bpp, colors, table);
+#if !PICO_NO_HARDWARE
+        scanvideo_palette_configure_interp(&pal);
+#endif
+        for (uint width = 3; width <= MAX_WIDTH; width++) {
+            for (uint i = 0; i < count_of(src); i++) {
+                src[i] = (uint32_t) rand() ^ ((uint32_t) rand() << 16);
+            }
+            scanvideo_palette_expand_row(&pal, expanded, src, width);
+            scanvideo_palette_expand_row_portable(&pal, reference, src, width);
+            if (memcmp(expanded, reference, width * sizeof(uint16_t))) {
+                printf("FAILED: %dbpp row expansion mismatch at width %d\n", bpp, width);
+                failures++;
+            }
+            scanvideo_scanline_buffer_t buffer = {
+                    .data = scanline_data,
+                    .data_max = count_of(scanline_data),
+            };
+            scanvideo_palette_expand_scanline(&pal, &buffer, src, width);
+            if (!check_scanline(&buffer, (const uint16_t *) reference, width)) {
+                printf("FAILED: %dbpp bad scanline at width %d\n", bpp, width);
+                failures++;
+            }
+        }
+        // rough timing of a full width row with each implementation
+        absolute_time_t t0 = get_absolute_time();
+        scanvideo_palette_expand_row(&pal, expanded, src, MAX_WIDTH);
+        absolute_time_t t1 = get_absolute_time();
+        scanvideo_palette_expand_row_portable(&pal, reference, src, MAX_WIDTH);
+        absolute_time_t t2 = get_absolute_time();
+        printf("%dbpp %d pixels: expand_row %dus, portable %dus\n", bpp, MAX_WIDTH,
+               (int) absolute_time_diff_us(t0, t1), (int) absolute_time_diff_us(t1, t2));
+    }
+    if (failures) {
+        printf("%d FAILURES\n", failures);
+    } else {
+        printf("PASSED\n");
+    }
+    return failures != 0;
+}
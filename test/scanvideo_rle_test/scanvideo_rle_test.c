@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "pico/scanvideo/rle.h"
+
+#define WIDTH 320
+#define HEIGHT 60
+
+static uint16_t pixels[WIDTH * HEIGHT];
+static uint32_t encoded[SCANVIDEO_RLE_HEADER_WORDS + HEIGHT + 1 + HEIGHT * ((WIDTH + 7) / 2)];
+static uint16_t decoded[WIDTH + 1];
+static uint32_t scanline_data[(WIDTH + 7) / 2];
+
+static void make_flat_ui(void) {
+    // a few solid panels with text-like detail
+    for (uint y = 0; y < HEIGHT; y++) {
+        for (uint x = 0; x < WIDTH; x++) {
+            uint16_t c = x < 80 ? 0x1234 : (y < 16 ? 0x7fff : 0x0421);
+            if (y >= 20 && y < 28 && x >= 100 && x < 220 && ((x * 7 + y * 3) % 5) == 0) c = 0x001f;
+            pixels[y * WIDTH + x] = c;
+        }
+    }
+}
+
+static void make_gradient(void) {
+    for (uint y = 0; y < HEIGHT; y++) {
+        for (uint x = 0; x < WIDTH; x++) {
+            pixels[y * WIDTH + x] = (uint16_t) (((x / 10) & 0x1f) | (((y / 2) & 0x1f) << 5));
+        }
+    }
+}
+
+static void make_noise(void) {
+    for (uint i = 0; i < count_of(pixels); i++) {
+        pixels[i] = (uint16_t) rand();
+    }
+}
+
+static int check_image(const char *name) {
+    int failures = 0;
+    size_t words = scanvideo_rle_encode_image(pixels, WIDTH, HEIGHT, WIDTH, encoded, count_of(encoded));
+    scanvideo_rle_image_t image;
+    if (!words || !scanvideo_rle_image_init(&image, encoded) || image.width != WIDTH || image.height != HEIGHT) {
+        printf("FAILED: %s: couldn't encode image\n", name);
+        return 1;
+    }
+    for (uint y = 0; y < HEIGHT; y++) {
+        uint line_words;
+        const uint32_t *line = scanvideo_rle_image_line(&image, y, &line_words);
+        int n = scanvideo_rle_decode_line(line, line_words, decoded, count_of(decoded));
+        if (n != WIDTH + 1 || memcmp(decoded, pixels + y * WIDTH, WIDTH * sizeof(uint16_t)) || decoded[WIDTH]) {
+            printf("FAILED: %s: line %d doesn't round trip\n", name, y);
+            failures++;
+        }
+        scanvideo_scanline_buffer_t buffer = {
+                .data = scanline_data,
+                .data_max = count_of(scanline_data),
+        };
+        if (!scanvideo_rle_image_copy_line(&image, y, &buffer) || buffer.data_used != line_words ||
+            memcmp(buffer.data, line, line_words * sizeof(uint32_t))) {
+            printf("FAILED: %s: line %d copy\n", name, y);
+            failures++;
+        }
+    }
+    size_t raw_bytes = WIDTH * HEIGHT * 2;
+    size_t frame_bytes = scanvideo_rle_image_frame_bytes(&image);
+    printf("%-8s %d bytes (raw %d): %d bytes per frame, %d%% of raw\n", name, (int) (words * 4), (int) raw_bytes,
+           (int) frame_bytes, (int) (frame_bytes * 100 / raw_bytes));
+    return failures;
+}
+
+int main(void) {
+    stdio_init_all();
+
+    printf("scanvideo rle test\n");
+    int failures = 0;
+    // short lines exercise every raw/color run boundary
+    for (uint width = 1; width <= 16; width++) {
+        for (uint pass = 0; pass < 100; pass++) {
+            for (uint x = 0; x < width; x++) pixels[x] = (uint16_t) (rand() & 1);
+            int words = scanvideo_rle_encode_line(pixels, width, encoded, scanvideo_rle_max_line_words(width));
+            int n = words < 0 ? -1 : scanvideo_rle_decode_line(encoded, (uint) words, decoded, count_of(decoded));
+            if (n != (int) width + 1 || memcmp(decoded, pixels, width * sizeof(uint16_t))) {
+                printf("FAILED: line of width %d doesn't round trip\n", width);
+                failures++;
+                break;
+            }
+        }
+    }
+    make_flat_ui();
+    failures += check_image("flat ui");
+    make_gradient();
+    failures += check_image("gradient");
+    make_noise();
+    failures += check_image("noise");
+    if (failures) {
+        printf("%d FAILURES\n", failures);
+    } else {
+        printf("PASSED\n");
+    }
+    return failures != 0;
+}
@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Runs lines encoded by composable_encode_scaled_line through the fractional xscale variant of the composable
+// scanline program (on a model of the PIO state machine, with the delays set by composable_set_program_delays, as
+// used by video_24mhz_composable_adapt_for_mode), and checks that every source pixel is output for exactly the pixels
+// it should be.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "pico/scanvideo/composable_scanline.h"
+
+#if !PICO_SCANVIDEO_ENABLE_FRACTIONAL_XSCALE
+#error this test requires PICO_SCANVIDEO_ENABLE_FRACTIONAL_XSCALE
+#endif
+
+#define MAX_WIDTH 96
+// output pixels looked at for each line (the widest line, plus some blanking)
+#define OUTPUT_PIXELS (MAX_WIDTH * 7 / 2 + 16)
+#define DATA_WORDS (MAX_WIDTH / 2 + 8)
+
+static const struct {
+    uint xscale;
+    uint xscale_denominator;
+} scales[] = {
+        {3, 2},
+        {5, 2},
+        {7, 2},
+        {4, 3},
+        {5, 3},
+        {5, 4},
+        {7, 4},
+};
+
+static uint16_t program[32];
+static uint16_t pixels[MAX_WIDTH];
+static uint32_t data[DATA_WORDS];
+// the pins on each cycle, starting with the one on which the first token is dispatched
+static uint16_t pins_by_cycle[OUTPUT_PIXELS * 2];
+static uint16_t expected[OUTPUT_PIXELS];
+
+#define PROGRAM(x) __EXTRA_CONCAT(video_24mhz_composable_fractional_xscale_, x)
+
+// as video_24mhz_composable_adapt_for_mode does when the program is loaded
+static bool adapt_program(uint xscale, uint xscale_denominator) {
+    memcpy(program, PROGRAM(program_instructions), sizeof(PROGRAM(program_instructions)));
+    return composable_set_program_delays(program, xscale, xscale_denominator);
+}
+
+// run the state machine from the end of the wait for the scanline IRQ until it waits again (with out shifting right
+// and autopull at 32 bits, as configured by video_24mhz_composable_configure_pio), recording the pins on each cycle
+static bool run_line(const uint32_t *line, uint words) {
+    uint pc = video_24mhz_composable_program_extern(nop_raw);
+    uint32_t osr = 0, x = 0;
+    uint shift_count = 32, next_word = 0, cycle = 0;
+    uint16_t pins = 0;
+    while (true) {
+        uint instr = program[pc];
+        uint delay = (instr >> 8u) & 0x1fu;
+        uint next_pc = pc == PROGRAM(wrap) ? PROGRAM(wrap_target) : pc + 1;
+        switch (instr >> 13u) {
+            case 0: { // jmp
+                uint condition = (instr >> 5u) & 7u;
+                if (condition == 0) {
+                    next_pc = instr & 0x1fu;
+                } else if (condition == 2) {
+                    if (x) next_pc = instr & 0x1fu;
+                    x--;
+                } else {
+                    return false;
+                }
+                break;
+            }
+            case 1: // wait (for the next scanline)
+                if (next_word != words || shift_count != 32) return false;
+                while (cycle < count_of(pins_by_cycle)) pins_by_cycle[cycle++] = pins;
+                return true;
+            case 3: { // out
+                uint bits = instr & 0x1fu;
+                if (!bits) bits = 32;
+                if (shift_count >= 32) {
+                    if (next_word == words) return false;
+                    osr = line[next_word++];
+                    shift_count = 0;
+                }
+                uint32_t value = bits == 32 ? osr : osr & ((1u << bits) - 1);
+                osr = bits == 32 ? 0 : osr >> bits;
+                shift_count = MIN(32, shift_count + bits);
+                switch ((instr >> 5u) & 7u) {
+                    case 0:
+                        pins = (uint16_t) value;
+                        break;
+                    case 1:
+                        x = value;
+                        break;
+                    case 3:
+                        break;
+                    case 5:
+                        next_pc = value;
+                        break;
+                    default:
+                        return false;
+                }
+                break;
+            }
+            default:
+                return false;
+        }
+        for (uint i = 0; i <= delay; i++) {
+            if (cycle == count_of(pins_by_cycle)) return false;
+            pins_by_cycle[cycle++] = pins;
+        }
+        pc = next_pc;
+    }
+}
+
+// the cycle on which the first pixel of a line made of other tokens starts
+static int first_pixel_cycle(void) {
+    static const uint16_t tokens[4] = {COMPOSABLE_RAW_1P, 0xffff, COMPOSABLE_EOL_SKIP_ALIGN, 0};
+    uint32_t line[2];
+    memcpy(line, tokens, sizeof(line));
+    if (!run_line(line, count_of(line))) return -1;
+    for (uint i = 0; i < count_of(pins_by_cycle); i++) {
+        if (pins_by_cycle[i]) return (int) i;
+    }
+    return -1;
+}
+
+static uint check_scale(uint xscale, uint xscale_denominator) {
+    int origin = adapt_program(xscale, xscale_denominator) ? first_pixel_cycle() : -1;
+    if (origin < 0) {
+        printf("FAILED: %d/%d: program didn't adapt, or a raw pixel didn't run\n", xscale, xscale_denominator);
+        return 1;
+    }
+    // the encoder can only line the scaled run up exactly when the header's extra pixel makes up a whole group
+    bool exact = xscale % xscale_denominator == 1;
+    uint failures = 0;
+    for (uint width = xscale_denominator; width <= MAX_WIDTH; width += xscale_denominator) {
+        for (uint i = 0; i < width; i++) pixels[i] = (uint16_t) (rand() | 1);
+        int words = composable_encode_scaled_line(pixels, width, xscale, xscale_denominator, data, count_of(data));
+        if (words < 0 || !run_line(data, (uint) words)) {
+            printf("FAILED: %d/%d: %d wide line didn't encode or run\n", xscale, xscale_denominator, width);
+            failures++;
+            continue;
+        }
+        if (composable_encode_scaled_line(pixels, width, xscale, xscale_denominator, data, (uint) words - 1) != -1) {
+            printf("FAILED: %d/%d: %d wide line fit in fewer words\n", xscale, xscale_denominator, width);
+            failures++;
+        }
+        // pixel i is output from i * xscale / xscale_denominator (plus the lead in if there is one)
+        uint lead_in = exact && width > xscale_denominator ? 0 : 1;
+        memset(expected, 0, sizeof(expected));
+        for (uint i = 0; i < width; i++) {
+            uint start = lead_in + i * xscale / xscale_denominator;
+            uint end = lead_in + (i + 1) * xscale / xscale_denominator;
+            for (uint p = start; p < end; p++) expected[p] = pixels[i];
+        }
+        for (uint p = 0; p < OUTPUT_PIXELS - 1; p++) {
+            uint c = (uint) origin + p * 2;
+            if (pins_by_cycle[c] != expected[p] || pins_by_cycle[c + 1] != expected[p]) {
+                printf("FAILED: %d/%d: %d wide line has output pixel %d wrong\n", xscale, xscale_denominator, width,
+                       p);
+                failures++;
+                break;
+            }
+        }
+    }
+    printf("%d/%d: %s\n", xscale, xscale_denominator, exact ? "pixels exactly placed" : "one pixel lead in");
+    return failures;
+}
+
+int main(void) {
+    stdio_init_all();
+
+    printf("scanvideo scaled line test\n");
+    uint failures = 0;
+    for (uint i = 0; i < count_of(scales); i++) {
+        failures += check_scale(scales[i].xscale, scales[i].xscale_denominator);
+    }
+    if (failures) {
+        printf("%d FAILURES\n", failures);
+    } else {
+        printf("PASSED\n");
+    }
+    return failures != 0;
+}
@@ -0,0 +1,164 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Checks scanline cache hits, misses, invalidation and LRU eviction (for every plane), using buffers filled with a
+// pattern derived from the line number and the generation of its contents, in place of a real video back-end.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "pico/scanvideo/scanline_cache.h"
+
+#define HEIGHT 16
+#define SLOT_COUNT 4
+#define SLOT_WORDS 8
+
+static uint32_t data[PICO_SCANVIDEO_PLANE_COUNT][SLOT_WORDS + 1];
+static scanvideo_scanline_buffer_t buffer;
+static scanvideo_scanline_cache_t cache;
+// the contents each line currently has (bumped on invalidation)
+static uint32_t contents[HEIGHT];
+static uint ended;
+static int failures;
+
+// stands in for the video back-end
+void scanvideo_end_scanline_generation(scanvideo_scanline_buffer_t *b) {
+    ended++;
+}
+
+static uint32_t *plane_data(uint plane) {
+    return data[plane];
+}
+
+static uint16_t *plane_used(uint plane) {
+#if PICO_SCANVIDEO_PLANE_COUNT > 1
+    if (plane == 1) return &buffer.data2_used;
+#endif
+    return &buffer.data_used;
+}
+
+// plane p of a line is (line + p) % 3 + 1 words long, or too long for a slot if long is set
+static uint plane_words(uint line, uint plane, bool too_long) {
+    return too_long && plane == PICO_SCANVIDEO_PLANE_COUNT - 1 ? SLOT_WORDS + 1 : (line + plane) % 3 + 1;
+}
+
+static void new_buffer(uint line) {
+    buffer.scanline_id = line;
+    buffer.status = 0;
+    for (uint p = 0; p < PICO_SCANVIDEO_PLANE_COUNT; p++) {
+        memset(plane_data(p), 0xee, sizeof(data[p]));
+        *plane_used(p) = 0;
+    }
+}
+
+static void generate(uint line, bool too_long) {
+    for (uint p = 0; p < PICO_SCANVIDEO_PLANE_COUNT; p++) {
+        uint words = plane_words(line, p, too_long);
+        for (uint i = 0; i < words; i++) {
+            plane_data(p)[i] = (line << 24u) | (contents[line] << 8u) | (p << 4u) | i;
+        }
+        *plane_used(p) = (uint16_t) words;
+    }
+    buffer.status = SCANLINE_OK;
+}
+
+static bool buffer_ok(uint line) {
+    if (buffer.status != SCANLINE_OK) return false;
+    for (uint p = 0; p < PICO_SCANVIDEO_PLANE_COUNT; p++) {
+        uint words = plane_words(line, p, false);
+        if (*plane_used(p) != words) return false;
+        for (uint i = 0; i < words; i++) {
+            if (plane_data(p)[i] != ((line << 24u) | (contents[line] << 8u) | (p << 4u) | i)) return false;
+        }
+    }
+    return true;
+}
+
+// look a line up, generating it on a miss; returns whether it was a hit
+static bool show_line(uint line, bool too_long) {
+    new_buffer(line);
+    bool hit = scanvideo_scanline_cache_lookup(&cache, &buffer);
+    if (hit) {
+        if (!buffer_ok(line)) {
+            printf("FAILED: line %d hit with the wrong contents\n", line);
+            failures++;
+        }
+    } else {
+        generate(line, too_long);
+    }
+    scanvideo_scanline_cache_end_scanline_generation(&cache, &buffer);
+    return hit;
+}
+
+static void expect(bool ok, const char *what) {
+    if (!ok) {
+        printf("FAILED: %s\n", what);
+        failures++;
+    }
+}
+
+int main(void) {
+    stdio_init_all();
+
+    printf("scanvideo scanline cache test (%d planes)\n", PICO_SCANVIDEO_PLANE_COUNT);
+    buffer.data = data[0];
+    buffer.data_max = SLOT_WORDS + 1;
+#if PICO_SCANVIDEO_PLANE_COUNT > 1
+    buffer.data2 = data[1];
+    buffer.data2_max = SLOT_WORDS + 1;
+#endif
+    if (!scanvideo_scanline_cache_init(&cache, HEIGHT, SLOT_COUNT, SLOT_WORDS)) {
+        panic("scanvideo_scanline_cache_init failed");
+    }
+
+    expect(!show_line(0, false), "first lookup of a line misses");
+    expect(show_line(0, false), "second lookup of a line hits");
+
+    // invalidation
+    scanvideo_scanline_cache_invalidate(&cache, 0, 1);
+    contents[0]++;
+    expect(!show_line(0, false), "lookup after invalidation misses");
+    expect(show_line(0, false), "lookup of the regenerated line hits");
+    scanvideo_scanline_cache_invalidate(&cache, 2, 100);
+    expect(show_line(0, false), "invalidating other lines leaves a line cached");
+
+    // LRU eviction: fill the other slots, touch line 0 so it is most recently used, then add one more line
+    for (uint line = 1; line < SLOT_COUNT; line++) {
+        expect(!show_line(line, false), "lookup of a new line misses");
+    }
+    expect(show_line(0, false), "a line stays cached while there are free slots");
+    expect(!show_line(SLOT_COUNT, false), "lookup of one line too many misses");
+    expect(!show_line(1, false), "the least recently used line is evicted");
+    expect(show_line(0, false), "a recently used line is not evicted");
+
+    // a line too long for a slot (in the last plane) is not cached
+    scanvideo_scanline_cache_stats_t stats;
+    scanvideo_scanline_cache_get_stats(&cache, &stats, false);
+    uint32_t uncacheable = stats.uncacheable;
+    expect(!show_line(HEIGHT - 1, true), "first lookup of a long line misses");
+    expect(!show_line(HEIGHT - 1, false), "a line too long for a slot is not cached");
+    scanvideo_scanline_cache_get_stats(&cache, &stats, false);
+    expect(stats.uncacheable == uncacheable + 1, "long lines are counted as uncacheable");
+
+    // lines past the height of the cache are never cached
+    expect(!show_line(HEIGHT, false), "line past the cache height misses");
+    expect(!show_line(HEIGHT, false), "line past the cache height is not cached");
+
+    scanvideo_scanline_cache_get_stats(&cache, &stats, true);
+    expect(stats.hits + stats.misses == ended, "every line is counted as a hit or a miss");
+    printf("%d hits, %d misses, %d evictions, %d uncacheable\n", (int) stats.hits, (int) stats.misses,
+           (int) stats.evictions, (int) stats.uncacheable);
+    expect(stats.hits == 5 && stats.misses == 11, "hit and miss counts");
+
+    scanvideo_scanline_cache_deinit(&cache);
+    if (failures) {
+        printf("%d FAILURES\n", failures);
+    } else {
+        printf("PASSED\n");
+    }
+    return failures != 0;
+}
@@ -0,0 +1,470 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pico/stdlib.h"
+#include "pico/scanvideo/scanline_queue.h"
+
+#define MAX_BUFFER_COUNT 32
+#define HEIGHT 240
+#define RANDOM_STEPS 200000
+#define BENCHMARK_LINES 100000
+#define LOCK_HOLD_REPEATS 200000
+
+static const uint buffer_counts[] = {8, 16, 32};
+
+typedef struct {
+    scanvideo_scanline_queue_entry_t entry;
+    uint32_t scanline_id;
+} test_buffer_t;
+
+static test_buffer_t buffers[MAX_BUFFER_COUNT];
+static scanvideo_scanline_queue_t q;
+static uint buffer_count;
+
+static void init_queue(uint count) {
+    static spin_lock_t *locks[3];
+    if (!locks[0]) {
+        for (uint i = 0; i < count_of(locks); i++) {
+            locks[i] = spin_lock_init(spin_lock_claim_unused(true));
+        }
+    }
+    buffer_count = count;
+    scanvideo_scanline_queue_init(&q, locks[0], locks[1], locks[2]);
+    for (int i = (int) count - 1; i >= 0; i--) {
+        scanvideo_scanline_queue_add_buffer(&q, &buffers[i].entry);
+    }
+}
+
+static uint32_t id_after(uint32_t scanline_id) {
+    return (scanline_id & 0xffffu) < HEIGHT - 1 ? scanline_id + 1 : (scanline_id & 0xffff0000u) + 0x10000u;
+}
+
+static uint list_count(const scanvideo_scanline_queue_entry_t *e) {
+    uint n = 0;
+    for (; e; e = e->next) n++;
+    return n;
+}
+
+static bool list_ascending(const scanvideo_scanline_queue_entry_t *head, const scanvideo_scanline_queue_entry_t *tail) {
+    if (!head) return !tail;
+    const scanvideo_scanline_queue_entry_t *e = head;
+    for (; e->next; e = e->next) {
+        if (scanvideo_scanline_id_is_after(e->scanline_id, e->next->scanline_id)) return false;
+    }
+    return e == tail;
+}
+
+static uint generated_count(void) {
+    uint n = 0;
+    for (uint i = 0; i < PICO_SCANVIDEO_SCANLINE_QUEUE_SLOTS; i++) {
+        n += list_count(q.generated.slots[i]);
+    }
+    return n;
+}
+
+static bool generated_contains(uint32_t scanline_id) {
+    for (const scanvideo_scanline_queue_entry_t *e = q.generated.slots[scanvideo_scanline_queue_slot(scanline_id)];
+         e; e = e->next) {
+        if (e->scanline_id == scanline_id) return true;
+    }
+    return false;
+}
+
+// every buffer is in the right slot in order, the occupied mask matches, and nothing is before the display
+static bool generated_ok(uint32_t display_id) {
+    for (uint i = 0; i < PICO_SCANVIDEO_SCANLINE_QUEUE_SLOTS; i++) {
+        const scanvideo_scanline_queue_entry_t *e = q.generated.slots[i];
+        if (!e != !(q.generated.occupied & (1u << i))) return false;
+        for (; e; e = e->next) {
+            if (scanvideo_scanline_queue_slot(e->scanline_id) != i) return false;
+            if (scanvideo_scanline_id_is_after(display_id, e->scanline_id)) return false;
+            if (e->next && !scanvideo_scanline_id_is_after(e->next->scanline_id, e->scanline_id)) return false;
+        }
+    }
+    return true;
+}
+
+// the generator takes buffers, and finishes them in a random order; the display latches each scanline in turn
+// (when it has been generated in time) and releases it once "sent". Both occasionally skip lines, and buffers
+// are regularly generated too late
+static int random_test(uint count) {
+    int failures = 0;
+    init_queue(count);
+    test_buffer_t *generating[MAX_BUFFER_COUNT];
+    uint generating_count = 0;
+    uint32_t next_generate_id = 0;
+    uint32_t next_display_id = 0;
+    for (uint step = 0; step < RANDOM_STEPS && failures < 10; step++) {
+        uint action = (uint) rand() % 8;
+        scanvideo_scanline_queue_entry_t *local_free_list = NULL;
+        if (action < 3) {
+            test_buffer_t *b = (test_buffer_t *) scanvideo_scanline_queue_take_free(&q, 1);
+            if (b) {
+                uint32_t save = spin_lock_blocking(q.generated.lock);
+                scanvideo_scanline_queue_locked_begin_generation(&q, &b->entry);
+                // like the back-ends, never generate a scanline twice, but catch up with the display
+                if (scanvideo_scanline_id_is_after(next_display_id, next_generate_id)) {
+                    next_generate_id = next_display_id;
+                }
+                // occasionally leave a gap (which may put two buffers in a slot)
+                for (uint skip = rand() % 16 ? 0 : (uint) rand() % 48; skip; skip--) {
+                    next_generate_id = id_after(next_generate_id);
+                }
+                b->scanline_id = next_generate_id;
+                next_generate_id = id_after(next_generate_id);
+                spin_unlock(q.generated.lock, save);
+                generating[generating_count++] = b;
+            }
+        } else if (action < 6) {
+            if (generating_count) {
+                uint i = (uint) rand() % generating_count;
+                test_buffer_t *b = generating[i];
+                generating[i] = generating[--generating_count];
+                uint32_t save = spin_lock_blocking(q.generated.lock);
+                scanvideo_scanline_queue_entry_t *too_late = scanvideo_scanline_queue_locked_add_generated(
+                        &q, &b->entry, b->scanline_id);
+                uint32_t display_id = q.generated.display_id;
+                spin_unlock(q.generated.lock, save);
+                if (too_late != (scanvideo_scanline_id_is_after(display_id, b->scanline_id) ? &b->entry : NULL)) {
+                    printf("FAILED: step %d add of %08x with display at %08x\n", step, b->scanline_id, display_id);
+                    failures++;
+                }
+                local_free_list = too_late;
+            }
+        } else {
+            bool expected = generated_contains(next_display_id);
+            uint32_t save = spin_lock_blocking(q.generated.lock);
+            test_buffer_t *b = (test_buffer_t *) scanvideo_scanline_queue_locked_try_latch(&q, next_display_id,
+                                                                                           &local_free_list);
+            spin_unlock(q.generated.lock, save);
+            if (expected != (b != NULL) || (b && b->scanline_id != next_display_id)) {
+                printf("FAILED: step %d latch of %08x\n", step, next_display_id);
+                failures++;
+            }
+            for (scanvideo_scanline_queue_entry_t *e = local_free_list; e; e = e->next) {
+                if (!scanvideo_scanline_id_is_after(next_display_id, e->scanline_id)) {
+                    printf("FAILED: step %d dropped %08x which isn't before %08x\n", step, e->scanline_id,
+                           next_display_id);
+                    failures++;
+                }
+            }
+            if (b) {
+                scanvideo_scanline_queue_entry_t *released = NULL;
+                scanvideo_scanline_queue_release_irqs_enabled(&q, 1, &released);
+                if (released != &b->entry) {
+                    printf("FAILED: step %d released the wrong buffer\n", step);
+                    failures++;
+                }
+                scanvideo_scanline_list_prepend_all(&local_free_list, released);
+            }
+            // sometimes skip lines, as the DBI back-end does for partial updates
+            for (uint skip = rand() % 8 ? 1 : 1 + (uint) rand() % 40; skip; skip--) {
+                next_display_id = id_after(next_display_id);
+            }
+        }
+        uint free_count = list_count(local_free_list);
+        scanvideo_scanline_queue_free_irqs_enabled(&q, local_free_list);
+        uint total = list_count(q.free_list.head) + generated_count() + list_count(q.in_use.head) +
+                     generating_count;
+        if (total != count || !generated_ok(q.generated.display_id) ||
+            !list_ascending(q.in_use.head, q.in_use.tail) || q.in_use.head) {
+            printf("FAILED: step %d bad queue state (%d buffers, %d freed)\n", step, total, free_count);
+            failures++;
+        }
+    }
+    return failures;
+}
+
+static int take_free_test(void) {
+    int failures = 0;
+    init_queue(8);
+    scanvideo_scanline_queue_entry_t *e = scanvideo_scanline_queue_take_free(&q, 6);
+    if (list_count(e) != 6 || list_count(q.free_list.head) != 2) {
+        printf("FAILED: take_free of 6\n");
+        failures++;
+    }
+    if (scanvideo_scanline_queue_take_free(&q, 3) || list_count(q.free_list.head) != 2) {
+        printf("FAILED: take_free of more than are free\n");
+        failures++;
+    }
+    scanvideo_scanline_queue_free_irqs_enabled(&q, e);
+    if (list_count(q.free_list.head) != 8) {
+        printf("FAILED: free\n");
+        failures++;
+    }
+    return failures;
+}
+
+static int insert_in_use_after_test(void) {
+    int failures = 0;
+    init_queue(8);
+    scanvideo_scanline_queue_entry_t *e[3];
+    scanvideo_scanline_queue_entry_t *local_free_list = NULL;
+    for (uint i = 0; i < 2; i++) {
+        e[i] = scanvideo_scanline_queue_take_free(&q, 1);
+        uint32_t save = spin_lock_blocking(q.generated.lock);
+        scanvideo_scanline_queue_locked_begin_generation(&q, e[i]);
+        scanvideo_scanline_queue_locked_add_generated(&q, e[i], i);
+        scanvideo_scanline_queue_locked_try_latch(&q, i, &local_free_list);
+        spin_unlock(q.generated.lock, save);
+    }
+    e[2] = scanvideo_scanline_queue_take_free(&q, 1);
+    uint32_t save = spin_lock_blocking(q.generated.lock);
+    scanvideo_scanline_queue_locked_insert_in_use_after(&q, e[1], e[2]);
+    spin_unlock(q.generated.lock, save);
+    if (q.in_use.tail != e[2] || e[2]->scanline_id != 1 || list_count(q.in_use.head) != 3 || local_free_list) {
+        printf("FAILED: insert_in_use_after\n");
+        failures++;
+    }
+    return failures;
+}
+
+// time a latch/release cycle per scanline with buffers generated in order, and in reverse order in batches
+static void benchmark(uint count, bool reverse) {
+    init_queue(count);
+    uint32_t next_display_id = 0;
+    uint32_t next_generate_id = 0;
+    absolute_time_t t0 = get_absolute_time();
+    for (uint line = 0; line < BENCHMARK_LINES; line += count) {
+        scanvideo_scanline_queue_entry_t *e = scanvideo_scanline_queue_take_free(&q, count);
+        test_buffer_t *batch[MAX_BUFFER_COUNT];
+        uint32_t save = spin_lock_blocking(q.generated.lock);
+        for (uint i = 0; i < count; i++) {
+            batch[i] = (test_buffer_t *) e;
+            e = e->next;
+            batch[i]->entry.next = NULL;
+            scanvideo_scanline_queue_locked_begin_generation(&q, &batch[i]->entry);
+            batch[i]->scanline_id = next_generate_id;
+            next_generate_id = id_after(next_generate_id);
+        }
+        spin_unlock(q.generated.lock, save);
+        for (uint i = 0; i < count; i++) {
+            test_buffer_t *b = batch[reverse ? count - 1 - i : i];
+            save = spin_lock_blocking(q.generated.lock);
+            scanvideo_scanline_queue_locked_add_generated(&q, &b->entry, b->scanline_id);
+            spin_unlock(q.generated.lock, save);
+        }
+        for (uint i = 0; i < count; i++) {
+            scanvideo_scanline_queue_entry_t *local_free_list = NULL;
+            save = spin_lock_blocking(q.generated.lock);
+            scanvideo_scanline_queue_locked_try_latch(&q, next_display_id, &local_free_list);
+            spin_unlock(q.generated.lock, save);
+            scanvideo_scanline_queue_release_irqs_enabled(&q, 1, &local_free_list);
+            scanvideo_scanline_queue_free_irqs_enabled(&q, local_free_list);
+            next_display_id = id_after(next_display_id);
+        }
+    }
+    int64_t us = absolute_time_diff_us(t0, get_absolute_time());
+    printf("%2d buffers, %-13s: %d lines in %dus (%dns per line)\n", count, reverse ? "reverse order" : "in order",
+           BENCHMARK_LINES, (int) us, (int) (us * 1000 / BENCHMARK_LINES));
+}
+
+// --- worst case lock hold time, compared with the sorted lists the queue used to be made of
+
+static struct {
+    scanvideo_scanline_queue_entry_t *head;
+    scanvideo_scanline_queue_entry_t *tail;
+    scanvideo_scanline_queue_entry_t *in_use_head;
+    scanvideo_scanline_queue_entry_t *in_use_tail;
+} sorted;
+
+static void sorted_insert(scanvideo_scanline_queue_entry_t *e) {
+    if (!sorted.head) {
+        sorted.head = sorted.tail = e;
+    } else if (scanvideo_scanline_id_is_after(e->scanline_id, sorted.tail->scanline_id)) {
+        sorted.tail->next = e;
+        sorted.tail = e;
+    } else if (!scanvideo_scanline_id_is_after(e->scanline_id, sorted.head->scanline_id)) {
+        e->next = sorted.head;
+        sorted.head = e;
+    } else {
+        scanvideo_scanline_queue_entry_t *prev = sorted.head;
+        while (scanvideo_scanline_id_is_after(e->scanline_id, prev->next->scanline_id)) {
+            prev = prev->next;
+        }
+        e->next = prev->next;
+        prev->next = e;
+    }
+}
+
+static scanvideo_scanline_queue_entry_t *sorted_try_latch(uint32_t scanline_id,
+                                                          scanvideo_scanline_queue_entry_t **local_free_list) {
+    scanvideo_scanline_queue_entry_t *e;
+    while (NULL != (e = sorted.head)) {
+        if (scanvideo_scanline_id_is_after(e->scanline_id, scanline_id)) return NULL;
+        scanvideo_scanline_list_remove_head(&sorted.head, &sorted.tail);
+        if (e->scanline_id == scanline_id) {
+            spin_lock_unsafe_blocking(q.in_use.lock);
+            scanvideo_scanline_list_append(&sorted.in_use_head, &sorted.in_use_tail, e);
+            spin_unlock_unsafe(q.in_use.lock);
+            return e;
+        }
+        scanvideo_scanline_list_prepend(local_free_list, e);
+    }
+    return NULL;
+}
+
+// fill the queue (or the sorted lists) with generated buffers for lines first to first + count - 1 except skip,
+// with the display at display_id
+static void setup_generated(bool ring, uint count, uint32_t display_id, uint32_t first, uint32_t skip) {
+    if (ring) {
+        init_queue(count);
+        q.generated.display_id = display_id;
+        scanvideo_scanline_queue_take_free(&q, count);
+        for (uint i = 0; i < count; i++) {
+            if (first + i == skip) continue;
+            buffers[i].entry.next = NULL;
+            scanvideo_scanline_queue_locked_begin_generation(&q, &buffers[i].entry);
+            scanvideo_scanline_queue_locked_add_generated(&q, &buffers[i].entry, first + i);
+        }
+    } else {
+        sorted.head = sorted.tail = sorted.in_use_head = sorted.in_use_tail = NULL;
+        for (uint i = 0; i < count; i++) {
+            if (first + i == skip) continue;
+            buffers[i].entry.next = NULL;
+            buffers[i].entry.scanline_id = first + i;
+            sorted_insert(&buffers[i].entry);
+        }
+    }
+}
+
+enum lock_hold_case {
+    // a buffer generated out of order, just before the last one queued
+    LOCK_HOLD_ADD_OUT_OF_ORDER,
+    // latch (and release) the next line with the queue full of buffers for the following lines
+    LOCK_HOLD_LATCH_NEXT,
+    // latch the next line, when the generator has fallen behind and count - 1 buffers were generated too late
+    LOCK_HOLD_GENERATOR_BEHIND,
+    // the rest don't happen every scanline; latch the last queued line, dropping the count - 1 before it
+    LOCK_HOLD_DISPLAY_SKIP,
+    // latch the first line of a new frame with the queue full
+    LOCK_HOLD_LATCH_NEW_FRAME,
+    LOCK_HOLD_CASE_COUNT
+};
+
+static const char *lock_hold_case_names[] = {"add out of order", "latch next line", "generator behind",
+                                             "display skips lines", "latch new frame"};
+
+static void lock_hold_setup(bool ring, uint count, enum lock_hold_case c) {
+    switch (c) {
+        case LOCK_HOLD_ADD_OUT_OF_ORDER:
+            setup_generated(ring, count, 0, 0, count - 2);
+            break;
+        case LOCK_HOLD_GENERATOR_BEHIND:
+            // the ring turns away the late buffers as they are added
+            setup_generated(ring, count, count - 1, 0, 0xffffffff);
+            break;
+        case LOCK_HOLD_LATCH_NEW_FRAME:
+            setup_generated(ring, count, HEIGHT - 1, 0x10000, 0xffffffff);
+            break;
+        default:
+            setup_generated(ring, count, 0, 0, 0xffffffff);
+            break;
+    }
+}
+
+static void lock_hold_op(bool ring, uint count, enum lock_hold_case c) {
+    scanvideo_scanline_queue_entry_t *local_free_list = NULL;
+    uint32_t save = spin_lock_blocking(q.generated.lock);
+    switch (c) {
+        case LOCK_HOLD_ADD_OUT_OF_ORDER:
+            buffers[count - 2].entry.next = NULL;
+            if (ring) {
+                scanvideo_scanline_queue_locked_begin_generation(&q, &buffers[count - 2].entry);
+                scanvideo_scanline_queue_locked_add_generated(&q, &buffers[count - 2].entry, count - 2);
+            } else {
+                buffers[count - 2].entry.scanline_id = count - 2;
+                sorted_insert(&buffers[count - 2].entry);
+            }
+            break;
+        case LOCK_HOLD_LATCH_NEXT:
+            if (ring) {
+                scanvideo_scanline_queue_locked_try_latch(&q, 0, &local_free_list);
+                scanvideo_scanline_queue_release_irqs_enabled(&q, 1, &local_free_list);
+            } else {
+                sorted_try_latch(0, &local_free_list);
+                uint32_t in_use_save = spin_lock_blocking(q.in_use.lock);
+                scanvideo_scanline_list_prepend(&local_free_list, scanvideo_scanline_list_remove_head(
+                        &sorted.in_use_head, &sorted.in_use_tail));
+                spin_unlock(q.in_use.lock, in_use_save);
+            }
+            break;
+        case LOCK_HOLD_GENERATOR_BEHIND:
+        case LOCK_HOLD_DISPLAY_SKIP:
+            if (ring) {
+                scanvideo_scanline_queue_locked_try_latch(&q, count - 1, &local_free_list);
+            } else {
+                sorted_try_latch(count - 1, &local_free_list);
+            }
+            break;
+        default:
+            if (ring) {
+                scanvideo_scanline_queue_locked_try_latch(&q, 0x10000, &local_free_list);
+            } else {
+                sorted_try_latch(0x10000, &local_free_list);
+            }
+            break;
+    }
+    spin_unlock(q.generated.lock, save);
+}
+
+// the time for the locked operation, found by subtracting the time for setting up the queue alone
+static int lock_hold_ns(bool ring, uint count, enum lock_hold_case c) {
+    absolute_time_t t0 = get_absolute_time();
+    for (uint i = 0; i < LOCK_HOLD_REPEATS; i++) {
+        lock_hold_setup(ring, count, c);
+    }
+    absolute_time_t t1 = get_absolute_time();
+    for (uint i = 0; i < LOCK_HOLD_REPEATS; i++) {
+        lock_hold_setup(ring, count, c);
+        lock_hold_op(ring, count, c);
+    }
+    absolute_time_t t2 = get_absolute_time();
+    int64_t ns = (absolute_time_diff_us(t1, t2) - absolute_time_diff_us(t0, t1)) * 1000 / LOCK_HOLD_REPEATS;
+    return ns < 0 ? 0 : (int) ns;
+}
+
+static void lock_hold_benchmark(uint count) {
+    int worst[2] = {0, 0};
+    for (uint c = 0; c < LOCK_HOLD_CASE_COUNT; c++) {
+        int ns[2];
+        for (uint ring = 0; ring < 2; ring++) {
+            ns[ring] = lock_hold_ns(ring, count, (enum lock_hold_case) c);
+            if (c < LOCK_HOLD_DISPLAY_SKIP && ns[ring] > worst[ring]) worst[ring] = ns[ring];
+        }
+        printf("%2d buffers, %-20s: sorted lists %4dns, ring %4dns\n", count, lock_hold_case_names[c], ns[0],
+               ns[1]);
+    }
+    printf("%2d buffers, worst case per scanline: sorted lists %4dns, ring %4dns\n", count, worst[0], worst[1]);
+}
+
+int main(void) {
+    stdio_init_all();
+
+    printf("scanvideo scanline queue test\n");
+    int failures = 0;
+    for (uint i = 0; i < count_of(buffer_counts); i++) {
+        failures += random_test(buffer_counts[i]);
+    }
+    failures += take_free_test();
+    failures += insert_in_use_after_test();
+    for (uint i = 0; i < count_of(buffer_counts); i++) {
+        benchmark(buffer_counts[i], false);
+        benchmark(buffer_counts[i], true);
+    }
+    for (uint i = 0; i < count_of(buffer_counts); i++) {
+        lock_hold_benchmark(buffer_counts[i]);
+    }
+    if (failures) {
+        printf("%d FAILURES\n", failures);
+    } else {
+        printf("PASSED\n");
+    }
+    return failures != 0;
+}
@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pico/stdlib.h"
+#include "pico/scanvideo/timing_calc.h"
+
+#define MAX_SYS_CLOCK_KHZ 266000
+
+// published CVT timings (as produced by the VESA spreadsheet and e.g. "cvt" / "cvt -r")
+typedef struct {
+    uint16_t width, height, refresh;
+    uint8_t blanking;
+    uint32_t ideal_clock_freq;
+    uint16_t h_front_porch, h_pulse, h_total;
+    uint16_t v_front_porch, v_pulse, v_total;
+    uint8_t h_sync_polarity, v_sync_polarity;
+} known_timing_t;
+
+static const known_timing_t known_timings[] = {
+        {640,  480,  60, SCANVIDEO_TIMING_CVT,    23750000,  16, 64,  800,  3, 4, 500,  1, 0},
+        {800,  600,  60, SCANVIDEO_TIMING_CVT,    38250000,  32, 80,  1024, 3, 4, 624,  1, 0},
+        {1024, 768,  60, SCANVIDEO_TIMING_CVT,    63500000,  48, 104, 1328, 3, 4, 798,  1, 0},
+        {1280, 720,  60, SCANVIDEO_TIMING_CVT,    74500000,  64, 128, 1664, 3, 5, 748,  1, 0},
+        {1280, 800,  60, SCANVIDEO_TIMING_CVT_RB, 71000000,  48, 32,  1440, 3, 6, 823,  0, 1},
+        {1920, 1080, 50, SCANVIDEO_TIMING_CVT_RB, 115000000, 48, 32,  2080, 3, 5, 1106, 0, 1},
+};
+
+static int known_timing_tests(void) {
+    int failures = 0;
+    for (uint i = 0; i < count_of(known_timings); i++) {
+        const known_timing_t *k = known_timings + i;
+        scanvideo_timing_calc_result_t r;
+        enum scanvideo_timing_status status = scanvideo_timing_calc_cvt(k->width, k->height, k->refresh,
+                                                                         (enum scanvideo_timing_blanking) k->blanking,
+                                                                         MAX_SYS_CLOCK_KHZ, &r);
+        const scanvideo_timing_t *t = &r.timing;
+        printf("%4dx%-4d@%d %-6s %9d Hz (ideal %9d Hz, %6d ppm) clk_sys %6d kHz / %d, %d.%03d Hz\n",
+               k->width, k->height, k->refresh, k->blanking == SCANVIDEO_TIMING_CVT_RB ? "CVT-RB" : "CVT",
+               (int) t->clock_freq, (int) r.ideal_clock_freq, (int) r.clock_error_ppm, (int) r.sys_clock_khz,
+               (int) r.clock_divisor, (int) (r.refresh_mhz / 1000), (int) (r.refresh_mhz % 1000));
+        if (status != SCANVIDEO_TIMING_OK ||
+            r.ideal_clock_freq != k->ideal_clock_freq ||
+            t->h_active != k->width || t->h_front_porch != k->h_front_porch || t->h_pulse != k->h_pulse ||
+            t->h_total != k->h_total || t->v_active != k->height || t->v_front_porch != k->v_front_porch ||
+            t->v_pulse != k->v_pulse || t->v_total != k->v_total || t->h_sync_polarity != k->h_sync_polarity ||
+            t->v_sync_polarity != k->v_sync_polarity) {
+            printf("FAILED: %dx%d@%d status %d, got %d %d/%d/%d %d/%d/%d\n", k->width, k->height, k->refresh,
+                   status, (int) r.ideal_clock_freq, t->h_front_porch, t->h_pulse, t->h_total, t->v_front_porch,
+                   t->v_pulse, t->v_total);
+            failures++;
+        }
+        if (r.sys_clock_khz > MAX_SYS_CLOCK_KHZ || t->clock_freq != r.sys_clock_khz * 1000u / r.clock_divisor) {
+            printf("FAILED: %dx%d@%d inconsistent clocks\n", k->width, k->height, k->refresh);
+            failures++;
+        }
+    }
+    return failures;
+}
+
+// every generated timing must satisfy the checks, and the clock error must be what the search claims
+static int sweep_tests(void) {
+    static const uint16_t widths[] = {320, 400, 424, 640, 720, 800, 1024, 1280, 1360, 1600, 1920};
+    static const uint16_t heights[] = {200, 240, 480, 576, 600, 720, 768, 1024, 1080, 1200};
+    static const uint8_t refreshes[] = {24, 30, 50, 60, 72, 75, 85};
+    static const uint32_t max_clocks_khz[] = {48000, 133000, 266000};
+    int failures = 0;
+    uint count = 0, clock_failures = 0;
+    int32_t worst_ppm = 0;
+    for (uint w = 0; w < count_of(widths); w++) {
+        for (uint h = 0; h < count_of(heights); h++) {
+            for (uint f = 0; f < count_of(refreshes); f++) {
+                for (uint b = 0; b < 2; b++) {
+                    for (uint m = 0; m < count_of(max_clocks_khz); m++) {
+                        scanvideo_timing_calc_result_t r;
+                        enum scanvideo_timing_status status = scanvideo_timing_calc_cvt(
+                                widths[w], heights[h], refreshes[f], (enum scanvideo_timing_blanking) b,
+                                max_clocks_khz[m], &r);
+                        count++;
+                        if (status == SCANVIDEO_TIMING_ERR_CLOCK) {
+                            clock_failures++;
+                            if (r.ideal_clock_freq * 2 <= max_clocks_khz[m] * 1000u) {
+                                printf("FAILED: %dx%d@%d no clock found for %d Hz\n", widths[w], heights[h],
+                                       refreshes[f], (int) r.ideal_clock_freq);
+                                failures++;
+                            }
+                            continue;
+                        }
+                        if (status != SCANVIDEO_TIMING_OK) {
+                            printf("FAILED: %dx%d@%d status %d\n", widths[w], heights[h], refreshes[f], status);
+                            failures++;
+                            continue;
+                        }
+                        int64_t error = (int64_t) r.timing.clock_freq - r.ideal_clock_freq;
+                        if (r.clock_error_ppm != (int32_t) (error * 1000000 / r.ideal_clock_freq)) {
+                            printf("FAILED: %dx%d@%d wrong ppm\n", widths[w], heights[h], refreshes[f]);
+                            failures++;
+                        }
+                        if (abs(r.clock_error_ppm) > SCANVIDEO_TIMING_CALC_MAX_CLOCK_ERROR_PPM) {
+                            printf("FAILED: %dx%d@%d error %d ppm\n", widths[w], heights[h], refreshes[f],
+                                   (int) r.clock_error_ppm);
+                            failures++;
+                        }
+                        if (abs(r.clock_error_ppm) > abs(worst_ppm)) worst_ppm = r.clock_error_ppm;
+                    }
+                }
+            }
+        }
+    }
+    printf("%d timings (%d need a faster clk_sys), worst clock error %d ppm\n", count, clock_failures,
+           (int) worst_ppm);
+    return failures;
+}
+
+// of equally exact clocks the fastest (within the limit) is chosen, leaving the most cycles for scanline generation
+static int sys_clock_tests(void) {
+    static const struct {
+        uint32_t clock_freq;
+        uint32_t max_sys_clock_khz;
+        uint32_t sys_clock_khz;
+        uint32_t divisor;
+    } cases[] = {
+            {23750000, 266000, 190000, 8},
+            {23750000, 133000, 95000,  4},
+            {23750000, 48000,  47500,  2},
+            {25200000, 133000, 126000, 5},
+            {74250000, 266000, 148500, 2},
+    };
+    int failures = 0;
+    for (uint i = 0; i < count_of(cases); i++) {
+        uint32_t sys_clock_khz, divisor;
+        if (!scanvideo_timing_calc_sys_clock(cases[i].clock_freq, cases[i].max_sys_clock_khz, &sys_clock_khz,
+                                             &divisor) ||
+            sys_clock_khz != cases[i].sys_clock_khz || divisor != cases[i].divisor) {
+            printf("FAILED: %d Hz up to %d kHz chose clk_sys %d kHz / %d, expected %d kHz / %d\n",
+                   (int) cases[i].clock_freq, (int) cases[i].max_sys_clock_khz, (int) sys_clock_khz, (int) divisor,
+                   (int) cases[i].sys_clock_khz, (int) cases[i].divisor);
+            failures++;
+        }
+    }
+    // and the same choice is what scanvideo_timing_calc_cvt recommends
+    scanvideo_timing_calc_result_t r;
+    if (scanvideo_timing_calc_cvt(640, 480, 60, SCANVIDEO_TIMING_CVT, 133000, &r) != SCANVIDEO_TIMING_OK ||
+        r.sys_clock_khz != 95000 || r.clock_divisor != 4) {
+        printf("FAILED: 640x480@60 recommended clk_sys %d kHz / %d, expected 95000 kHz / 4\n",
+               (int) r.sys_clock_khz, (int) r.clock_divisor);
+        failures++;
+    }
+    return failures;
+}
+
+static int check_tests(void) {
+    // 640x480@60 with a 25.2MHz pixel clock from a 151.2MHz clk_sys
+    const scanvideo_timing_t good = {
+            .clock_freq = 25200000,
+            .h_active = 640, .v_active = 480,
+            .h_front_porch = 16, .h_pulse = 96, .h_total = 800, .h_sync_polarity = 1,
+            .v_front_porch = 10, .v_pulse = 2, .v_total = 525, .v_sync_polarity = 1,
+    };
+    static const struct {
+        const char *name;
+        int field_offset;
+        uint16_t value;
+        uint32_t sys_clock_khz;
+        enum scanvideo_timing_status expected;
+    } cases[] = {
+            {"good",                   -1, 0, 151200, SCANVIDEO_TIMING_OK},
+            {"no clock check",         -1, 0, 0, SCANVIDEO_TIMING_OK},
+            {"clock not a divisor",    -1, 0, 150000, SCANVIDEO_TIMING_ERR_CLOCK},
+            {"clock too slow",         -1, 0, 25200, SCANVIDEO_TIMING_ERR_CLOCK},
+            {"short sync",             offsetof(scanvideo_timing_t, h_pulse), 11, 0, SCANVIDEO_TIMING_ERR_H_PULSE},
+            {"short back porch",       offsetof(scanvideo_timing_t, h_total), 755, 0,
+                                                                                   SCANVIDEO_TIMING_ERR_H_BACK_PORCH},
+            {"no front porch",         offsetof(scanvideo_timing_t, h_front_porch), 0, 0, SCANVIDEO_TIMING_OK},
+            {"long back porch",        offsetof(scanvideo_timing_t, h_total), 9100, 0,
+                                                                                   SCANVIDEO_TIMING_ERR_H_TOTAL},
+            {"no v front porch",       offsetof(scanvideo_timing_t, v_front_porch), 0, 0,
+                                                                                   SCANVIDEO_TIMING_ERR_V_BLANK},
+            {"no vsync",               offsetof(scanvideo_timing_t, v_pulse), 0, 0, SCANVIDEO_TIMING_ERR_V_BLANK},
+            {"no v back porch",        offsetof(scanvideo_timing_t, v_total), 492, 0, SCANVIDEO_TIMING_ERR_V_BLANK},
+    };
+    int failures = 0;
+    for (uint i = 0; i < count_of(cases); i++) {
+        scanvideo_timing_t t = good;
+        if (cases[i].field_offset >= 0) {
+            *(uint16_t *) ((uint8_t *) &t + cases[i].field_offset) = cases[i].value;
+        }
+        enum scanvideo_timing_status status = scanvideo_timing_check(&t, cases[i].sys_clock_khz);
+        if (status != cases[i].expected) {
+            printf("FAILED: check %s returned %d, expected %d\n", cases[i].name, status, cases[i].expected);
+            failures++;
+        }
+    }
+    return failures;
+}
+
+int main(void) {
+    stdio_init_all();
+
+    printf("scanvideo timing calc test\n");
+    int failures = known_timing_tests();
+    failures += sweep_tests();
+    failures += sys_clock_tests();
+    failures += check_tests();
+    if (failures) {
+        printf("%d FAILURES\n", failures);
+    } else {
+        printf("PASSED\n");
+    }
+    return failures != 0;
+}
@@ -0,0 +1,453 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Replays block access traces against a simulated card, with and without the sector cache, checking the data read
+// and what ends up on the card, and reporting hit rates and the time the card would have taken by a simple cost
+// model (a fixed cost per command plus a cost per sector).
+//
+// The built in traces are modelled on what a FAT filesystem does (on a volume with 4K clusters) for a few typical
+// workloads. On the host, a recorded trace can be replayed instead by passing the name of a file with one access per
+// line: "R <sector> <count>", "W <sector> <count>" or "S" (sync).
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "pico/sd_card_cache.h"
+
+#define SECTOR_WORDS (SD_SECTOR_SIZE / 4)
+#define SIM_SECTORS 16384
+#define MAX_ACCESS_SECTORS 64
+
+// rough costs of a 4 bit, 25MHz card
+#define READ_COMMAND_US 250
+#define WRITE_COMMAND_US 1000
+#define SECTOR_US 45
+
+#define CACHE_SECTORS 32
+#define READ_AHEAD_SECTORS 8
+
+// modelled FAT volume layout
+#define FAT_SECTOR 32
+#define FAT_SECTORS 64
+#define FAT2_SECTOR (FAT_SECTOR + FAT_SECTORS)
+#define ROOT_DIR_SECTOR (FAT2_SECTOR + FAT_SECTORS)
+#define CLUSTER_SECTORS 8
+#define DATA_SECTOR (ROOT_DIR_SECTOR + CLUSTER_SECTORS)
+
+static uint8_t sim_versions[SIM_SECTORS];   // version of the data in each sector of the simulated card
+static uint8_t shadow_versions[SIM_SECTORS];// version of the data most recently written to each sector
+static uint64_t sim_us;
+static uint sim_commands;
+static bool sim_corrupt;
+
+static uint32_t buf[MAX_ACCESS_SECTORS * SECTOR_WORDS];
+static uint32_t arena[SD_CACHE_ARENA_SIZE(CACHE_SECTORS, READ_AHEAD_SECTORS) / 4];
+
+static void fill(uint32_t *data, uint32_t sector, uint version) {
+    data[0] = (sector << 8u) | version;
+    for (uint i = 1; i < SECTOR_WORDS; i++) data[i] = (sector * 0x9e3779b9u) ^ (version << 24u) ^ (i * 0x85ebca6bu);
+}
+
+static bool check_sector(const uint32_t *data, uint32_t sector, uint version) {
+    static uint32_t expected[SECTOR_WORDS];
+    fill(expected, sector, version);
+    return !memcmp(data, expected, SD_SECTOR_SIZE);
+}
+
+static int sim_read(__unused const sd_block_device_t *device, uint32_t sector, uint sector_count, uint32_t *data) {
+    if (sector + sector_count > SIM_SECTORS) return SD_ERR_BAD_PARAM;
+    sim_commands++;
+    sim_us += READ_COMMAND_US + sector_count * SECTOR_US;
+    for (uint i = 0; i < sector_count; i++) fill(data + i * SECTOR_WORDS, sector + i, sim_versions[sector + i]);
+    return SD_OK;
+}
+
+static int sim_write(__unused const sd_block_device_t *device, uint32_t sector, uint sector_count,
+                     const uint32_t *data) {
+    if (sector + sector_count > SIM_SECTORS) return SD_ERR_BAD_PARAM;
+    sim_commands++;
+    sim_us += WRITE_COMMAND_US + sector_count * SECTOR_US;
+    for (uint i = 0; i < sector_count; i++) {
+        const uint32_t *d = data + i * SECTOR_WORDS;
+        uint version = d[0] & 0xffu;
+        if ((d[0] >> 8u) != sector + i || !check_sector(d, sector + i, version)) sim_corrupt = true;
+        sim_versions[sector + i] = (uint8_t) version;
+    }
+    return SD_OK;
+}
+
+static uint32_t sim_get_sector_count(__unused const sd_block_device_t *device) {
+    return SIM_SECTORS;
+}
+
+static const sd_block_device_t sim_device = {
+        .read = sim_read,
+        .write = sim_write,
+        .get_sector_count = sim_get_sector_count,
+};
+
+// the same card, but not saying how big it is
+static const sd_block_device_t unsized_sim_device = {
+        .read = sim_read,
+        .write = sim_write,
+};
+
+// --- replay
+
+typedef struct {
+    const char *name;
+    const sd_block_device_t *device;
+    int errors;
+} replay_t;
+
+static void replay_read(replay_t *r, uint32_t sector, uint count) {
+    while (count) {
+        uint n = MIN(count, MAX_ACCESS_SECTORS);
+        int rc = sd_block_device_read(r->device, sector, n, buf);
+        if (rc) {
+            if (!r->errors++) printf("  read of %d sectors at %d returned %d\n", n, (int) sector, rc);
+            return;
+        }
+        for (uint i = 0; i < n; i++) {
+            if (!check_sector(buf + i * SECTOR_WORDS, sector + i, shadow_versions[sector + i])) {
+                if (!r->errors++) printf("  sector %d read back wrong\n", (int) (sector + i));
+            }
+        }
+        sector += n;
+        count -= n;
+    }
+}
+
+static void replay_write(replay_t *r, uint32_t sector, uint count) {
+    while (count) {
+        uint n = MIN(count, MAX_ACCESS_SECTORS);
+        for (uint i = 0; i < n; i++) fill(buf + i * SECTOR_WORDS, sector + i, ++shadow_versions[sector + i]);
+        int rc = sd_block_device_write(r->device, sector, n, buf);
+        if (rc && !r->errors++) printf("  write of %d sectors at %d returned %d\n", n, (int) sector, rc);
+        sector += n;
+        count -= n;
+    }
+}
+
+static void replay_sync(replay_t *r) {
+    int rc = sd_block_device_sync(r->device);
+    if (rc && !r->errors++) printf("  sync returned %d\n", rc);
+}
+
+// --- modelled traces
+
+typedef void (*trace_func_t)(replay_t *r);
+
+static void fat_update(replay_t *r, uint cluster) {
+    // FatFs style read, modify, write of the FAT sector holding the cluster, and of its mirror
+    uint32_t sector = (cluster * 4) / SD_SECTOR_SIZE;
+    replay_read(r, FAT_SECTOR + sector, 1);
+    replay_write(r, FAT_SECTOR + sector, 1);
+    replay_write(r, FAT2_SECTOR + sector, 1);
+}
+
+static uint32_t cluster_sector(uint cluster) {
+    return DATA_SECTOR + (cluster - 2) * CLUSTER_SECTORS;
+}
+
+// opening files all over a tree of 16 directories: every lookup walks the root directory and then a subdirectory,
+// following its cluster chain through the FAT
+static void trace_directory_walk(replay_t *r) {
+    uint32_t seed = 1;
+    for (uint i = 0; i < 400; i++) {
+        seed = seed * 1103515245u + 12345u;
+        uint dir = (seed >> 16u) % 16;
+        replay_read(r, ROOT_DIR_SECTOR, 1);
+        replay_read(r, ROOT_DIR_SECTOR + 1, 1);
+        uint cluster = 3 + dir * 2;
+        replay_read(r, FAT_SECTOR + (cluster * 4) / SD_SECTOR_SIZE, 1);
+        for (uint s = 0; s <= (seed >> 24u) % 4; s++) {
+            replay_read(r, cluster_sector(cluster) + s, 1);
+        }
+        // and reading the first sector of the file (which is all over the place)
+        replay_read(r, cluster_sector(100 + (seed >> 8u) % 1500), 1);
+    }
+}
+
+// copying a 512K file a sector at a time (as with a small f_read/f_write buffer), allocating the destination
+// cluster by cluster
+static void trace_file_copy(replay_t *r) {
+    uint src = 200;
+    uint dst = 400;
+    replay_read(r, ROOT_DIR_SECTOR, 1);
+    for (uint c = 0; c < 128; c++) {
+        replay_read(r, FAT_SECTOR + ((src + c) * 4) / SD_SECTOR_SIZE, 1);
+        for (uint s = 0; s < CLUSTER_SECTORS; s++) {
+            replay_read(r, cluster_sector(src + c) + s, 1);
+            replay_write(r, cluster_sector(dst + c) + s, 1);
+        }
+        fat_update(r, dst + c);
+    }
+    replay_read(r, ROOT_DIR_SECTOR, 1);
+    replay_write(r, ROOT_DIR_SECTOR, 1);
+    replay_sync(r);
+}
+
+// a data logger appending a record at a time, with an f_sync (FAT, mirror and directory entry) every 16 records
+static void trace_data_logger(replay_t *r) {
+    uint first = 1200;
+    for (uint i = 0; i < 2048; i++) {
+        uint cluster = first + i / CLUSTER_SECTORS;
+        if (!(i % CLUSTER_SECTORS)) fat_update(r, cluster);
+        replay_write(r, cluster_sector(cluster) + i % CLUSTER_SECTORS, 1);
+        if ((i % 16) == 15) {
+            replay_read(r, ROOT_DIR_SECTOR + 1, 1);
+            replay_write(r, ROOT_DIR_SECTOR + 1, 1);
+            replay_sync(r);
+        }
+    }
+}
+
+// a host mounting the volume over USB mass storage (which reads the boot sectors and the whole FAT a few sectors at a
+// time), listing the root, then reading a couple of files in 32K requests
+static void trace_msc_mount(replay_t *r) {
+    replay_read(r, 0, 1);
+    replay_read(r, 1, 1);
+    replay_read(r, 0, 1);
+    for (uint s = 0; s < FAT_SECTORS; s += 8) {
+        replay_read(r, FAT_SECTOR + s, 8);
+    }
+    replay_read(r, ROOT_DIR_SECTOR, CLUSTER_SECTORS);
+    replay_read(r, FAT_SECTOR, 1);
+    for (uint f = 0; f < 2; f++) {
+        uint32_t sector = cluster_sector(600 + f * 200);
+        for (uint s = 0; s < 1024; s += 64) {
+            replay_read(r, sector + s, 64);
+        }
+        replay_read(r, ROOT_DIR_SECTOR, 1);
+    }
+    for (uint s = 0; s < FAT_SECTORS; s += 8) {
+        replay_read(r, FAT_SECTOR + s, 8);
+    }
+}
+
+// reading the last few sectors of the card a sector at a time (e.g. a backup GPT header, or the end of a file at the
+// end of the volume), where read ahead mustn't run off the end
+static void trace_end_of_device(replay_t *r) {
+    for (uint32_t s = SIM_SECTORS - 8; s < SIM_SECTORS; s++) {
+        replay_read(r, s, 1);
+    }
+    replay_read(r, SIM_SECTORS - 1, 1);
+}
+
+#if !PICO_ON_DEVICE
+static const char *trace_file_name;
+
+static void trace_file(replay_t *r) {
+    FILE *f = fopen(trace_file_name, "r");
+    if (!f) {
+        printf("  can't open %s\n", trace_file_name);
+        r->errors++;
+        return;
+    }
+    char op;
+    unsigned long sector;
+    uint count;
+    char line[80];
+    while (fgets(line, sizeof(line), f)) {
+        count = 1;
+        if (sscanf(line, " %c %lu %u", &op, &sector, &count) < 1) continue;
+        if (op != 'S' && (sector >= SIM_SECTORS || sector + count > SIM_SECTORS)) continue;
+        if (op == 'R') replay_read(r, sector, count);
+        if (op == 'W') replay_write(r, sector, count);
+        if (op == 'S') replay_sync(r);
+    }
+    fclose(f);
+}
+#endif
+
+// --- configurations
+
+typedef struct {
+    const char *name;
+    bool cache;
+    uint read_ahead_sectors;
+    bool pin_fat;
+} configuration_t;
+
+static const configuration_t configurations[] = {
+        {"no cache", false, 0, false},
+        {"LRU", true, 0, false},
+        {"LRU+read ahead", true, READ_AHEAD_SECTORS, false},
+        {"LRU+read ahead+pinned FAT", true, READ_AHEAD_SECTORS, true},
+};
+
+static int run(const char *trace_name, trace_func_t trace) {
+    int failures = 0;
+    uint64_t uncached_us = 0;
+    printf("%s:\n", trace_name);
+    for (uint c = 0; c < count_of(configurations); c++) {
+        const configuration_t *config = &configurations[c];
+        // all traces start from the same card
+        for (uint s = 0; s < SIM_SECTORS; s++) sim_versions[s] = shadow_versions[s] = (uint8_t) s;
+        sim_corrupt = false;
+        static sd_cache_t cache;
+        replay_t r = {.name = config->name, .device = &sim_device};
+        if (config->cache) {
+            sd_cache_config_t cache_config = sd_cache_get_default_config();
+            cache_config.read_ahead_sectors = config->read_ahead_sectors;
+            int rc = sd_cache_init(&cache, &sim_device, arena, sizeof(arena), &cache_config);
+            // just the FAT sector which directory lookups go through; each pinned sector is one less for the LRU, so
+            // pinning sectors which aren't in constant use costs more than it saves
+            if (!rc && config->pin_fat) rc = sd_cache_pin(&cache, FAT_SECTOR, 1);
+            if (rc) {
+                printf("  %s: cache set up returned %d\n", config->name, rc);
+                failures++;
+                continue;
+            }
+            r.device = sd_cache_device(&cache);
+        }
+        sim_us = 0;
+        sim_commands = 0;
+        trace(&r);
+        replay_sync(&r);
+        uint64_t us = sim_us;
+        if (!config->cache) uncached_us = us;
+        for (uint s = 0; s < SIM_SECTORS; s++) {
+            if (sim_versions[s] != shadow_versions[s]) {
+                if (!r.errors++) printf("  sector %d didn't reach the card\n", s);
+            }
+        }
+        if (sim_corrupt) {
+            printf("  data written to the card was corrupt\n");
+            r.errors++;
+        }
+        printf("  %-26s %5d commands, %6d.%03d ms", config->name, sim_commands, (int) (us / 1000), (int) (us % 1000));
+        if (config->cache) {
+            const sd_cache_stats_t *stats = sd_cache_get_stats(&cache);
+            uint hits = stats->read_hits + stats->read_ahead_hits;
+            printf(" (%d%% of no cache), read hit rate %d%% (%d%% from read ahead), %d evictions",
+                   uncached_us ? (int) (us * 100 / uncached_us) : 0,
+                   stats->read_sectors ? (int) (hits * 100 / stats->read_sectors) : 0,
+                   stats->read_sectors ? (int) (stats->read_ahead_hits * 100 / stats->read_sectors) : 0,
+                   (int) stats->evictions);
+        }
+        printf("\n");
+        if (r.errors) {
+            printf("  FAILED: %s: %d errors\n", config->name, r.errors);
+            failures++;
+        }
+    }
+    return failures;
+}
+
+// --- basic behaviour
+
+static int check(bool ok, const char *what) {
+    if (!ok) printf("FAILED: %s\n", what);
+    return ok ? 0 : 1;
+}
+
+static int test_basics(void) {
+    int failures = 0;
+    static sd_cache_t cache;
+    sd_cache_config_t config = sd_cache_get_default_config();
+    config.read_ahead_sectors = READ_AHEAD_SECTORS;
+    for (uint s = 0; s < SIM_SECTORS; s++) sim_versions[s] = shadow_versions[s] = 0;
+    failures += check(sd_cache_init(&cache, &sim_device, arena, sizeof(arena), &config) == SD_OK, "init");
+    failures += check(sd_cache_sector_count(&cache) == CACHE_SECTORS, "arena holds CACHE_SECTORS sectors");
+    failures += check(sd_cache_init(&cache, &sim_device, arena, READ_AHEAD_SECTORS * SD_SECTOR_SIZE, &config) ==
+                      SD_ERR_BAD_PARAM, "arena with no room for sectors is rejected");
+    sd_cache_init(&cache, &sim_device, arena, sizeof(arena), &config);
+    replay_t r = {.name = "basics", .device = sd_cache_device(&cache)};
+
+    // a sector stays cached while less than CACHE_SECTORS others are read, and pinned ones stay regardless
+    failures += check(sd_cache_pin(&cache, 1000, 2) == SD_OK, "pin");
+    replay_read(&r, 0, 1);
+    for (uint s = 0; s < CACHE_SECTORS - 4; s++) replay_read(&r, 100 + s * 2, 1);
+    sim_commands = 0;
+    replay_read(&r, 0, 1);
+    failures += check(sim_commands == 0, "recently used sector is still cached");
+    for (uint s = 0; s < CACHE_SECTORS * 2; s++) replay_read(&r, 200 + s * 2, 1);
+    sim_commands = 0;
+    replay_read(&r, 0, 1);
+    failures += check(sim_commands == 1, "least recently used sector is evicted");
+    sim_commands = 0;
+    replay_read(&r, 1000, 2);
+    failures += check(sim_commands == 0, "pinned sectors are not evicted");
+    sd_cache_unpin(&cache, 1000, 2);
+    failures += check(sd_cache_pin(&cache, 2000, CACHE_SECTORS) == SD_ERR_BAD_PARAM, "can't pin the whole cache");
+    sd_cache_unpin(&cache, 2000, CACHE_SECTORS - 1);
+
+    // consecutive dirty sectors are written back together
+    sim_commands = 0;
+    for (uint s = 0; s < 12; s++) replay_write(&r, 3000 + s, 1);
+    failures += check(sim_commands == 0, "writes are held back");
+    replay_sync(&r);
+    failures += check(sim_commands == 2, "dirty sectors are written back a window at a time");
+
+    // streaming reads come through the read ahead window and don't evict what's cached
+    replay_read(&r, 0, 1);
+    sd_cache_reset_stats(&cache);
+    for (uint s = 0; s < 256; s++) replay_read(&r, 4000 + s, 1);
+    const sd_cache_stats_t *stats = sd_cache_get_stats(&cache);
+    failures += check(stats->device_reads <= 256 / READ_AHEAD_SECTORS + config.read_ahead_trigger + 1, "sequential reads are read ahead");
+    // (only the reads before the stream is noticed are cached)
+    failures += check(stats->evictions <= config.read_ahead_trigger, "read ahead doesn't evict cached sectors");
+    sim_commands = 0;
+    replay_read(&r, 0, 1);
+    failures += check(sim_commands == 0, "cached sector survives streaming");
+
+    // a write to a sector in the read ahead window is seen by later reads
+    replay_read(&r, 5000, 1);
+    replay_read(&r, 5001, 1);
+    replay_read(&r, 5002, 1);
+    replay_write(&r, 5004, 1);
+    replay_read(&r, 5003, 2);
+
+    replay_sync(&r);
+    for (uint s = 0; s < SIM_SECTORS; s++) {
+        if (sim_versions[s] != shadow_versions[s]) r.errors++;
+    }
+    failures += check(!r.errors && !sim_corrupt, "data is consistent");
+
+    // read ahead stops at the end of the device, or if the device doesn't say where that is, the window read fails
+    // and just the sectors asked for are read
+    sd_cache_reset_stats(&cache);
+    trace_end_of_device(&r);
+    failures += check(!r.errors && stats->device_read_sectors <= 8, "read ahead stops at the end of the device");
+    failures += check(sd_block_device_sector_count(sd_cache_device(&cache)) == SIM_SECTORS, "cache passes on sector count");
+    sd_cache_init(&cache, &unsized_sim_device, arena, sizeof(arena), &config);
+    trace_end_of_device(&r);
+    failures += check(!r.errors, "read ahead falls back when the device size isn't known");
+    return failures;
+}
+
+#if PICO_ON_DEVICE
+int main(void) {
+#else
+int main(int argc, char **argv) {
+#endif
+    stdio_init_all();
+
+    printf("sd card cache test (%d sector cache, %d byte arena)\n", CACHE_SECTORS, (int) sizeof(arena));
+    int failures = test_basics();
+#if !PICO_ON_DEVICE
+    if (argc > 1) {
+        trace_file_name = argv[1];
+        failures += run(trace_file_name, trace_file);
+    } else
+#endif
+    {
+        failures += run("directory walk", trace_directory_walk);
+        failures += run("file copy", trace_file_copy);
+        failures += run("data logger", trace_data_logger);
+        failures += run("usb mass storage mount", trace_msc_mount);
+        failures += run("end of device", trace_end_of_device);
+    }
+    if (failures) {
+        printf("%d FAILURES\n", failures);
+    } else {
+        printf("PASSED\n");
+    }
+    return failures != 0;
+}
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "pico/sd_card_crc.h"
+
+#define BLOCK_WORDS 128
+// blocks checked for the benchmark
+#define BENCHMARK_BLOCKS 256
+
+static uint32_t block[BLOCK_WORDS];
+static uint32_t suffix[2];
+// 512 bytes for each line
+static uint32_t spec_block[BLOCK_WORDS * 4];
+
+// bit at a time CRC16 of one line, reading the nibbles in the order they were received
+static uint16_t reference_crc(const uint32_t *data, uint word_count, uint lane) {
+    uint crc = 0;
+    for (uint i = 0; i < word_count; i++) {
+        for (int shift = 28; shift >= 0; shift -= 4) {
+            uint bit = (data[i] >> (shift + (int) lane)) & 1u;
+            crc = (crc << 1u) ^ ((((crc >> 15u) ^ bit) & 1u) ? 0x1021u : 0);
+        }
+    }
+    return (uint16_t) crc;
+}
+
+// interleave the CRCs as they are sent after the data
+static void make_suffix(const uint16_t crcs[4]) {
+    suffix[0] = suffix[1] = 0;
+    for (uint bit = 0; bit < 16; bit++) {
+        for (uint lane = 0; lane < 4; lane++) {
+            uint b = (crcs[lane] >> (15 - bit)) & 1u;
+            suffix[bit / 8] |= b << ((7 - bit % 8) * 4 + lane);
+        }
+    }
+}
+
+static void byteswap(uint32_t *data, uint word_count) {
+    for (uint i = 0; i < word_count; i++) data[i] = __builtin_bswap32(data[i]);
+}
+
+static int check_block(uint word_count) {
+    uint16_t expected[4];
+    for (uint lane = 0; lane < 4; lane++) expected[lane] = reference_crc(block, word_count, lane);
+    make_suffix(expected);
+    int failures = 0;
+    for (uint swapped = 0; swapped < 2; swapped++) {
+        uint16_t crcs[4];
+        sd_crc16_4bit(block, word_count, swapped, crcs);
+        if (memcmp(crcs, expected, sizeof(crcs))) {
+            printf("FAILED: %d words%s: CRCs %04x %04x %04x %04x, expected %04x %04x %04x %04x\n", word_count,
+                   swapped ? " (byte swapped)" : "", crcs[0], crcs[1], crcs[2], crcs[3], expected[0], expected[1],
+                   expected[2], expected[3]);
+            failures++;
+        } else if (!sd_crc16_4bit_check(block, word_count, suffix, swapped)) {
+            printf("FAILED: %d words%s: check failed\n", word_count, swapped ? " (byte swapped)" : "");
+            failures++;
+        }
+        byteswap(block, word_count);
+        byteswap(suffix, 2);
+    }
+    return failures;
+}
+
+static int check_corruption(void) {
+    int failures = 0;
+    uint16_t crcs[4];
+    sd_crc16_4bit(block, BLOCK_WORDS, true, crcs);
+    make_suffix(crcs);
+    byteswap(suffix, 2);
+    for (uint i = 0; i < 64; i++) {
+        uint bit = (uint) rand() % (BLOCK_WORDS * 32);
+        block[bit / 32] ^= 1u << (bit % 32);
+        if (sd_crc16_4bit_check(block, BLOCK_WORDS, suffix, true)) {
+            printf("FAILED: corrupt data bit %d not detected\n", bit);
+            failures++;
+        }
+        block[bit / 32] ^= 1u << (bit % 32);
+        suffix[i & 1u] ^= 1u << (i / 2);
+        if (sd_crc16_4bit_check(block, BLOCK_WORDS, suffix, true)) {
+            printf("FAILED: corrupt CRC bit %d not detected\n", i);
+            failures++;
+        }
+        suffix[i & 1u] ^= 1u << (i / 2);
+    }
+    if (!sd_crc16_4bit_check(block, BLOCK_WORDS, suffix, true)) {
+        printf("FAILED: restored block doesn't check\n");
+        failures++;
+    }
+    return failures;
+}
+
+static void benchmark(void) {
+    absolute_time_t start = get_absolute_time();
+    uint ok = 0;
+    for (uint i = 0; i < BENCHMARK_BLOCKS; i++) {
+        ok += sd_crc16_4bit_check(block, BLOCK_WORDS, suffix, true);
+    }
+    int64_t us = absolute_time_diff_us(start, get_absolute_time());
+    // bytes per us is MB/s
+    uint kb_per_s = us > 0 ? (uint) ((uint64_t) BENCHMARK_BLOCKS * BLOCK_WORDS * 4 * 1000 / (uint64_t) us) : 0;
+    printf("4 bit CRC check: %d.%03d MB/s (%d blocks ok); the bus delivers 12.5 MB/s at 25 MHz, 25 MB/s at 50 MHz\n",
+           kb_per_s / 1000, kb_per_s % 1000, ok);
+}
+
+int main(void) {
+    stdio_init_all();
+
+    printf("sd card crc test\n");
+    int failures = 0;
+    for (uint word_count = 0; word_count <= 8; word_count++) {
+        for (uint i = 0; i < word_count; i++) block[i] = (uint32_t) rand() ^ ((uint32_t) rand() << 16);
+        failures += check_block(word_count);
+    }
+    // the example from the SD specification: 512 bytes of 0xff on a line have a CRC of 0x7fa1
+    memset(spec_block, 0xff, sizeof(spec_block));
+    uint16_t crcs[4];
+    sd_crc16_4bit(spec_block, count_of(spec_block), true, crcs);
+    for (uint lane = 0; lane < 4; lane++) {
+        if (crcs[lane] != 0x7fa1) {
+            printf("FAILED: CRC of 0xff data on DAT%d is %04x\n", lane, crcs[lane]);
+            failures++;
+        }
+    }
+    memset(block, 0xff, sizeof(block));
+    failures += check_block(BLOCK_WORDS);
+    for (uint pass = 0; pass < 16; pass++) {
+        for (uint i = 0; i < BLOCK_WORDS; i++) block[i] = (uint32_t) rand() ^ ((uint32_t) rand() << 16);
+        failures += check_block(BLOCK_WORDS);
+    }
+    failures += check_corruption();
+    benchmark();
+    if (failures) {
+        printf("%d FAILURES\n", failures);
+    } else {
+        printf("PASSED\n");
+    }
+    return failures != 0;
+}
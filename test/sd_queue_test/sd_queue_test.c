@@ -0,0 +1,409 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Runs the SD request queue against a simulated card, checking the order of completions, which requests are merged
+// into which commands, the data, and the handling of errors.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "pico/sd_card_queue.h"
+
+#define SECTOR_WORDS (SD_SECTOR_SIZE / 4)
+#define SIM_SECTORS 256
+// polls before a simulated command completes
+#define SIM_LATENCY 3
+#define MAX_COMMANDS 64
+#define MAX_REQUESTS 64
+
+static uint32_t sim_data[SIM_SECTORS][SECTOR_WORDS];
+
+static struct {
+    bool busy;
+    bool write;
+    uint32_t sector;
+    uint count;
+    uint32_t *const *bufs;
+    const uint32_t *data;
+    uint polls;
+    int fail_sector;    // sector which gets a CRC error, or -1
+    int reject_count;   // number of commands to refuse to start
+    bool overlapped;    // a command was started while another was in flight
+} sim;
+
+static struct {
+    bool write;
+    uint32_t sector;
+    uint count;
+} commands[MAX_COMMANDS];
+static uint command_count;
+
+static int sim_start(bool write, uint32_t sector, uint count) {
+    if (sim.busy) sim.overlapped = true;
+    if (sim.reject_count) {
+        sim.reject_count--;
+        return SD_ERR_BAD_RESPONSE;
+    }
+    if (command_count < MAX_COMMANDS) {
+        commands[command_count].write = write;
+        commands[command_count].sector = sector;
+        commands[command_count].count = count;
+        command_count++;
+    }
+    sim.busy = true;
+    sim.write = write;
+    sim.sector = sector;
+    sim.count = count;
+    sim.polls = 0;
+    return SD_OK;
+}
+
+static int sim_start_read(uint32_t *const *bufs, uint32_t sector, uint sector_count) {
+    sim.bufs = bufs;
+    return sim_start(false, sector, sector_count);
+}
+
+static int sim_start_write(const uint32_t *data, uint32_t sector, uint sector_count) {
+    sim.data = data;
+    return sim_start(true, sector, sector_count);
+}
+
+static bool sim_complete(bool write, int *status) {
+    if (!sim.busy || sim.write != write || ++sim.polls < SIM_LATENCY) {
+        *status = SD_OK;
+        return !sim.busy;
+    }
+    sim.busy = false;
+    *status = SD_OK;
+    for (uint i = 0; i < sim.count; i++) {
+        uint32_t s = sim.sector + i;
+        if (s >= SIM_SECTORS || (int) s == sim.fail_sector) {
+            *status = s >= SIM_SECTORS ? SD_ERR_BAD_PARAM : SD_ERR_CRC;
+            break;
+        }
+        if (write) {
+            memcpy(sim_data[s], sim.data + i * SECTOR_WORDS, SD_SECTOR_SIZE);
+        } else {
+            memcpy(sim.bufs[i], sim_data[s], SD_SECTOR_SIZE);
+        }
+    }
+    return true;
+}
+
+static bool sim_read_complete(int *status) {
+    return sim_complete(false, status);
+}
+
+static bool sim_write_complete(int *status) {
+    return sim_complete(true, status);
+}
+
+static const sd_queue_card_t sim_card = {
+        .start_read = sim_start_read,
+        .start_write = sim_start_write,
+        .read_complete = sim_read_complete,
+        .write_complete = sim_write_complete,
+        .max_read_sectors = 8,
+        .max_write_sectors = 4,
+};
+
+static sd_queue_t queue;
+static sd_queue_request_t requests[MAX_REQUESTS];
+static uint32_t bufs[MAX_REQUESTS][8 * SECTOR_WORDS];
+// the request indices in the order their callbacks were called
+static uint completed[MAX_REQUESTS];
+static int completed_status[MAX_REQUESTS];
+static uint completed_count;
+static bool busy_in_callback;
+
+static void callback(sd_queue_request_t *request, int status) {
+    uint i = (uint) (request - requests);
+    completed[completed_count] = i;
+    completed_status[completed_count] = status;
+    completed_count++;
+    // the next command should already be in flight if there is one
+    if (!sd_queue_is_idle(&queue) && !sim.busy) busy_in_callback = true;
+}
+
+static void reset(void) {
+    memset(&sim, 0, sizeof(sim));
+    sim.fail_sector = -1;
+    command_count = 0;
+    completed_count = 0;
+    busy_in_callback = false;
+    sd_queue_init(&queue, &sim_card);
+    for (uint s = 0; s < SIM_SECTORS; s++) {
+        for (uint i = 0; i < SECTOR_WORDS; i++) sim_data[s][i] = s << 16u | i;
+    }
+    memset(bufs, 0, sizeof(bufs));
+}
+
+static void submit(uint i, bool write, uint32_t sector, uint count, uint32_t *buf) {
+    requests[i].buf = buf ? buf : bufs[i];
+    requests[i].write = write;
+    requests[i].sector = sector;
+    requests[i].sector_count = count;
+    requests[i].callback = callback;
+    sd_queue_submit(&queue, &requests[i]);
+}
+
+static int check_commands(const char *test, const uint expected[][3], uint expected_count) {
+    int failures = 0;
+    if (command_count != expected_count) {
+        printf("FAILED: %s: %d commands, expected %d\n", test, command_count, expected_count);
+        failures++;
+    }
+    for (uint i = 0; i < MIN(command_count, expected_count); i++) {
+        if (commands[i].write != expected[i][0] || commands[i].sector != expected[i][1] ||
+            commands[i].count != expected[i][2]) {
+            printf("FAILED: %s: command %d is %s %d x %d, expected %s %d x %d\n", test, i,
+                   commands[i].write ? "write" : "read", (int) commands[i].sector, commands[i].count,
+                   expected[i][0] ? "write" : "read", expected[i][1], expected[i][2]);
+            failures++;
+        }
+    }
+    if (sim.overlapped) {
+        printf("FAILED: %s: a command was started while another was in flight\n", test);
+        failures++;
+    }
+    if (busy_in_callback) {
+        printf("FAILED: %s: the card was idle during a callback with requests outstanding\n", test);
+        failures++;
+    }
+    return failures;
+}
+
+static int check_completions(const char *test, uint count, int status) {
+    int failures = 0;
+    if (completed_count != count) {
+        printf("FAILED: %s: %d requests completed, expected %d\n", test, completed_count, count);
+        return 1;
+    }
+    for (uint i = 0; i < count; i++) {
+        if (completed[i] != i) {
+            printf("FAILED: %s: completion %d was request %d\n", test, i, completed[i]);
+            failures++;
+        }
+        if (completed_status[i] != status) {
+            printf("FAILED: %s: request %d completed with %d, expected %d\n", test, completed[i], completed_status[i],
+                   status);
+            failures++;
+        }
+    }
+    return failures;
+}
+
+static int check_read_data(const char *test, uint i) {
+    for (uint s = 0; s < requests[i].sector_count; s++) {
+        if (memcmp(requests[i].buf + s * SECTOR_WORDS, sim_data[requests[i].sector + s], SD_SECTOR_SIZE)) {
+            printf("FAILED: %s: request %d has the wrong data for sector %d\n", test, i, (int) requests[i].sector + s);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int test_merge(void) {
+    const char *test = "merge";
+    reset();
+    // the first request goes straight to the card, the rest queue up behind it
+    submit(0, false, 0, 1, NULL);
+    submit(1, false, 10, 1, NULL);
+    submit(2, false, 11, 2, NULL);
+    submit(3, false, 13, 1, NULL);
+    submit(4, false, 20, 1, NULL);
+    // a write doesn't merge with a read of the next sector
+    submit(5, true, 21, 1, NULL);
+    // nor a read with the previous write
+    submit(6, false, 22, 1, NULL);
+    // nor a read of an earlier sector
+    submit(7, false, 21, 1, NULL);
+    sd_queue_wait(&queue);
+    static const uint expected[][3] = {
+            {0, 0, 1}, {0, 10, 4}, {0, 20, 1}, {1, 21, 1}, {0, 22, 1}, {0, 21, 1},
+    };
+    int failures = check_commands(test, expected, count_of(expected));
+    failures += check_completions(test, 8, SD_OK);
+    for (uint i = 0; i < 8; i++) {
+        if (i != 5) failures += check_read_data(test, i);
+    }
+    return failures;
+}
+
+static int test_split(void) {
+    const char *test = "split";
+    reset();
+    submit(0, false, 100, 1, NULL);
+    // more sectors than fit in one command; the remainder merges with the next request
+    submit(1, false, 101, 7, NULL);
+    submit(2, false, 108, 3, NULL);
+    submit(3, false, 111, 8, NULL);
+    sd_queue_wait(&queue);
+    static const uint expected[][3] = {
+            {0, 100, 1}, {0, 101, 8}, {0, 109, 8}, {0, 117, 2},
+    };
+    int failures = check_commands(test, expected, count_of(expected));
+    failures += check_completions(test, 4, SD_OK);
+    for (uint i = 0; i < 4; i++) failures += check_read_data(test, i);
+    return failures;
+}
+
+static int test_writes(void) {
+    const char *test = "writes";
+    reset();
+    static uint32_t data[8][SECTOR_WORDS];
+    for (uint s = 0; s < 8; s++) {
+        for (uint i = 0; i < SECTOR_WORDS; i++) data[s][i] = 0xa5000000u | s << 16u | i;
+    }
+    submit(0, false, 0, 1, NULL);
+    // contiguous in memory and on the card, so merged (and split at max_write_sectors)
+    submit(1, true, 50, 2, data[0]);
+    submit(2, true, 52, 3, data[2]);
+    // adjacent on the card, but not in memory
+    submit(3, true, 55, 1, data[6]);
+    // adjacent in memory, but not on the card
+    submit(4, true, 57, 1, data[7]);
+    submit(5, false, 50, 8, NULL);
+    sd_queue_wait(&queue);
+    static const uint expected[][3] = {
+            {0, 0, 1}, {1, 50, 4}, {1, 54, 1}, {1, 55, 1}, {1, 57, 1}, {0, 50, 8},
+    };
+    int failures = check_commands(test, expected, count_of(expected));
+    failures += check_completions(test, 6, SD_OK);
+    for (uint s = 0; s < 8; s++) {
+        // sector 56 wasn't written
+        const uint32_t *expected_data = s < 5 ? data[s] : s == 5 ? data[6] : s == 7 ? data[7] : NULL;
+        const uint32_t *d = requests[5].buf + s * SECTOR_WORDS;
+        if (expected_data ? memcmp(d, expected_data, SD_SECTOR_SIZE) : d[0] != 56u << 16u) {
+            printf("FAILED: %s: sector %d read back as %08x\n", test, 50 + s, (uint) d[0]);
+            failures++;
+        }
+    }
+    return failures;
+}
+
+static int test_errors(void) {
+    const char *test = "errors";
+    int failures = 0;
+    reset();
+    submit(0, false, 0, 1, NULL);
+    submit(1, false, 30, 2, NULL);
+    submit(2, false, 32, 1, NULL);
+    submit(3, false, 40, 1, NULL);
+    sim.fail_sector = 30;
+    sd_queue_wait(&queue);
+    // the whole merged command fails, but the queue carries on
+    if (completed_count != 4 || completed_status[0] != SD_OK || completed_status[1] != SD_ERR_CRC ||
+        completed_status[2] != SD_ERR_CRC || completed_status[3] != SD_OK) {
+        printf("FAILED: %s: CRC error not reported to just the requests in the failing command\n", test);
+        failures++;
+    }
+    failures += check_read_data(test, 3);
+
+    reset();
+    // a failing split request isn't continued
+    submit(0, false, 0, 1, NULL);
+    submit(1, false, 60, 12, NULL);
+    submit(2, false, 80, 1, NULL);
+    sim.fail_sector = 62;
+    sd_queue_wait(&queue);
+    static const uint expected[][3] = {
+            {0, 0, 1}, {0, 60, 8}, {0, 80, 1},
+    };
+    failures += check_commands(test, expected, count_of(expected));
+    if (completed_count != 3 || completed_status[1] != SD_ERR_CRC || completed_status[2] != SD_OK) {
+        printf("FAILED: %s: failing split request not completed with an error\n", test);
+        failures++;
+    }
+
+    reset();
+    // a command which doesn't start
+    submit(0, false, 0, 1, NULL);
+    submit(1, false, 5, 1, NULL);
+    submit(2, false, 9, 1, NULL);
+    sim.reject_count = 1;
+    sd_queue_wait(&queue);
+    if (completed_count != 3 || completed_status[0] != SD_OK || completed_status[1] != SD_ERR_BAD_RESPONSE ||
+        completed_status[2] != SD_OK) {
+        printf("FAILED: %s: command which failed to start not reported\n", test);
+        failures++;
+    }
+    return failures;
+}
+
+// follows a chain of sectors, as for a FAT cluster chain or directory, submitting the next read from the callback
+static uint chain_next[SIM_SECTORS];
+static uint chain_reads;
+static sd_queue_request_t chain_request;
+static uint32_t chain_buf[SECTOR_WORDS];
+
+static void chain_callback(sd_queue_request_t *request, int status) {
+    if (status) return;
+    chain_reads++;
+    uint next = chain_next[request->sector];
+    if (next) {
+        request->sector = next;
+        sd_queue_submit(&queue, request);
+    }
+}
+
+static int test_chain(void) {
+    const char *test = "chain";
+    reset();
+    uint s = 3;
+    for (uint i = 0; i < 10; i++) {
+        chain_next[s] = (s * 7 + 5) % SIM_SECTORS;
+        s = chain_next[s];
+    }
+    chain_request.buf = chain_buf;
+    chain_request.sector = 3;
+    chain_request.sector_count = 1;
+    chain_request.write = false;
+    chain_request.callback = chain_callback;
+    sd_queue_submit(&queue, &chain_request);
+    sd_queue_wait(&queue);
+    if (chain_reads != 11 || command_count != 11) {
+        printf("FAILED: %s: %d reads in %d commands, expected 11\n", test, chain_reads, command_count);
+        return 1;
+    }
+    return 0;
+}
+
+// many single sector reads of consecutive sectors (e.g. a file read a sector at a time) take far fewer commands
+static int test_sequential(void) {
+    const char *test = "sequential";
+    reset();
+    for (uint i = 0; i < MAX_REQUESTS; i++) submit(i, false, 128 + i, 1, NULL);
+    sd_queue_wait(&queue);
+    int failures = check_completions(test, MAX_REQUESTS, SD_OK);
+    for (uint i = 0; i < MAX_REQUESTS; i++) failures += check_read_data(test, i);
+    printf("%d single sector reads took %d commands\n", MAX_REQUESTS, command_count);
+    if (command_count != 1 + (MAX_REQUESTS - 1 + sim_card.max_read_sectors - 1) / sim_card.max_read_sectors) {
+        printf("FAILED: %s: too many commands\n", test);
+        failures++;
+    }
+    return failures;
+}
+
+int main(void) {
+    stdio_init_all();
+
+    printf("sd card queue test\n");
+    int failures = 0;
+    failures += test_merge();
+    failures += test_split();
+    failures += test_writes();
+    failures += test_errors();
+    failures += test_chain();
+    failures += test_sequential();
+    if (failures) {
+        printf("%d FAILURES\n", failures);
+    } else {
+        printf("PASSED\n");
+    }
+    return failures != 0;
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Compares the sustained read rate of repeated PICO_SD_MAX_BLOCK_COUNT block reads with that of a streaming read of
+// the same sectors, and checks that a stream whose consumer is slower than the card (so the clock is stopped
+// between blocks) still reads the right data. Needs a card with at least TEST_SECTORS sectors (which are only read).
+
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+#include "pico/sd_card.h"
+
+#define TEST_SECTORS 4096
+#define RING_SECTORS 32
+// busy wait per sector for the slow consumer
+#define SLOW_CONSUMER_US 200
+
+static uint32_t buf[PICO_SD_MAX_BLOCK_COUNT * 128];
+static uint32_t ring[RING_SECTORS * 128];
+
+static uint32_t checksum(uint32_t sum, const uint32_t *data) {
+    for (uint i = 0; i < 128; i++) sum = (sum << 1 | sum >> 31) ^ data[i];
+    return sum;
+}
+
+static void print_rate(const char *what, int64_t us) {
+    uint kb_per_s = us > 0 ? (uint) ((uint64_t) TEST_SECTORS * 512 * 1000 / (uint64_t) us) : 0;
+    printf("%-40s %d.%03d MB/s\n", what, kb_per_s / 1000, kb_per_s % 1000);
+}
+
+static int read_blocks(uint32_t *sum) {
+    for (uint sector = 0; sector < TEST_SECTORS; sector += PICO_SD_MAX_BLOCK_COUNT) {
+        int rc = sd_readblocks_sync(buf, sector, PICO_SD_MAX_BLOCK_COUNT);
+        if (rc) return rc;
+        for (uint i = 0; i < PICO_SD_MAX_BLOCK_COUNT; i++) *sum = checksum(*sum, buf + i * 128);
+    }
+    return SD_OK;
+}
+
+static int stream(uint32_t *sum, uint consumer_us) {
+    int rc = sd_stream_start(ring, RING_SECTORS, 0);
+    for (uint sector = 0; sector < TEST_SECTORS && !rc;) {
+        uint32_t *data = sd_stream_acquire(&rc);
+        if (data) {
+            *sum = checksum(*sum, data);
+            if (consumer_us) busy_wait_us_32(consumer_us);
+            sd_stream_release();
+            sector++;
+        }
+    }
+    int stop_rc = sd_stream_stop();
+    return rc ? rc : stop_rc;
+}
+
+int main(void) {
+    stdio_init_all();
+
+    printf("SD card stream test\n");
+    if (sd_init_4pins() < 0) {
+        panic("sd_init_4pins failed");
+    }
+    int failures = 0;
+    uint32_t blocks_sum = 0, stream_sum = 0, slow_sum = 0;
+
+    absolute_time_t start = get_absolute_time();
+    int rc = read_blocks(&blocks_sum);
+    print_rate("repeated " __XSTRING(PICO_SD_MAX_BLOCK_COUNT) " block reads:", absolute_time_diff_us(start, get_absolute_time()));
+    if (rc) {
+        printf("FAILED: block reads returned %d\n", rc);
+        failures++;
+    }
+
+    start = get_absolute_time();
+    rc = stream(&stream_sum, 0);
+    print_rate("stream (" __XSTRING(RING_SECTORS) " sector ring):", absolute_time_diff_us(start, get_absolute_time()));
+    if (rc || stream_sum != blocks_sum) {
+        printf("FAILED: stream returned %d, checksum %08x expected %08x\n", rc, (uint) stream_sum, (uint) blocks_sum);
+        failures++;
+    }
+
+    start = get_absolute_time();
+    rc = stream(&slow_sum, SLOW_CONSUMER_US);
+    print_rate("stream with a slow consumer:", absolute_time_diff_us(start, get_absolute_time()));
+    if (rc || slow_sum != blocks_sum) {
+        printf("FAILED: slow stream returned %d, checksum %08x expected %08x\n", rc, (uint) slow_sum, (uint) blocks_sum);
+        failures++;
+    }
+
+    if (failures) {
+        printf("%d FAILURES\n", failures);
+    } else {
+        printf("PASSED\n");
+    }
+    return 0;
+}
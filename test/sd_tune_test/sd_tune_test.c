@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Reports the bus speed negotiated and clock chosen at init, then checks the choice holds up over more sectors than
+// sd_tune_clock reads, by comparing them with the same sectors read at the tuning reference speed, and times them.
+
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+#include "pico/sd_card.h"
+#include "hardware/clocks.h"
+
+#define TEST_SECTORS 1024
+
+static uint32_t buf[PICO_SD_MAX_BLOCK_COUNT * 128];
+static uint32_t hashes[TEST_SECTORS / PICO_SD_MAX_BLOCK_COUNT];
+
+// the sd_set_clock_divider argument for (at most) hz
+static uint divider_for(uint hz) {
+    uint div = (clock_get_hz(clk_sys) + 2 * hz - 1) / (2 * hz);
+#ifdef PICO_SD_CARD_EXTRA_CLOCK_DIVIDER
+    div = (div + PICO_SD_CARD_EXTRA_CLOCK_DIVIDER - 1) / PICO_SD_CARD_EXTRA_CLOCK_DIVIDER;
+#endif
+    return div;
+}
+
+static int read_all(bool check, int64_t *us) {
+    absolute_time_t start = get_absolute_time();
+    for (uint i = 0; i < count_of(hashes); i++) {
+        int rc = sd_readblocks_sync(buf, i * PICO_SD_MAX_BLOCK_COUNT, PICO_SD_MAX_BLOCK_COUNT);
+        if (rc) return rc;
+        uint32_t h = 0;
+        for (uint j = 0; j < count_of(buf); j++) h = (h ^ buf[j]) * 0x01000193u;
+        if (check && h != hashes[i]) {
+            printf("sectors %d to %d differ\n", i * PICO_SD_MAX_BLOCK_COUNT, (i + 1) * PICO_SD_MAX_BLOCK_COUNT - 1);
+            return SD_ERR_CRC;
+        }
+        hashes[i] = h;
+    }
+    *us = absolute_time_diff_us(start, get_absolute_time());
+    return SD_OK;
+}
+
+int main(void) {
+    stdio_init_all();
+
+    printf("SD card clock tuning test\n");
+    if (sd_init_4pins() < 0) {
+        panic("sd_init_4pins failed");
+    }
+    uint hz = sd_get_clock_hz();
+    uint rate = sd_get_measured_read_rate();
+    printf("%s speed, clock %d.%03d MHz (clk_sys %d MHz), tuning read rate %d.%03d MB/s\n",
+           sd_is_high_speed() ? "high" : "default", hz / 1000000, (hz / 1000) % 1000,
+           (int) (clock_get_hz(clk_sys) / 1000000), rate / 1000000, (rate / 1000) % 1000);
+
+    int64_t us;
+    uint tuned_div = clock_get_hz(clk_sys) / (2 * hz);
+#ifdef PICO_SD_CARD_EXTRA_CLOCK_DIVIDER
+    tuned_div /= PICO_SD_CARD_EXTRA_CLOCK_DIVIDER;
+#endif
+    sd_set_clock_divider(divider_for(PICO_SD_TUNE_REFERENCE_HZ));
+    int rc = read_all(false, &us);
+    if (!rc) {
+        sd_set_clock_divider(tuned_div);
+        rc = read_all(true, &us);
+    }
+    if (rc) {
+        printf("FAILED: %d\n", rc);
+    } else {
+        uint kb_per_s = us > 0 ? (uint) ((uint64_t) TEST_SECTORS * 512 * 1000 / (uint64_t) us) : 0;
+        printf("%d sectors read at %d.%03d MB/s\n", TEST_SECTORS, kb_per_s / 1000, kb_per_s % 1000);
+        printf("PASSED\n");
+    }
+    return 0;
+}
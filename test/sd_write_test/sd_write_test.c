@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Measures the sustained write rate of a data logging style workload (consecutive sectors appended in order) written
+// a sector at a time, and PICO_SD_MAX_BLOCK_COUNT sectors at a time, along with how much of the time the CPU spent in
+// the driver rather than being free for other work; then reads the sectors back to check them.
+//
+// NOTE: this overwrites TEST_SECTORS sectors of the card starting at TEST_FIRST_SECTOR
+
+#include <stdio.h>
+
+#include "pico/stdlib.h"
+#include "pico/sd_card.h"
+
+#ifndef TEST_FIRST_SECTOR
+#define TEST_FIRST_SECTOR 0x100000
+#endif
+#define TEST_SECTORS 1024
+
+static uint32_t buf[PICO_SD_MAX_BLOCK_COUNT * 128];
+
+static void fill(uint32_t *data, uint32_t sector, uint pass) {
+    for (uint i = 0; i < 128; i++) data[i] = (sector << 16u) ^ (pass << 12u) ^ (i * 0x9e3779b9u);
+}
+
+static int write_log(uint blocks_per_write, uint pass, int64_t *driver_us) {
+    *driver_us = 0;
+    for (uint32_t sector = 0; sector < TEST_SECTORS; sector += blocks_per_write) {
+        for (uint i = 0; i < blocks_per_write; i++) fill(buf + i * 128, sector + i, pass);
+        absolute_time_t t = get_absolute_time();
+        int rc = sd_writeblocks_async(buf, TEST_FIRST_SECTOR + sector, blocks_per_write);
+        *driver_us += absolute_time_diff_us(t, get_absolute_time());
+        if (rc) return rc;
+        bool done;
+        do {
+            t = get_absolute_time();
+            done = sd_write_complete(&rc);
+            *driver_us += absolute_time_diff_us(t, get_absolute_time());
+            // (this is where a logger would be getting on with something else)
+        } while (!done);
+        if (rc) return rc;
+    }
+    return SD_OK;
+}
+
+static int check(uint pass) {
+    static uint32_t expected[128];
+    for (uint32_t sector = 0; sector < TEST_SECTORS; sector += PICO_SD_MAX_BLOCK_COUNT) {
+        int rc = sd_readblocks_sync(buf, TEST_FIRST_SECTOR + sector, PICO_SD_MAX_BLOCK_COUNT);
+        if (rc) return rc;
+        for (uint i = 0; i < PICO_SD_MAX_BLOCK_COUNT; i++) {
+            fill(expected, sector + i, pass);
+            for (uint j = 0; j < 128; j++) {
+                if (buf[i * 128 + j] != expected[j]) {
+                    printf("sector %d word %d read back as %08x, expected %08x\n", (int) (sector + i), j,
+                           (uint) buf[i * 128 + j], (uint) expected[j]);
+                    return SD_ERR_CRC;
+                }
+            }
+        }
+    }
+    return SD_OK;
+}
+
+static int run(const char *what, uint blocks_per_write, uint pass) {
+    int64_t driver_us;
+    absolute_time_t start = get_absolute_time();
+    int rc = write_log(blocks_per_write, pass, &driver_us);
+    int64_t us = absolute_time_diff_us(start, get_absolute_time());
+    uint kb_per_s = us > 0 ? (uint) ((uint64_t) TEST_SECTORS * 512 * 1000 / (uint64_t) us) : 0;
+    printf("%-28s %d.%03d MB/s, CPU in driver %d%%\n", what, kb_per_s / 1000, kb_per_s % 1000,
+           us > 0 ? (int) (driver_us * 100 / us) : 0);
+    if (rc) {
+        printf("FAILED: %s: write returned %d\n", what, rc);
+        return 1;
+    }
+    rc = check(pass);
+    if (rc) {
+        printf("FAILED: %s: read back returned %d\n", what, rc);
+        return 1;
+    }
+    return 0;
+}
+
+int main(void) {
+    stdio_init_all();
+
+    printf("SD card write test (overwriting sectors %d to %d)\n", TEST_FIRST_SECTOR,
+           TEST_FIRST_SECTOR + TEST_SECTORS - 1);
+    if (sd_init_4pins() < 0) {
+        panic("sd_init_4pins failed");
+    }
+    int failures = 0;
+    failures += run("single block writes:", 1, 0);
+    failures += run(__XSTRING(PICO_SD_MAX_BLOCK_COUNT) " block writes:", PICO_SD_MAX_BLOCK_COUNT, 1);
+    if (failures) {
+        printf("%d FAILURES\n", failures);
+    } else {
+        printf("PASSED\n");
+    }
+    return 0;
+}
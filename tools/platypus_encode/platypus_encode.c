@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Encodes a raw 16bpp image (little endian pixels, in the platypus pixel format; RGB555, or RGB565 when built with
+// VIDEO_DBI) as platypus row pairs, written as a C array to be compiled into flash and decoded with
+// platypus_decompress_row. The compression ratio and the speed of the host decoder are reported.
+//
+// usage: platypus_encode [-l] [-i | -v] <input.raw> <width> <height> <array_name> [output.h | output.bin]
+//
+// -l only uses exact encodings; without it some blocks lose the low bit of some color channels
+// -i writes an indexed image (see platypus_image.h) which can be decoded from any row pair
+// -v treats the input as a sequence of frames, and writes them as a stream of platypus frames (see
+//    platypus_frame.h), each holding only the changes from the one before
+//
+// An output file ending in .bin is written as raw little endian words (e.g. to be streamed from SD) rather than C.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "platypus_encode.h"
+
+#define DECODE_REPEATS 16
+
+static bool write_output(const uint32_t *encoded, size_t words, const char *input, uint width, uint height,
+                         const char *description, const char *name, const char *path) {
+    bool binary = path && strlen(path) > 4 && !strcmp(path + strlen(path) - 4, ".bin");
+    FILE *out = path ? fopen(path, binary ? "wb" : "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "can't open %s\n", path);
+        return false;
+    }
+    if (binary) {
+        for (size_t i = 0; i < words; i++) {
+            uint8_t b[4] = {(uint8_t) encoded[i], (uint8_t) (encoded[i] >> 8), (uint8_t) (encoded[i] >> 16),
+                            (uint8_t) (encoded[i] >> 24)};
+            fwrite(b, 1, 4, out);
+        }
+    } else {
+        fprintf(out, "// generated by platypus_encode from %s (%dx%d%s)\n", input, width, height, description);
+        fprintf(out, "#include <stdint.h>\n\n");
+        fprintf(out, "const uint32_t %s[%d] __attribute__((aligned(4))) = {", name, (int) words);
+        for (size_t i = 0; i < words; i++) {
+            fprintf(out, "%s0x%08x,", (i % 8) ? " " : "\n        ", (unsigned) encoded[i]);
+        }
+        fprintf(out, "\n};\n");
+    }
+    if (out != stdout) fclose(out);
+    return true;
+}
+
+static uint max_channel_error(uint16_t a, uint16_t b) {
+    static const uint8_t shifts[] = {PLATYPUS_PIXEL_RSHIFT, PLATYPUS_PIXEL_GSHIFT, PLATYPUS_PIXEL_BSHIFT};
+    uint max_error = 0;
+    for (uint c = 0; c < 3; c++) {
+        int d = (int) ((a >> shifts[c]) & 0x1fu) - (int) ((b >> shifts[c]) & 0x1fu);
+        max_error = MAX(max_error, (uint) abs(d));
+    }
+    return max_error;
+}
+
+static int encode_video(const uint16_t *pixels, uint frames, uint width, uint height, bool lossless, char **argv,
+                        int argc) {
+    size_t pixel_count = (size_t) width * height;
+    size_t max_frame_words = platypus_encode_max_frame_words(width, height);
+    uint32_t *encoded = (uint32_t *) malloc(max_frame_words * frames * sizeof(uint32_t));
+    uint16_t *reference = (uint16_t *) malloc(pixel_count * sizeof(uint16_t));
+    platypus_encode_stats_t stats = {0};
+    size_t words = 0, key_words = 0;
+    for (uint f = 0; f < frames; f++) {
+        size_t n = platypus_encode_frame(pixels + f * pixel_count, width, height, width, !f, lossless, reference,
+                                         encoded + words, max_frame_words, f ? &stats : NULL);
+        if (!n) {
+            fprintf(stderr, "encoding frame %d failed\n", f);
+            return 1;
+        }
+        if (!f) key_words = n;
+        words += n;
+    }
+    if (!write_output(encoded, words, argv[1], width, height, lossless ? ", video, lossless" : ", video", argv[4],
+                      argc > 5 ? argv[5] : NULL)) {
+        return 1;
+    }
+
+    // decode it back to check it, then again to time the decoder
+    uint16_t *framebuffer = (uint16_t *) malloc(pixel_count * sizeof(uint16_t));
+    uint max_error = 0;
+    uint64_t blocks = 0;
+    const uint32_t *frame = encoded;
+    for (uint f = 0; f < frames; f++, frame += platypus_frame_words(frame)) {
+        if (!platypus_frame_check(frame, width, height)) {
+            fprintf(stderr, "frame %d is invalid\n", f);
+            return 1;
+        }
+        blocks += platypus_frame_decode(frame, framebuffer, width);
+        for (size_t i = 0; i < pixel_count; i++) {
+            max_error = MAX(max_error, max_channel_error(pixels[f * pixel_count + i], framebuffer[i]));
+        }
+    }
+    absolute_time_t start = get_absolute_time();
+    for (uint i = 0; i < DECODE_REPEATS; i++) {
+        frame = encoded;
+        for (uint f = 0; f < frames; f++, frame += platypus_frame_words(frame)) {
+            platypus_frame_decode(frame, framebuffer, width);
+        }
+    }
+    int64_t us = absolute_time_diff_us(start, get_absolute_time());
+
+    size_t raw_bytes = pixel_count * 2;
+    fprintf(stderr, "%s: %d frames, %d bytes (raw 16bpp %d bytes per frame); key frame %d bytes, then %d bytes "
+                    "per frame; %d%% of blocks decoded (max channel error %d)\n", argv[4], frames, (int) (words * 4),
+            (int) raw_bytes, (int) (key_words * 4),
+            frames > 1 ? (int) ((words - key_words) * 4 / (frames - 1)) : 0,
+            (int) (blocks * 400 / (pixel_count * frames)), max_error);
+    fprintf(stderr, "%d unchanged blocks, %d row pairs copied\n", (int) stats.blocks_unchanged,
+            (int) stats.row_pairs_copied);
+    if (us > 0) {
+        fprintf(stderr, "host decode: %d frames/s\n", (int) (frames * DECODE_REPEATS * 1000000ull / (uint64_t) us));
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    bool lossless = false, indexed = false, video = false;
+    while (argc > 1 && (!strcmp(argv[1], "-l") || !strcmp(argv[1], "-i") || !strcmp(argv[1], "-v"))) {
+        if (argv[1][1] == 'l') lossless = true;
+        else if (argv[1][1] == 'i') indexed = true;
+        else video = true;
+        argc--;
+        argv++;
+    }
+    if (argc < 5 || (indexed && video)) {
+        fprintf(stderr, "usage: platypus_encode [-l] [-i | -v] <input.raw> <width> <height> <array_name> "
+                        "[output.h | output.bin]\n");
+        return 1;
+    }
+    uint width = (uint) atoi(argv[2]);
+    uint height = (uint) atoi(argv[3]);
+    if (!width || (width & 1u) || width > 0xffff || !height || (height & 1u) || height > 0xffff) {
+        fprintf(stderr, "bad image size %sx%s (both must be even)\n", argv[2], argv[3]);
+        return 1;
+    }
+    FILE *in = fopen(argv[1], "rb");
+    if (!in) {
+        fprintf(stderr, "can't open %s\n", argv[1]);
+        return 1;
+    }
+    size_t pixel_count = (size_t) width * height;
+    uint frames = 1;
+    if (video) {
+        fseek(in, 0, SEEK_END);
+        frames = (uint) ((size_t) ftell(in) / (pixel_count * 2));
+        fseek(in, 0, SEEK_SET);
+        if (!frames) frames = 1;
+    }
+    uint16_t *pixels = (uint16_t *) malloc(pixel_count * frames * sizeof(uint16_t));
+    uint8_t *bytes = (uint8_t *) malloc(pixel_count * frames * 2);
+    size_t read = fread(bytes, 2, pixel_count * frames, in);
+    fclose(in);
+    if (read != pixel_count * frames) {
+        fprintf(stderr, "%s is too short for a %dx%d image\n", argv[1], width, height);
+        return 1;
+    }
+    for (size_t i = 0; i < pixel_count * frames; i++) {
+        pixels[i] = (uint16_t) (bytes[i * 2] | (bytes[i * 2 + 1] << 8));
+    }
+    if (video) return encode_video(pixels, frames, width, height, lossless, argv, argc);
+
+    size_t max_words = platypus_encode_max_indexed_image_words(width, height);
+    uint32_t *encoded = (uint32_t *) malloc(max_words * sizeof(uint32_t));
+    platypus_encode_stats_t stats = {0};
+    size_t words;
+    if (indexed) {
+        words = platypus_encode_indexed_image(pixels, width, height, width, lossless, encoded, max_words, &stats);
+    } else {
+        words = platypus_encode_image(pixels, width, height, width, lossless, encoded, max_words, &stats);
+    }
+    if (!words) {
+        fprintf(stderr, "encoding failed\n");
+        return 1;
+    }
+    char description[32];
+    snprintf(description, sizeof(description), "%s%s", lossless ? ", lossless" : "", indexed ? ", indexed" : "");
+    if (!write_output(encoded, words, argv[1], width, height, description, argv[4], argc > 5 ? argv[5] : NULL)) {
+        return 1;
+    }
+
+    // decode it back to check it, then again to time the decoder
+    uint32_t *row0 = (uint32_t *) malloc(width * 2);
+    uint32_t *row1 = (uint32_t *) malloc(width * 2);
+    uint max_error = 0;
+    const uint32_t *data = encoded;
+    size_t data_words = words;
+    if (indexed) {
+        platypus_image_t image;
+        if (!platypus_image_init(&image, encoded)) {
+            fprintf(stderr, "indexed image is invalid\n");
+            return 1;
+        }
+        data = image.data;
+        data_words -= (size_t) (image.data - encoded);
+    }
+    const uint32_t *s = data;
+    for (uint y = 0; y < height; y += 2) {
+        s = platypus_decompress_row(row0, row1, s, width);
+        for (uint x = 0; x < width; x++) {
+            for (uint r = 0; r < 2; r++) {
+                uint16_t a = pixels[(y + r) * width + x];
+                uint16_t b = (uint16_t) ((r ? row1 : row0)[x / 2] >> ((x & 1u) * 16));
+                max_error = MAX(max_error, max_channel_error(a, b));
+            }
+        }
+    }
+    if (s != data + data_words) {
+        fprintf(stderr, "decoded %d words, expected %d\n", (int) (s - data), (int) data_words);
+        return 1;
+    }
+    absolute_time_t start = get_absolute_time();
+    for (uint i = 0; i < DECODE_REPEATS; i++) {
+        s = data;
+        for (uint y = 0; y < height; y += 2) {
+            s = platypus_decompress_row(row0, row1, s, width);
+        }
+    }
+    int64_t us = absolute_time_diff_us(start, get_absolute_time());
+
+    size_t raw_bytes = pixel_count * 2;
+    fprintf(stderr, "%s: %d bytes (raw 16bpp %d bytes, ratio %d.%02d); blocks 3:%d 4:%d 7:%d 8:%d (%d lossy, max "
+                    "channel error %d)\n", argv[4], (int) (words * 4), (int) raw_bytes,
+            (int) (raw_bytes / (words * 4)), (int) (raw_bytes * 100 / (words * 4) % 100), (int) stats.blocks_3,
+            (int) stats.blocks_4, (int) stats.blocks_7, (int) stats.blocks_8, (int) stats.lossy_blocks, max_error);
+    if (us > 0) {
+        fprintf(stderr, "host decode: %d pixels/us\n", (int) (pixel_count * DECODE_REPEATS / (uint64_t) us));
+    }
+    return 0;
+}
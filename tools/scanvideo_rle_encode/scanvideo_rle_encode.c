@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2020 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Encodes a raw 16bpp image (little endian pixels, already in the scanvideo pixel format) as a
+// pico/scanvideo/rle.h image, written as a C array to be compiled into (and displayed from) flash.
+//
+// usage: scanvideo_rle_encode <input.raw> <width> <height> <array_name> [output.h]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "pico/scanvideo/rle.h"
+
+int main(int argc, char **argv) {
+    if (argc < 5) {
+        fprintf(stderr, "usage: %s <input.raw> <width> <height> <array_name> [output.h]\n", argv[0]);
+        return 1;
+    }
+    uint width = (uint) atoi(argv[2]);
+    uint height = (uint) atoi(argv[3]);
+    if (!width || width > 0xffff || !height || height > 0xffff) {
+        fprintf(stderr, "bad image size %sx%s\n", argv[2], argv[3]);
+        return 1;
+    }
+    FILE *in = fopen(argv[1], "rb");
+    if (!in) {
+        fprintf(stderr, "can't open %s\n", argv[1]);
+        return 1;
+    }
+    size_t pixel_count = (size_t) width * height;
+    uint16_t *pixels = (uint16_t *) malloc(pixel_count * sizeof(uint16_t));
+    uint8_t *bytes = (uint8_t *) malloc(pixel_count * 2);
+    size_t read = fread(bytes, 2, pixel_count, in);
+    fclose(in);
+    if (read != pixel_count) {
+        fprintf(stderr, "%s is too short for a %dx%d image\n", argv[1], width, height);
+        return 1;
+    }
+    for (size_t i = 0; i < pixel_count; i++) {
+        pixels[i] = (uint16_t) (bytes[i * 2] | (bytes[i * 2 + 1] << 8));
+    }
+    size_t max_words = scanvideo_rle_max_image_words(width, height);
+    uint32_t *encoded = (uint32_t *) malloc(max_words * sizeof(uint32_t));
+    size_t words = scanvideo_rle_encode_image(pixels, width, height, width, encoded, max_words);
+    if (!words) {
+        fprintf(stderr, "encoding failed\n");
+        return 1;
+    }
+
+    FILE *out = argc > 5 ? fopen(argv[5], "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "can't open %s\n", argv[5]);
+        return 1;
+    }
+    fprintf(out, "// generated by scanvideo_rle_encode from %s (%dx%d)\n", argv[1], width, height);
+    fprintf(out, "#include <stdint.h>\n\n");
+    fprintf(out, "const uint32_t %s[%d] __attribute__((aligned(4))) = {", argv[4], (int) words);
+    for (size_t i = 0; i < words; i++) {
+        fprintf(out, "%s0x%08x,", (i % 8) ? " " : "\n        ", (unsigned) encoded[i]);
+    }
+    fprintf(out, "\n};\n");
+    if (out != stdout) fclose(out);
+
+    scanvideo_rle_image_t image;
+    scanvideo_rle_image_init(&image, encoded);
+    size_t raw_bytes = pixel_count * 2;
+    size_t frame_bytes = scanvideo_rle_image_frame_bytes(&image);
+    fprintf(stderr, "%s: %d bytes (raw 16bpp %d bytes); %d bytes read per frame (%d%% of raw)\n", argv[4],
+            (int) (words * 4), (int) raw_bytes, (int) frame_bytes, (int) (frame_bytes * 100 / raw_bytes));
+    return 0;
+}